@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/parallel.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/meshloader.h>
+
+/**
+* Writes one bumpy height field (2M triangles by default) as a binary PLY and as an OBJ under /tmp,
+* loads each on 1, 2, 4... threads up to every processor and prints MB/s and triangles/s.
+* Every load is checked against the generated vertices and indices.
+*
+* Usage: loaderBench [triangles]
+*/
+
+static float height(float x, float y)
+{
+    return -6 + .5f * sinf(x * 3) * cosf(y * 3);
+}
+
+static void buildVertices(point3f* vertices, unsigned int side)
+{
+    for(unsigned int y = 0; y <= side; y++)
+    {
+        for(unsigned int x = 0; x <= side; x++)
+        {
+            float fx = mapToRangef(x, 0, side, -8, 8);
+            float fy = mapToRangef(y, 0, side, -2, 10);
+            vector3f_set(vertices[y * (side + 1) + x], fx, fy, height(fx, fy));
+        }
+    }
+}
+
+static void buildIndices(uint32_t* indices, unsigned int side)
+{
+    uint32_t* idx = indices;
+    for(unsigned int y = 0; y < side; y++)
+    {
+        for(unsigned int x = 0; x < side; x++)
+        {
+            uint32_t v = y * (side + 1) + x;
+            uint32_t quad[4] = {v, v + 1, v + side + 1, v + side + 2};
+            *idx++ = quad[0]; *idx++ = quad[1]; *idx++ = quad[2];
+            *idx++ = quad[1]; *idx++ = quad[3]; *idx++ = quad[2];
+        }
+    }
+}
+
+static bool writePLY(const char* path, const point3f* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t triangles)
+{
+    FILE* f = fopen(path, "wb");
+    if(f == NULL)
+        return false;
+    fprintf(f, "ply\nformat binary_little_endian 1.0\ncomment loaderBench height field\n");
+    fprintf(f, "element vertex %u\nproperty float x\nproperty float y\nproperty float z\n", vertexCount);
+    fprintf(f, "element face %u\nproperty list uchar int vertex_indices\nend_header\n", triangles);
+    fwrite(vertices, sizeof(point3f), vertexCount, f);
+    for(uint32_t i = 0; i < triangles; i++)
+    {
+        unsigned char count = 3;
+        fwrite(&count, 1, 1, f);
+        fwrite(indices + 3 * i, sizeof(uint32_t), 3, f);
+    }
+    return fclose(f) == 0;
+}
+
+static bool writeOBJ(const char* path, const point3f* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t triangles)
+{
+    FILE* f = fopen(path, "w");
+    if(f == NULL)
+        return false;
+    fprintf(f, "# loaderBench height field\no field\n");
+    for(uint32_t i = 0; i < vertexCount; i++)
+        fprintf(f, "v %.9g %.9g %.9g\n", vertices[i][0], vertices[i][1], vertices[i][2]);
+    for(uint32_t i = 0; i < triangles; i++)
+        fprintf(f, "f %u %u %u\n", indices[3 * i] + 1, indices[3 * i + 1] + 1, indices[3 * i + 2] + 1);
+    return fclose(f) == 0;
+}
+
+static bool matches(const meshBuffers* loaded, const point3f* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t triangles)
+{
+    return loaded->vertexCount == vertexCount && loaded->triangleCount == triangles &&
+           memcmp(loaded->vertices, vertices, vertexCount * sizeof(point3f)) == 0 &&
+           memcmp(loaded->indices, indices, (size_t)triangles * 3 * sizeof(uint32_t)) == 0;
+}
+
+static unsigned int bench(const char* path, const point3f* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t triangles)
+{
+    unsigned int mismatches = 0;
+    unsigned int processors = getProcessorCount();
+    for(unsigned int threads = 1;; threads = threads * 2 < processors ? threads * 2 : processors)
+    {
+        meshBuffers loaded;
+        meshLoadStats stats;
+        if(loadMeshBuffers(path, threads, &loaded, &stats) != MESH_LOAD_OK)
+        {
+            printMeshLoadStats(path, &stats);
+            return 1;
+        }
+        printf(KRED"%s["KBLU"threads:"KGRN"%2u "KBLU"size:"KGRN"%5.1fMB ", path, threads, stats.fileSize * 1e-6);
+        printf(KBLU"parse:"KGRN"%6.1fms "KBLU"throughput:"KGRN"%7.1fMB/s ", stats.parseTime * 1000.0, stats.fileSize / stats.parseTime * 1e-6);
+        printf(KBLU"rate:"KGRN"%6.2fMtriangles/s"KRED"]\n"KNRM, triangles / stats.parseTime * 1e-6);
+        if(!matches(&loaded, vertices, vertexCount, indices, triangles))
+        {
+            printf(KRED"%s loaded on %u threads does not match what was written\n"KNRM, path, threads);
+            mismatches++;
+        }
+        free(loaded.vertices);
+        free(loaded.normals);
+        free(loaded.indices);
+        if(threads == processors)
+            break;
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int triangles = argc > 1 ? (unsigned int)atoi(argv[1]) : 2000000;
+    unsigned int side = (unsigned int)sqrtf(triangles / 2.0f);
+    side = side < 1 ? 1 : side;
+    triangles = 2 * side * side;
+    unsigned int vertexCount = (side + 1) * (side + 1);
+
+    point3f* vertices = malloc(vertexCount * sizeof(point3f));
+    uint32_t* indices = malloc((size_t)triangles * 3 * sizeof(uint32_t));
+    buildVertices(vertices, side);
+    buildIndices(indices, side);
+
+    const char* plyPath = "/tmp/loaderBench.ply";
+    const char* objPath = "/tmp/loaderBench.obj";
+    if(!writePLY(plyPath, vertices, vertexCount, indices, triangles) || !writeOBJ(objPath, vertices, vertexCount, indices, triangles))
+    {
+        printf(KRED"could not write the test meshes to /tmp\n"KNRM);
+        return 1;
+    }
+
+    unsigned int mismatches = bench(plyPath, vertices, vertexCount, indices, triangles);
+    mismatches += bench(objPath, vertices, vertexCount, indices, triangles);
+
+    remove(plyPath);
+    remove(objPath);
+    free(vertices);
+    free(indices);
+    return mismatches > 0;
+}
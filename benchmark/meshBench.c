@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/triangle.h>
+#include <rayTracerCore/shapes/mesh.h>
+
+// Camera rays traced through each version of the surface
+#define BENCH_TRACE_RAYS 1000000u
+
+/**
+* One bumpy height field (1M triangles by default) built as separate triangle objects
+* under a bvh and as an indexed mesh. Prints the bytes each needs per triangle, the
+* build times and primary ray rates, and checks both find the same hits.
+*
+* Usage: meshBench [triangles]
+*/
+
+static float height(float x, float y)
+{
+    return -6 + .5f * sinf(x * 3) * cosf(y * 3);
+}
+
+static void buildVertices(point3f* vertices, unsigned int side)
+{
+    for(unsigned int y = 0; y <= side; y++)
+    {
+        for(unsigned int x = 0; x <= side; x++)
+        {
+            float fx = mapToRangef(x, 0, side, -8, 8);
+            float fy = mapToRangef(y, 0, side, -2, 10);
+            vector3f_set(vertices[y * (side + 1) + x], fx, fy, height(fx, fy));
+        }
+    }
+}
+
+static void buildIndices(uint32_t* indices, unsigned int side)
+{
+    uint32_t* idx = indices;
+    for(unsigned int y = 0; y < side; y++)
+    {
+        for(unsigned int x = 0; x < side; x++)
+        {
+            uint32_t v = y * (side + 1) + x;
+            uint32_t quad[4] = {v, v + 1, v + side + 1, v + side + 2};
+            *idx++ = quad[0]; *idx++ = quad[1]; *idx++ = quad[2];
+            *idx++ = quad[1]; *idx++ = quad[3]; *idx++ = quad[2];
+        }
+    }
+}
+
+static void buildRay(ray* r)
+{
+    vector3f_set(r->origin, 0, 0, 1);
+    point3f target = {mapToRangef(rand(), 0, RAND_MAX, -9, 9), mapToRangef(rand(), 0, RAND_MAX, -3, 11), -8};
+    vector3f_sub_new(r->dir, target, r->origin);
+    vector3f_normalize(r->dir);
+    r->tmin = 0;
+    r->tmax = INFINITY;
+}
+
+static bool sameVector(const vector3f a, const vector3f b)
+{
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+static void printResult(const char* name, unsigned int triangles, size_t bytes, double buildTime, unsigned long long hits, double traceTime)
+{
+    printf(KRED"%s["KBLU"triangles:"KGRN"%u ", name, triangles);
+    printf(KBLU"bytes:"KGRN"%zu "KBLU"bytes/triangle:"KGRN"%.1f ", bytes, (double)bytes / triangles);
+    printf(KBLU"build:"KGRN"%4.1fms ", buildTime * 1000.0);
+    printf(KBLU"hit rate:"KGRN"%4.1f%% ", 100.0 * hits / BENCH_TRACE_RAYS);
+    printf(KBLU"rate:"KGRN"%5.2fMrays/s"KRED"]\n"KNRM, BENCH_TRACE_RAYS / traceTime * 1e-6);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int triangles = argc > 1 ? (unsigned int)atoi(argv[1]) : 1000000;
+    unsigned int side = (unsigned int)sqrtf(triangles / 2.0f);
+    side = side < 1 ? 1 : side;
+    triangles = 2 * side * side;
+    unsigned int vertexCount = (side + 1) * (side + 1);
+    const material mat = {.reflect = false, .color = {.3, .6, .3}};
+
+    point3f* vertices = malloc(vertexCount * sizeof(point3f));
+    uint32_t* indices = malloc(triangles * 3 * sizeof(uint32_t));
+    buildVertices(vertices, side);
+    buildIndices(indices, side);
+
+    double start = getTimeSeconds();
+    object* list = NULL;
+    for(unsigned int i = triangles; i-- > 0;)
+    {
+        object* tri = createTriangle(mat, vertices[indices[3 * i]], vertices[indices[3 * i + 1]], vertices[indices[3 * i + 2]]);
+        tri->next = list;
+        list = tri;
+    }
+    bvh* tree = buildBVH(list);
+    bvhPackLeaves(tree);
+    double objectBuild = getTimeSeconds() - start;
+    size_t objectBytes = bvhMemoryUsage(tree) + (size_t)triangles * (sizeof(object) + sizeof(triangle_t));
+
+    start = getTimeSeconds();
+    object* mesh = createMesh(mat, vertices, vertexCount, indices, triangles, NULL);
+    double meshBuild = getTimeSeconds() - start;
+    if(mesh == NULL)
+        return 1;
+
+    unsigned long long objectHits = 0, meshHits = 0, mismatches = 0;
+    rayHit* expected = malloc(BENCH_TRACE_RAYS * sizeof(rayHit));
+    srand(2);
+    start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_TRACE_RAYS; i++)
+    {
+        ray r;
+        buildRay(&r);
+        expected[i].depth = 0;
+        expected[i].hit = false;
+        objectHits += bvhClosestHit(tree, r, &expected[i]);
+    }
+    double objectTrace = getTimeSeconds() - start;
+
+    srand(2);
+    start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_TRACE_RAYS; i++)
+    {
+        ray r;
+        buildRay(&r);
+        rayHit rh;
+        rh.hit = false;
+        float t;
+        if(mesh->hit(r, mesh, &t, &rh))
+        {
+            meshHits++;
+            mismatches += !expected[i].hit || !sameVector(rh.location, expected[i].location) ||
+                          !sameVector(rh.normal, expected[i].normal);
+        }
+        else
+            mismatches += expected[i].hit;
+    }
+    double meshTrace = getTimeSeconds() - start;
+
+    printResult("triangle objects", triangles, objectBytes, objectBuild, objectHits, objectTrace);
+    printResult("mesh", triangles, meshMemoryUsage(mesh->shape), meshBuild, meshHits, meshTrace);
+    if(mismatches > 0)
+        printf(KRED"objects and mesh disagree on %llu rays\n"KNRM, mismatches);
+
+    free(expected);
+    cleanBVH(&tree);
+    cleanObjectList(&list);
+    cleanObjectList(&mesh);
+    return mismatches > 0;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/trianglepacket.h>
+#include <rayTracerCore/shapes/geometry.h>
+
+// Rays aimed at each packet
+#define BENCH_RAYS 4
+// Every run does at least this many ray triangle tests
+#define BENCH_MIN_TESTS 40000000u
+
+/**
+* Times the 8 wide triangle packet kernels against each other and against 8 separate
+* obj->hit calls, after checking every kernel agrees with the scalar one lane for lane.
+* Packets are neighbouring cells of a height field, the way a BVH leaf groups them.
+*
+* Usage: packetBench [packets]
+*/
+
+typedef int(*packetKernel)(const trianglePacket*, const ray*, float, float[TRIANGLE_PACKET_WIDTH]);
+
+static object** buildMesh(unsigned int count)
+{
+    const material mat = {.reflect = false, .color = {.3, .6, .3}};
+    object** triangles = malloc(count * sizeof(object*));
+    // 4 cells a row per packet, rows of packets stacked up the wall
+    unsigned int rows = (unsigned int)sqrtf(count / 8.0f);
+    rows = rows < 1 ? 1 : rows;
+    unsigned int cols = (count / 8 + rows - 1) / rows * 4;
+    for(unsigned int i = 0; i < count / 2; i++)
+    {
+        unsigned int x = i % cols, y = i / cols;
+        point3f p[4];
+        for(int c = 0; c < 4; c++)
+        {
+            float fx = mapToRangef(x + (c & 1), 0, cols, -8, 8);
+            float fy = mapToRangef(y + (c >> 1), 0, rows, -2, 10);
+            vector3f_set(p[c], fx, fy, -6 + .5f * sinf(fx * 3) * cosf(fy * 3));
+        }
+        triangles[2 * i] = createTriangle(mat, p[0], p[1], p[2]);
+        triangles[2 * i + 1] = createTriangle(mat, p[1], p[3], p[2]);
+    }
+    return triangles;
+}
+
+/**
+* Each ray aims at a triangle of its packet so a fair share of lanes hit
+*/
+static void buildRays(ray* rays, object* const* triangles, unsigned int packets)
+{
+    srand(1);
+    for(unsigned int i = 0; i < packets * BENCH_RAYS; i++)
+    {
+        const triangle_t* tri = triangles[i / BENCH_RAYS * TRIANGLE_PACKET_WIDTH + rand() % TRIANGLE_PACKET_WIDTH]->shape;
+        float u = mapToRangef(rand(), 0, RAND_MAX, 0, 1), v = mapToRangef(rand(), 0, RAND_MAX, 0, 1);
+        if(u + v > 1)
+        {
+            u = 1 - u;
+            v = 1 - v;
+        }
+        point3f target;
+        for(int k = 0; k < 3; k++)
+            target[k] = tri->a[k] + u * tri->e1[k] + v * tri->e2[k];
+        vector3f_set(rays[i].origin, mapToRangef(rand(), 0, RAND_MAX, -1, 1), mapToRangef(rand(), 0, RAND_MAX, -1, 1), 1);
+        vector3f_sub_new(rays[i].dir, target, rays[i].origin);
+        vector3f_normalize(rays[i].dir);
+        rays[i].tmin = 0;
+        rays[i].tmax = INFINITY;
+    }
+}
+
+static unsigned long long validate(const char* name, packetKernel kernel, const trianglePacket* packets, unsigned int count, const ray* rays)
+{
+    unsigned long long mismatches = 0;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        // Its own rays and a neighbour's, which mostly miss
+        for(unsigned int j = i * BENCH_RAYS; j < (i + 2) * BENCH_RAYS && j < count * BENCH_RAYS; j++)
+        {
+            float expected[TRIANGLE_PACKET_WIDTH], t[TRIANGLE_PACKET_WIDTH];
+            int expectedMask = trianglePacketTestScalar(&packets[i], &rays[j], INFINITY, expected);
+            int mask = kernel(&packets[i], &rays[j], INFINITY, t);
+            if(mask != expectedMask)
+            {
+                mismatches++;
+                continue;
+            }
+            for(int lane = 0; lane < TRIANGLE_PACKET_WIDTH; lane++)
+                mismatches += (mask >> lane & 1) && t[lane] != expected[lane];
+        }
+    }
+    if(mismatches > 0)
+        printf(KRED"%s disagrees with scalar on %llu tests\n"KNRM, name, mismatches);
+    return mismatches;
+}
+
+static void benchKernel(const char* name, packetKernel kernel, const trianglePacket* packets, unsigned int count, const ray* rays)
+{
+    unsigned int passes = (BENCH_MIN_TESTS / TRIANGLE_PACKET_WIDTH + count - 1) / count;
+    unsigned long long tests = (unsigned long long)passes * count;
+    unsigned long long hits = 0;
+    double start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        for(unsigned int i = 0; i < count; i++)
+        {
+            float t[TRIANGLE_PACKET_WIDTH];
+            hits += __builtin_popcount(kernel(&packets[i], &rays[i * BENCH_RAYS + pass % BENCH_RAYS], INFINITY, t));
+        }
+    }
+    double time = getTimeSeconds() - start;
+    printf(KRED"%s["KBLU"packets:"KGRN"%u ", name, count);
+    printf(KBLU"hit rate:"KGRN"%4.1f%% ", 100.0 * hits / (tests * TRIANGLE_PACKET_WIDTH));
+    printf(KBLU"packet:"KGRN"%5.2fns "KBLU"triangle:"KGRN"%4.2fns"KRED"]\n"KNRM, time * 1e9 / tests, time * 1e9 / (tests * TRIANGLE_PACKET_WIDTH));
+}
+
+static void benchObjects(object* const* triangles, unsigned int count, const ray* rays)
+{
+    unsigned int passes = (BENCH_MIN_TESTS / TRIANGLE_PACKET_WIDTH + count - 1) / count;
+    unsigned long long tests = (unsigned long long)passes * count;
+    unsigned long long hits = 0;
+    rayHit rh;
+    rh.depth = 0;
+    double start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        for(unsigned int i = 0; i < count; i++)
+        {
+            const ray r = rays[i * BENCH_RAYS + pass % BENCH_RAYS];
+            for(int lane = 0; lane < TRIANGLE_PACKET_WIDTH; lane++)
+            {
+                const object* obj = triangles[i * TRIANGLE_PACKET_WIDTH + lane];
+                float t;
+                hits += obj->hit(r, obj, &t, &rh);
+            }
+        }
+    }
+    double time = getTimeSeconds() - start;
+    printf(KRED"objects["KBLU"packets:"KGRN"%u ", count);
+    printf(KBLU"hit rate:"KGRN"%4.1f%% ", 100.0 * hits / (tests * TRIANGLE_PACKET_WIDTH));
+    printf(KBLU"packet:"KGRN"%5.2fns "KBLU"triangle:"KGRN"%4.2fns"KRED"]\n"KNRM, time * 1e9 / tests, time * 1e9 / (tests * TRIANGLE_PACKET_WIDTH));
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int count = argc > 1 ? (unsigned int)atoi(argv[1]) : 1024;
+    count = count < 1 ? 1 : count;
+    unsigned int triangleCount = count * TRIANGLE_PACKET_WIDTH;
+    object** triangles = buildMesh(triangleCount);
+    trianglePacket* packets = NULL;
+    if(posix_memalign((void**)&packets, 64, count * sizeof(trianglePacket)) != 0)
+        return 1;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        const triangle_t* shapes[TRIANGLE_PACKET_WIDTH];
+        for(int lane = 0; lane < TRIANGLE_PACKET_WIDTH; lane++)
+            shapes[lane] = triangles[i * TRIANGLE_PACKET_WIDTH + lane]->shape;
+        packTriangles(&packets[i], shapes, TRIANGLE_PACKET_WIDTH);
+    }
+    ray* rays = malloc(count * BENCH_RAYS * sizeof(ray));
+    buildRays(rays, triangles, count);
+
+    unsigned long long mismatches = 0;
+#ifdef __SSE__
+    mismatches += validate("sse", trianglePacketTestSSE, packets, count, rays);
+#endif
+#ifdef __AVX2__
+    mismatches += validate("avx2", trianglePacketTestAVX2, packets, count, rays);
+#endif
+
+    benchObjects(triangles, count, rays);
+    benchKernel("scalar", trianglePacketTestScalar, packets, count, rays);
+#ifdef __SSE__
+    benchKernel("sse", trianglePacketTestSSE, packets, count, rays);
+#endif
+#ifdef __AVX2__
+    benchKernel("avx2", trianglePacketTestAVX2, packets, count, rays);
+#endif
+
+    for(unsigned int i = 0; i < triangleCount; i++)
+    {
+        object* obj = triangles[i];
+        obj->next = NULL;
+        cleanObjectList(&obj);
+    }
+    free(triangles);
+    free(packets);
+    free(rays);
+    return mismatches > 0;
+}
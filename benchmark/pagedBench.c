@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/mesh.h>
+#include <rayTracerCore/shapes/pagedmesh.h>
+
+#define BENCH_RAYS 262144u
+#define BENCH_BATCH 65536u
+#define BENCH_FILE "/tmp/pagedBench.pmesh"
+
+/**
+* Writes a height field (1M triangles by default) as a paged mesh, then traces the same
+* scattered rays through it with the whole file, half and a tenth of it allowed in memory.
+* Single rays wait for every page they miss, batches park them and read each page once.
+* Prints the ray rates and page counters of both and checks them against the mesh in memory.
+*
+* Usage: pagedBench [triangles] [page triangles]
+*/
+
+static float height(float x, float y)
+{
+    return -6 + .5f * sinf(x * 3) * cosf(y * 3);
+}
+
+static object* buildHeightField(unsigned int side)
+{
+    uint32_t vertexCount = (side + 1) * (side + 1);
+    point3f* vertices = malloc(vertexCount * sizeof(point3f));
+    for(unsigned int y = 0; y <= side; y++)
+    {
+        for(unsigned int x = 0; x <= side; x++)
+        {
+            float fx = mapToRangef(x, 0, side, -8, 8);
+            float fy = mapToRangef(y, 0, side, -2, 10);
+            vector3f_set(vertices[y * (side + 1) + x], fx, fy, height(fx, fy));
+        }
+    }
+    uint32_t* indices = malloc((size_t)side * side * 6 * sizeof(uint32_t));
+    uint32_t* idx = indices;
+    for(unsigned int y = 0; y < side; y++)
+    {
+        for(unsigned int x = 0; x < side; x++)
+        {
+            uint32_t v = y * (side + 1) + x;
+            *idx++ = v; *idx++ = v + 1; *idx++ = v + side + 1;
+            *idx++ = v + 1; *idx++ = v + side + 2; *idx++ = v + side + 1;
+        }
+    }
+    const material mat = {.reflect = false, .color = {.5, .5, .5}};
+    return createMesh(mat, vertices, vertexCount, indices, side * side * 2, NULL);
+}
+
+// Scattered over the whole surface so consecutive rays rarely share a page
+static void buildRays(ray* rays, unsigned int count)
+{
+    srand(2);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        ray* r = &rays[i];
+        vector3f_set(r->origin, 0, 4, 1);
+        point3f target = {mapToRangef(rand(), 0, RAND_MAX, -9, 9), mapToRangef(rand(), 0, RAND_MAX, -3, 11), -8};
+        vector3f_sub_new(r->dir, target, r->origin);
+        vector3f_normalize(r->dir);
+        r->tmin = 0;
+        r->tmax = INFINITY;
+    }
+}
+
+static void printRun(const char* name, const pagedMesh_t* pm, double time, unsigned int mismatches)
+{
+    const pagedMeshStats* s = &pm->stats;
+    uint64_t lookups = s->hits + s->faults;
+    printf(KRED"  %s["KBLU"rate:"KGRN"%6.3fMrays/s ", name, BENCH_RAYS / time * 1e-6);
+    printf(KBLU"faults:"KGRN"%llu "KBLU"hit rate:"KGRN"%5.1f%% ", (unsigned long long)s->faults, lookups > 0 ? 100.0 * s->hits / lookups : 0.0);
+    printf(KBLU"deferred:"KGRN"%llu "KBLU"read:"KGRN"%.1fMB "KBLU"peak:"KGRN"%.1fMB"KRED"]\n"KNRM,
+           (unsigned long long)s->deferred, s->bytesRead * 1e-6, s->peakBytes * 1e-6);
+    if(mismatches > 0)
+        printf(KRED"  %u rays disagree with the mesh in memory\n"KNRM, mismatches);
+}
+
+static void bench(const ray* rays, const float* expected, size_t budget, const char* label)
+{
+    const material mat = {.reflect = false, .color = {.5, .5, .5}};
+    printf(KRED"budget:%s\n"KNRM, label);
+
+    object* paged = loadPagedMesh(BENCH_FILE, mat, budget);
+    unsigned int mismatches = 0;
+    double start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_RAYS; i++)
+    {
+        float t = INFINITY;
+        hitPath path;
+        if(!paged->intersect(&rays[i], paged, &t, &path))
+            t = INFINITY;
+        mismatches += t != expected[i];
+    }
+    printRun("single", paged->shape, getTimeSeconds() - start, mismatches);
+    cleanObjectList(&paged);
+
+    paged = loadPagedMesh(BENCH_FILE, mat, budget);
+    ray* batch = malloc(BENCH_BATCH * sizeof(ray));
+    pagedTriangle* hits = malloc(BENCH_BATCH * sizeof(pagedTriangle));
+    mismatches = 0;
+    start = getTimeSeconds();
+    for(unsigned int first = 0; first < BENCH_RAYS; first += BENCH_BATCH)
+    {
+        unsigned int count = BENCH_RAYS - first < BENCH_BATCH ? BENCH_RAYS - first : BENCH_BATCH;
+        for(unsigned int i = 0; i < count; i++)
+            batch[i] = rays[first + i];
+        pagedMeshClosestHits(paged->shape, batch, count, hits);
+        for(unsigned int i = 0; i < count; i++)
+        {
+            float t = hits[i].page != PAGED_MESH_NO_PAGE ? batch[i].tmax : INFINITY;
+            mismatches += t != expected[first + i];
+        }
+    }
+    printRun("batched", paged->shape, getTimeSeconds() - start, mismatches);
+    free(batch);
+    free(hits);
+    cleanObjectList(&paged);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int triangles = argc > 1 ? (unsigned int)atoi(argv[1]) : 1000000;
+    uint32_t pageTriangles = argc > 2 ? (uint32_t)atoi(argv[2]) : 0;
+    unsigned int side = (unsigned int)sqrtf(triangles / 2.f);
+    if(side < 1)
+        side = 1;
+
+    object* mesh = buildHeightField(side);
+    double start = getTimeSeconds();
+    if(!writePagedMesh(BENCH_FILE, mesh->shape, pageTriangles))
+    {
+        printf(KRED"%s could not be written\n"KNRM, BENCH_FILE);
+        return 1;
+    }
+    double writeTime = getTimeSeconds() - start;
+
+    ray* rays = malloc(BENCH_RAYS * sizeof(ray));
+    float* expected = malloc(BENCH_RAYS * sizeof(float));
+    buildRays(rays, BENCH_RAYS);
+    start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_RAYS; i++)
+    {
+        ray testRay = rays[i];
+        expected[i] = meshClosestTriangle(mesh->shape, &testRay) != MESH_NO_TRIANGLE ? testRay.tmax : INFINITY;
+    }
+    double memoryTime = getTimeSeconds() - start;
+    size_t meshBytes = meshMemoryUsage(mesh->shape);
+    cleanObjectList(&mesh);
+
+    const material mat = {.reflect = false, .color = {.5, .5, .5}};
+    object* paged = loadPagedMesh(BENCH_FILE, mat, 0);
+    const pagedMesh_t* pm = paged->shape;
+    size_t pageBytes = 0;
+    for(uint32_t p = 0; p < pm->pageCount; p++)
+        pageBytes += pm->pages[p].bytes;
+    printf(KRED"paged mesh["KBLU"triangles:"KGRN"%u "KBLU"pages:"KGRN"%u "KBLU"page bytes:"KGRN"%.1fMB ", side * side * 2, pm->pageCount, pageBytes * 1e-6);
+    printf(KBLU"resident without pages:"KGRN"%zu bytes "KBLU"write:"KGRN"%4.1fms "KBLU"in memory:"KGRN"%6.3fMrays/s %.1fMB"KRED"]\n"KNRM,
+           pagedMeshMemoryUsage(pm), writeTime * 1000.0, BENCH_RAYS / memoryTime * 1e-6, meshBytes * 1e-6);
+    cleanObjectList(&paged);
+
+    bench(rays, expected, 0, "unlimited");
+    bench(rays, expected, pageBytes / 2, "1/2 of the pages");
+    bench(rays, expected, pageBytes / 10, "1/10 of the pages");
+
+    free(rays);
+    free(expected);
+    remove(BENCH_FILE);
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/primitives.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/shapes/geometry.h>
+
+// Every run does at least this many ray primitive tests
+#define BENCH_MIN_TESTS 50000000u
+// Rays traced through the bvh of each scene
+#define BENCH_BVH_RAYS 1000000u
+
+/**
+* Brute force closest hits over the same scene kept as the linked object list and as a
+* primitiveStore, at 1k, 100k and 1M primitives unless sizes are given. Then the same rays
+* through one bvh, its leaves tested through object pointers and as batches of store ids.
+* Half the primitives are small spheres and half triangles, interleaved the way a scene builds them.
+*
+* Usage: primitiveBench [primitives...]
+*/
+
+static object* buildScene(unsigned int count)
+{
+    const material mat = {.reflect = false, .color = {.5, .5, .5}};
+    float size = 8.f / cbrtf((float)count);
+    object* list = NULL;
+    srand(1);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        point3f p = {mapToRangef(rand(), 0, RAND_MAX, -8, 8), mapToRangef(rand(), 0, RAND_MAX, -8, 8), mapToRangef(rand(), 0, RAND_MAX, -24, -8)};
+        object* obj;
+        if(i & 1)
+        {
+            point3f b = {p[0] + size, p[1], p[2]}, c = {p[0], p[1] + size, p[2]};
+            obj = createTriangle(mat, p, b, c);
+        }
+        else
+            obj = createSphere(mat, size * .5f, p);
+        obj->next = list;
+        list = obj;
+    }
+    return list;
+}
+
+static void buildRay(ray* r)
+{
+    vector3f_set(r->origin, 0, 0, 1);
+    vector3f_set(r->dir, mapToRangef(rand(), 0, RAND_MAX, -.4f, .4f), mapToRangef(rand(), 0, RAND_MAX, -.4f, .4f), -1);
+    vector3f_normalize(r->dir);
+    r->tmin = 0;
+    r->tmax = INFINITY;
+}
+
+/**
+* What the list accelerator did before the store: every object through its hit pointer
+*/
+static bool listClosestHit(const object* list, const ray r, rayHit* rh)
+{
+    rayHit testrh;
+    testrh.depth = 0;
+    float time = INFINITY;
+    bool hit = false;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+    {
+        float hitTime = 0;
+        if(obj->hit(r, obj, &hitTime, &testrh) && hitTime < time)
+        {
+            time = hitTime;
+            *rh = testrh;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+/**
+* What bvh leaves did before they held ids: the same traversal as bvhClosestPrimitive,
+* every leaf primitive through its intersect pointer
+*/
+static const object* pointerClosestHit(const bvh* tree, ray* r, hitPath* path)
+{
+    vector3f invDir = {1.f / r->dir[0], 1.f / r->dir[1], 1.f / r->dir[2]};
+    bool dirNeg[3] = {invDir[0] < 0, invDir[1] < 0, invDir[2] < 0};
+    const object* nearest = NULL;
+    uint32_t stack[BVH_STACK_SIZE];
+    int sp = 0;
+    uint32_t index = 0;
+    while(true)
+    {
+        const bvhNode* node = &tree->nodes[index];
+        float tnear;
+        if(aabbHit(&node->bounds, r, invDir, r->tmax, &tnear))
+        {
+            if(node->count == 0)
+            {
+                stack[sp++] = dirNeg[node->axis] ? index + 1 : node->offset;
+                index = dirNeg[node->axis] ? node->offset : index + 1;
+                continue;
+            }
+            for(uint32_t i = node->offset; i < node->offset + node->count; i++)
+            {
+                const object* obj = tree->primitives[i];
+                float t;
+                if(obj->intersect(r, obj, &t, path) && t < r->tmax)
+                {
+                    r->tmax = t;
+                    nearest = obj;
+                }
+            }
+        }
+        if(sp == 0)
+            break;
+        index = stack[--sp];
+    }
+    return nearest;
+}
+
+static void benchBVH(const object* list, unsigned int count)
+{
+    bvh* tree = buildBVH(list);
+    float* pointerT = malloc(BENCH_BVH_RAYS * sizeof(float));
+    srand(3);
+    double start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_BVH_RAYS; i++)
+    {
+        ray r;
+        buildRay(&r);
+        ray testRay = r;
+        hitPath path;
+        const object* nearest = pointerClosestHit(tree, &testRay, &path);
+        pointerT[i] = INFINITY;
+        if(nearest != NULL)
+        {
+            rayHit rh;
+            nearest->surface(r, nearest, testRay.tmax, &path, &rh);
+            vector3f toHit = {};
+            vector3f_sub_new(toHit, rh.location, r.origin);
+            pointerT[i] = vector3f_dot(toHit, r.dir);
+        }
+    }
+    double pointerTime = getTimeSeconds() - start;
+
+    unsigned int mismatches = 0;
+    srand(3);
+    start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_BVH_RAYS; i++)
+    {
+        ray r;
+        buildRay(&r);
+        rayHit rh;
+        float t = INFINITY;
+        if(bvhClosestHit(tree, r, &rh))
+        {
+            vector3f toHit = {};
+            vector3f_sub_new(toHit, rh.location, r.origin);
+            t = vector3f_dot(toHit, r.dir);
+        }
+        mismatches += t != pointerT[i];
+    }
+    double idTime = getTimeSeconds() - start;
+
+    printf(KRED"bvh primitives:%u["KBLU"rays:"KGRN"%u ", count, BENCH_BVH_RAYS);
+    printf(KBLU"pointers:"KGRN"%5.1fns "KBLU"ids:"KGRN"%5.1fns "KBLU"per ray ", pointerTime * 1e9 / BENCH_BVH_RAYS, idTime * 1e9 / BENCH_BVH_RAYS);
+    printf(KBLU"speedup:"KGRN"%4.2fx"KRED"]\n"KNRM, pointerTime / idTime);
+    if(mismatches > 0)
+        printf(KRED"pointer and id leaves disagree on %u rays\n"KNRM, mismatches);
+
+    free(pointerT);
+    cleanBVH(&tree);
+}
+
+static void bench(unsigned int count)
+{
+    object* list = buildScene(count);
+    primitiveStore* store = buildPrimitiveStore(list);
+    unsigned int rays = (BENCH_MIN_TESTS + count - 1) / count;
+    unsigned long long tests = (unsigned long long)rays * count;
+    float* listT = malloc(rays * sizeof(float));
+
+    unsigned int hits = 0;
+    srand(2);
+    double start = getTimeSeconds();
+    for(unsigned int i = 0; i < rays; i++)
+    {
+        ray r;
+        buildRay(&r);
+        rayHit rh;
+        listT[i] = INFINITY;
+        if(listClosestHit(list, r, &rh))
+        {
+            hits++;
+            vector3f toHit = {};
+            vector3f_sub_new(toHit, rh.location, r.origin);
+            listT[i] = vector3f_dot(toHit, r.dir);
+        }
+    }
+    double listTime = getTimeSeconds() - start;
+
+    unsigned int mismatches = 0;
+    srand(2);
+    start = getTimeSeconds();
+    for(unsigned int i = 0; i < rays; i++)
+    {
+        ray r;
+        buildRay(&r);
+        ray testRay = r;
+        hitPath path;
+        primitiveId id = primitiveStoreClosestHit(store, &testRay, &path);
+        float t = INFINITY;
+        if(id != PRIMITIVE_NONE)
+        {
+            rayHit rh;
+            primitiveSurface(store, id, r, testRay.tmax, &path, &rh);
+            vector3f toHit = {};
+            vector3f_sub_new(toHit, rh.location, r.origin);
+            t = vector3f_dot(toHit, r.dir);
+        }
+        mismatches += t != listT[i];
+    }
+    double arrayTime = getTimeSeconds() - start;
+
+    printf(KRED"primitives:%u["KBLU"rays:"KGRN"%u ", count, rays);
+    printf(KBLU"hit rate:"KGRN"%4.1f%% ", 100.0 * hits / rays);
+    printf(KBLU"list:"KGRN"%5.2fns "KBLU"arrays:"KGRN"%5.2fns "KBLU"per primitive ", listTime * 1e9 / tests, arrayTime * 1e9 / tests);
+    printf(KBLU"speedup:"KGRN"%4.2fx "KBLU"store:"KGRN"%zu bytes"KRED"]\n"KNRM, listTime / arrayTime, primitiveStoreMemoryUsage(store));
+    if(mismatches > 0)
+        printf(KRED"list and arrays disagree on %u rays\n"KNRM, mismatches);
+
+    free(listT);
+    cleanPrimitiveStore(&store);
+    benchBVH(list, count);
+    cleanObjectList(&list);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 1)
+    {
+        for(int i = 1; i < argc; i++)
+            bench((unsigned int)atoi(argv[i]));
+        return 0;
+    }
+    bench(1000);
+    bench(100000);
+    bench(1000000);
+    return 0;
+}
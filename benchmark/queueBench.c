@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <util/parallel.h>
+#include <util/ringbuffer.h>
+#include <util/workqueue.h>
+
+#define BENCH_ITEMS 4000000u
+#define BENCH_CAPACITY 1024u
+#define BENCH_BATCH 32u
+
+/**
+* Moves the same items through the lock free queues and a mutex around ringbuffer, on 1, 2, 4...
+* producers and as many consumers up to the core count (at least 4). The deque test has its owner push
+* and pop every item while the other threads steal. Prints Mitems/s and checks every item came out once.
+*
+* Usage: queueBench [max threads] [items]
+*/
+
+typedef enum
+{
+    QUEUE_SPSC,
+    QUEUE_MPMC,
+    QUEUE_LOCKED
+} queueKind;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    ringbuffer rb;
+} lockedQueue;
+
+typedef struct
+{
+    queueKind kind;
+    void* queue;
+    size_t batch;
+    size_t items;               // per producer
+    _Atomic size_t consumed;
+    size_t total;
+    _Atomic uint64_t sum;
+} queueRun;
+
+typedef struct
+{
+    queueRun* run;
+    unsigned int index;
+} queueThread;
+
+static size_t push(queueRun* run, const size_t* items, size_t count)
+{
+    switch(run->kind)
+    {
+    case QUEUE_SPSC:
+        return spscPush(run->queue, items, count);
+    case QUEUE_MPMC:
+        return mpmcPush(run->queue, items, count);
+    default:
+    {
+        lockedQueue* q = run->queue;
+        size_t pushed = 0;
+        pthread_mutex_lock(&q->lock);
+        while(pushed < count && !rbFull(&q->rb))
+            rbadd(&q->rb, &items[pushed++]);
+        pthread_mutex_unlock(&q->lock);
+        return pushed;
+    }
+    }
+}
+
+static size_t pop(queueRun* run, size_t* items, size_t count)
+{
+    switch(run->kind)
+    {
+    case QUEUE_SPSC:
+        return spscPop(run->queue, items, count);
+    case QUEUE_MPMC:
+        return mpmcPop(run->queue, items, count);
+    default:
+    {
+        lockedQueue* q = run->queue;
+        size_t popped = 0;
+        pthread_mutex_lock(&q->lock);
+        while(popped < count && !rbEmpty(&q->rb))
+            rbpop(&q->rb, &items[popped++]);
+        pthread_mutex_unlock(&q->lock);
+        return popped;
+    }
+    }
+}
+
+static void* producer(void* arg)
+{
+    queueThread* t = arg;
+    queueRun* run = t->run;
+    size_t items[BENCH_BATCH];
+    size_t next = t->index * run->items + 1, last = (t->index + 1) * run->items + 1;
+    while(next < last)
+    {
+        size_t count = 0;
+        while(count < run->batch && next + count < last)
+        {
+            items[count] = next + count;
+            count++;
+        }
+        size_t pushed = push(run, items, count);
+        next += pushed;
+        if(pushed == 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void* consumer(void* arg)
+{
+    queueThread* t = arg;
+    queueRun* run = t->run;
+    size_t items[BENCH_BATCH];
+    uint64_t sum = 0;
+    while(atomic_load_explicit(&run->consumed, memory_order_relaxed) < run->total)
+    {
+        size_t popped = pop(run, items, run->batch);
+        for(size_t i = 0; i < popped; i++)
+            sum += items[i];
+        if(popped > 0)
+            atomic_fetch_add_explicit(&run->consumed, popped, memory_order_relaxed);
+        else
+            sched_yield();
+    }
+    atomic_fetch_add(&run->sum, sum);
+    return NULL;
+}
+
+static void printRate(const char* name, unsigned int threads, size_t batch, size_t items, double time, bool valid)
+{
+    printf(KRED"%s["KBLU"threads:"KGRN"%2u+%-2u "KBLU"batch:"KGRN"%2zu ", name, threads, threads, batch);
+    printf(KBLU"rate:"KGRN"%7.2fMitems/s"KRED"]%s\n"KNRM, items / time * 1e-6, valid ? "" : " items lost or repeated");
+}
+
+static void runQueue(queueKind kind, unsigned int threads, size_t batch, size_t items)
+{
+    static const char* names[] = {"spsc  ", "mpmc  ", "locked"};
+    queueRun run = {.kind = kind, .batch = batch, .items = items / threads, .total = items / threads * threads};
+    atomic_init(&run.consumed, 0);
+    atomic_init(&run.sum, 0);
+    lockedQueue locked;
+    if(kind == QUEUE_SPSC)
+        run.queue = createSPSC(BENCH_CAPACITY);
+    else if(kind == QUEUE_MPMC)
+        run.queue = createMPMC(BENCH_CAPACITY);
+    else
+    {
+        pthread_mutex_init(&locked.lock, NULL);
+        createRB(&locked.rb, BENCH_CAPACITY, sizeof(size_t));
+        run.queue = &locked;
+    }
+
+    pthread_t* handles = malloc(2 * threads * sizeof(pthread_t));
+    queueThread* args = malloc(2 * threads * sizeof(queueThread));
+    double start = getTimeSeconds();
+    for(unsigned int t = 0; t < threads; t++)
+    {
+        args[t] = (queueThread){&run, t};
+        args[threads + t] = (queueThread){&run, t};
+        pthread_create(&handles[t], NULL, producer, &args[t]);
+        pthread_create(&handles[threads + t], NULL, consumer, &args[threads + t]);
+    }
+    for(unsigned int t = 0; t < 2 * threads; t++)
+        pthread_join(handles[t], NULL);
+    double time = getTimeSeconds() - start;
+
+    uint64_t expected = (uint64_t) run.total * (run.total + 1) / 2;
+    printRate(names[kind], threads, batch, run.total, time, atomic_load(&run.sum) == expected && atomic_load(&run.consumed) == run.total);
+    free(args);
+    free(handles);
+    if(kind == QUEUE_SPSC)
+        cleanSPSC((spscQueue**) &run.queue);
+    else if(kind == QUEUE_MPMC)
+        cleanMPMC((mpmcQueue**) &run.queue);
+    else
+    {
+        cleanRB(&locked.rb);
+        pthread_mutex_destroy(&locked.lock);
+    }
+}
+
+typedef struct
+{
+    workDeque* deque;
+    _Atomic size_t taken;
+    size_t total;
+    _Atomic uint64_t sum;
+    _Atomic size_t steals;
+} dequeRun;
+
+static void* thief(void* arg)
+{
+    dequeRun* run = arg;
+    uint64_t sum = 0;
+    size_t steals = 0, item;
+    while(atomic_load_explicit(&run->taken, memory_order_relaxed) < run->total)
+    {
+        if(dequeSteal(run->deque, &item) == STEAL_SUCCESS)
+        {
+            sum += item;
+            steals++;
+            atomic_fetch_add_explicit(&run->taken, 1, memory_order_relaxed);
+        }
+        else
+            sched_yield();
+    }
+    atomic_fetch_add(&run->sum, sum);
+    atomic_fetch_add(&run->steals, steals);
+    return NULL;
+}
+
+// The owner refills its deque in batches and pops, threads - 1 thieves steal from the other end
+static void runDeque(unsigned int threads, size_t items)
+{
+    dequeRun run = {.deque = createWorkDeque(BENCH_CAPACITY), .total = items};
+    atomic_init(&run.taken, 0);
+    atomic_init(&run.sum, 0);
+    atomic_init(&run.steals, 0);
+    pthread_t* handles = malloc(threads * sizeof(pthread_t));
+    double start = getTimeSeconds();
+    for(unsigned int t = 1; t < threads; t++)
+        pthread_create(&handles[t], NULL, thief, &run);
+
+    size_t batch[BENCH_BATCH], next = 1, item;
+    uint64_t sum = 0;
+    while(next <= items)
+    {
+        size_t count = 0;
+        while(count < BENCH_BATCH && next + count <= items)
+        {
+            batch[count] = next + count;
+            count++;
+        }
+        next += dequePush(run.deque, batch, count);
+        // Work off half of what was pushed so thieves have something to take
+        for(size_t i = 0; i < count / 2 && dequePop(run.deque, &item); i++)
+        {
+            sum += item;
+            atomic_fetch_add_explicit(&run.taken, 1, memory_order_relaxed);
+        }
+    }
+    while(dequePop(run.deque, &item))
+    {
+        sum += item;
+        atomic_fetch_add_explicit(&run.taken, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add(&run.sum, sum);
+    // Spin until thieves finish with what they already took
+    while(atomic_load(&run.taken) < run.total)
+        sched_yield();
+    for(unsigned int t = 1; t < threads; t++)
+        pthread_join(handles[t], NULL);
+    double time = getTimeSeconds() - start;
+
+    uint64_t expected = (uint64_t) items * (items + 1) / 2;
+    printf(KRED"deque ["KBLU"threads:"KGRN"1+%-3u"KBLU"stolen:"KGRN"%5.1f%% ", threads - 1, 100.0 * atomic_load(&run.steals) / items);
+    printf(KBLU"rate:"KGRN"%7.2fMitems/s"KRED"]%s\n"KNRM, items / time * 1e-6, atomic_load(&run.sum) == expected ? "" : " items lost or repeated");
+    free(handles);
+    cleanWorkDeque(&run.deque);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int maxThreads = argc > 1 ? (unsigned int) atoi(argv[1]) : getProcessorCount();
+    size_t items = argc > 2 ? (size_t) atol(argv[2]) : BENCH_ITEMS;
+    if(argc <= 1 && maxThreads < 4)
+        maxThreads = 4;
+
+    runQueue(QUEUE_SPSC, 1, 1, items);
+    runQueue(QUEUE_SPSC, 1, BENCH_BATCH, items);
+    for(unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        for(size_t batch = 1; batch <= BENCH_BATCH; batch *= BENCH_BATCH)
+        {
+            runQueue(QUEUE_MPMC, threads, batch, items);
+            runQueue(QUEUE_LOCKED, threads, batch, items);
+        }
+    }
+    for(unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+        runDeque(threads, items);
+    return 0;
+}
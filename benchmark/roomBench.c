@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/accel.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/plane.h>
+#include <rayTracerCore/shapes/box.h>
+
+#define BENCH_RAYS 2000000u
+
+// The room, rays start inside it so every one of them hits something
+#define ROOM_X 10.f
+#define ROOM_Y 6.f
+#define ROOM_Z 20.f
+
+/**
+* The same room with crates in it built twice: out of triangle pairs and 12 triangle boxes the way
+* buildScene1 used to, and out of a floor plane, quads and boxes. Both go through a SAH bvh and
+* are timed on closest hits and shadow rays from random points inside the room.
+*
+* Usage: roomBench [crates...]
+*/
+
+static const material mat = {.reflect = false, .color = {.5, .5, .5}};
+
+static void push(object** list, object* obj)
+{
+    obj->next = *list;
+    *list = obj;
+}
+
+static void addTriangleQuad(object** list, const point3f corner, const vector3f u, const vector3f v)
+{
+    point3f b = {}, c = {}, d = {};
+    vector3f_add_new(b, corner, u);
+    vector3f_add_new(c, b, v);
+    vector3f_add_new(d, corner, v);
+    push(list, createTriangle(mat, corner, b, c));
+    push(list, createTriangle(mat, corner, c, d));
+}
+
+static void addTriangleBox(object** list, const point3f min, const point3f max)
+{
+    vector3f size = {};
+    vector3f_sub_new(size, max, min);
+    for(int axis = 0; axis < 3; axis++)
+    {
+        vector3f u = {}, v = {};
+        u[(axis + 1) % 3] = size[(axis + 1) % 3];
+        v[(axis + 2) % 3] = size[(axis + 2) % 3];
+        point3f far = {min[0], min[1], min[2]};
+        far[axis] = max[axis];
+        addTriangleQuad(list, min, u, v);
+        addTriangleQuad(list, far, u, v);
+    }
+}
+
+static void crate(point3f min, point3f max)
+{
+    float size = mapToRangef(rand(), 0, RAND_MAX, .3f, 1.2f);
+    vector3f_set(min, mapToRangef(rand(), 0, RAND_MAX, -ROOM_X + 1, ROOM_X - 2), 0,
+                 mapToRangef(rand(), 0, RAND_MAX, -ROOM_Z + 1, -2));
+    vector3f_set(max, min[0] + size, size * mapToRangef(rand(), 0, RAND_MAX, .5f, 2.5f), min[2] + size);
+}
+
+/**
+* Floor at y 0, ceiling, four walls, then the crates. native swaps in a plane for the floor and quads and boxes for the rest.
+*/
+static object* buildRoom(unsigned int crates, bool native)
+{
+    object* list = NULL;
+    point3f origin = {-ROOM_X, 0, -ROOM_Z}, top = {-ROOM_X, ROOM_Y, -ROOM_Z}, right = {ROOM_X, 0, -ROOM_Z}, front = {-ROOM_X, 0, 0};
+    vector3f x = {2 * ROOM_X, 0, 0}, y = {0, ROOM_Y, 0}, z = {0, 0, ROOM_Z};
+    if(native)
+    {
+        vector3f up = {0, 1, 0};
+        push(&list, createPlane(mat, up, origin));
+        push(&list, createQuad(mat, top, z, x));
+        push(&list, createQuad(mat, origin, x, y));
+        push(&list, createQuad(mat, front, y, x));
+        push(&list, createQuad(mat, origin, y, z));
+        push(&list, createQuad(mat, right, z, y));
+    }
+    else
+    {
+        addTriangleQuad(&list, origin, z, x);
+        addTriangleQuad(&list, top, z, x);
+        addTriangleQuad(&list, origin, x, y);
+        addTriangleQuad(&list, front, y, x);
+        addTriangleQuad(&list, origin, y, z);
+        addTriangleQuad(&list, right, z, y);
+    }
+    srand(1);
+    for(unsigned int i = 0; i < crates; i++)
+    {
+        point3f min = {}, max = {};
+        crate(min, max);
+        if(native)
+            push(&list, createBox(mat, min, max));
+        else
+            addTriangleBox(&list, min, max);
+    }
+    return list;
+}
+
+static void roomPoint(point3f p)
+{
+    vector3f_set(p, mapToRangef(rand(), 0, RAND_MAX, -ROOM_X + .1f, ROOM_X - .1f), mapToRangef(rand(), 0, RAND_MAX, 3.5f, ROOM_Y - .1f),
+                 mapToRangef(rand(), 0, RAND_MAX, -ROOM_Z + .1f, -.1f));
+}
+
+static void buildRay(ray* r)
+{
+    roomPoint(r->origin);
+    vector3f_set(r->dir, mapToRangef(rand(), 0, RAND_MAX, -1, 1), mapToRangef(rand(), 0, RAND_MAX, -1, 1), mapToRangef(rand(), 0, RAND_MAX, -1, 1));
+    vector3f_normalize(r->dir);
+    r->tmin = 1e-4f;
+    r->tmax = INFINITY;
+}
+
+// Towards a light somewhere else in the room, blocked by whatever stands between
+static void buildShadowRay(ray* r)
+{
+    point3f target = {};
+    roomPoint(r->origin);
+    roomPoint(target);
+    target[1] = mapToRangef(rand(), 0, RAND_MAX, 0.1f, ROOM_Y - .1f);
+    vector3f_sub_new(r->dir, target, r->origin);
+    r->tmax = vector3f_norm(r->dir);
+    vector3f_normalize(r->dir);
+    r->tmin = 1e-4f;
+}
+
+typedef struct
+{
+    double closestTime, shadowTime;
+    unsigned int objects, shadowed;
+} roomRun;
+
+static void run(const object* list, float* distances, bool* blocked, roomRun* result)
+{
+    const accelOptions options = {.builder = BVH_SAH, .width = BVH2, .packets = true};
+    accel* a = buildAccel(ACCEL_BVH, list, &options);
+    result->objects = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        result->objects++;
+
+    srand(2);
+    double start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_RAYS; i++)
+    {
+        ray r;
+        buildRay(&r);
+        rayHit rh;
+        distances[i] = INFINITY;
+        if(a->closestHit(a, r, &rh))
+        {
+            vector3f toHit = {};
+            vector3f_sub_new(toHit, rh.location, r.origin);
+            distances[i] = vector3f_norm(toHit);
+        }
+    }
+    result->closestTime = getTimeSeconds() - start;
+
+    result->shadowed = 0;
+    start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_RAYS; i++)
+    {
+        ray r;
+        buildShadowRay(&r);
+        blocked[i] = a->anyHit(a, r, NULL);
+        result->shadowed += blocked[i];
+    }
+    result->shadowTime = getTimeSeconds() - start;
+    cleanAccel(&a);
+}
+
+static void bench(unsigned int crates)
+{
+    float* triangleT = malloc(BENCH_RAYS * sizeof(float));
+    float* nativeT = malloc(BENCH_RAYS * sizeof(float));
+    bool* triangleBlocked = malloc(BENCH_RAYS * sizeof(bool));
+    bool* nativeBlocked = malloc(BENCH_RAYS * sizeof(bool));
+
+    object* triangles = buildRoom(crates, false);
+    roomRun tri;
+    run(triangles, triangleT, triangleBlocked, &tri);
+    cleanObjectList(&triangles);
+
+    object* native = buildRoom(crates, true);
+    roomRun nat;
+    run(native, nativeT, nativeBlocked, &nat);
+    cleanObjectList(&native);
+
+    // Different math on the same surfaces, distances only have to agree closely
+    unsigned int mismatches = 0;
+    for(unsigned int i = 0; i < BENCH_RAYS; i++)
+    {
+        bool same = fabsf(triangleT[i] - nativeT[i]) <= 1e-3f * fmaxf(1.f, triangleT[i]);
+        mismatches += !same;
+    }
+    unsigned int shadowMismatches = 0;
+    for(unsigned int i = 0; i < BENCH_RAYS; i++)
+        shadowMismatches += triangleBlocked[i] != nativeBlocked[i];
+
+    printf(KRED"crates:%u["KBLU"rays:"KGRN"%u "KBLU"objects:"KGRN"%u/%u ", crates, BENCH_RAYS, tri.objects, nat.objects);
+    printf(KBLU"closest:"KGRN"%5.1fns/%5.1fns "KBLU"speedup:"KGRN"%4.2fx ", tri.closestTime * 1e9 / BENCH_RAYS, nat.closestTime * 1e9 / BENCH_RAYS,
+           tri.closestTime / nat.closestTime);
+    printf(KBLU"shadow:"KGRN"%5.1fns/%5.1fns "KBLU"speedup:"KGRN"%4.2fx ", tri.shadowTime * 1e9 / BENCH_RAYS, nat.shadowTime * 1e9 / BENCH_RAYS,
+           tri.shadowTime / nat.shadowTime);
+    printf(KBLU"shadowed:"KGRN"%4.1f%%"KRED"]\n"KNRM, 100.0 * tri.shadowed / BENCH_RAYS);
+    if(mismatches > 0 || shadowMismatches > 0)
+        printf(KRED"triangles and native primitives disagree on %u closest hits and %u shadow rays\n"KNRM, mismatches, shadowMismatches);
+
+    free(triangleT);
+    free(nativeT);
+    free(triangleBlocked);
+    free(nativeBlocked);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 1)
+    {
+        for(int i = 1; i < argc; i++)
+            bench((unsigned int)atoi(argv[i]));
+        return 0;
+    }
+    bench(20);
+    bench(200);
+    bench(2000);
+    return 0;
+}
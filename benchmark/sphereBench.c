@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/spherepacket.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/ellipsoid.h>
+
+// Rays aimed at each packet
+#define BENCH_RAYS 4
+// Every kernel run does at least this many ray sphere tests
+#define BENCH_MIN_TESTS 40000000u
+// Camera rays traced through the whole cloud
+#define BENCH_TRACE_RAYS 1000000u
+
+/**
+* A particle cloud: times sphereHit against the general ellipsoid path it replaced, the
+* 8 wide sphere packet kernels after checking they agree with the scalar one, and closest
+* hits through a BVH over the whole cloud with and without packed leaves.
+*
+* Usage: sphereBench [spheres]
+*/
+
+typedef int(*packetKernel)(const spherePacket*, const ray*, float, float[SPHERE_PACKET_WIDTH]);
+typedef bool(*sphereHitFunction)(const ray, const object*, float*, rayHit*);
+
+static object** buildCloud(unsigned int count)
+{
+    const material mat = {.reflect = false, .color = {.8, .3, .3}};
+    object** spheres = malloc(count * sizeof(object*));
+    // Radius keeps the cloud about as dense whatever the count
+    float radius = 4.f / cbrtf((float)count);
+    srand(1);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        point3f center = {mapToRangef(rand(), 0, RAND_MAX, -8, 8), mapToRangef(rand(), 0, RAND_MAX, -8, 8), mapToRangef(rand(), 0, RAND_MAX, -24, -8)};
+        spheres[i] = createSphere(mat, radius * mapToRangef(rand(), 0, RAND_MAX, .5f, 1.5f), center);
+    }
+    return spheres;
+}
+
+/**
+* Each ray aims at a sphere of its packet so a fair share of lanes hit
+*/
+static void buildRays(ray* rays, object* const* spheres, unsigned int packets)
+{
+    for(unsigned int i = 0; i < packets * BENCH_RAYS; i++)
+    {
+        const ellipsoid_t* e = spheres[i / BENCH_RAYS * SPHERE_PACKET_WIDTH + rand() % SPHERE_PACKET_WIDTH]->shape;
+        point3f target = {e->center[0] + mapToRangef(rand(), 0, RAND_MAX, -e->a, e->a), e->center[1] + mapToRangef(rand(), 0, RAND_MAX, -e->a, e->a), e->center[2]};
+        vector3f_set(rays[i].origin, 0, 0, 1);
+        vector3f_sub_new(rays[i].dir, target, rays[i].origin);
+        vector3f_normalize(rays[i].dir);
+        rays[i].tmin = 0;
+        rays[i].tmax = INFINITY;
+    }
+}
+
+static unsigned long long validate(const char* name, packetKernel kernel, const spherePacket* packets, unsigned int count, const ray* rays)
+{
+    unsigned long long mismatches = 0;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        for(unsigned int j = i * BENCH_RAYS; j < (i + 1) * BENCH_RAYS; j++)
+        {
+            float expected[SPHERE_PACKET_WIDTH], t[SPHERE_PACKET_WIDTH];
+            int expectedMask = spherePacketTestScalar(&packets[i], &rays[j], INFINITY, expected);
+            int mask = kernel(&packets[i], &rays[j], INFINITY, t);
+            if(mask != expectedMask)
+            {
+                mismatches++;
+                continue;
+            }
+            for(int lane = 0; lane < SPHERE_PACKET_WIDTH; lane++)
+                mismatches += (mask >> lane & 1) && t[lane] != expected[lane];
+        }
+    }
+    if(mismatches > 0)
+        printf(KRED"%s disagrees with scalar on %llu tests\n"KNRM, name, mismatches);
+    return mismatches;
+}
+
+static void printRate(const char* name, unsigned long long tests, unsigned long long hits, double time)
+{
+    printf(KRED"%s["KBLU"tests:"KGRN"%llu ", name, tests);
+    printf(KBLU"hit rate:"KGRN"%4.1f%% ", 100.0 * hits / tests);
+    printf(KBLU"sphere:"KGRN"%4.2fns"KRED"]\n"KNRM, time * 1e9 / tests);
+}
+
+static void benchObjects(const char* name, sphereHitFunction hit, object* const* spheres, unsigned int count, const ray* rays)
+{
+    unsigned int passes = (BENCH_MIN_TESTS / SPHERE_PACKET_WIDTH + count - 1) / count;
+    unsigned long long hits = 0;
+    rayHit rh;
+    rh.depth = 0;
+    double start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        for(unsigned int i = 0; i < count; i++)
+        {
+            const ray r = rays[i * BENCH_RAYS + pass % BENCH_RAYS];
+            for(int lane = 0; lane < SPHERE_PACKET_WIDTH; lane++)
+            {
+                float t;
+                hits += hit(r, spheres[i * SPHERE_PACKET_WIDTH + lane], &t, &rh);
+            }
+        }
+    }
+    printRate(name, (unsigned long long)passes * count * SPHERE_PACKET_WIDTH, hits, getTimeSeconds() - start);
+}
+
+static void benchKernel(const char* name, packetKernel kernel, const spherePacket* packets, unsigned int count, const ray* rays)
+{
+    unsigned int passes = (BENCH_MIN_TESTS / SPHERE_PACKET_WIDTH + count - 1) / count;
+    unsigned long long hits = 0;
+    double start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        for(unsigned int i = 0; i < count; i++)
+        {
+            float t[SPHERE_PACKET_WIDTH];
+            hits += __builtin_popcount(kernel(&packets[i], &rays[i * BENCH_RAYS + pass % BENCH_RAYS], INFINITY, t));
+        }
+    }
+    printRate(name, (unsigned long long)passes * count * SPHERE_PACKET_WIDTH, hits, getTimeSeconds() - start);
+}
+
+/**
+* Primary rays from in front of the cloud, the same rays with and without packets
+*/
+static void benchTrace(const char* name, const bvh* tree)
+{
+    unsigned long long hits = 0;
+    srand(2);
+    double start = getTimeSeconds();
+    for(unsigned int i = 0; i < BENCH_TRACE_RAYS; i++)
+    {
+        ray r;
+        vector3f_set(r.origin, 0, 0, 1);
+        vector3f_set(r.dir, mapToRangef(rand(), 0, RAND_MAX, -.4f, .4f), mapToRangef(rand(), 0, RAND_MAX, -.4f, .4f), -1);
+        vector3f_normalize(r.dir);
+        r.tmin = 0;
+        r.tmax = INFINITY;
+        rayHit rh;
+        rh.depth = 0;
+        hits += bvhClosestHit(tree, r, &rh);
+    }
+    double time = getTimeSeconds() - start;
+    printf(KRED"%s["KBLU"rays:"KGRN"%u ", name, BENCH_TRACE_RAYS);
+    printf(KBLU"hit rate:"KGRN"%4.1f%% ", 100.0 * hits / BENCH_TRACE_RAYS);
+    printf(KBLU"rate:"KGRN"%5.2fMrays/s"KRED"]\n"KNRM, BENCH_TRACE_RAYS / time * 1e-6);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int count = argc > 1 ? (unsigned int)atoi(argv[1]) : 1000000;
+    unsigned int packetCount = count / SPHERE_PACKET_WIDTH;
+    packetCount = packetCount < 1 ? 1 : packetCount;
+    count = packetCount * SPHERE_PACKET_WIDTH;
+    object** spheres = buildCloud(count);
+
+    spherePacket* packets = NULL;
+    if(posix_memalign((void**)&packets, 64, packetCount * sizeof(spherePacket)) != 0)
+        return 1;
+    for(unsigned int i = 0; i < packetCount; i++)
+    {
+        const ellipsoid_t* shapes[SPHERE_PACKET_WIDTH];
+        for(int lane = 0; lane < SPHERE_PACKET_WIDTH; lane++)
+            shapes[lane] = spheres[i * SPHERE_PACKET_WIDTH + lane]->shape;
+        packSpheres(&packets[i], shapes, SPHERE_PACKET_WIDTH);
+    }
+    ray* rays = malloc(packetCount * BENCH_RAYS * sizeof(ray));
+    buildRays(rays, spheres, packetCount);
+
+    unsigned long long mismatches = 0;
+#ifdef __SSE__
+    mismatches += validate("sse", spherePacketTestSSE, packets, packetCount, rays);
+#endif
+#ifdef __AVX2__
+    mismatches += validate("avx2", spherePacketTestAVX2, packets, packetCount, rays);
+#endif
+
+    benchObjects("ellipsoidHit", ellipsoidHit, spheres, packetCount, rays);
+    benchObjects("sphereHit", sphereHit, spheres, packetCount, rays);
+    benchKernel("scalar", spherePacketTestScalar, packets, packetCount, rays);
+#ifdef __SSE__
+    benchKernel("sse", spherePacketTestSSE, packets, packetCount, rays);
+#endif
+#ifdef __AVX2__
+    benchKernel("avx2", spherePacketTestAVX2, packets, packetCount, rays);
+#endif
+    free(packets);
+    free(rays);
+
+    object* list = NULL;
+    for(unsigned int i = count; i-- > 0;)
+    {
+        spheres[i]->next = list;
+        list = spheres[i];
+    }
+    free(spheres);
+    bvh* tree = buildBVH(list);
+    printBVHStats(tree);
+    benchTrace("bvh", tree);
+    bvhPackLeaves(tree);
+    printBVHStats(tree);
+    benchTrace("bvh packets", tree);
+    cleanBVH(&tree);
+    cleanObjectList(&list);
+    return mismatches > 0;
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <util/vector.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/primitives.h>
+#include <rayTracerCore/shapes/geometry.h>
+
+#define BENCH_RAYS 1024
+// Every run does at least this many ray triangle tests
+#define BENCH_MIN_TESTS 20000000u
+
+/**
+* Times ray triangle tests through the same object function pointers the renderer uses.
+* The walls stay in cache, the mesh streams every triangle through memory.
+*
+* Usage: triangleBench [mesh triangles]
+*/
+
+static void addObject(object** list, object* obj)
+{
+    obj->next = *list;
+    *list = obj;
+}
+
+// The room from buildScene1 in main.c
+static object* buildWalls(void)
+{
+    const material mat = {.reflect = false, .color = {.79, .79, .4}};
+    const point3f walls[6][3] = {
+        {{-8, -2, -10}, {8, -2, -10}, {8, 10, -10}},
+        {{-8, -2, -10}, {8, 10, -10}, {-8, 10, -10}},
+        {{-8, -2, -10}, {8, -2, -0}, {8, -2, -10}},
+        {{-8, -2, -10}, {-8, -2, -0}, {8, -2, -0}},
+        {{8, -2, -10}, {8, -2, -0}, {8, 10, -10}},
+        {{-8, -2, -0}, {-8, -2, -10}, {-8, 10, -10}}};
+    object* list = NULL;
+    for(int i = 5; i >= 0; i--)
+        addObject(&list, createTriangle(mat, walls[i][0], walls[i][1], walls[i][2]));
+    return list;
+}
+
+/**
+* Bumpy height field across the back of the room, two triangles per grid cell
+*/
+static object* buildMesh(unsigned int triangles)
+{
+    const material mat = {.reflect = false, .color = {.3, .6, .3}};
+    unsigned int side = (unsigned int)sqrtf(triangles / 2.0f);
+    side = side < 1 ? 1 : side;
+    object* list = NULL;
+    for(unsigned int y = side; y-- > 0;)
+    {
+        for(unsigned int x = side; x-- > 0;)
+        {
+            point3f p[4];
+            for(int c = 0; c < 4; c++)
+            {
+                float fx = mapToRangef(x + (c & 1), 0, side, -8, 8);
+                float fy = mapToRangef(y + (c >> 1), 0, side, -2, 10);
+                vector3f_set(p[c], fx, fy, -6 + .5f * sinf(fx * 3) * cosf(fy * 3));
+            }
+            addObject(&list, createTriangle(mat, p[1], p[3], p[2]));
+            addObject(&list, createTriangle(mat, p[0], p[1], p[2]));
+        }
+    }
+    return list;
+}
+
+static void buildRays(ray* rays, unsigned int count)
+{
+    srand(1);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        vector3f_set(rays[i].origin, 0, 0, 1);
+        point3f target = {mapToRangef(rand(), 0, RAND_MAX, -9, 9), mapToRangef(rand(), 0, RAND_MAX, -3, 11), -8};
+        vector3f_sub_new(rays[i].dir, target, rays[i].origin);
+        vector3f_normalize(rays[i].dir);
+        rays[i].tmin = 0;
+        rays[i].tmax = INFINITY;
+    }
+}
+
+static void bench(const char* name, object* list, const ray* rays)
+{
+    unsigned int count = 0;
+    for(object* obj = list; obj != NULL; obj = obj->next)
+        count++;
+    const object** objects = malloc(count * sizeof(object*));
+    count = 0;
+    for(object* obj = list; obj != NULL; obj = obj->next)
+        objects[count++] = obj;
+    // The same triangles as a BVH leaf holds them, one run of ids in a primitiveStore
+    primitiveStore* store = createPrimitiveStore();
+    primitiveId* ids = malloc(count * sizeof(primitiveId));
+    for(unsigned int i = 0; i < count; i++)
+        ids[i] = primitiveStoreAddObject(store, objects[i]);
+    unsigned int passes = (BENCH_MIN_TESTS + count - 1) / count;
+    unsigned long long tests = (unsigned long long)passes * count;
+
+    unsigned long long hits = 0;
+    rayHit rh;
+    rh.depth = 0;
+    double start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        for(unsigned int i = 0; i < count; i++)
+        {
+            float t;
+            hits += objects[i]->hit(rays[(pass + i) % BENCH_RAYS], objects[i], &t, &rh);
+        }
+    }
+    double hitTime = getTimeSeconds() - start;
+
+    // Nearest hit over every triangle per ray, filling a record for each closer candidate against the BVH leaf loop
+    // that only keeps the nearest id and fills its record once
+    unsigned long long mismatches = 0;
+    float recordZ[BENCH_RAYS];
+    start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        const ray r = rays[pass % BENCH_RAYS];
+        rayHit testrh, best;
+        testrh.depth = 0;
+        float nearest = INFINITY;
+        for(unsigned int i = 0; i < count; i++)
+        {
+            float t;
+            if(objects[i]->hit(r, objects[i], &t, &testrh) && t < nearest)
+            {
+                nearest = t;
+                best = testrh;
+            }
+        }
+        recordZ[pass % BENCH_RAYS] = nearest < INFINITY ? best.location[2] : INFINITY;
+    }
+    double recordTime = getTimeSeconds() - start;
+
+    start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        const ray r = rays[pass % BENCH_RAYS];
+        ray testRay = r;
+        float z = INFINITY;
+        hitPath path;
+        primitiveId nearest = primitivesClosestHit(store, ids, count, &testRay, &path);
+        if(nearest != PRIMITIVE_NONE)
+        {
+            primitiveSurface(store, nearest, r, testRay.tmax, &path, &rh);
+            z = rh.location[2];
+        }
+        mismatches += z != recordZ[pass % BENCH_RAYS];
+    }
+    double deferredTime = getTimeSeconds() - start;
+
+    unsigned long long occluded = 0;
+    start = getTimeSeconds();
+    for(unsigned int pass = 0; pass < passes; pass++)
+    {
+        for(unsigned int i = 0; i < count; i++)
+            occluded += objects[i]->test(rays[(pass + i) % BENCH_RAYS], objects[i]);
+    }
+    double testTime = getTimeSeconds() - start;
+
+    printf(KRED"%s["KBLU"triangles:"KGRN"%u ", name, count);
+    printf(KBLU"tests:"KGRN"%llu ", tests);
+    printf(KBLU"hit rate:"KGRN"%4.1f%% ", 100.0 * hits / tests);
+    printf(KBLU"hit:"KGRN"%4.2fns/test ", hitTime * 1e9 / tests);
+    printf(KBLU"test:"KGRN"%4.2fns/test ", testTime * 1e9 / tests);
+    printf(KBLU"closest record:"KGRN"%4.2fns/test "KBLU"deferred:"KGRN"%4.2fns/test"KRED"]\n"KNRM, recordTime * 1e9 / tests, deferredTime * 1e9 / tests);
+    if(hits != occluded)
+        printf(KRED"hit and test disagree: %llu vs %llu\n"KNRM, hits, occluded);
+    if(mismatches > 0)
+        printf(KRED"records and deferred surfaces disagree on %llu rays\n"KNRM, mismatches);
+    free(ids);
+    cleanPrimitiveStore(&store);
+    free(objects);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int meshTriangles = argc > 1 ? (unsigned int)atoi(argv[1]) : 1000000;
+    ray* rays = malloc(BENCH_RAYS * sizeof(ray));
+    buildRays(rays, BENCH_RAYS);
+
+    object* walls = buildWalls();
+    bench("walls", walls, rays);
+    cleanObjectList(&walls);
+
+    object* mesh = buildMesh(meshTriangles);
+    bench("mesh", mesh, rays);
+    cleanObjectList(&mesh);
+
+    free(rays);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef _AABB_H_
+#define _AABB_H_
+
+#include <stdbool.h>
+#include <math.h>
+#include <util/vector.h>
+#include <rayTracerCore/ray.h>
+
+typedef struct
+{
+    point3f min, max;
+} aabb;
+
+static inline void aabbEmpty(aabb* box)
+{
+    vector3f_set(box->min, INFINITY, INFINITY, INFINITY);
+    vector3f_set(box->max, -INFINITY, -INFINITY, -INFINITY);
+}
+
+static inline void aabbExtendPoint(aabb* box, const point3f p)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        box->min[i] = fminf(box->min[i], p[i]);
+        box->max[i] = fmaxf(box->max[i], p[i]);
+    }
+}
+
+static inline void aabbExtend(aabb* box, const aabb* other)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        box->min[i] = fminf(box->min[i], other->min[i]);
+        box->max[i] = fmaxf(box->max[i], other->max[i]);
+    }
+}
+
+static inline void aabbCentroid(point3f c, const aabb* box)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        c[i] = .5f * (box->min[i] + box->max[i]);
+    }
+}
+
+static inline float aabbSurfaceArea(const aabb* box)
+{
+    float dx = box->max[0] - box->min[0];
+    float dy = box->max[1] - box->min[1];
+    float dz = box->max[2] - box->min[2];
+    if(dx < 0 || dy < 0 || dz < 0)
+        return 0;
+    return 2.f * (dx * dy + dy * dz + dz * dx);
+}
+
+static inline int aabbLongestAxis(const aabb* box)
+{
+    float dx = box->max[0] - box->min[0];
+    float dy = box->max[1] - box->min[1];
+    float dz = box->max[2] - box->min[2];
+    if(dx > dy && dx > dz)
+        return 0;
+    return dy > dz ? 1 : 2;
+}
+
+/**
+* Slab test against a ray with a precomputed reciprocal direction.
+* On a hit tnear holds the entry distance.
+*/
+static inline bool aabbHit(const aabb* box, const ray* r, const vector3f invDir, float tmax, float* tnear)
+{
+    float t0 = r->tmin, t1 = tmax;
+    for(int i = 0; i < 3; i++)
+    {
+        float tn = (box->min[i] - r->origin[i]) * invDir[i];
+        float tf = (box->max[i] - r->origin[i]) * invDir[i];
+        if(tn > tf)
+        {
+            float tmp = tn;
+            tn = tf;
+            tf = tmp;
+        }
+        t0 = tn > t0 ? tn : t0;
+        t1 = tf < t1 ? tf : t1;
+        if(t0 > t1)
+            return false;
+    }
+    *tnear = t0;
+    return true;
+}
+
+void printAABB(const aabb box);
+
+#endif // _AABB_H_
@@ -0,0 +1,64 @@
+#ifndef _ACCEL_H_
+#define _ACCEL_H_
+
+#include <stdbool.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/lbvh.h>
+#include <rayTracerCore/frustum.h>
+
+typedef enum
+{
+    ACCEL_LIST,
+    ACCEL_BVH,
+    ACCEL_GRID
+} accelType;
+
+typedef struct
+{
+    bvhBuilder builder;
+    bvhWidth width;
+    bool compressed;        // quantized wide nodes, BVH2 is collapsed to BVH4 first
+    bool packets;           // leaf triangles tested 8 at a time
+    lbvhOptions lbvh;
+    const char* cachePath;  // NULL always rebuilds the bvh
+    float gridDensity;      // target cells per primitive, 0 picks GRID_DEFAULT_DENSITY
+} accelOptions;
+
+typedef struct accel_t accel;
+
+typedef bool(*accelClosestHitFunction)(const accel*, const ray, rayHit*);
+// occluder receives the first object found blocking the ray, it may be NULL
+typedef bool(*accelAnyHitFunction)(const accel*, const ray, const object** occluder);
+// Fills cull with what of the scene can be seen through a tile's frustum
+typedef void(*accelCullFunction)(const accel*, const frustum*, frustumCull*);
+// Closest hit for a ray inside the frustum cull was built from
+typedef bool(*accelClosestHitCulledFunction)(const accel*, const frustumCull*, const ray, rayHit*);
+typedef void(*accelPrintFunction)(const accel*);
+typedef void(*accelDestroyFunction)(void*);
+
+/**
+* Anything that can answer closest hit and any hit queries over a scene list.
+* data belongs to the implementation and is released through destroy.
+*/
+struct accel_t
+{
+    accelType type;
+    unsigned int id;    // unique per build, never reused
+    void* data;
+    accelClosestHitFunction closestHit;
+    accelAnyHitFunction anyHit;
+    accelCullFunction cull;
+    accelClosestHitCulledFunction closestHitCulled;
+    accelPrintFunction print;
+    accelDestroyFunction destroy;
+};
+
+accel* buildAccel(accelType type, const object* list, const accelOptions* options);
+bool parseAccelType(const char* name, accelType* type);
+const char* accelTypeName(accelType type);
+void cleanAccel(accel** a);
+
+#endif // _ACCEL_H_
@@ -0,0 +1,222 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <rayTracerCore/aabb.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/primitives.h>
+#include <rayTracerCore/frustum.h>
+#include <rayTracerCore/trianglepacket.h>
+#include <rayTracerCore/spherepacket.h>
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 8
+#define BVH_STACK_SIZE 128
+// Subtrees whose SAH cost grew past this ratio since they were built are rebuilt by bvhUpdate
+#define BVH_PARTIAL_REBUILD_RATIO 1.25f
+// Past this ratio for the whole tree it is rebuilt from scratch
+#define BVH_FULL_REBUILD_RATIO 1.75f
+// Leaves with fewer triangles or spheres than this test them one by one
+#define BVH_PACKET_MIN 2
+// leafPacket entries hold the packet index, whether it is a spherePacket and the count of primitives it covers
+#define BVH_PACKET_ENTRY(index, spheres, count) ((uint32_t)(index) << 5 | (uint32_t)(spheres) << 4 | (count))
+#define BVH_PACKET_INDEX(entry) ((entry) >> 5)
+#define BVH_PACKET_SPHERES(entry) ((entry) >> 4 & 1)
+#define BVH_PACKET_COUNT(entry) ((entry) & 0xF)
+
+/**
+* Nodes are stored depth first in one array.
+* An interior node's first child directly follows it and offset is the second child,
+* a leaf's offset is the first entry in the primitive and id arrays and count is non zero.
+*/
+typedef struct
+{
+    aabb bounds;
+    uint32_t offset;
+    uint16_t count;
+    uint16_t axis;
+} bvhNode;
+
+typedef enum
+{
+    BVH2 = 2,
+    BVH4 = 4,
+    BVH8 = 8
+} bvhWidth;
+
+typedef enum
+{
+    BVH_SAH,
+    BVH_LBVH
+} bvhBuilder;
+
+typedef enum
+{
+    BVH_REFIT,
+    BVH_PARTIAL_REBUILD,
+    BVH_FULL_REBUILD
+} bvhUpdateResult;
+
+typedef struct
+{
+    bvhBuilder builder;
+    unsigned int buildThreads;
+    double buildTime;
+    double collapseTime;
+    unsigned int nodeCount;
+    unsigned int leafCount;
+    unsigned int maxDepth;
+    unsigned int wideNodeCount;
+    float sahCost;
+    double updateTime;
+    unsigned int refits;
+    unsigned int partialRebuilds;
+    unsigned int fullRebuilds;
+    bool cached;
+    double loadTime;
+    unsigned int packedTriangles;
+    unsigned int packedSpheres;
+} bvhStats;
+
+typedef struct bvh_t
+{
+    bvhNode* nodes;
+    unsigned int nodeCount;
+    const object** primitives; // what the tree was built over, edits and the cache work on these
+    unsigned int primitiveCount;
+    primitiveStore* store;     // the primitives copied in leaf order, see bvhSyncPrimitives
+    primitiveId* ids;          // ids[i] is primitives[i] in store, traversal only reads these
+    bvhWidth width;
+    void* wideNodes;
+    unsigned int wideNodeCount;
+    bool compressed;      // wideNodes are qbvh4Node/qbvh8Node and nodes is NULL
+    float* referenceCost; // subtree SAH cost when each node was last built
+    void* mapping;        // read only cache file nodes point into, see bvhcache.h
+    size_t mappingSize;
+    bool packed;          // leaves test their triangles or spheres as packets, edits drop them until the next refit or update
+    trianglePacket* packets;
+    unsigned int packetCount;
+    spherePacket* spherePackets;
+    unsigned int spherePacketCount;
+    uint32_t* leafPacket; // by a leaf's first primitive, 0 when it has no packet
+    bvhStats stats;
+} bvh;
+
+/**
+* A leaf's packed triangles or spheres sit at the front of its primitives and are tested together first,
+* the rest go to primitivesClosestHit as one batch of ids
+*/
+static inline bool bvhIntersectLeaf(const bvh* tree, uint32_t offset, uint32_t count, const ray r, ray* testRay, primitiveId* nearest, hitPath* path)
+{
+    uint32_t entry = tree->leafPacket != NULL ? tree->leafPacket[offset] : 0;
+    uint32_t packed = BVH_PACKET_COUNT(entry);
+    bool hit = false;
+    if(packed > 0)
+    {
+        float t;
+        // Strictly nearer than the current hit, the same as the scalar path
+        float tmax = nextafterf(testRay->tmax, 0);
+        int lane = BVH_PACKET_SPHERES(entry) ? spherePacketIntersect(&tree->spherePackets[BVH_PACKET_INDEX(entry)], &r, tmax, &t)
+                                             : trianglePacketIntersect(&tree->packets[BVH_PACKET_INDEX(entry)], &r, tmax, &t);
+        if(lane >= 0)
+        {
+            testRay->tmax = t;
+            *nearest = tree->ids[offset + lane];
+            hit = true;
+        }
+    }
+    if(packed == count)
+        return hit;
+    primitiveId id = primitivesClosestHit(tree->store, tree->ids + offset + packed, count - packed, testRay, path);
+    if(id == PRIMITIVE_NONE)
+        return hit;
+    *nearest = id;
+    return true;
+}
+
+/**
+* Stops at the first primitive blocking r and hands it back through occluder when that is not NULL
+*/
+static inline bool bvhOccludeLeaf(const bvh* tree, uint32_t offset, uint32_t count, const ray r, const object** occluder)
+{
+    uint32_t entry = tree->leafPacket != NULL ? tree->leafPacket[offset] : 0;
+    uint32_t packed = BVH_PACKET_COUNT(entry);
+    if(packed > 0)
+    {
+        float t[TRIANGLE_PACKET_WIDTH];
+        int mask = BVH_PACKET_SPHERES(entry) ? spherePacketTest(&tree->spherePackets[BVH_PACKET_INDEX(entry)], &r, r.tmax, t)
+                                             : trianglePacketTest(&tree->packets[BVH_PACKET_INDEX(entry)], &r, r.tmax, t);
+        if(mask)
+        {
+            if(occluder != NULL)
+                *occluder = primitiveObject(tree->store, tree->ids[offset + __builtin_ctz(mask)]);
+            return true;
+        }
+    }
+    primitiveId id = primitivesAnyHit(tree->store, tree->ids + offset + packed, count - packed, r);
+    if(id == PRIMITIVE_NONE)
+        return false;
+    if(occluder != NULL)
+        *occluder = primitiveObject(tree->store, id);
+    return true;
+}
+
+bvh* buildBVH(const object* list);
+/**
+* The SAH nodes over count boxes of something that is not an object list, such as a mesh's triangles.
+* order gets the box index behind each leaf entry, the caller tests leaves itself.
+*/
+bvhNode* buildBVHNodes(const aabb* bounds, uint32_t count, uint32_t* order, unsigned int* nodeCount);
+/**
+* Checks nodes read from a file before they are traversed: children inside the array, leaves inside
+* the count primitives and no path deeper than the traversal stack.
+*/
+bool bvhValidNodes(const bvhNode* nodes, uint32_t nodeCount, uint32_t primitiveCount);
+bool bvhClosestHit(const bvh* tree, const ray r, rayHit* rh);
+/**
+* The nearest primitive before r->tmax without its surface, r->tmax is pulled in to its hit time.
+* PRIMITIVE_NONE on a miss, primitiveSurface(tree->store, ...) fills in the rest from it and path.
+*/
+primitiveId bvhClosestPrimitive(const bvh* tree, ray* r, hitPath* path);
+bool bvhAnyHit(const bvh* tree, const ray r, const object** occluder);
+/**
+* Keeps the subtrees of tree that can be seen through f.
+* bvhClosestHitCulled then only traverses what was kept, so it is only valid for rays inside f.
+*/
+void bvhCullFrustum(const bvh* tree, const frustum* f, frustumCull* cull);
+bool bvhClosestHitCulled(const bvh* tree, const frustumCull* cull, const ray r, rayHit* rh);
+float bvhSAHCost(const bvh* tree);
+void bvhResetQuality(bvh* tree);
+
+/**
+* Copies primitives into a fresh store in leaf order so each leaf's primitives of one type get
+* consecutive ids. Every build and edit below ends with it, callers only need it after
+* reordering primitives themselves.
+*/
+void bvhSyncPrimitives(bvh* tree);
+
+/**
+* Moving primitives (see setEllipsoidCenter, setTriangleVertices) or inserting and
+* removing them leaves the tree stale until refitBVH or bvhUpdate is called.
+*/
+void refitBVH(bvh* tree);
+bvhUpdateResult bvhUpdate(bvh* tree);
+void bvhInsert(bvh* tree, const object* obj);
+bool bvhRemove(bvh* tree, const object* obj);
+
+/**
+* Moves each leaf's triangles, or its spheres when it has more of them, to its front and
+* copies them into a trianglePacket or spherePacket.
+* Refits and updates repack on their own once a tree has been packed.
+*/
+void bvhPackLeaves(bvh* tree);
+void bvhPackLeaf(bvh* tree, uint32_t offset, uint32_t count);
+
+size_t bvhMemoryUsage(const bvh* tree);
+void printBVHStats(const bvh* tree);
+void cleanBVH(bvh** tree);
+
+#endif // _BVH_H_
@@ -0,0 +1,50 @@
+#ifndef _BVH_CACHE_H_
+#define _BVH_CACHE_H_
+
+#include <stdint.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/lbvh.h>
+
+#define BVH_CACHE_MAGIC 0x48564252u // "RBVH"
+#define BVH_CACHE_VERSION 1
+#define BVH_CACHE_ALIGN 64
+
+/**
+* On disk layout: this header, then the nodes exactly as bvhNode stores them, then one
+* uint32_t per primitive holding its position in the scene's object list.
+* Nothing in the file is a pointer so it can be mapped anywhere.
+*/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;           // bvhCacheKey of the scene and build settings
+    uint64_t fileSize;
+    uint32_t nodeSize;      // sizeof(bvhNode) when written
+    uint32_t nodeCount;
+    uint32_t primitiveCount;
+    uint32_t builder;
+    uint32_t buildThreads;
+    uint32_t leafCount;
+    uint32_t maxDepth;
+    float sahCost;
+    double buildTime;
+    uint64_t nodesOffset;
+    uint64_t primitivesOffset;
+} bvhCacheHeader;
+
+typedef enum
+{
+    BVH_CACHE_HIT,
+    BVH_CACHE_MISSING,
+    BVH_CACHE_STALE,    // written for another scene or other settings
+    BVH_CACHE_INVALID   // wrong version or damaged
+} bvhCacheStatus;
+
+uint64_t bvhCacheKey(const object* list, bvhBuilder builder, const lbvhOptions* options);
+bvh* loadBVHCache(const char* path, const object* list, uint64_t key, bvhCacheStatus* status);
+bool saveBVHCache(const char* path, const bvh* tree, const object* list, uint64_t key);
+// Loads path if it matches the scene, otherwise builds the tree and rewrites the cache
+bvh* cachedBVH(const char* path, const object* list, bvhBuilder builder, const lbvhOptions* options);
+
+#endif // _BVH_CACHE_H_
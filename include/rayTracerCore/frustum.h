@@ -0,0 +1,89 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <rayTracerCore/aabb.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/shapes/geometry.h>
+
+#define FRUSTUM_PLANES 5
+// Partially visible nodes stop being opened once a tile keeps this many subtrees
+#define FRUSTUM_MAX_SUBTREES 64
+
+/**
+* Planes through the camera origin around every primary ray of a screen tile plus one
+* facing along the view direction. Points with dot(normal, p) + d >= 0 are inside all of them.
+* direction points through the middle of the tile and orders what is kept front to back.
+*/
+typedef struct
+{
+    vector3f normal[FRUSTUM_PLANES];
+    float d[FRUSTUM_PLANES];
+    point3f origin;
+    vector3f direction;
+} frustum;
+
+/**
+* What is left of a scene for one tile.
+* primitives are tested one by one and subtrees are node indices in the accelerator
+* to traverse, nearest first once sortFrustumCull has run. The arrays are reused from tile to tile.
+*/
+typedef struct
+{
+    const object** primitives;
+    unsigned int primitiveCount, primitiveCapacity;
+    uint32_t* subtrees;
+    float* depth;           // distance along the tile's direction to the front of each subtree
+    unsigned int subtreeCount, subtreeCapacity;
+    unsigned int total;     // primitives in the scene
+    unsigned int kept;      // primitives in primitives or under subtrees
+} frustumCull;
+
+/**
+* Frustum around pixels [x0, x1) x [y0, y1), padded by a pixel so every sample stays inside
+*/
+void buildTileFrustum(frustum* f, const perspective p, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1);
+
+/**
+* Conservative, a box straddling two planes outside their corner is kept
+*/
+static inline bool frustumCullsAABB(const frustum* f, const aabb* box)
+{
+    for(int i = 0; i < FRUSTUM_PLANES; i++)
+    {
+        const float* n = f->normal[i];
+        // The corner furthest along the normal
+        float far = n[0] * (n[0] >= 0 ? box->max[0] : box->min[0]) +
+                    n[1] * (n[1] >= 0 ? box->max[1] : box->min[1]) +
+                    n[2] * (n[2] >= 0 ? box->max[2] : box->min[2]);
+        if(far + f->d[i] < 0)
+            return true;
+    }
+    return false;
+}
+
+static inline bool frustumContainsAABB(const frustum* f, const aabb* box)
+{
+    for(int i = 0; i < FRUSTUM_PLANES; i++)
+    {
+        const float* n = f->normal[i];
+        float near = n[0] * (n[0] >= 0 ? box->min[0] : box->max[0]) +
+                     n[1] * (n[1] >= 0 ? box->min[1] : box->max[1]) +
+                     n[2] * (n[2] >= 0 ? box->min[2] : box->max[2]);
+        if(near + f->d[i] < 0)
+            return false;
+    }
+    return true;
+}
+
+void resetFrustumCull(frustumCull* cull, unsigned int total);
+void frustumCullAddPrimitive(frustumCull* cull, const object* obj);
+void frustumCullAddSubtree(frustumCull* cull, const frustum* f, uint32_t node, const aabb* bounds, unsigned int primitives);
+// Puts the nearest subtrees first so the first hits shrink tmax for the rest
+void sortFrustumCull(frustumCull* cull);
+// Fraction of the scene's primitives the tile never has to look at
+float frustumCullRatio(const frustumCull* cull);
+void cleanFrustumCull(frustumCull* cull);
+
+#endif // _FRUSTUM_H_
@@ -0,0 +1,53 @@
+#ifndef _GRID_H_
+#define _GRID_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/aabb.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/primitives.h>
+
+#define GRID_DEFAULT_DENSITY 4.0f
+#define GRID_MAX_RESOLUTION 256
+// Direct mapped per ray mailbox, a power of two
+#define GRID_MAILBOX_SIZE 32
+// Untested ids of a cell are handed to the store this many at a time
+#define GRID_BATCH_SIZE 64
+
+typedef struct
+{
+    unsigned int primitiveCount;
+    unsigned int cellCount;
+    unsigned int emptyCells;
+    unsigned int references;
+    float density;
+    double buildTime;
+} gridStats;
+
+/**
+* Uniform grid over the scene bounds. Cell c holds the primitive ids
+* cellPrimitives[cellStart[c], cellStart[c + 1]) into store, a primitive
+* overlapping several cells is listed in each of them.
+*/
+typedef struct
+{
+    aabb bounds;
+    int resolution[3];
+    vector3f cellSize;
+    vector3f invCellSize;
+    uint32_t* cellStart;
+    primitiveId* cellPrimitives;
+    primitiveStore* store;
+    gridStats stats;
+} grid;
+
+grid* buildGrid(const object* list, float density);
+bool gridClosestHit(const grid* g, const ray r, rayHit* rh);
+bool gridAnyHit(const grid* g, const ray r, const object** occluder);
+size_t gridMemoryUsage(const grid* g);
+void printGridStats(const grid* g);
+void cleanGrid(grid** g);
+
+#endif // _GRID_H_
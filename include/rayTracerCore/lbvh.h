@@ -0,0 +1,19 @@
+#ifndef _LBVH_H_
+#define _LBVH_H_
+
+#include <rayTracerCore/bvh.h>
+
+#define LBVH_TREELET_LEAVES 7
+
+typedef struct
+{
+    unsigned int mortonBits;    // 30 or 63
+    unsigned int threads;       // 0 uses every online processor
+    unsigned int treeletRounds; // 0 skips treelet restructuring
+} lbvhOptions;
+
+static const lbvhOptions LBVH_DEFAULTS = {.mortonBits = 30, .threads = 0, .treeletRounds = 0};
+
+bvh* buildLBVH(const object* list, const lbvhOptions* options);
+
+#endif // _LBVH_H_
@@ -31,4 +31,21 @@ float getDiffuseFactor(const rayHit rh, const light l);
 float getSpecularFactor(const rayHit rh, const light l);
 bool inShadow(const rayHit rh, const light l);
 
+// Lights per thread that remember their last occluder
+#define SHADOW_CACHE_LIGHTS 4
+
+typedef struct
+{
+    unsigned long long rays;
+    unsigned long long cacheTests;
+    unsigned long long cacheHits;
+} shadowCacheStats;
+
+void setShadowCache(bool enabled);
+bool getShadowCache(void);
+// Adds the calling thread's counters to the totals, call once a thread is done tracing
+void flushShadowCacheStats(void);
+void getShadowCacheStats(shadowCacheStats* stats);
+void printShadowCacheStats(void);
+
 #endif // _LIGHT_H_
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef _MESH_LOADER_H_
+#define _MESH_LOADER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <rayTracerCore/material.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/mesh.h>
+
+typedef enum
+{
+    MESH_LOAD_OK,
+    MESH_LOAD_MISSING,
+    MESH_LOAD_UNSUPPORTED,  // ascii PLY, unknown extension or a layout the parser does not take
+    MESH_LOAD_INVALID       // truncated file or indices past the vertices
+} meshLoadStatus;
+
+/**
+* The buffers createMesh takes, normals is NULL when the file has none
+*/
+typedef struct
+{
+    point3f* vertices;
+    vector3f* normals;
+    uint32_t* indices;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+} meshBuffers;
+
+typedef struct
+{
+    meshLoadStatus status;
+    unsigned int threads;
+    size_t fileSize;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    bool normals;
+    double parseTime;   // mapping and parsing into the buffers
+    double buildTime;   // the mesh's bvh
+} meshLoadStats;
+
+/**
+* Binary PLY (either byte order) and Wavefront OBJ, picked by extension.
+* The file is mapped and split into one chunk per thread that parses straight into the
+* shared buffers, threads 0 uses every online processor. Polygons are split into fans.
+* OBJ normals are only kept when every corner uses its vertex's own index for them.
+*/
+meshLoadStatus loadMeshBuffers(const char* path, unsigned int threads, meshBuffers* out, meshLoadStats* stats);
+// loadMeshBuffers then createMesh, NULL on failure with the reason in stats->status
+object* loadMesh(const char* path, const material mat, unsigned int threads, meshLoadStats* stats);
+void printMeshLoadStats(const char* path, const meshLoadStats* stats);
+
+#endif // _MESH_LOADER_H_
@@ -0,0 +1,90 @@
+#ifndef _PRIMITIVES_H_
+#define _PRIMITIVES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <rayTracerCore/aabb.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/material.h>
+#include <rayTracerCore/shapes/geometry.h>
+
+/**
+* A primitive id is its geoEnum above its index in that type's array
+*/
+typedef uint32_t primitiveId;
+
+#define PRIMITIVE_TYPES (PAGED_MESH + 1)
+#define PRIMITIVE_INDEX_BITS 28
+#define PRIMITIVE_MAX_INDEX ((1u << PRIMITIVE_INDEX_BITS) - 1)
+#define PRIMITIVE_NONE UINT32_MAX
+#define PRIMITIVE_ID(type, index) ((primitiveId)(type) << PRIMITIVE_INDEX_BITS | (uint32_t)(index))
+#define PRIMITIVE_TYPE(id) ((geoEnum)((id) >> PRIMITIVE_INDEX_BITS))
+#define PRIMITIVE_INDEX(id) ((id) & PRIMITIVE_MAX_INDEX)
+
+/**
+* Every primitive of one type back to back, the shape records are the ones the objects point at.
+* Types without a kernel of their own (instances and meshes) only fill objects and are tested through them.
+*/
+typedef struct
+{
+    void* shapes;
+    material* materials;
+    const object** objects; // what each primitive was added from, NULL for ones added directly
+    uint32_t count, capacity;
+    size_t stride;
+} primitiveArray;
+
+/**
+* The scene as one dense array per primitive type.
+* Intersection walks each array with its type's kernel instead of calling through every object.
+*/
+typedef struct
+{
+    primitiveArray arrays[PRIMITIVE_TYPES];
+    uint32_t count;
+} primitiveStore;
+
+primitiveStore* createPrimitiveStore(void);
+// Copies every object of list, createSphere and createTriangle stay the way to build a scene
+primitiveStore* buildPrimitiveStore(const object* list);
+// Returns PRIMITIVE_NONE once the type's array is full
+primitiveId primitiveStoreAddObject(primitiveStore* store, const object* obj);
+primitiveId primitiveStoreAddSphere(primitiveStore* store, const material mat, float radius, const point3f center);
+primitiveId primitiveStoreAddTriangle(primitiveStore* store, const material mat, const point3f p1, const point3f p2, const point3f p3);
+
+static inline const void* primitiveShape(const primitiveStore* store, primitiveId id)
+{
+    const primitiveArray* a = &store->arrays[PRIMITIVE_TYPE(id)];
+    return (const char*)a->shapes + PRIMITIVE_INDEX(id) * a->stride;
+}
+
+static inline const object* primitiveObject(const primitiveStore* store, primitiveId id)
+{
+    const primitiveArray* a = &store->arrays[PRIMITIVE_TYPE(id)];
+    return a->objects != NULL ? a->objects[PRIMITIVE_INDEX(id)] : NULL;
+}
+
+/**
+* Nearest primitive hit strictly before r->tmax, which is pulled in to it. PRIMITIVE_NONE on a miss.
+* primitiveStoreClosestHit walks every array, primitivesClosestHit the given ids in runs of one type.
+* path gets the nearest hit's path when it is an instance or mesh, and is left alone otherwise.
+*/
+primitiveId primitiveStoreClosestHit(const primitiveStore* store, ray* r, hitPath* path);
+primitiveId primitivesClosestHit(const primitiveStore* store, const primitiveId* ids, uint32_t count, ray* r, hitPath* path);
+// Any primitive hit within [r.tmin, r.tmax], of the whole store or of the given ids
+primitiveId primitiveStoreAnyHit(const primitiveStore* store, const ray r);
+primitiveId primitivesAnyHit(const primitiveStore* store, const primitiveId* ids, uint32_t count, const ray r);
+
+/**
+* Fills rh for the hit on id at distance t along r that one of the functions above found, with the path it gave back
+*/
+void primitiveSurface(const primitiveStore* store, primitiveId id, const ray r, float t, const hitPath* path, rayHit* rh);
+void primitiveBounds(const primitiveStore* store, primitiveId id, aabb* box);
+
+size_t primitiveStoreMemoryUsage(const primitiveStore* store);
+void printPrimitiveStoreStats(const primitiveStore* store);
+void cleanPrimitiveStore(primitiveStore** store);
+
+#endif // _PRIMITIVES_H_
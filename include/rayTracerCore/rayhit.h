@@ -6,6 +6,7 @@
 #include <rayTracerCore/material.h>
 
 struct obj;
+struct accel_t;
 
 typedef struct
 {
@@ -17,6 +18,7 @@ typedef struct
     ray originRay;
     float offsetError;
     struct obj* objects;
+    const struct accel_t* accel;
 } rayHit;
 
 void printRayHit(const rayHit);
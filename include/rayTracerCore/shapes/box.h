@@ -0,0 +1,55 @@
+#ifndef _BOX_H_
+#define _BOX_H_
+
+#include <stdbool.h>
+#include <math.h>
+#include <util/vector.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/material.h>
+#include <rayTracerCore/aabb.h>
+#include <rayTracerCore/shapes/geometry.h>
+
+/**
+* A solid axis aligned box, its own bounds are exactly the shape
+*/
+typedef struct
+{
+    point3f min, max;
+} box_t;
+
+/**
+* Slab test. A ray starting inside hits the face it leaves through, t is only written on a hit.
+* fminf and fmaxf drop the NaN a zero direction gives on a slab's own plane.
+*/
+static inline bool boxIntersect(const ray* r, const box_t* b, float* t)
+{
+    float t0 = -INFINITY, t1 = INFINITY;
+    for(int i = 0; i < 3; i++)
+    {
+        float inv = 1.f / r->dir[i];
+        float tn = (b->min[i] - r->origin[i]) * inv;
+        float tf = (b->max[i] - r->origin[i]) * inv;
+        t0 = fmaxf(t0, fminf(tn, tf));
+        t1 = fminf(t1, fmaxf(tn, tf));
+    }
+    if(t0 > t1)
+        return false;
+    float hitT = t0 >= r->tmin ? t0 : t1;
+    if(hitT < r->tmin || hitT > r->tmax)
+        return false;
+    *t = hitT;
+    return true;
+}
+
+object* createBox(const material mat, const point3f min, const point3f max);
+
+bool boxTestHit(const ray r, const object *obj);
+bool boxHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool boxHitTime(const ray *r, const object *o, float *time, hitPath *path);
+void boxHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+// The normal is the face the hit is closest to relative to the box's size
+void boxSurface(const ray r, const box_t *b, const material mat, float t, rayHit *rayH);
+void boxBounds(const object *o, aabb *box);
+void boxPrint(void *);
+
+#endif // _BOX_H_
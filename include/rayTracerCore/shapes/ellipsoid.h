@@ -6,14 +6,79 @@
 #include <rayTracerCore/ray.h>
 #include <util/vector.h>
 #include <rayTracerCore/shapes/geometry.h>
+#include <util/usefulfunctions.h>
 
+/**
+* Radii along x, y and z. invRadiusSq holds 1/a^2, 1/b^2 and 1/c^2 for the intersection,
+* set them together with setEllipsoidRadii. Spheres only read invRadiusSq[0].
+*/
 typedef struct
 {
     float a,b,c;
     point3f center;
+    vector3f invRadiusSq;
 } ellipsoid_t;
 
+/**
+* Nearest root of A t^2 + B t + C inside [tmin, tmax], t is only written on a hit
+*/
+static inline bool ellipsoidNearestRoot(const ray* r, float A, float B, float C, float* t)
+{
+    float t0,t1;
+    if(!quadratic(A, B, C, &t0, &t1))
+        return false;
+
+    if (t0 > r->tmax || t1 < r->tmin)
+        return false;
+    float thit = t0;
+    if (t0 < r->tmin) {
+        thit = t1;
+        if (thit > r->tmax) return false;
+    }
+    *t = thit;
+    return true;
+}
+
+static inline bool ellipsoidIntersect(const ray* r, const ellipsoid_t* e, float* t)
+{
+    const float* inv = e->invRadiusSq;
+    vector3f origin = {};
+    vector3f_sub_new(origin, r->origin, e->center);
+    float A = r->dir[0]*r->dir[0]* inv[0] + r->dir[1]*r->dir[1]* inv[1] + r->dir[2]*r->dir[2]* inv[2];
+    float B = 2*(r->dir[0]*origin[0]* inv[0] + r->dir[1]*origin[1]* inv[1] + r->dir[2]*origin[2]* inv[2]);
+    float C = (origin[0]*origin[0]* inv[0] + origin[1]*origin[1]* inv[1] + origin[2]*origin[2]* inv[2]) - 1;
+    return ellipsoidNearestRoot(r, A, B, C, t);
+}
+
+/**
+* One radius lets the dot products be summed before scaling, spherepacket.c repeats this exactly
+*/
+static inline bool sphereIntersect(const ray* r, const ellipsoid_t* e, float* t)
+{
+    float inv = e->invRadiusSq[0];
+    float ox = r->origin[0] - e->center[0];
+    float oy = r->origin[1] - e->center[1];
+    float oz = r->origin[2] - e->center[2];
+    float A = (r->dir[0]*r->dir[0] + r->dir[1]*r->dir[1] + r->dir[2]*r->dir[2]) * inv;
+    float B = 2*((r->dir[0]*ox + r->dir[1]*oy + r->dir[2]*oz) * inv);
+    float C = (ox*ox + oy*oy + oz*oz) * inv - 1;
+    return ellipsoidNearestRoot(r, A, B, C, t);
+}
+
 bool ellipsoidTestHit(const ray, const object*);
 bool ellipsoidHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool ellipsoidHitTime(const ray *r, const object *o, float *time, hitPath *path);
+void ellipsoidHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+bool sphereTestHit(const ray, const object*);
+bool sphereHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool sphereHitTime(const ray *r, const object *o, float *time, hitPath *path);
+// Fills in a sphere hit at distance t that was already found, see spherepacket.h
+void sphereHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+void sphereSurface(const ray r, const ellipsoid_t *e, const material mat, float t, rayHit *rayH);
+void ellipsoidSurface(const ray r, const ellipsoid_t *e, const material mat, float t, rayHit *rayH);
+void ellipsoidBounds(const object *o, aabb *box);
+void ellipsoidShapeBounds(const ellipsoid_t *e, aabb *box);
 void ellipsoidPrint(void *);
+void setEllipsoidCenter(object *o, const point3f center);
+void setEllipsoidRadii(object *o, float a, float b, float c);
 #endif // _SPHERE_H_
\ No newline at end of file
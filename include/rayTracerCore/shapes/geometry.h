@@ -2,22 +2,62 @@
 #define _GEOMETRY_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <rayTracerCore/ray.h>
 #include <rayTracerCore/material.h>
 #include <util/vector.h>
 #include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/aabb.h>
 
 typedef enum
 {
     SPHERE,
-    TRIANGLE
+    ELLIPSOID,
+    TRIANGLE,
+    INSTANCE,
+    MESH,
+    PLANE,
+    QUAD,
+    BOX,
+    PAGED_MESH
 } geoEnum;
 
 typedef struct obj object;
 
+// Deepest nesting of compound shapes a hit can go through, see createInstanceGeometry
+#define HIT_PATH_LEVELS 8
+
+/**
+* Where a hit landed inside a compound shape: a mesh's triangle, a paged mesh's page and triangle,
+* or the primitive of an instance's tree and its time in the instance's space.
+*/
+typedef struct
+{
+    uint32_t primitive;
+    uint32_t detail;
+    float time;
+} hitLevel;
+
+/**
+* What intersect found inside compound shapes, for surface to pick up without searching again.
+* Levels are innermost first, each compound shape appends its own after whatever its hit primitive left.
+* Other shapes neither read nor write it, it may be NULL when surface is called on them directly.
+*/
+typedef struct
+{
+    uint32_t depth;
+    hitLevel level[HIT_PATH_LEVELS];
+} hitPath;
+
 typedef bool(*testHit)(const ray, const object*);
 typedef bool(*hitFunction)(const ray, const object* ,float* /*time*/, rayHit *);
+// Only the hit time, traversal keeps the nearest object and asks it for the surface once at the end.
+// The ray goes by pointer so a tmax that just shrank is not copied for every candidate.
+// path may be scribbled on by a miss, test candidates into a scratch one and keep the nearest's for its surface.
+typedef bool(*intersectFunction)(const ray*, const object*, float* /*time*/, hitPath*);
+typedef void(*surfaceFunction)(const ray, const object*, float /*time*/, const hitPath*, rayHit *);
 typedef void(*printFunction)(void*);
+typedef void(*boundsFunction)(const object*, aabb*);
 
 struct obj
 {
@@ -25,15 +65,22 @@ struct obj
     material mat;
     void * shape;
     hitFunction hit;
+    intersectFunction intersect;
+    surfaceFunction surface;
     testHit test;
     printFunction print;
+    boundsFunction bounds;
     object* next;
 };
 
 void printObjectList(const object* o);
 void cleanObjectList(object** list);
+bool removeFromObjectList(object** list, const object* o);
 
+// Points o at shape and fills in its type's functions, for shapes that do not come from the create functions
+void initObject(object* o, geoEnum type, const material mat, void* shape);
 object* createSphere(const material mat, const float radius, const point3f center);
+object* createEllipsoid(const material mat, const vector3f radii, const point3f center);
 object* createTriangle(const material mat, const point3f p1, const point3f p2, const point3f p3);
 
 
@@ -0,0 +1,56 @@
+#ifndef _INSTANCE_H_
+#define _INSTANCE_H_
+
+#include <stdbool.h>
+#include <rayTracerCore/material.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <util/transform.h>
+
+/**
+* Geometry shared between instances, it owns its object list and the
+* bottom level bvh built over it in object space.
+* It has to outlive every instance pointing at it.
+*/
+typedef struct
+{
+    object* objects;
+    bvh* tree;
+    aabb bounds;
+    unsigned int primitiveCount;
+    unsigned int pathDepth; // hitPath levels its primitives fill, meshes one and instances one more than their geometry
+} instanceGeometry;
+
+/**
+* An instance is an ordinary object, so a bvh over a scene list holding instances
+* is the top level structure. Rays are moved into object space on entry.
+*/
+typedef struct
+{
+    const instanceGeometry* geometry;
+    transform objectToWorld;
+    transform worldToObject;
+    bool overrideMat;
+} instance_t;
+
+/**
+* list may not hold planes, the shared tree needs finite bounds.
+* Returns NULL and leaves list to the caller when instances nest too deep for a hitPath.
+*/
+instanceGeometry* createInstanceGeometry(object* list);
+void cleanInstanceGeometry(instanceGeometry** geometry);
+size_t instanceGeometryMemoryUsage(const instanceGeometry* geometry);
+
+// mat overrides every material of the geometry, NULL keeps them
+object* createInstance(const instanceGeometry* geometry, const transform* objectToWorld, const material* mat);
+
+bool instanceTestHit(const ray r, const object *obj);
+bool instanceHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool instanceHitTime(const ray *r, const object *o, float *time, hitPath *path);
+void instanceHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+void instanceBounds(const object *o, aabb *box);
+void instancePrint(void *);
+bool setInstanceTransform(object *o, const transform* objectToWorld);
+
+#endif // _INSTANCE_H_
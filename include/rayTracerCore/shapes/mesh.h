@@ -0,0 +1,71 @@
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <util/vector.h>
+#include <rayTracerCore/aabb.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/material.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/triangle.h>
+
+#define MESH_NO_TRIANGLE UINT32_MAX
+
+/**
+* Triangles sharing one vertex buffer, each one three 32 bit indices into it.
+* A mesh is a single opaque object to the scene, like an instance. Its triangles are
+* addressed by index through the mesh's own bvh, whose leaf entries are triangle indices,
+* and a hit names its triangle in the hitPath level the mesh adds.
+* The scene's bvh or grid only sees the mesh's bounds, never (mesh, triangle) entries, so
+* its splits can not separate one mesh's triangles from another object's. Overlapping meshes
+* all get walked where they overlap.
+*/
+typedef struct
+{
+    point3f* vertices;
+    vector3f* normals;  // one per vertex for smooth shading, NULL shades each triangle flat
+    uint32_t* indices;  // three per triangle
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+    bvhNode* nodes;
+    unsigned int nodeCount;
+    uint32_t* order;    // triangle index of each leaf entry
+} mesh_t;
+
+/**
+* The mesh takes the buffers, they have to come from malloc.
+* Returns NULL and leaves them to the caller when an index is past vertexCount.
+*/
+object* createMesh(const material mat, point3f* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t triangleCount, vector3f* normals);
+
+static inline void meshTriangle(const mesh_t* m, uint32_t tri, triangle_t* out)
+{
+    const uint32_t* idx = m->indices + 3 * tri;
+    vector3f_copy(out->a, m->vertices[idx[0]]);
+    vector3f_sub_new(out->e1, m->vertices[idx[1]], out->a);
+    vector3f_sub_new(out->e2, m->vertices[idx[2]], out->a);
+}
+
+/**
+* Index of the nearest triangle hit strictly before r->tmax, which is pulled in to it. MESH_NO_TRIANGLE on a miss.
+*/
+uint32_t meshClosestTriangle(const mesh_t* m, ray* r);
+bool meshAnyTriangle(const mesh_t* m, const ray* r);
+// Fills rh for the hit on triangle tri at distance t along r
+void meshSurface(const ray r, const mesh_t* m, uint32_t tri, const material mat, float t, rayHit* rh);
+void meshTriangleBounds(const mesh_t* m, uint32_t tri, aabb* box);
+
+bool meshTestHit(const ray r, const object *obj);
+bool meshHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool meshHitTime(const ray *r, const object *o, float *time, hitPath *path);
+void meshHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+void meshBounds(const object *o, aabb *box);
+void meshPrint(void *);
+size_t meshMemoryUsage(const mesh_t* m);
+// Frees the buffers, cleanObjectList calls it before freeing the shape
+void cleanMeshBuffers(mesh_t* m);
+
+#endif // _MESH_H_
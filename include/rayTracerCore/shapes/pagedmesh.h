@@ -0,0 +1,133 @@
+#ifndef _PAGED_MESH_H_
+#define _PAGED_MESH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <rayTracerCore/aabb.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/rayhit.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/mesh.h>
+
+#define PAGED_MESH_MAGIC 0x4d475052u // "RPGM"
+#define PAGED_MESH_VERSION 1
+#define PAGED_MESH_ALIGN 4096          // pages start on OS page boundaries
+#define PAGED_MESH_PAGE_TRIANGLES 16384 // default triangles per page
+#define PAGED_MESH_NO_PAGE UINT32_MAX
+
+/**
+* On disk layout: this header, the top level nodes, the page table, then the pages.
+* The top level is the mesh bvh cut where a subtree first fits in a page, its leaves hold
+* one page index each. A page is a small mesh of its own: vertices, normals when the mesh has
+* them, local indices, its bvh nodes and leaf order, each 64 byte aligned from the page start.
+*/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t fileSize;
+    uint32_t nodeSize;      // sizeof(bvhNode) when written
+    uint32_t topNodeCount;
+    uint32_t pageCount;
+    uint32_t triangleCount;
+    uint32_t vertexCount;   // summed over the pages, vertices on a page border are stored by each of them
+    uint32_t normals;
+    uint64_t topNodesOffset;
+    uint64_t pagesOffset;
+} pagedMeshHeader;
+
+typedef struct
+{
+    uint64_t offset;
+    uint64_t bytes;
+    uint32_t vertexCount, triangleCount, nodeCount, pad;
+} pagedMeshPageRecord;
+
+typedef struct
+{
+    uint64_t hits;          // lookups that found the page resident
+    uint64_t faults;        // pages read from disk
+    uint64_t evictions;
+    uint64_t deferred;      // batch rays parked until their page was read
+    uint64_t bytesRead;
+    size_t residentBytes;
+    size_t peakBytes;
+} pagedMeshStats;
+
+typedef enum
+{
+    PAGE_MISSING,
+    PAGE_LOADING,
+    PAGE_RESIDENT
+} pageState;
+
+typedef struct
+{
+    void* data;
+    mesh_t mesh;            // points into data while resident
+    pageState state;
+    uint32_t pins;          // users testing the page, it is not evicted while pinned
+    uint32_t prev, next;    // least recently used list of resident pages
+} pagedMeshSlot;
+
+/**
+* A mesh too big for memory. The top level nodes and page table stay resident, pages are read
+* on demand into a cache holding at most budget bytes, least recently used pages go first.
+* Single rays through the object functions wait for the pages they need. Batches through
+* pagedMeshClosestHits and pagedMeshAnyHits park rays on missing pages and read each once.
+*/
+typedef struct
+{
+    int fd;
+    bvhNode* top;
+    uint32_t topNodeCount;
+    pagedMeshPageRecord* pages;
+    uint32_t pageCount;
+    uint32_t triangleCount;
+    bool normals;
+    pagedMeshSlot* slots;
+    uint32_t lruHead, lruTail;  // head is the most recently used
+    size_t budget;              // 0 keeps every page once read
+    pagedMeshStats stats;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+} pagedMesh_t;
+
+/**
+* Where a batch ray hit, triangle is local to the page
+*/
+typedef struct
+{
+    uint32_t page;
+    uint32_t triangle;
+} pagedTriangle;
+
+/**
+* Cuts m's bvh into pages of at most pageTriangles triangles, 0 picks PAGED_MESH_PAGE_TRIANGLES.
+* Written next to path and renamed over it, false on failure.
+*/
+bool writePagedMesh(const char* path, const mesh_t* m, uint32_t pageTriangles);
+// Reads the header, top level and page table only, NULL when the file is missing or invalid
+object* loadPagedMesh(const char* path, const material mat, size_t budget);
+
+// Closest hit of each ray, its tmax pulled in to the hit. hits[i].page is PAGED_MESH_NO_PAGE on a miss.
+void pagedMeshClosestHits(pagedMesh_t* pm, ray* rays, uint32_t count, pagedTriangle* hits);
+void pagedMeshAnyHits(pagedMesh_t* pm, const ray* rays, uint32_t count, bool* blocked);
+void pagedMeshSurface(pagedMesh_t* pm, const ray r, pagedTriangle hit, const material mat, float t, rayHit* rh);
+
+bool pagedMeshTestHit(const ray r, const object *obj);
+bool pagedMeshHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool pagedMeshHitTime(const ray *r, const object *o, float *time, hitPath *path);
+void pagedMeshHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+void pagedMeshBounds(const object *o, aabb *box);
+void pagedMeshPrint(void *);
+void printPagedMeshStats(const pagedMesh_t* pm);
+// The resident part: top level, page table and the pages currently cached
+size_t pagedMeshMemoryUsage(const pagedMesh_t* pm);
+// Frees the cache and closes the file, cleanObjectList calls it before freeing the shape
+void cleanPagedMesh(pagedMesh_t* pm);
+
+#endif // _PAGED_MESH_H_
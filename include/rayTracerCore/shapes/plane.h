@@ -0,0 +1,95 @@
+#ifndef _PLANE_H_
+#define _PLANE_H_
+
+#include <stdbool.h>
+#include <util/vector.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/material.h>
+#include <rayTracerCore/shapes/geometry.h>
+
+/**
+* Every point p with dot(normal, p) == offset. A plane has no bounds, accelerators
+* test it on its own before everything else.
+*/
+typedef struct
+{
+    vector3f normal;    // unit length
+    float offset;
+} plane_t;
+
+/**
+* The parallelogram corner + a*u + b*v for a and b in [0, 1].
+* du and dv turn a point in the plane back into a and b with one dot product each.
+*/
+typedef struct
+{
+    point3f corner;
+    vector3f u, v;
+    vector3f normal;    // unit length, along cross(u, v)
+    float offset;
+    vector3f du, dv;
+} parallelogram_t;
+
+static inline bool planeHitDistance(const ray* r, const vector3f normal, float offset, float* t)
+{
+    float denom = vector3f_dot(normal, r->dir);
+    if(denom == 0)
+        return false;
+    float hitT = (offset - vector3f_dot(normal, r->origin)) / denom;
+    if(hitT < r->tmin || hitT > r->tmax)
+        return false;
+    *t = hitT;
+    return true;
+}
+
+static inline bool planeIntersect(const ray* r, const plane_t* p, float* t)
+{
+    return planeHitDistance(r, p->normal, p->offset, t);
+}
+
+/**
+* The plane's hit first, then whether it lands inside the parallelogram, t is only written on a hit
+*/
+static inline bool quadIntersect(const ray* r, const parallelogram_t* q, float* t)
+{
+    float hitT;
+    if(!planeHitDistance(r, q->normal, q->offset, &hitT))
+        return false;
+    vector3f p = {r->origin[0] + hitT * r->dir[0] - q->corner[0],
+                  r->origin[1] + hitT * r->dir[1] - q->corner[1],
+                  r->origin[2] + hitT * r->dir[2] - q->corner[2]};
+    float a = vector3f_dot(p, q->du);
+    if(a < 0.f || a > 1.f)
+        return false;
+    float b = vector3f_dot(p, q->dv);
+    if(b < 0.f || b > 1.f)
+        return false;
+    *t = hitT;
+    return true;
+}
+
+// normal does not have to be unit length, point is anywhere on the plane
+object* createPlane(const material mat, const vector3f normal, const point3f point);
+object* createQuad(const material mat, const point3f corner, const vector3f u, const vector3f v);
+
+bool planeTestHit(const ray r, const object *obj);
+bool planeHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool planeHitTime(const ray *r, const object *o, float *time, hitPath *path);
+void planeHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+void planeBounds(const object *o, aabb *box);
+void planeShapeBounds(const plane_t *p, aabb *box);
+void planePrint(void *);
+
+bool quadTestHit(const ray r, const object *obj);
+bool quadHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool quadHitTime(const ray *r, const object *o, float *time, hitPath *path);
+void quadHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+void quadBounds(const object *o, aabb *box);
+void quadShapeBounds(const parallelogram_t *q, aabb *box);
+void quadPrint(void *);
+void setQuadVertices(object *o, const point3f corner, const vector3f u, const vector3f v);
+
+// Both are flat, a hit only needs the location and the stored normal
+void planarSurface(const ray r, const vector3f normal, const material mat, float t, rayHit *rayH);
+
+#endif // _PLANE_H_
@@ -6,13 +6,55 @@
 #include <rayTracerCore/material.h>
 #include <rayTracerCore/shapes/geometry.h>
 
+/**
+* Edges and the geometric normal are worked out once when the vertices are set,
+* b and c are a + e1 and a + e2. Intersection reads a, e1 and e2 and a hit copies normal.
+*/
 typedef struct
 {
-    point3f a,b,c;
+    point3f a;
+    vector3f e1, e2;
+    vector3f normal;    // unit length
 } triangle_t;
 
+/**
+* Moller-Trumbore against the precomputed edges, t is only written on a hit
+*/
+static inline bool triangleIntersect(const ray* r, const triangle_t* tri, float* t)
+{
+    vector3f s1 = {};
+    vector3f_cross_new(s1, r->dir, tri->e2);
+    float det = vector3f_dot(s1, tri->e1);
+    if(det == 0)
+        return false;
+    float invD = 1.f/ det;
+    vector3f d = {};
+    vector3f_sub_new(d, r->origin, tri->a);
+    float b1 = vector3f_dot(d, s1) * invD;
+    if(b1 < 0.f || b1 > 1.f)
+        return false;
+    vector3f s2 = {};
+    vector3f_cross_new(s2, d, tri->e1);
+    float b2 = vector3f_dot(r->dir, s2) * invD;
+    if(b2 < 0.f || (b1+b2) > 1.f)
+        return false;
+
+    float hitT = vector3f_dot(tri->e2, s2)*invD;
+    if(hitT < r->tmin || hitT > r->tmax)
+        return false;
+    *t = hitT;
+    return true;
+}
+
 bool triangleTestHit(const ray r, const object *obj);
 bool triangleHit(const ray r, const object *o, float *time, rayHit *rayH);
+bool triangleHitTime(const ray *r, const object *o, float *time, hitPath *path);
+// Fills in a hit at distance t that was already found, see trianglepacket.h
+void triangleHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH);
+void triangleSurface(const ray r, const triangle_t *tri, const material mat, float t, rayHit *rayH);
+void triangleBounds(const object *o, aabb *box);
+void triangleShapeBounds(const triangle_t *tri, aabb *box);
 void trianglePrint(void*);
+void setTriangleVertices(object *o, const point3f p1, const point3f p2, const point3f p3);
 
 #endif // _TRIANGLE_H_
\ No newline at end of file
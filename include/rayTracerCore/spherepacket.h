@@ -0,0 +1,66 @@
+#ifndef _SPHERE_PACKET_H_
+#define _SPHERE_PACKET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/shapes/ellipsoid.h>
+
+#define SPHERE_PACKET_WIDTH 8
+
+/**
+* Centers and inverse squared radii of up to 8 spheres, one lane array per value.
+* Unused lanes have an inverse squared radius of 0 and never hit.
+*/
+typedef struct
+{
+    float cx[8], cy[8], cz[8];
+    float invRadiusSq[8];
+} __attribute__((aligned(32))) spherePacket;
+
+void packSpheres(spherePacket* p, const ellipsoid_t* const* spheres, unsigned int count);
+
+/**
+* Same contract as the trianglePacket kernels: distances in t, a mask of the lanes hit within
+* [r->tmin, tmax] returned. Each solves 8 quadratics at once and agrees with sphereHit bit for bit.
+*/
+int spherePacketTestScalar(const spherePacket* p, const ray* r, float tmax, float t[SPHERE_PACKET_WIDTH]);
+#ifdef __SSE__
+int spherePacketTestSSE(const spherePacket* p, const ray* r, float tmax, float t[SPHERE_PACKET_WIDTH]);
+#endif
+#ifdef __AVX2__
+int spherePacketTestAVX2(const spherePacket* p, const ray* r, float tmax, float t[SPHERE_PACKET_WIDTH]);
+#endif
+
+static inline int spherePacketTest(const spherePacket* p, const ray* r, float tmax, float t[SPHERE_PACKET_WIDTH])
+{
+#if defined(__AVX2__)
+    return spherePacketTestAVX2(p, r, tmax, t);
+#elif defined(__SSE__)
+    return spherePacketTestSSE(p, r, tmax, t);
+#else
+    return spherePacketTestScalar(p, r, tmax, t);
+#endif
+}
+
+/**
+* Lane of the nearest hit within [r->tmin, tmax] or -1, ties go to the lower lane
+*/
+static inline int spherePacketIntersect(const spherePacket* p, const ray* r, float tmax, float* nearest)
+{
+    float t[SPHERE_PACKET_WIDTH];
+    int mask = spherePacketTest(p, r, tmax, t);
+    int best = -1;
+    while(mask)
+    {
+        int lane = __builtin_ctz(mask);
+        mask &= mask - 1;
+        if(best < 0 || t[lane] < t[best])
+            best = lane;
+    }
+    if(best >= 0)
+        *nearest = t[best];
+    return best;
+}
+
+#endif // _SPHERE_PACKET_H_
@@ -0,0 +1,69 @@
+#ifndef _TRIANGLE_PACKET_H_
+#define _TRIANGLE_PACKET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <rayTracerCore/ray.h>
+#include <rayTracerCore/shapes/triangle.h>
+
+#define TRIANGLE_PACKET_WIDTH 8
+
+/**
+* Up to 8 triangles with every coordinate in its own lane array so one ray is
+* tested against all of them at once. Unused lanes are degenerate and never hit.
+*/
+typedef struct
+{
+    float ax[8], ay[8], az[8];
+    float e1x[8], e1y[8], e1z[8];
+    float e2x[8], e2y[8], e2z[8];
+} __attribute__((aligned(32))) trianglePacket;
+
+void packTriangles(trianglePacket* p, const triangle_t* const* triangles, unsigned int count);
+
+/**
+* Each kernel writes every lane's distance to t and returns a mask of the lanes hit
+* within [r->tmin, tmax]. The scalar one is the reference the others are checked against.
+*/
+int trianglePacketTestScalar(const trianglePacket* p, const ray* r, float tmax, float t[TRIANGLE_PACKET_WIDTH]);
+#ifdef __SSE__
+int trianglePacketTestSSE(const trianglePacket* p, const ray* r, float tmax, float t[TRIANGLE_PACKET_WIDTH]);
+#endif
+#ifdef __AVX2__
+int trianglePacketTestAVX2(const trianglePacket* p, const ray* r, float tmax, float t[TRIANGLE_PACKET_WIDTH]);
+#endif
+// The widest kernel this build has
+const char* trianglePacketKernelName(void);
+
+static inline int trianglePacketTest(const trianglePacket* p, const ray* r, float tmax, float t[TRIANGLE_PACKET_WIDTH])
+{
+#if defined(__AVX2__)
+    return trianglePacketTestAVX2(p, r, tmax, t);
+#elif defined(__SSE__)
+    return trianglePacketTestSSE(p, r, tmax, t);
+#else
+    return trianglePacketTestScalar(p, r, tmax, t);
+#endif
+}
+
+/**
+* Lane of the nearest hit within [r->tmin, tmax] or -1, ties go to the lower lane
+*/
+static inline int trianglePacketIntersect(const trianglePacket* p, const ray* r, float tmax, float* nearest)
+{
+    float t[TRIANGLE_PACKET_WIDTH];
+    int mask = trianglePacketTest(p, r, tmax, t);
+    int best = -1;
+    while(mask)
+    {
+        int lane = __builtin_ctz(mask);
+        mask &= mask - 1;
+        if(best < 0 || t[lane] < t[best])
+            best = lane;
+    }
+    if(best >= 0)
+        *nearest = t[best];
+    return best;
+}
+
+#endif // _TRIANGLE_PACKET_H_
@@ -0,0 +1,79 @@
+#ifndef _WIDE_BVH_H_
+#define _WIDE_BVH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/frustum.h>
+
+#define WIDEBVH_STACK_SIZE (BVH_STACK_SIZE * 8)
+#define WIDEBVH_EMPTY 0xFFFFFFFFu
+
+/**
+* Collapsed nodes keep their children's bounds as min/max lanes so one ray can be
+* slab tested against every child at once.
+* A lane with a non zero count is a leaf starting at child in the primitive array,
+* otherwise child is the index of another wide node. Unused lanes hold inverted
+* bounds and never hit.
+*/
+typedef struct
+{
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    uint32_t child[4];
+    uint16_t count[4];
+} __attribute__((aligned(64))) bvh4Node;
+
+typedef struct
+{
+    float minX[8], minY[8], minZ[8];
+    float maxX[8], maxY[8], maxZ[8];
+    uint32_t child[8];
+    uint16_t count[8];
+} __attribute__((aligned(64))) bvh8Node;
+
+/**
+* Compressed wide nodes store each child box as 8 bit steps from the node's own
+* origin, one power of two step size per axis. Boxes are rounded outwards so
+* traversal stays conservative. valid has a bit set for every used lane.
+*/
+typedef struct
+{
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t valid;
+    uint8_t qminX[4], qminY[4], qminZ[4];
+    uint8_t qmaxX[4], qmaxY[4], qmaxZ[4];
+    uint32_t child[4];
+    uint16_t count[4];
+} __attribute__((aligned(64))) qbvh4Node;
+
+typedef struct
+{
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t valid;
+    uint8_t qminX[8], qminY[8], qminZ[8];
+    uint8_t qmaxX[8], qmaxY[8], qmaxZ[8];
+    uint32_t child[8];
+    uint16_t count[8];
+} __attribute__((aligned(64))) qbvh8Node;
+
+void collapseBVH(bvh* tree, bvhWidth width);
+/**
+* Swaps the wide nodes for compressed ones and frees the binary nodes.
+* A binary tree is collapsed to BVH4 first. Edits rebuild the binary nodes,
+* and bvhUpdate compresses again afterwards.
+*/
+void compressBVH(bvh* tree);
+// bvhPackLeaves for a compressed tree, which has no binary nodes left to find the leaves in
+void wideBVHPackLeaves(bvh* tree);
+size_t wideBVHNodeSize(bvhWidth width);
+size_t compressedBVHNodeSize(bvhWidth width);
+// bvhClosestPrimitive for wide trees, a cull limits it to the subtrees that were kept
+primitiveId wideBVHClosestPrimitive(const bvh* tree, const frustumCull* cull, ray* r, hitPath* path);
+bool wideBVHAnyHit(const bvh* tree, const ray r, const object** occluder);
+// Subtrees kept by the cull are wide node indices
+void wideBVHCullFrustum(const bvh* tree, const frustum* f, frustumCull* cull);
+
+#endif // _WIDE_BVH_H_
@@ -1,4 +1,134 @@
 #ifndef _SCENE_LOADER_H_
 #define _SCENE_LOADER_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <rayTracerCore/light.h>
+#include <rayTracerCore/material.h>
+#include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/ellipsoid.h>
+#include <rayTracerCore/shapes/triangle.h>
+#include <rayTracerCore/shapes/instance.h>
+#include <rayTracerCore/shapes/mesh.h>
+#include <rayTracerCore/shapes/plane.h>
+#include <rayTracerCore/shapes/box.h>
+#include <util/transform.h>
+
+#define SCENE_MAGIC 0x4e435352u // "RSCN"
+#define SCENE_VERSION 2
+#define SCENE_ALIGN 64
+#define SCENE_TOP_LEVEL UINT32_MAX
+
+/**
+* Where the camera sits and the image plane in front of it, the resolution is left to the renderer
+*/
+typedef struct
+{
+    point3f eye;
+    point3f lookat;
+    vector3f up;
+    float width, height, viewPlaneDistance;
+} sceneView;
+
+typedef enum
+{
+    SCENE_LIGHTS,
+    SCENE_MATERIALS,
+    SCENE_ELLIPSOIDS,   // spheres and ellipsoids
+    SCENE_TRIANGLES,
+    SCENE_PLANES,
+    SCENE_QUADS,
+    SCENE_BOXES,
+    SCENE_MESHES,
+    SCENE_GEOMETRIES,
+    SCENE_INSTANCES,
+    SCENE_OBJECTS,
+    SCENE_SECTIONS
+} sceneSection;
+
+typedef struct
+{
+    uint64_t offset;
+    uint32_t count;
+    uint32_t stride;    // sizeof the record when written, a different build's layout is turned down
+} sceneSectionRecord;
+
+/**
+* On disk layout: this header, then each section's records back to back, each 64 byte aligned,
+* then the mesh buffers. Lights, materials, the shape records and bvhNode are stored exactly
+* as the renderer keeps them and used straight from the mapping. Offsets stand in for pointers.
+*/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t fileSize;
+    sceneView view;
+    sceneSectionRecord sections[SCENE_SECTIONS];
+} sceneHeader;
+
+typedef struct
+{
+    uint32_t type;      // geoEnum
+    uint32_t material;
+    uint32_t shape;     // index into the type's section
+    uint32_t geometry;  // the instance geometry owning the object, SCENE_TOP_LEVEL for the scene itself
+} sceneObjectRecord;
+
+/**
+* A mesh with its bvh, so loading it does not rebuild anything. normals is 0 without them.
+*/
+typedef struct
+{
+    uint64_t vertices, normals, indices, nodes, order;
+    uint32_t vertexCount, triangleCount, nodeCount, pad;
+} sceneMeshRecord;
+
+typedef struct
+{
+    uint32_t geometry;
+    uint32_t overrideMat;
+    transform objectToWorld;
+    transform worldToObject;
+} sceneInstanceRecord;
+
+typedef enum
+{
+    SCENE_LOAD_OK,
+    SCENE_LOAD_MISSING,
+    SCENE_LOAD_INVALID  // wrong version, another build's layout or damaged
+} sceneLoadStatus;
+
+/**
+* A scene mapped from a file. Objects point at shapes inside the mapping, which is read only,
+* so apart from the mesh indices and trees checked on load only the pages a render touches are read from disk.
+* The objects belong to the scene, clean it with cleanScene and never with cleanObjectList.
+*/
+typedef struct
+{
+    sceneView view;
+    const light* lights;
+    uint32_t lightCount;
+    object* objects;    // top level list, in the order it was saved
+    uint32_t objectCount;
+    object* objectArray;
+    mesh_t* meshes;
+    instance_t* instances;
+    instanceGeometry** geometries;
+    uint32_t meshCount, instanceCount, geometryCount;
+    void* mapping;
+    size_t mappingSize;
+    double loadTime;
+} scene_t;
+
+/**
+* Writes list, its instance geometries and meshes with their bvhs. Instances may not nest and paged meshes are turned down.
+* Written next to path and renamed over it, false on failure.
+*/
+bool saveScene(const char* path, const sceneView* view, const light* lights, uint32_t lightCount, const object* list);
+scene_t* loadScene(const char* path, sceneLoadStatus* status);
+void printSceneStats(const char* path, const scene_t* s);
+void cleanScene(scene_t** s);
+
 #endif
@@ -0,0 +1,35 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stddef.h>
+
+/**
+* Body of a parallel loop, called once per thread with that thread's [begin, end) chunk.
+* Chunks only depend on the thread count and loop size, so two loops over the same
+* range hand every thread the same chunk.
+*/
+typedef void(*parallelBody)(void* ctx, size_t begin, size_t end, unsigned int thread);
+
+/**
+* One task of a work stealing loop, thread is the worker running it for per thread scratch
+*/
+typedef void(*parallelTaskBody)(void* ctx, size_t task, unsigned int thread);
+
+typedef struct
+{
+    size_t tasks;       // tasks the worker ran
+    size_t steals;      // of those, how many came from another worker's deque
+    double busyTime;    // seconds spent in task bodies
+} parallelWorkerStats;
+
+unsigned int getProcessorCount(void);
+void parallelFor(unsigned int threads, size_t count, parallelBody body, void* ctx);
+/**
+* Runs tasks [0, count) on threads workers, 0 uses every core. Each worker's deque starts with a
+* contiguous block of tasks and is worked from the front, an idle worker steals from the back of
+* another's so uneven tasks do not leave workers waiting at the end. Tasks may run in any order.
+* stats is NULL or holds one entry per worker.
+*/
+void parallelForStealing(unsigned int threads, size_t count, parallelTaskBody body, void* ctx, parallelWorkerStats* stats);
+
+#endif // _PARALLEL_H_
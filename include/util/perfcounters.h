@@ -0,0 +1,27 @@
+#ifndef _PERFCOUNTERS_H_
+#define _PERFCOUNTERS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+* Hardware cache references and misses of this process through perf_event_open. Threads created
+* while counting are included once they have been joined. Without the kernel's permission, or
+* off Linux, start returns false and the counts stay 0.
+*/
+typedef struct
+{
+    int references;
+    int misses;
+} perfCounters;
+
+typedef struct
+{
+    uint64_t references;
+    uint64_t misses;
+} perfCounts;
+
+bool startPerfCounters(perfCounters* c);
+void stopPerfCounters(perfCounters* c, perfCounts* counts);
+
+#endif // _PERFCOUNTERS_H_
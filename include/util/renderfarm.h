@@ -0,0 +1,86 @@
+#ifndef _RENDER_FARM_H_
+#define _RENDER_FARM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FARM_MAGIC 0x4d524146u // "FARM"
+#define FARM_VERSION 1
+#define FARM_INFLIGHT 2         // tiles handed to a worker before it has to answer, hides the round trip
+#define FARM_WORKER_WAIT 60.0   // seconds the coordinator waits with no worker connected before giving up
+
+/**
+* Coordinator and workers talk in these headers, each followed by bytes of payload: nothing for a
+* hello or bye, the frame description for a tile and the tile's RGB pixels for a result.
+* Both ends are assumed to share byte order and struct layout, the farm is one cluster build.
+*/
+typedef enum
+{
+    FARM_HELLO,     // worker, once connected
+    FARM_TILE,      // coordinator, render this
+    FARM_RESULT,    // worker, the tile's pixels
+    FARM_BYE        // coordinator, every tile is done
+} farmMessageType;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t type;
+    uint32_t job;       // the coordinator's tile id, echoed back with the result
+    uint32_t frame;
+    uint32_t x0, y0, x1, y1;
+    uint32_t bytes;
+} farmMessage;
+
+typedef struct
+{
+    uint32_t frame;
+    uint32_t x0, y0, x1, y1;
+} farmTile;
+
+/**
+* One image to render. data is sent with each of its tiles so workers need no other state than
+* their scene, image is width * height RGB and filled in as results arrive.
+*/
+typedef struct
+{
+    const void* data;
+    uint32_t bytes;
+    char* image;
+    unsigned int width, height;
+} farmFrame;
+
+typedef struct
+{
+    unsigned int tileSize;
+    double stallTimeout;        // seconds a tile may be out before it goes to another worker
+    const uint32_t* tileOrder;  // order tiles of a frame are handed out in, NULL for scanlines
+} farmOptions;
+
+typedef struct
+{
+    unsigned int workers;       // connected over the whole render
+    unsigned int workersLost;   // closed or failed before the end
+    unsigned int tiles;
+    unsigned int reassigned;    // handed out again after a stall or a lost worker
+    unsigned int duplicates;    // late results for tiles another worker already finished
+    uint64_t bytesReceived;
+} farmStats;
+
+// Pixels of one tile, x1 - x0 by y1 - y0 RGB rows. false drops the connection.
+typedef bool(*farmRenderFn)(void* ctx, const farmTile* tile, const void* frameData, uint32_t frameBytes, char* pixels);
+
+/**
+* Addresses are unix:/path or tcp:host:port, an empty host listens on every interface and
+* connects to localhost. -1 or false on failure.
+*/
+int farmListen(const char* address);
+// Hands out every tile of every frame, the same tile of each frame back to back, and returns once all are in
+bool farmCoordinate(int listenFd, farmFrame* frames, unsigned int frameCount, const farmOptions* options, farmStats* stats);
+// Keeps retrying the connection for a while so workers can start before the coordinator
+bool farmWork(const char* address, farmRenderFn render, void* ctx, unsigned int* tilesRendered);
+void printFarmStats(const farmStats* stats, double time);
+
+#endif // _RENDER_FARM_H_
@@ -18,6 +18,7 @@ void resizeRB(ringbuffer *buffer, int const newSize);
 void cleanRB(ringbuffer* buffer);
 bool rbEmpty(ringbuffer *buffer);
 bool rbFull(ringbuffer *buffer);
+// Single threaded, a full buffer overwrites its oldest element. util/workqueue has the thread safe queues.
 void rbadd(ringbuffer *buffer, const void *elem);
 void rbpop(ringbuffer *buffer, void *elem);
 void rbpeek(ringbuffer *buffer, void *elem);
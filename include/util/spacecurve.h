@@ -0,0 +1,24 @@
+#ifndef _SPACECURVE_H_
+#define _SPACECURVE_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+    ORDER_ROW,      // scanlines, left to right then top to bottom
+    ORDER_MORTON,   // Z order, bits of x and y interleaved
+    ORDER_HILBERT   // neighbours along the curve are always neighbours in the grid
+} curveOrder;
+
+void mortonDecode2D(uint32_t code, unsigned int* x, unsigned int* y);
+// side is a power of two, d in [0, side * side)
+void hilbertDecode2D(unsigned int side, uint32_t d, unsigned int* x, unsigned int* y);
+
+/**
+* Fills order with the width * height cells (y * width + x) of a grid in curve order.
+* Grids that are not power of two squares walk the curve over the square covering them and skip what falls outside.
+*/
+void buildCurveOrder(uint32_t* order, unsigned int width, unsigned int height, curveOrder curve);
+const char* curveOrderName(curveOrder curve);
+
+#endif // _SPACECURVE_H_
@@ -0,0 +1,30 @@
+#ifndef _TRANSFORM_H_
+#define _TRANSFORM_H_
+
+#include <stdbool.h>
+#include <util/vector.h>
+
+/**
+* Affine 3x4 row major matrix, the last column is the translation.
+*/
+typedef struct
+{
+    float m[3][4];
+} transform;
+
+void transformIdentity(transform* t);
+void transformTranslation(transform* t, const vector3f offset);
+void transformScale(transform* t, float x, float y, float z);
+void transformRotation(transform* t, const vector3f axis, float radians);
+// result = a * b, so b is applied first
+void transformMul(transform* result, const transform* a, const transform* b);
+bool transformInverse(transform* result, const transform* t);
+
+void transformPoint(point3f result, const transform* t, const point3f p);
+void transformVector(vector3f result, const transform* t, const vector3f v);
+// Normals go through the inverse transpose, so this takes the inverse of the transform
+void transformNormal(vector3f result, const transform* inverse, const vector3f n);
+
+void printTransform(const transform* t);
+
+#endif // _TRANSFORM_H_
@@ -1,9 +1,11 @@
 #ifndef _USEFULFUNCTIONS_H_
 #define _USEFULFUNCTIONS_H_
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <math.h>
 #include <stdio.h>
+#include <time.h>
 
 #ifdef NDEBUG
 #   define DEBUG
@@ -77,4 +79,24 @@ static inline float getPixelHeight(float screenHeight, float res_y)
     return screenHeight / res_y;
 }
 
+static inline double getTimeSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// 64 bit FNV-1a, chain calls by passing the previous result as hash
+#define FNV1A_SEED 0xcbf29ce484222325ull
+static inline uint64_t fnv1a64(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = data;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 #endif // _USEFULFUNCTIONS_H_
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef _WORK_QUEUE_H_
+#define _WORK_QUEUE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/**
+* Bounded lock free queues of size_t work items, tile indices or pointers cast to size_t.
+* Capacities round up to a power of two. Unlike ringbuffer nothing is overwritten when full,
+* pushes report how many items fit and pops how many were there. Indices written by different
+* threads sit on their own cache lines.
+*/
+
+#define WORK_QUEUE_LINE 64
+
+/**
+* One producer and one consumer. Each side keeps a copy of the other's index and only reloads it
+* when the copy says the queue is full or empty.
+*/
+typedef struct
+{
+    _Atomic size_t head __attribute__((aligned(WORK_QUEUE_LINE)));  // next item to pop, written by the consumer
+    size_t tailCache;
+    _Atomic size_t tail __attribute__((aligned(WORK_QUEUE_LINE)));  // next slot to push, written by the producer
+    size_t headCache;
+    size_t mask __attribute__((aligned(WORK_QUEUE_LINE)));
+    size_t* items;
+} spscQueue;
+
+typedef struct
+{
+    _Atomic size_t sequence;    // position the slot is ready for, pushes wait for pos and pops for pos + 1
+    size_t item;
+} mpmcSlot;
+
+/**
+* Any number of producers and consumers. Every slot carries a sequence number, so a thread claims a
+* run of ready slots with one compare and swap on its index and never waits on the other side.
+*/
+typedef struct
+{
+    _Atomic size_t head __attribute__((aligned(WORK_QUEUE_LINE)));
+    _Atomic size_t tail __attribute__((aligned(WORK_QUEUE_LINE)));
+    size_t mask __attribute__((aligned(WORK_QUEUE_LINE)));
+    mpmcSlot* slots;
+} mpmcQueue;
+
+/**
+* Chase-Lev work stealing deque. The owner pushes and pops at the bottom without atomic read modify
+* writes except when taking the last item, other threads steal from the top with a compare and swap.
+*/
+typedef struct
+{
+    _Atomic ptrdiff_t top __attribute__((aligned(WORK_QUEUE_LINE)));      // stolen from, any thread
+    _Atomic ptrdiff_t bottom __attribute__((aligned(WORK_QUEUE_LINE)));   // owner only
+    size_t mask __attribute__((aligned(WORK_QUEUE_LINE)));
+    _Atomic size_t* items;
+} workDeque;
+
+typedef enum
+{
+    STEAL_EMPTY,
+    STEAL_ABORT,    // lost a race with the owner or another thief, the deque may still hold items
+    STEAL_SUCCESS
+} stealResult;
+
+// NULL when out of memory
+spscQueue* createSPSC(size_t capacity);
+void cleanSPSC(spscQueue** q);
+size_t spscPush(spscQueue* q, const size_t* items, size_t count);
+size_t spscPop(spscQueue* q, size_t* items, size_t count);
+
+mpmcQueue* createMPMC(size_t capacity);
+void cleanMPMC(mpmcQueue** q);
+size_t mpmcPush(mpmcQueue* q, const size_t* items, size_t count);
+size_t mpmcPop(mpmcQueue* q, size_t* items, size_t count);
+
+workDeque* createWorkDeque(size_t capacity);
+void cleanWorkDeque(workDeque** d);
+// Owner only. Pushed in order, so the last item pushed is popped first and the first is stolen first.
+size_t dequePush(workDeque* d, const size_t* items, size_t count);
+bool dequePop(workDeque* d, size_t* item);
+stealResult dequeSteal(workDeque* d, size_t* item);
+
+#endif // _WORK_QUEUE_H_
@@ -28,11 +28,25 @@
 #include <util/usefulfunctions.h>
 #include <rayTracerCore/ray.h>
 #include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/shapes/plane.h>
 #include <util/colors.h>
 #include <util/imageio.h>
 #include <rayTracerCore/light.h>
 #include <rayTracerCore/material.h>
+#include <rayTracerCore/accel.h>
+#include <rayTracerCore/frustum.h>
+#include <rayTracerCore/shapes/instance.h>
+#include <rayTracerCore/meshloader.h>
+#include <rayTracerCore/shapes/pagedmesh.h>
+#include <sceneloader.h>
+#include <util/parallel.h>
+#include <util/spacecurve.h>
+#include <util/perfcounters.h>
+#include <util/renderfarm.h>
 #include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #define XRES 512
 #define YRES 512
@@ -42,6 +56,7 @@
 #define SAMPLES_Y 1
 #define SCENE 0
 #define SHADING 0
+#define TILE_SIZE 16
 
 #ifndef ANAGLYPH
 #define ANAGLYPH 1
@@ -59,8 +74,27 @@ vector3f camPos = {0, 0, 1};
 int buildRef = 0;
 int toe = 0;
 int xres = XRES, yres = YRES;
+accelType accelerator = ACCEL_BVH;
+accelOptions accelSettings = {.builder = BVH_SAH, .width = BVH2, .compressed = false, .packets = true, .lbvh = {.mortonBits = 30, .threads = 0, .treeletRounds = 0}, .cachePath = NULL, .gridDensity = 0};
+instanceGeometry* prismGeometry = NULL;
+unsigned int prismCopies = 0;
+int tileCulling = 1;
+int cullMap = 0;
+unsigned int tileSize = TILE_SIZE;
+curveOrder renderOrder = ORDER_HILBERT;
+unsigned int farmWorkers = 0;
+char* farmAddress = NULL;
+char* workerAddress = NULL;
+double farmStall = 10;
+int scalingReport = 0;
 float width = 4, height = 4, viewPlaneDistance = 2;
 char* file = "scene.png";
+char* meshFile = NULL;
+char* pagedFile = NULL;
+size_t pageBudget = 0;
+char* sceneFile = NULL;
+char* saveSceneFile = NULL;
+scene_t* loadedScene = NULL;
 
 
 
@@ -113,34 +147,21 @@ void addToObjectList(object **list, object *newObject)
     }
 }
 
-void trace(const ray r, rayHit *rh, const object *objects)
+// Primary and reflected rays traced by this thread since its last tile finished
+static __thread unsigned long long tracedRays = 0;
+
+/**
+* tile is what survived the frustum cull of the primary ray's tile, NULL traces against the whole scene
+*/
+void trace(const ray r, rayHit *rh, const accel *scene, const frustumCull *tile)
 {
+    tracedRays++;
     rh->hit = false;
     rh->mat = EMPTYNESS;
-    rayHit testrh;
-    testrh.hit = false;
-    testrh.depth = rh->depth;
-    float time = INFINITY;
-    for (const object *obj = objects; obj != NULL; obj = obj->next)
-    {
-        float hitTime = 0;
-
-        bool hit = obj->hit(r, obj, &hitTime, &testrh);
-        if (hit)
-            DEBUGOUT(printDepth(rh->depth);
-                         printf("Hit: ");
-                         printRayHit(testrh));
-        if (hit && hitTime < time)
-        {
-            DEBUGOUT(printDepth(rh->depth);
-                         printf("Replacing ");
-                         printRayHit(*rh);
-                         printf(" with ");
-                         printRayHit(testrh));
-            time = hitTime;
-            *rh = testrh;
-        }
-    }
+    if (tile != NULL)
+        scene->closestHitCulled(scene, tile, r, rh);
+    else
+        scene->closestHit(scene, r, rh);
     if (rh->hit) DEBUGOUT(printf("\n"));
 
 
@@ -156,7 +177,8 @@ void trace(const ray r, rayHit *rh, const object *objects)
         vector3f_add(rh->location, offset);
         reflectRay(&reflect, rh->location, rh->normal, r);
         rh->depth++;
-        trace(reflect, rh, objects);
+        // Reflections leave the tile's frustum
+        trace(reflect, rh, scene, NULL);
     }
 }
 
@@ -189,10 +211,53 @@ void buildScene1(object **list)
         {  .811, .5f, -3.158 },
         {  .174, 0, -1.015 },
         {  .811, -.5f, -3.158}};
-    addToObjectList(list, createTriangle(priMat, priTop[0], priTop[1], priTop[2]));
-    addToObjectList(list, createTriangle(priMat, priBottom[2], priBottom[1], priBottom[0]));
-    addToObjectList(list, createTriangle(priMat, priLeft[2], priLeft[1], priLeft[0]));
-    addToObjectList(list, createTriangle(priMat, priRight[2], priRight[1], priRight[0]));
+    object* prism = NULL;
+    addToObjectList(&prism, createTriangle(priMat, priTop[0], priTop[1], priTop[2]));
+    addToObjectList(&prism, createTriangle(priMat, priBottom[2], priBottom[1], priBottom[0]));
+    addToObjectList(&prism, createTriangle(priMat, priLeft[2], priLeft[1], priLeft[0]));
+    addToObjectList(&prism, createTriangle(priMat, priRight[2], priRight[1], priRight[0]));
+    prismGeometry = createInstanceGeometry(prism);
+    transform prismPlace;
+    transformIdentity(&prismPlace);
+    addToObjectList(list, createInstance(prismGeometry, &prismPlace, NULL));
+
+    // Extra copies along the back wall only cost an instance each
+    unsigned int columns = (unsigned int) ceilf(sqrtf((float) prismCopies));
+    for (unsigned int copy = 0; copy < prismCopies; copy++)
+    {
+        transform scale, rotate, move;
+        vector3f up = {0, 1, 0};
+        vector3f offset = {
+            mapToRangef((float) (copy % columns) + .5f, 0, (float) columns, -7, 7),
+            mapToRangef((float) (copy / columns) + .5f, 0, (float) columns, -1, 9),
+            -6.5f};
+        transformScale(&scale, .3f, .3f, .3f);
+        transformRotation(&rotate, up, (float) copy);
+        transformTranslation(&move, offset);
+        transformMul(&prismPlace, &rotate, &scale);
+        transformMul(&prismPlace, &move, &prismPlace);
+        addToObjectList(list, createInstance(prismGeometry, &prismPlace, copy & 1 ? &color : NULL));
+    }
+    if (prismCopies > 0)
+        printf("Prism instances: %u sharing %zu bytes of geometry, %zu bytes each\n", prismCopies + 1,
+               instanceGeometryMemoryUsage(prismGeometry), sizeof(object) + sizeof(instance_t));
+    
+    if (meshFile != NULL)
+    {
+        meshLoadStats stats;
+        object* mesh = loadMesh(meshFile, priMat, accelSettings.lbvh.threads, &stats);
+        printMeshLoadStats(meshFile, &stats);
+        if (mesh != NULL)
+            addToObjectList(list, mesh);
+    }
+    if (pagedFile != NULL)
+    {
+        object* paged = loadPagedMesh(pagedFile, priMat, pageBudget);
+        if (paged != NULL)
+            addToObjectList(list, paged);
+        else
+            printf(KRED"paged mesh %s could not be opened\n"KNRM, pagedFile);
+    }
     
     // Spheres
     vector3f sph1Center = {0, 0, -1};
@@ -211,30 +276,14 @@ void buildScene1(object **list)
     addToObjectList(list, createSphere(sph3Mat, sph3Radius, sph3Center));
 
     //back wall
-    vector3f back1points[3] = {
-        {-8, -2, -10},
-        {8,  -2, -10},
-        {8,  10, -10}};
-    vector3f back2points[3] = {
-        {-8, -2, -10},
-        {8,  10, -10},
-        {-8, 10, -10}};
+    vector3f backCorner = {-8, -2, -10}, backU = {16, 0, 0}, backV = {0, 12, 0};
     material backMat = {.reflect = false, .color = {.79, .79, .4}};
-    addToObjectList(list, createTriangle(backMat, back1points[0], back1points[1], back1points[2]));
-    addToObjectList(list, createTriangle(backMat, back2points[0], back2points[1], back2points[2]));
+    addToObjectList(list, createQuad(backMat, backCorner, backU, backV));
 
     //floor
-    vector3f floor1points[3] = {
-        {-8, -2, -10},
-        {8,  -2, -0},
-        {8,  -2, -10}};
-    vector3f floor2points[3] = {
-        {-8, -2, -10},
-        {-8, -2, -0},
-        {8,  -2, -0}};
+    vector3f floorCorner = {-8, -2, -10}, floorU = {0, 0, 10}, floorV = {16, 0, 0};
     material floorMat = {.reflect = false, .color = {.5, .1, .5}};
-    addToObjectList(list, createTriangle(floorMat, floor1points[0], floor1points[1], floor1points[2]));
-    addToObjectList(list, createTriangle(floorMat, floor2points[0], floor2points[1], floor2points[2]));
+    addToObjectList(list, createQuad(floorMat, floorCorner, floorU, floorV));
 
     // right red triangle
     vector3f rightpoints[3] = {
@@ -253,6 +302,21 @@ void buildScene1(object **list)
 
 }
 
+/**
+* The scene file's objects and first light when one was loaded, otherwise the reference scene
+*/
+void buildScene(object **list)
+{
+    if (loadedScene != NULL)
+    {
+        *list = loadedScene->objects;
+        if (loadedScene->lightCount > 0)
+            l = loadedScene->lights[0];
+        return;
+    }
+    buildScene1(list);
+}
+
 void buildScene2(object **list)
 {
     DPRINT("Building Scene\n");
@@ -285,17 +349,423 @@ void buildScene2(object **list)
     }
 
     //floor
-    vector3f floor1points[3] = {
-        {-8, -10+8, 10*2},
-        {8,  -10+8, 10*2},
-        {8,  -10+8, -10*2}};
-    vector3f floor2points[3] = {
-        {-8, -10+8,  10*2},
-        { 8, -10+8, -10*2},
-        {-8, -10+8, -10*2}};
+    vector3f floorNormal = {0, 1, 0}, floorPoint = {0, -2, 0};
     material floorMat = white;
-    addToObjectList(list, createTriangle(floorMat, floor1points[0], floor1points[1], floor1points[2]));
-    addToObjectList(list, createTriangle(floorMat, floor2points[0], floor2points[1], floor2points[2]));
+    addToObjectList(list, createPlane(floorMat, floorNormal, floorPoint));
+}
+
+void shadePixel(const perspective p, unsigned int x, unsigned int y, const accel *scene, const frustumCull *tile, object *objects, char *i)
+{
+    if (x == XBREAK && y == YBREAK)
+    {
+        volatile int b = 1;
+        b++;
+    }
+    sampler samples;
+    getSampler(&samples, SAMPLES_X, SAMPLES_Y, p, x, y, GLOBAL);
+    rayHit samplesRayHits[samples.numOfSamplesX * samples.numOfSamplesY];
+    for (unsigned int sample = 0; sample < samples.numOfSamplesX * samples.numOfSamplesY; sample++)
+    {
+        samplesRayHits[sample].depth = 0;
+        trace(samples.rays[sample], &samplesRayHits[sample], scene, tile);
+        samplesRayHits[sample].objects = objects;
+        samplesRayHits[sample].accel = scene;
+        if (samplesRayHits[sample].hit)
+        {
+            float ambinentFactor = l.ambinentFactor;
+            float diffuse = getDiffuseFactor(samplesRayHits[sample], l);
+            float specular = getSpecularFactor(samplesRayHits[sample], l);
+            if (inShadow(samplesRayHits[sample], l))
+            {
+                DEBUGOUT(printf("In Shadow"));
+                diffuse = 0.0f;
+                specular = 0.0f;
+            }
+            DEBUGOUT(printf("Ambinent: %4.4f Diffuse: %4.4f Specular: %4.4f\n", ambinentFactor, diffuse, specular));
+            vector3f ambientColor = {}, diffuseColor = {}, specularColor = {};
+            vector3f_scaleMul_new(ambientColor, samplesRayHits[sample].mat.color, ambinentFactor);
+            vector3f_scaleMul_new(diffuseColor, samplesRayHits[sample].mat.color, diffuse);
+            vector3f_scaleMul_new(specularColor, samplesRayHits[sample].mat.color, specular);
+            vector3f_copy(samplesRayHits[sample].mat.color, ambientColor);
+            vector3f_add(samplesRayHits[sample].mat.color, diffuseColor);
+            vector3f_add(samplesRayHits[sample].mat.color, specularColor);
+        }
+    }
+    vector3f color = {};
+    getFinalColor(color, samplesRayHits, samples.numOfSamplesX * samples.numOfSamplesY);
+#define MIN(x, y) ((x < y) ? x : y)
+    i[XY2INDEX(x, y, 0, xres, 3)] = (char) mapToRangef(MIN(color[0], 1), 0, 1, 0, 255);
+    i[XY2INDEX(x, y, 1, xres, 3)] = (char) mapToRangef(MIN(color[1], 1), 0, 1, 0, 255);
+    i[XY2INDEX(x, y, 2, xres, 3)] = (char) mapToRangef(MIN(color[2], 1), 0, 1, 0, 255);
+#undef MIN
+    cleanSampler(&samples);
+}
+
+/**
+* One digit per tile, 0 when nothing was culled up to 9 when at least 90% of the scene was
+*/
+void printCullMap(const float *ratios, unsigned int tilesX, unsigned int tilesY)
+{
+    for (unsigned int ty = 0; ty < tilesY; ty++)
+    {
+        for (unsigned int tx = 0; tx < tilesX; tx++)
+        {
+            int digit = (int) (ratios[ty * tilesX + tx] * 10);
+            printf("%d", digit > 9 ? 9 : digit);
+        }
+        printf("\n");
+    }
+}
+
+typedef struct
+{
+    const perspective *views;   // every view has the same resolution, one image each
+    char **images;
+    unsigned int viewCount;
+    const accel *scene;
+    object *objects;
+    unsigned int tilesX, tileCount;
+    uint32_t *tileOrder;    // tiles and the pixels in a tile in renderOrder
+    uint32_t *pixelOrder;
+    float *ratios;          // per view, then per tile
+    frustumCull *culls;     // one per thread, reused tile after tile
+    double *cullTimes;
+    unsigned long long *rays;
+} tileRender;
+
+/**
+* Runs the tile's primary rays through each paged mesh as one batch first, so the pages they miss are parked
+* and read once in file order instead of one wait per pixel. Shading then finds them resident unless the
+* budget already evicted them again.
+*/
+static void batchPagedTile(const perspective *p, object *objects, unsigned int x0, unsigned int y0,
+                           unsigned int x1, unsigned int y1)
+{
+    ray *rays = NULL;
+    pagedTriangle *hits = NULL;
+    uint32_t count = 0;
+    for (object *obj = objects; obj != NULL; obj = obj->next)
+    {
+        if (obj->type != PAGED_MESH)
+            continue;
+        if (rays == NULL)
+        {
+            uint32_t capacity = (x1 - x0) * (y1 - y0) * SAMPLES_X * SAMPLES_Y;
+            rays = malloc(capacity * sizeof(ray));
+            hits = malloc(capacity * sizeof(pagedTriangle));
+            if (rays == NULL || hits == NULL)
+                break;
+        }
+        count = 0;
+        for (unsigned int y = y0; y < y1; y++)
+        {
+            for (unsigned int x = x0; x < x1; x++)
+            {
+                sampler samples;
+                getSampler(&samples, SAMPLES_X, SAMPLES_Y, *p, x, y, GLOBAL);
+                for (unsigned int sample = 0; sample < samples.numOfSamplesX * samples.numOfSamplesY; sample++)
+                    rays[count++] = samples.rays[sample];
+                cleanSampler(&samples);
+            }
+        }
+        pagedMeshClosestHits(obj->shape, rays, count, hits);
+    }
+    free(rays);
+    free(hits);
+}
+
+/**
+* Shades [x0, x1) x [y0, y1) in pixelOrder, the curve over an orderSide square, and returns the share of the
+* scene culled. cull is the calling thread's scratch and only used with tile culling on.
+*/
+float shadeTile(const perspective *p, const accel *scene, object *objects, char *image, unsigned int x0, unsigned int y0,
+                unsigned int x1, unsigned int y1, const uint32_t *pixelOrder, unsigned int orderSide, frustumCull *cull, double *cullTime)
+{
+    const frustumCull *tile = NULL;
+    float ratio = 0;
+    if (tileCulling)
+    {
+        double cullStart = getTimeSeconds();
+        frustum f;
+        buildTileFrustum(&f, *p, x0, y0, x1, y1);
+        scene->cull(scene, &f, cull);
+        *cullTime += getTimeSeconds() - cullStart;
+        ratio = frustumCullRatio(cull);
+        tile = cull;
+    }
+    batchPagedTile(p, objects, x0, y0, x1, y1);
+    for (unsigned int pixel = 0; pixel < orderSide * orderSide; pixel++)
+    {
+        // Edge tiles skip the part of the curve past the image
+        unsigned int x = x0 + pixelOrder[pixel] % orderSide, y = y0 + pixelOrder[pixel] / orderSide;
+        if (x < x1 && y < y1)
+            shadePixel(*p, x, y, scene, tile, objects, image);
+    }
+    return ratio;
+}
+
+void renderTile(void *ctx, size_t task, unsigned int thread)
+{
+    tileRender *r = ctx;
+    // The views of one tile are consecutive tasks, so they usually run back to back on the same thread
+    uint32_t t = r->tileOrder[task / r->viewCount];
+    unsigned int view = (unsigned int) (task % r->viewCount);
+    const perspective *p = &r->views[view];
+    unsigned int x0 = (unsigned int) (t % r->tilesX) * tileSize, y0 = (unsigned int) (t / r->tilesX) * tileSize;
+    unsigned int x1 = x0 + tileSize < p->res_x ? x0 + tileSize : p->res_x;
+    unsigned int y1 = y0 + tileSize < p->res_y ? y0 + tileSize : p->res_y;
+    r->ratios[view * r->tileCount + t] = shadeTile(p, r->scene, r->objects, r->images[view], x0, y0, x1, y1,
+                                                   r->pixelOrder, tileSize, &r->culls[thread], &r->cullTimes[thread]);
+    r->rays[thread] += tracedRays;
+    tracedRays = 0;
+    // Workers end with the loop, so their shadow counters are merged as they go
+    flushShadowCacheStats();
+}
+
+/**
+* Renders tileSize squares of each view into its image on threads workers stealing tiles from each other,
+* culling the scene against each tile's frustum first so its primary rays only look at what the tile can see.
+* Tiles and the pixels inside them are visited in renderOrder, workers start on consecutive runs of tiles.
+* The same tile of every view is scheduled together, so stereo eyes reuse what the other just touched.
+* Returns the wall time, the tile, thread, ray rate and cache stats are printed when report is set.
+*/
+double renderTiles(const perspective *views, char **images, unsigned int viewCount, const accel *scene, object *objects, unsigned int threads, bool report)
+{
+    unsigned int tilesX = (views[0].res_x + tileSize - 1) / tileSize;
+    unsigned int tilesY = (views[0].res_y + tileSize - 1) / tileSize;
+    unsigned int tileCount = tilesX * tilesY;
+    tileRender r = {.views = views, .images = images, .viewCount = viewCount, .scene = scene, .objects = objects, .tilesX = tilesX, .tileCount = tileCount};
+    r.tileOrder = malloc(tileCount * sizeof(uint32_t));
+    r.pixelOrder = malloc(tileSize * tileSize * sizeof(uint32_t));
+    buildCurveOrder(r.tileOrder, tilesX, tilesY, renderOrder);
+    buildCurveOrder(r.pixelOrder, tileSize, tileSize, renderOrder);
+    r.ratios = calloc(tileCount * viewCount, sizeof(float));
+    r.culls = calloc(threads, sizeof(frustumCull));
+    r.cullTimes = calloc(threads, sizeof(double));
+    r.rays = calloc(threads, sizeof(unsigned long long));
+    parallelWorkerStats *workers = calloc(threads, sizeof(parallelWorkerStats));
+    shadowCacheStats shadowsBefore, shadowsAfter;
+    getShadowCacheStats(&shadowsBefore);
+    perfCounters counters;
+    bool counted = startPerfCounters(&counters);
+    double start = getTimeSeconds();
+    parallelForStealing(threads, tileCount * viewCount, renderTile, &r, workers);
+    double renderTime = getTimeSeconds() - start;
+    perfCounts cache;
+    stopPerfCounters(&counters, &cache);
+    getShadowCacheStats(&shadowsAfter);
+
+    double cullTime = 0;
+    for (unsigned int t = 0; t < threads; t++)
+    {
+        cleanFrustumCull(&r.culls[t]);
+        cullTime += r.cullTimes[t];
+    }
+
+    if (report && tileCulling)
+    {
+        float sum = 0, low = 1, high = 0;
+        for (unsigned int t = 0; t < tileCount * viewCount; t++)
+        {
+            sum += r.ratios[t];
+            low = r.ratios[t] < low ? r.ratios[t] : low;
+            high = r.ratios[t] > high ? r.ratios[t] : high;
+        }
+        printf(KRED"tiles["KBLU"count:"KGRN"%u(%ux%u) ", tileCount * viewCount, tileSize, tileSize);
+        printf(KBLU"culled:"KGRN"%4.1f%% avg %4.1f%% min %4.1f%% max ", 100 * sum / (tileCount * viewCount), 100 * low, 100 * high);
+        printf(KBLU"cull time:"KGRN"%4.4fms"KRED"]\n"KNRM, cullTime * 1000);
+        for (unsigned int v = 0; cullMap && v < viewCount; v++)
+            printCullMap(r.ratios + v * tileCount, tilesX, tilesY);
+    }
+    if (report)
+    {
+        size_t steals = 0;
+        double busy = 0, least = INFINITY, most = 0;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            steals += workers[t].steals;
+            busy += workers[t].busyTime;
+            least = workers[t].busyTime < least ? workers[t].busyTime : least;
+            most = workers[t].busyTime > most ? workers[t].busyTime : most;
+        }
+        printf(KRED"workers["KBLU"threads:"KGRN"%u "KBLU"tiles:"KGRN"%u(%ux%u) "KBLU"stolen:"KGRN"%zu ", threads, tileCount * viewCount, tileSize, tileSize, steals);
+        printf(KBLU"busy:"KGRN"%4.4fs min %4.4fs max "KBLU"utilization:"KGRN"%5.1f%%"KRED"]\n"KNRM, least, most,
+               renderTime > 0 ? 100 * busy / (renderTime * threads) : 100.0);
+
+        unsigned long long rays = 0, shadowRays = shadowsAfter.rays - shadowsBefore.rays;
+        for (unsigned int t = 0; t < threads; t++)
+            rays += r.rays[t];
+        printf(KRED"order["KBLU"curve:"KGRN"%s "KBLU"rays:"KGRN"%llu+%llu shadow ", curveOrderName(renderOrder), rays, shadowRays);
+        printf(KBLU"rate:"KGRN"%6.3fMrays/s ", renderTime > 0 ? (rays + shadowRays) / renderTime * 1e-6 : 0.0);
+        if (counted)
+        {
+            printf(KBLU"cache misses:"KGRN"%llu(%4.1f%% of references, %5.2f per ray)"KRED"]\n"KNRM, (unsigned long long) cache.misses,
+                   cache.references ? 100.0 * cache.misses / cache.references : 0.0,
+                   rays + shadowRays ? (double) cache.misses / (rays + shadowRays) : 0.0);
+        }
+        else
+            printf(KBLU"cache misses:"KGRN"n/a"KRED"]\n"KNRM);
+    }
+    free(workers);
+    free(r.rays);
+    free(r.cullTimes);
+    free(r.culls);
+    free(r.ratios);
+    free(r.pixelOrder);
+    free(r.tileOrder);
+    return renderTime;
+}
+
+/**
+* Renders the frame on 1, 2, 4... threads up to threads and prints each one's speedup over one thread
+* and its efficiency, the speedup divided by the thread count
+*/
+void reportScaling(const perspective *views, char **images, unsigned int viewCount, const accel *scene, object *objects, unsigned int threads)
+{
+    double single = 0;
+    for (unsigned int t = 1; t <= threads; t = t * 2 > threads && t < threads ? threads : t * 2)
+    {
+        double time = renderTiles(views, images, viewCount, scene, objects, t, false);
+        if (t == 1)
+            single = time;
+        printf(KRED"scaling["KBLU"threads:"KGRN"%3u "KBLU"time:"KGRN"%4.4fs ", t, time);
+        printf(KBLU"speedup:"KGRN"%5.2fx "KBLU"efficiency:"KGRN"%5.1f%%"KRED"]\n"KNRM, single / time, 100 * single / (time * t));
+    }
+}
+
+typedef struct
+{
+    const accel *scene;
+    object *objects;
+    char *image;            // whole frame, shadePixel indexes it with xres
+    uint32_t *pixelOrder;
+    unsigned int orderSide;
+    frustumCull cull;
+    double cullTime;
+} farmTileRender;
+
+/**
+* A farm tile's frame data is the view's perspective, the scene is this worker's own build
+*/
+bool renderFarmTile(void *ctx, const farmTile *t, const void *frameData, uint32_t frameBytes, char *pixels)
+{
+    farmTileRender *r = ctx;
+    perspective p;
+    if (frameBytes != sizeof(perspective))
+        return false;
+    memcpy(&p, frameData, sizeof(perspective));
+    if (p.res_x != (unsigned int) xres || p.res_y != (unsigned int) yres || t->x1 > p.res_x || t->y1 > p.res_y)
+    {
+        printf(KRED"farm worker: tile outside its %dx%d image, run workers with the coordinator's arguments\n"KNRM, xres, yres);
+        return false;
+    }
+    unsigned int side = t->x1 - t->x0 > t->y1 - t->y0 ? t->x1 - t->x0 : t->y1 - t->y0;
+    if (side > r->orderSide)
+    {
+        r->pixelOrder = realloc(r->pixelOrder, side * side * sizeof(uint32_t));
+        buildCurveOrder(r->pixelOrder, side, side, renderOrder);
+        r->orderSide = side;
+    }
+    shadeTile(&p, r->scene, r->objects, r->image, t->x0, t->y0, t->x1, t->y1, r->pixelOrder, r->orderSide, &r->cull, &r->cullTime);
+    unsigned int width = t->x1 - t->x0;
+    for (unsigned int y = t->y0; y < t->y1; y++)
+        memcpy(pixels + (size_t) (y - t->y0) * width * 3, r->image + XY2INDEX(t->x0, y, 0, xres, 3), width * 3);
+    return true;
+}
+
+/**
+* Builds the scene once and renders tiles for the coordinator at address until it says every frame is done
+*/
+bool runFarmWorker(const char *address)
+{
+    object *objects = NULL;
+    l = sceneLight2;
+    buildScene(&objects);
+    accel *scene = buildAccel(accelerator, objects, &accelSettings);
+    farmTileRender r = {.scene = scene, .objects = objects, .image = calloc((size_t) (xres * yres * 3), sizeof(char))};
+    unsigned int tiles = 0;
+    double start = getTimeSeconds();
+    bool ok = farmWork(address, renderFarmTile, &r, &tiles);
+    flushShadowCacheStats();
+    printf(KRED"farm worker %d["KBLU"tiles:"KGRN"%u "KBLU"time:"KGRN"%4.4fs"KRED"]%s\n"KNRM, (int) getpid(), tiles, getTimeSeconds() - start,
+           ok ? "" : " lost the coordinator");
+    cleanFrustumCull(&r.cull);
+    free(r.pixelOrder);
+    free(r.image);
+    cleanAccel(&scene);
+    if (loadedScene != NULL)
+        objects = NULL;
+    cleanObjectList(&objects);
+    cleanInstanceGeometry(&prismGeometry);
+    return ok;
+}
+
+/**
+* Renders the views on worker processes instead of threads: farmWorkers local ones forked from here plus
+* any that connect to farmAddress. Each worker builds the scene once and keeps it for every tile of every view.
+*/
+bool renderFarm(const perspective *views, char **images, unsigned int viewCount)
+{
+    char defaultAddress[64];
+    const char *address = farmAddress;
+    if (address == NULL)
+    {
+        snprintf(defaultAddress, sizeof(defaultAddress), "unix:/tmp/raytrace-farm-%d.sock", (int) getpid());
+        address = defaultAddress;
+    }
+    int listenFd = farmListen(address);
+    if (listenFd < 0)
+    {
+        printf(KRED"render farm: can not listen on %s\n"KNRM, address);
+        return false;
+    }
+    printf("Render farm on %s with %u local workers\n", address, farmWorkers);
+
+    fflush(stdout);
+    pid_t *children = calloc(farmWorkers > 0 ? farmWorkers : 1, sizeof(pid_t));
+    for (unsigned int w = 0; w < farmWorkers; w++)
+    {
+        children[w] = fork();
+        if (children[w] == 0)
+        {
+            close(listenFd);
+            exit(runFarmWorker(address) ? 0 : 1);
+        }
+    }
+
+    farmFrame frames[2];
+    for (unsigned int v = 0; v < viewCount; v++)
+        frames[v] = (farmFrame){.data = &views[v], .bytes = sizeof(perspective), .image = images[v], .width = views[v].res_x, .height = views[v].res_y};
+    unsigned int tilesX = (views[0].res_x + tileSize - 1) / tileSize;
+    unsigned int tilesY = (views[0].res_y + tileSize - 1) / tileSize;
+    uint32_t *tileOrder = malloc(tilesX * tilesY * sizeof(uint32_t));
+    buildCurveOrder(tileOrder, tilesX, tilesY, renderOrder);
+    farmOptions options = {.tileSize = tileSize, .stallTimeout = farmStall, .tileOrder = tileOrder};
+    farmStats stats;
+    double start = getTimeSeconds();
+    bool ok = farmCoordinate(listenFd, frames, viewCount, &options, &stats);
+    printFarmStats(&stats, getTimeSeconds() - start);
+    close(listenFd);
+    if (strncmp(address, "unix:", 5) == 0)
+        unlink(address + 5);
+
+    for (unsigned int w = 0; w < farmWorkers; w++)
+    {
+        if (children[w] <= 0)
+            continue;
+        // Stopped or stuck workers never act on the bye, give the rest a few seconds to clean up
+        int status;
+        for (int wait = 0; ok && wait < 50 && waitpid(children[w], &status, WNOHANG) == 0; wait++)
+            usleep(100000);
+        if (waitpid(children[w], &status, WNOHANG) == 0)
+        {
+            kill(children[w], SIGKILL);
+            waitpid(children[w], &status, 0);
+        }
+    }
+    free(children);
+    free(tileOrder);
+    return ok;
 }
 
 void parseArguments(int argc, char **argv)
@@ -319,16 +789,42 @@ void parseArguments(int argc, char **argv)
                 {"width",   required_argument,  0, 'w'},
                 {"height",  required_argument,  0, 'h'},
                 {"dist",    required_argument,  0, 'd'},
+                {"bvh",     required_argument,  0, 'b'},
+                {"accel",   required_argument,  0, 'a'},
+                {"compress", no_argument,       0, 'q'},
+                {"packets", required_argument,  0, 'p'},
+                {"density", required_argument,  0, 'g'},
+                {"builder", required_argument,  0, 'B'},
+                {"morton",  required_argument,  0, 'm'},
+                {"treelet", required_argument,  0, 'r'},
+                {"threads", required_argument,  0, 'j'},
+                {"instances", required_argument, 0, 'i'},
+                {"cache",   required_argument,  0, 'c'},
+                {"shadowcache", required_argument, 0, 'k'},
+                {"cull",    required_argument,  0, 'u'},
+                {"mesh",    required_argument,  0, 'M'},
+                {"scene",   required_argument,  0, 'S'},
+                {"savescene", required_argument, 0, 'W'},
+                {"paged",   required_argument,  0, 'P'},
+                {"budget",  required_argument,  0, 'e'},
+                {"cullmap", no_argument,        &cullMap, 1},
+                {"tile",    required_argument,  0, 'T'},
+                {"scaling", no_argument,        &scalingReport, 1},
+                {"order",   required_argument,  0, 'O'},
+                {"farm",    required_argument,  0, 'F'},
+                {"listen",  required_argument,  0, 'L'},
+                {"worker",  required_argument,  0, 'Y'},
+                {"stall",   required_argument,  0, 'Z'},
                 
                 {0, 0, 0, 0}
             };
         /* getopt_long stores the option index here. */
         int option_index = 0;
 #if ANAGLYPH
-        int c = getopt_long (argc, argv, "tx:y:h:w:s:",
+        int c = getopt_long (argc, argv, "tx:y:h:w:s:d:a:g:qp:b:B:m:r:j:i:c:k:u:M:S:W:P:e:T:O:F:L:Y:Z:",
                          long_options, &option_index);
 #else
-        int c = getopt_long (argc, argv, "x:y:f:h:w:",
+        int c = getopt_long (argc, argv, "x:y:f:h:w:d:a:g:qp:b:B:m:r:j:i:c:k:u:M:S:W:P:e:T:O:F:L:Y:Z:",
                          long_options, &option_index);
 #endif
         /* Detect the end of the options. */
@@ -370,6 +866,139 @@ void parseArguments(int argc, char **argv)
                 printf ("View Dist: %s\n", optarg);
                 viewPlaneDistance = (float) atof(optarg);
                 break;
+            case 'a':
+                printf ("Accelerator: %s\n", optarg);
+                if (!parseAccelType(optarg, &accelerator))
+                {
+                    printf ("Accelerator must be list, bvh or grid\n");
+                    exit(1);
+                }
+                break;
+            case 'g':
+                printf ("Grid Density: %s\n", optarg);
+                accelSettings.gridDensity = (float) atof(optarg);
+                break;
+            case 'q':
+                printf ("Compressed BVH\n");
+                accelSettings.compressed = true;
+                break;
+            case 'p':
+                printf ("Triangle Packets: %s\n", optarg);
+                accelSettings.packets = atoi(optarg) != 0;
+                break;
+            case 'b':
+                printf ("BVH Width: %s\n", optarg);
+                accelSettings.width = (bvhWidth) atoi(optarg);
+                if (accelSettings.width != BVH2 && accelSettings.width != BVH4 && accelSettings.width != BVH8)
+                {
+                    printf ("BVH width must be 2, 4 or 8\n");
+                    exit(1);
+                }
+                break;
+            case 'B':
+                printf ("BVH Builder: %s\n", optarg);
+                if (strcmp(optarg, "sah") == 0)
+                    accelSettings.builder = BVH_SAH;
+                else if (strcmp(optarg, "lbvh") == 0)
+                    accelSettings.builder = BVH_LBVH;
+                else
+                {
+                    printf ("BVH builder must be sah or lbvh\n");
+                    exit(1);
+                }
+                break;
+            case 'm':
+                printf ("Morton Bits: %s\n", optarg);
+                accelSettings.lbvh.mortonBits = (unsigned int) atoi(optarg);
+                if (accelSettings.lbvh.mortonBits != 30 && accelSettings.lbvh.mortonBits != 63)
+                {
+                    printf ("Morton bits must be 30 or 63\n");
+                    exit(1);
+                }
+                break;
+            case 'r':
+                printf ("Treelet Rounds: %s\n", optarg);
+                accelSettings.lbvh.treeletRounds = (unsigned int) atoi(optarg);
+                break;
+            case 'j':
+                printf ("Threads: %s\n", optarg);
+                accelSettings.lbvh.threads = (unsigned int) atoi(optarg);
+                break;
+            case 'i':
+                printf ("Prism Instances: %s\n", optarg);
+                prismCopies = (unsigned int) atoi(optarg);
+                break;
+            case 'c':
+                printf ("BVH Cache: %s\n", optarg);
+                accelSettings.cachePath = optarg;
+                break;
+            case 'k':
+                printf ("Shadow Cache: %s\n", optarg);
+                setShadowCache(atoi(optarg) != 0);
+                break;
+            case 'u':
+                printf ("Tile Culling: %s\n", optarg);
+                tileCulling = atoi(optarg) != 0;
+                break;
+            case 'M':
+                printf ("Mesh: %s\n", optarg);
+                meshFile = optarg;
+                break;
+            case 'S':
+                printf ("Scene: %s\n", optarg);
+                sceneFile = optarg;
+                break;
+            case 'W':
+                printf ("Save Scene: %s\n", optarg);
+                saveSceneFile = optarg;
+                break;
+            case 'P':
+                printf ("Paged Mesh: %s\n", optarg);
+                pagedFile = optarg;
+                break;
+            case 'e':
+                printf ("Page Budget: %sMB\n", optarg);
+                pageBudget = (size_t) (atof(optarg) * 1e6);
+                break;
+            case 'T':
+                printf ("Tile Size: %s\n", optarg);
+                tileSize = (unsigned int) atoi(optarg);
+                if (tileSize == 0)
+                {
+                    printf ("Tile size must be at least 1\n");
+                    exit(1);
+                }
+                break;
+            case 'O':
+                printf ("Render Order: %s\n", optarg);
+                if (strcmp(optarg, "row") == 0)
+                    renderOrder = ORDER_ROW;
+                else if (strcmp(optarg, "morton") == 0)
+                    renderOrder = ORDER_MORTON;
+                else if (strcmp(optarg, "hilbert") == 0)
+                    renderOrder = ORDER_HILBERT;
+                else
+                {
+                    printf ("Render order must be row, morton or hilbert\n");
+                    exit(1);
+                }
+                break;
+            case 'F':
+                printf ("Farm Workers: %s\n", optarg);
+                farmWorkers = (unsigned int) atoi(optarg);
+                break;
+            case 'L':
+                printf ("Farm Address: %s\n", optarg);
+                farmAddress = optarg;
+                break;
+            case 'Y':
+                printf ("Farm Worker Of: %s\n", optarg);
+                workerAddress = optarg;
+                break;
+            case 'Z':
+                printf ("Farm Stall Timeout: %ss\n", optarg);
+                farmStall = atof(optarg);
+                break;
 #if !ANAGLYPH
             case 'f':
                 printf ("Output File: %s\n", optarg);
@@ -399,6 +1028,28 @@ void parseArguments(int argc, char **argv)
 int main(int argc, char **argv)
 {
     parseArguments(argc, argv);
+    if (sceneFile != NULL)
+    {
+        sceneLoadStatus status;
+        loadedScene = loadScene(sceneFile, &status);
+        if (loadedScene == NULL)
+        {
+            printf(KRED"scene %s could not be loaded: %s\n"KNRM, sceneFile, status == SCENE_LOAD_MISSING ? "missing" : "invalid");
+            exit(1);
+        }
+        printSceneStats(sceneFile, loadedScene);
+        vector3f_copy(camPos, loadedScene->view.eye);
+        vector3f_copy(lookat, loadedScene->view.lookat);
+        vector3f_copy(lookup, loadedScene->view.up);
+        width = loadedScene->view.width;
+        height = loadedScene->view.height;
+        viewPlaneDistance = loadedScene->view.viewPlaneDistance;
+    }
+    // Saved before the eyes move apart
+    sceneView view = {.width = width, .height = height, .viewPlaneDistance = viewPlaneDistance};
+    vector3f_copy(view.eye, camPos);
+    vector3f_copy(view.lookat, lookat);
+    vector3f_copy(view.up, lookup);
     
 #if ANAGLYPH
     if(!toe)
@@ -415,9 +1066,6 @@ int main(int argc, char **argv)
 #if ANAGLYPH
     char* left =  calloc((size_t) (xres * yres * 3), sizeof(char));
     char* right =  calloc((size_t) (xres * yres * 3), sizeof(char));
-    char* i = right;
-#else
-    char* i = image;
 #endif
 
 
@@ -426,104 +1074,80 @@ int main(int argc, char **argv)
     setCamera(&cam, camPos, lookat, lookup);
     perspective p = {.cam = cam, .height = height, .width = width, .res_x = (unsigned int) xres, .res_y = (unsigned int) yres, .viewPlaneDistance = viewPlaneDistance};
     object *objects = NULL;
-    
-    do
-    {
+    accel *scene = NULL;
+
 #if ANAGLYPH == 1
-        if (buildRef)
-        {
-            i = left;
-            vector3f_add(camPos, shift);
-            if(!toe)
-            {
-                vector3f_add(lookat, shift);
-            }
-            setCamera(&cam, camPos, lookat, lookup);
-            p.cam = cam;
-            l = sceneLight2;
-            file = "reference-left.png";
-            buildScene1(&objects);
-        }
-        else
-        {
-            i = right;
-            l = sceneLight2;
-            file = "reference-right.png";
-            buildScene1(&objects);
-        }
-        buildRef++;
+    // Both eyes look at one scene build, the left eye sits shift over from the right
+    perspective leftView = p;
+    vector3f_add(camPos, shift);
+    if(!toe)
+    {
+        vector3f_add(lookat, shift);
+    }
+    setCamera(&leftView.cam, camPos, lookat, lookup);
+    perspective views[2] = {leftView, p};
+    char *images[2] = {left, right};
+    char *files[2] = {"reference-left.png", "reference-right.png"};
+    unsigned int viewCount = 2;
 #else
-        //Build List
-        if (buildRef)
-        {
-            buildRef++;
-            printf("Rendering reference\n");
-            l = sceneLight2;
-            file = "reference.png";
-            buildScene1(&objects);
-        }
-        else
+    perspective views[1] = {p};
+    char *images[1] = {image};
+    char *files[1] = {"reference.png"};
+    unsigned int viewCount = 1;
+    printf("Rendering reference\n");
+#endif
+    l = sceneLight2;
+    if (workerAddress != NULL)
+    {
+        bool served = runFarmWorker(workerAddress);
+        cleanScene(&loadedScene);
+        exit(served ? 0 : 1);
+    }
+    if (farmWorkers > 0 || farmAddress != NULL)
+    {
+        if (!renderFarm(views, images, viewCount))
+            exit(1);
+    }
+    else
+    {
+        double setupStart = getTimeSeconds();
+        buildScene(&objects);
+        if (saveSceneFile != NULL)
         {
-            buildRef++;
-            continue;
-            l = sceneLight;
-            buildScene2(&objects);
+            if (!saveScene(saveSceneFile, &view, &l, 1, objects))
+                printf(KRED"scene %s could not be written\n"KNRM, saveSceneFile);
+            saveSceneFile = NULL;
         }
-        
-#endif
-        
+        scene = buildAccel(accelerator, objects, &accelSettings);
+        double setupTime = getTimeSeconds() - setupStart;
+        scene->print(scene);
+        printf("Scene setup in %4.4fs for %u view%s\n", setupTime, viewCount, viewCount > 1 ? "s" : "");
 
-        for (unsigned int y = 0; y < p.res_y; y++)
+        unsigned int renderThreads = accelSettings.lbvh.threads > 0 ? accelSettings.lbvh.threads : getProcessorCount();
+        if (scalingReport)
+            reportScaling(views, images, viewCount, scene, objects, renderThreads);
+        double renderTime = renderTiles(views, images, viewCount, scene, objects, renderThreads, true);
+        printf("Rendered");
+        for (unsigned int v = 0; v < viewCount; v++)
+            printf(" %s", files[v]);
+        printf(" in %4.4fs\n", renderTime);
+        for (const object *obj = objects; obj != NULL; obj = obj->next)
         {
-            for (unsigned int x = 0; x < p.res_x; x++)
-            {
-                if (x == XBREAK && y == YBREAK)
-                {
-                    volatile int b = 1;
-                    b++;
-                }
-                sampler samples;
-                getSampler(&samples, SAMPLES_X, SAMPLES_Y, p, x, y, GLOBAL);
-                rayHit samplesRayHits[samples.numOfSamplesX * samples.numOfSamplesY];
-                for (unsigned int sample = 0; sample < samples.numOfSamplesX * samples.numOfSamplesY; sample++)
-                {
-                    samplesRayHits[sample].depth = 0;
-                    trace(samples.rays[sample], &samplesRayHits[sample], objects);
-                    samplesRayHits[sample].objects = objects;
-                    if (samplesRayHits[sample].hit)
-                    {
-                        float ambinentFactor = l.ambinentFactor;
-                        float diffuse = getDiffuseFactor(samplesRayHits[sample], l);
-                        float specular = getSpecularFactor(samplesRayHits[sample], l);
-                        if (inShadow(samplesRayHits[sample], l))
-                        {
-                            DEBUGOUT(printf("In Shadow"));
-                            diffuse = 0.0f;
-                            specular = 0.0f;
-                        }
-                        DEBUGOUT(printf("Ambinent: %4.4f Diffuse: %4.4f Specular: %4.4f\n", ambinentFactor, diffuse, specular));
-                        vector3f ambientColor = {}, diffuseColor = {}, specularColor = {};
-                        vector3f_scaleMul_new(ambientColor, samplesRayHits[sample].mat.color, ambinentFactor);
-                        vector3f_scaleMul_new(diffuseColor, samplesRayHits[sample].mat.color, diffuse);
-                        vector3f_scaleMul_new(specularColor, samplesRayHits[sample].mat.color, specular);
-                        vector3f_copy(samplesRayHits[sample].mat.color, ambientColor);
-                        vector3f_add(samplesRayHits[sample].mat.color, diffuseColor);
-                        vector3f_add(samplesRayHits[sample].mat.color, specularColor);
-                    }
-                }
-                vector3f color = {};
-                getFinalColor(color, samplesRayHits, samples.numOfSamplesX * samples.numOfSamplesY);
-#define MIN(x, y) ((x < y) ? x : y)
-                i[XY2INDEX(x, y, 0, xres, 3)] = (char) mapToRangef(MIN(color[0], 1), 0, 1, 0, 255);
-                i[XY2INDEX(x, y, 1, xres, 3)] = (char) mapToRangef(MIN(color[1], 1), 0, 1, 0, 255);
-                i[XY2INDEX(x, y, 2, xres, 3)] = (char) mapToRangef(MIN(color[2], 1), 0, 1, 0, 255);
-#undef MIN
-                cleanSampler(&samples);
-            }
+            if (obj->type == PAGED_MESH)
+                printPagedMeshStats(obj->shape);
         }
+        cleanAccel(&scene);
+        if (loadedScene != NULL)
+            objects = NULL;
         cleanObjectList(&objects);
-        writeImage(file, xres, yres, i);
-    } while(buildRef < 2);
+        cleanInstanceGeometry(&prismGeometry);
+        // The coordinator traces nothing, its workers' shadow rays stay in their processes
+        flushShadowCacheStats();
+        printShadowCacheStats();
+    }
+    for (unsigned int v = 0; v < viewCount; v++)
+        writeImage(files[v], xres, yres, images[v]);
+    cleanScene(&loadedScene);
     
 #if ANAGLYPH == 1
     float pixelWidth = getPixelWidth(p.width, p.res_x);
@@ -0,0 +1,11 @@
+#include <rayTracerCore/aabb.h>
+#include <util/colors.h>
+
+void printAABB(const aabb box)
+{
+    printf(KRED"aabb["KBLU"min:"KGRN);
+    vector3f_print(box.min);
+    printf(KBLU" max:"KGRN);
+    vector3f_print(box.max);
+    printf(KRED"]"KNRM);
+}
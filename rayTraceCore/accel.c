@@ -0,0 +1,380 @@
+#include <rayTracerCore/accel.h>
+#include <rayTracerCore/widebvh.h>
+#include <rayTracerCore/bvhcache.h>
+#include <rayTracerCore/grid.h>
+#include <rayTracerCore/primitives.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+static const char* accelNames[] = {"list", "bvh", "grid"};
+
+/**
+* Brute force over the scene copied into a primitiveStore, the reference every other structure has to agree with
+*/
+static bool listClosestHit(const accel* a, const ray r, rayHit* rh)
+{
+    ray testRay = r;
+    hitPath path;
+    primitiveId id = primitiveStoreClosestHit(a->data, &testRay, &path);
+    if(id == PRIMITIVE_NONE)
+        return false;
+    primitiveSurface(a->data, id, r, testRay.tmax, &path, rh);
+    return true;
+}
+
+static bool listAnyHit(const accel* a, const ray r, const object** occluder)
+{
+    primitiveId id = primitiveStoreAnyHit(a->data, r);
+    if(id == PRIMITIVE_NONE)
+        return false;
+    if(occluder != NULL)
+        *occluder = primitiveObject(a->data, id);
+    return true;
+}
+
+/**
+* Kept primitives go in as single primitive subtrees holding their ids, in store order so
+* runs of one type stay together for primitivesClosestHit
+*/
+static void listCull(const accel* a, const frustum* f, frustumCull* cull)
+{
+    const primitiveStore* store = a->data;
+    resetFrustumCull(cull, store->count);
+    for(int type = 0; type < PRIMITIVE_TYPES; type++)
+    {
+        for(uint32_t i = 0; i < store->arrays[type].count; i++)
+        {
+            aabb bounds;
+            primitiveId id = PRIMITIVE_ID(type, i);
+            primitiveBounds(store, id, &bounds);
+            if(!frustumCullsAABB(f, &bounds))
+                frustumCullAddSubtree(cull, f, id, &bounds, 1);
+        }
+    }
+}
+
+static bool listClosestHitCulled(const accel* a, const frustumCull* cull, const ray r, rayHit* rh)
+{
+    ray testRay = r;
+    hitPath path;
+    primitiveId id = primitivesClosestHit(a->data, cull->subtrees, cull->subtreeCount, &testRay, &path);
+    if(id == PRIMITIVE_NONE)
+        return false;
+    primitiveSurface(a->data, id, r, testRay.tmax, &path, rh);
+    return true;
+}
+
+static void listPrint(const accel* a)
+{
+    printPrimitiveStoreStats(a->data);
+}
+
+static void listDestroy(void* data)
+{
+    primitiveStore* store = data;
+    cleanPrimitiveStore(&store);
+}
+
+static bool bvhAccelClosestHit(const accel* a, const ray r, rayHit* rh)
+{
+    return bvhClosestHit(a->data, r, rh);
+}
+
+static bool bvhAccelAnyHit(const accel* a, const ray r, const object** occluder)
+{
+    return bvhAnyHit(a->data, r, occluder);
+}
+
+static void bvhAccelCull(const accel* a, const frustum* f, frustumCull* cull)
+{
+    bvhCullFrustum(a->data, f, cull);
+}
+
+static bool bvhAccelClosestHitCulled(const accel* a, const frustumCull* cull, const ray r, rayHit* rh)
+{
+    return bvhClosestHitCulled(a->data, cull, r, rh);
+}
+
+static void bvhAccelPrint(const accel* a)
+{
+    printBVHStats(a->data);
+}
+
+static void bvhAccelDestroy(void* data)
+{
+    bvh* tree = data;
+    cleanBVH(&tree);
+}
+
+static bool gridAccelClosestHit(const accel* a, const ray r, rayHit* rh)
+{
+    return gridClosestHit(a->data, r, rh);
+}
+
+static bool gridAccelAnyHit(const accel* a, const ray r, const object** occluder)
+{
+    return gridAnyHit(a->data, r, occluder);
+}
+
+/**
+* Rays only ever visit the cells they pass through, so a tile's frustum has nothing to add
+*/
+static void gridAccelCull(const accel* a, const frustum* f, frustumCull* cull)
+{
+    (void)f;
+    const grid* g = a->data;
+    resetFrustumCull(cull, g->stats.primitiveCount);
+    cull->kept = g->stats.primitiveCount;
+}
+
+static bool gridAccelClosestHitCulled(const accel* a, const frustumCull* cull, const ray r, rayHit* rh)
+{
+    (void)cull;
+    return gridClosestHit(a->data, r, rh);
+}
+
+static void gridAccelPrint(const accel* a)
+{
+    printGridStats(a->data);
+}
+
+static void gridAccelDestroy(void* data)
+{
+    grid* g = data;
+    cleanGrid(&g);
+}
+
+static unsigned int nextAccelId(void)
+{
+    static unsigned int nextId = 1;
+    return __atomic_fetch_add(&nextId, 1, __ATOMIC_RELAXED);
+}
+
+static accel* buildBoundedAccel(accelType type, const object* list, const accelOptions* options)
+{
+    accel* ret = malloc(sizeof(accel));
+    ret->type = type;
+    ret->id = nextAccelId();
+    switch(type)
+    {
+    case ACCEL_LIST:
+        ret->data = buildPrimitiveStore(list);
+        ret->closestHit = listClosestHit;
+        ret->anyHit = listAnyHit;
+        ret->cull = listCull;
+        ret->closestHitCulled = listClosestHitCulled;
+        ret->print = listPrint;
+        ret->destroy = listDestroy;
+        break;
+    case ACCEL_BVH:
+    {
+        bvh* tree;
+        if(options->cachePath != NULL)
+            tree = cachedBVH(options->cachePath, list, options->builder, &options->lbvh);
+        else
+            tree = options->builder == BVH_LBVH ? buildLBVH(list, &options->lbvh) : buildBVH(list);
+        collapseBVH(tree, options->width);
+        if(options->compressed)
+            compressBVH(tree);
+        if(options->packets)
+            bvhPackLeaves(tree);
+        ret->data = tree;
+        ret->closestHit = bvhAccelClosestHit;
+        ret->anyHit = bvhAccelAnyHit;
+        ret->cull = bvhAccelCull;
+        ret->closestHitCulled = bvhAccelClosestHitCulled;
+        ret->print = bvhAccelPrint;
+        ret->destroy = bvhAccelDestroy;
+        break;
+    }
+    case ACCEL_GRID:
+        ret->data = buildGrid(list, options->gridDensity);
+        ret->closestHit = gridAccelClosestHit;
+        ret->anyHit = gridAccelAnyHit;
+        ret->cull = gridAccelCull;
+        ret->closestHitCulled = gridAccelClosestHitCulled;
+        ret->print = gridAccelPrint;
+        ret->destroy = gridAccelDestroy;
+        break;
+    }
+    return ret;
+}
+
+/**
+* Planes have no bounds to put in a tree or grid. They are kept aside and tested first,
+* and the nearest one bounds the ray sent through the structure over everything else.
+*/
+typedef struct
+{
+    accel* bounded;
+    object* copies;             // the bounded objects relinked without the planes
+    const object** unbounded;
+    unsigned int unboundedCount;
+} unboundedAccel;
+
+static bool isUnbounded(const object* obj)
+{
+    aabb box;
+    obj->bounds(obj, &box);
+    for(int i = 0; i < 3; i++)
+    {
+        if(isinf(box.min[i]) || isinf(box.max[i]))
+            return true;
+    }
+    return false;
+}
+
+static const object* nearestUnbounded(const unboundedAccel* u, ray* r, hitPath* path)
+{
+    const object* nearest = NULL;
+    for(unsigned int i = 0; i < u->unboundedCount; i++)
+    {
+        float t;
+        hitPath candidate;
+        if(u->unbounded[i]->intersect(r, u->unbounded[i], &t, &candidate) && t < r->tmax)
+        {
+            r->tmax = t;
+            nearest = u->unbounded[i];
+            *path = candidate;
+        }
+    }
+    return nearest;
+}
+
+static bool unboundedClosestHit(const accel* a, const ray r, rayHit* rh)
+{
+    const unboundedAccel* u = a->data;
+    ray testRay = r;
+    hitPath path;
+    const object* nearest = nearestUnbounded(u, &testRay, &path);
+    if(u->bounded->closestHit(u->bounded, testRay, rh))
+        return true;
+    if(nearest == NULL)
+        return false;
+    nearest->surface(r, nearest, testRay.tmax, &path, rh);
+    return true;
+}
+
+static bool unboundedAnyHit(const accel* a, const ray r, const object** occluder)
+{
+    const unboundedAccel* u = a->data;
+    for(unsigned int i = 0; i < u->unboundedCount; i++)
+    {
+        if(u->unbounded[i]->test(r, u->unbounded[i]))
+        {
+            if(occluder != NULL)
+                *occluder = u->unbounded[i];
+            return true;
+        }
+    }
+    return u->bounded->anyHit(u->bounded, r, occluder);
+}
+
+static void unboundedCull(const accel* a, const frustum* f, frustumCull* cull)
+{
+    const unboundedAccel* u = a->data;
+    u->bounded->cull(u->bounded, f, cull);
+}
+
+static bool unboundedClosestHitCulled(const accel* a, const frustumCull* cull, const ray r, rayHit* rh)
+{
+    const unboundedAccel* u = a->data;
+    ray testRay = r;
+    hitPath path;
+    const object* nearest = nearestUnbounded(u, &testRay, &path);
+    if(u->bounded->closestHitCulled(u->bounded, cull, testRay, rh))
+        return true;
+    if(nearest == NULL)
+        return false;
+    nearest->surface(r, nearest, testRay.tmax, &path, rh);
+    return true;
+}
+
+static void unboundedPrint(const accel* a)
+{
+    const unboundedAccel* u = a->data;
+    u->bounded->print(u->bounded);
+    printf(KRED"unbounded["KBLU"planes:"KGRN"%u"KRED"]\n"KNRM, u->unboundedCount);
+}
+
+static void unboundedDestroy(void* data)
+{
+    unboundedAccel* u = data;
+    cleanAccel(&u->bounded);
+    free(u->copies);
+    free(u->unbounded);
+    free(u);
+}
+
+accel* buildAccel(accelType type, const object* list, const accelOptions* options)
+{
+    unsigned int count = 0, unboundedCount = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next, count++)
+        unboundedCount += isUnbounded(obj);
+    if(unboundedCount == 0)
+        return buildBoundedAccel(type, list, options);
+
+    unboundedAccel* u = malloc(sizeof(unboundedAccel));
+    u->copies = malloc((count - unboundedCount) * sizeof(object));
+    u->unbounded = malloc(unboundedCount * sizeof(object*));
+    u->unboundedCount = 0;
+    object* copy = NULL;
+    unsigned int copies = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+    {
+        if(isUnbounded(obj))
+        {
+            u->unbounded[u->unboundedCount++] = obj;
+            continue;
+        }
+        // Shapes stay shared, only the links change
+        u->copies[copies] = *obj;
+        u->copies[copies].next = NULL;
+        if(copy != NULL)
+            copy->next = &u->copies[copies];
+        copy = &u->copies[copies++];
+    }
+    u->bounded = buildBoundedAccel(type, copies > 0 ? u->copies : NULL, options);
+
+    accel* ret = malloc(sizeof(accel));
+    ret->type = type;
+    ret->id = nextAccelId();
+    ret->data = u;
+    ret->closestHit = unboundedClosestHit;
+    ret->anyHit = unboundedAnyHit;
+    ret->cull = unboundedCull;
+    ret->closestHitCulled = unboundedClosestHitCulled;
+    ret->print = unboundedPrint;
+    ret->destroy = unboundedDestroy;
+    return ret;
+}
+
+bool parseAccelType(const char* name, accelType* type)
+{
+    for(unsigned int i = 0; i < sizeof(accelNames) / sizeof(accelNames[0]); i++)
+    {
+        if(strcmp(name, accelNames[i]) == 0)
+        {
+            *type = (accelType)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* accelTypeName(accelType type)
+{
+    return accelNames[type];
+}
+
+void cleanAccel(accel** a)
+{
+    if(*a == NULL)
+        return;
+    (*a)->destroy((*a)->data);
+    free(*a);
+    *a = NULL;
+}
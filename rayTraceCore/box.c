@@ -0,0 +1,95 @@
+#include <rayTracerCore/shapes/box.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+object* createBox(const material mat, const point3f min, const point3f max)
+{
+    box_t* b = malloc(sizeof(box_t));
+    for(int i = 0; i < 3; i++)
+    {
+        b->min[i] = fminf(min[i], max[i]);
+        b->max[i] = fmaxf(min[i], max[i]);
+    }
+    object* ret = malloc(sizeof(object));
+    initObject(ret, BOX, mat, b);
+    return ret;
+}
+
+bool boxTestHit(const ray r, const object *obj)
+{
+    float t;
+    return boxIntersect(&r, obj->shape, &t);
+}
+
+bool boxHit(const ray r, const object *o, float *time, rayHit *rayH)
+{
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    float t;
+    if(!boxIntersect(&r, o->shape, &t))
+        return false;
+
+    *time = t;
+    boxHitRecord(r, o, t, NULL, rayH);
+    return true;
+}
+
+bool boxHitTime(const ray *r, const object *o, float *time, hitPath *path)
+{
+    (void)path;
+    return boxIntersect(r, o->shape, time);
+}
+
+void boxHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH)
+{
+    (void)path;
+    boxSurface(r, o->shape, o->mat, t, rayH);
+}
+
+void boxSurface(const ray r, const box_t *b, const material mat, float t, rayHit *rayH)
+{
+    rayH->hit = true;
+    rayH->mat = mat;
+    vector3f dirOffset = {};
+    vector3f_scaleMul_new(dirOffset, r.dir, t);
+    vector3f_add_new(rayH->location, r.origin, dirOffset);
+    // The axis the hit is furthest out along, measured in half sizes from the center
+    int axis = 0;
+    float best = -1, side = 1;
+    for(int i = 0; i < 3; i++)
+    {
+        float half = .5f * (b->max[i] - b->min[i]);
+        float d = rayH->location[i] - .5f * (b->min[i] + b->max[i]);
+        float scaled = half > 0 ? fabsf(d) / half : INFINITY;
+        if(scaled > best)
+        {
+            best = scaled;
+            axis = i;
+            side = d < 0 ? -1.f : 1.f;
+        }
+    }
+    vector3f_set(rayH->normal, 0, 0, 0);
+    rayH->normal[axis] = side;
+    rayH->originRay = r;
+    rayH->offsetError = .1;
+}
+
+void boxBounds(const object *o, aabb *box)
+{
+    const box_t* b = o->shape;
+    vector3f_copy(box->min, b->min);
+    vector3f_copy(box->max, b->max);
+}
+
+void boxPrint(void *s)
+{
+    const box_t* b = s;
+    printf(KCYN"box[");
+    printf(KBLU"min:"KGRN);
+    vector3f_print(b->min);
+    printf(KBLU"max:"KGRN);
+    vector3f_print(b->max);
+    printf(KCYN"]"KNRM);
+}
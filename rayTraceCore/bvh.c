@@ -0,0 +1,1053 @@
+#include <rayTracerCore/bvh.h>
+#include <rayTracerCore/widebvh.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define BVH_TRAVERSAL_COST 1.0f
+#define BVH_INTERSECT_COST 1.0f
+// Past this depth splits fall back to the object median so the traversal stack can not overflow
+#define BVH_MEDIAN_DEPTH 32
+
+typedef struct
+{
+    aabb bounds;
+    point3f centroid;
+    uint32_t index; // which box of buildBVHNodes this is
+    const object* obj;
+} buildPrim;
+
+typedef struct
+{
+    aabb bounds;
+    unsigned int count;
+} bvhBin;
+
+typedef struct
+{
+    bvh* tree;
+    buildPrim* prims;
+} buildState;
+
+static void swapPrims(buildPrim* a, buildPrim* b)
+{
+    buildPrim tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/**
+* Quickselect on the centroid axis so [start, mid) are all <= [mid, end)
+*/
+static void selectMedian(buildPrim* prims, unsigned int start, unsigned int end, unsigned int mid, int axis)
+{
+    while(end - start > 1)
+    {
+        float pivot = prims[(start + end) / 2].centroid[axis];
+        unsigned int i = start, j = end - 1;
+        while(i <= j)
+        {
+            while(prims[i].centroid[axis] < pivot) i++;
+            while(prims[j].centroid[axis] > pivot) j--;
+            if(i <= j)
+            {
+                swapPrims(&prims[i], &prims[j]);
+                i++;
+                if(j == 0) break;
+                j--;
+            }
+        }
+        if(mid <= j)
+            end = j + 1;
+        else if(mid >= i)
+            start = i;
+        else
+            return;
+    }
+}
+
+static int binIndex(const aabb* centroidBounds, const point3f centroid, int axis)
+{
+    float extent = centroidBounds->max[axis] - centroidBounds->min[axis];
+    int b = (int)(BVH_BINS * (centroid[axis] - centroidBounds->min[axis]) / extent);
+    if(b < 0) b = 0;
+    if(b >= BVH_BINS) b = BVH_BINS - 1;
+    return b;
+}
+
+/**
+* Evaluates the binned SAH over every axis.
+* Returns the cost of the best split, axis and bin are the split plane.
+*/
+static float findBestSplit(const buildPrim* prims, unsigned int start, unsigned int end, const aabb* bounds, const aabb* centroidBounds, int* bestAxis, int* bestBin)
+{
+    float bestCost = INFINITY;
+    float invArea = 1.f / aabbSurfaceArea(bounds);
+    *bestAxis = -1;
+    for(int axis = 0; axis < 3; axis++)
+    {
+        if(centroidBounds->max[axis] <= centroidBounds->min[axis])
+            continue;
+        bvhBin bins[BVH_BINS];
+        for(int b = 0; b < BVH_BINS; b++)
+        {
+            aabbEmpty(&bins[b].bounds);
+            bins[b].count = 0;
+        }
+        for(unsigned int i = start; i < end; i++)
+        {
+            int b = binIndex(centroidBounds, prims[i].centroid, axis);
+            bins[b].count++;
+            aabbExtend(&bins[b].bounds, &prims[i].bounds);
+        }
+
+        // Sweep from the right to get the cost of everything above each plane
+        float rightArea[BVH_BINS];
+        unsigned int rightCount[BVH_BINS];
+        aabb acc;
+        aabbEmpty(&acc);
+        unsigned int count = 0;
+        for(int b = BVH_BINS - 1; b > 0; b--)
+        {
+            aabbExtend(&acc, &bins[b].bounds);
+            count += bins[b].count;
+            rightArea[b] = aabbSurfaceArea(&acc);
+            rightCount[b] = count;
+        }
+
+        aabbEmpty(&acc);
+        count = 0;
+        for(int b = 0; b < BVH_BINS - 1; b++)
+        {
+            aabbExtend(&acc, &bins[b].bounds);
+            count += bins[b].count;
+            if(count == 0 || rightCount[b + 1] == 0)
+                continue;
+            float cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * invArea *
+                (aabbSurfaceArea(&acc) * count + rightArea[b + 1] * rightCount[b + 1]);
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                *bestAxis = axis;
+                *bestBin = b;
+            }
+        }
+    }
+    return bestCost;
+}
+
+static unsigned int buildRecursive(buildState* s, unsigned int start, unsigned int end, unsigned int depth)
+{
+    unsigned int index = s->tree->nodeCount++;
+    bvhNode* node = &s->tree->nodes[index];
+    unsigned int count = end - start;
+
+    aabb centroidBounds;
+    aabbEmpty(&node->bounds);
+    aabbEmpty(&centroidBounds);
+    for(unsigned int i = start; i < end; i++)
+    {
+        aabbExtend(&node->bounds, &s->prims[i].bounds);
+        aabbExtendPoint(&centroidBounds, s->prims[i].centroid);
+    }
+    if(depth > s->tree->stats.maxDepth)
+        s->tree->stats.maxDepth = depth;
+
+    node->axis = (uint16_t) aabbLongestAxis(&centroidBounds);
+    unsigned int mid = start;
+    if(count > 1 && depth < BVH_MEDIAN_DEPTH)
+    {
+        int axis, bin;
+        float cost = findBestSplit(s->prims, start, end, &node->bounds, &centroidBounds, &axis, &bin);
+        if(axis >= 0 && (count > BVH_MAX_LEAF || cost < BVH_INTERSECT_COST * count))
+        {
+            unsigned int i = start, j = end;
+            while(i < j)
+            {
+                if(binIndex(&centroidBounds, s->prims[i].centroid, axis) <= bin)
+                    i++;
+                else
+                    swapPrims(&s->prims[i], &s->prims[--j]);
+            }
+            mid = i;
+            node->axis = (uint16_t) axis;
+        }
+        else if(count > BVH_MAX_LEAF)
+        {
+            // Every centroid is in the same place, just halve the list
+            mid = start + count / 2;
+        }
+    }
+    else if(count > BVH_MAX_LEAF)
+    {
+        mid = start + count / 2;
+        selectMedian(s->prims, start, end, mid, node->axis);
+    }
+
+    if(mid == start)
+    {
+        node->offset = start;
+        node->count = (uint16_t) count;
+        s->tree->stats.leafCount++;
+        return index;
+    }
+
+    node->count = 0;
+    buildRecursive(s, start, mid, depth + 1);
+    unsigned int right = buildRecursive(s, mid, end, depth + 1);
+    s->tree->nodes[index].offset = right;
+    return index;
+}
+
+bvh* buildBVH(const object* list)
+{
+    double start = getTimeSeconds();
+    bvh* tree = calloc(1, sizeof(bvh));
+    unsigned int count = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        count++;
+    tree->primitiveCount = count;
+    tree->width = BVH2;
+    tree->stats.builder = BVH_SAH;
+    tree->stats.buildThreads = 1;
+    if(count == 0)
+    {
+        bvhSyncPrimitives(tree);
+        return tree;
+    }
+
+    buildState s;
+    s.tree = tree;
+    s.prims = malloc(count * sizeof(buildPrim));
+    unsigned int i = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next, i++)
+    {
+        obj->bounds(obj, &s.prims[i].bounds);
+        aabbCentroid(s.prims[i].centroid, &s.prims[i].bounds);
+        s.prims[i].obj = obj;
+    }
+
+    tree->nodes = malloc(2 * count * sizeof(bvhNode));
+    buildRecursive(&s, 0, count, 0);
+    tree->nodes = realloc(tree->nodes, tree->nodeCount * sizeof(bvhNode));
+
+    tree->primitives = malloc(count * sizeof(object*));
+    for(i = 0; i < count; i++)
+        tree->primitives[i] = s.prims[i].obj;
+    free(s.prims);
+    bvhSyncPrimitives(tree);
+
+    tree->stats.nodeCount = tree->nodeCount;
+    tree->stats.sahCost = bvhSAHCost(tree);
+    bvhResetQuality(tree);
+    tree->stats.buildTime = getTimeSeconds() - start;
+    return tree;
+}
+
+bvhNode* buildBVHNodes(const aabb* bounds, uint32_t count, uint32_t* order, unsigned int* nodeCount)
+{
+    *nodeCount = 0;
+    if(count == 0)
+        return NULL;
+    bvh scratch;
+    memset(&scratch, 0, sizeof(bvh));
+    buildState s;
+    s.tree = &scratch;
+    s.prims = malloc(count * sizeof(buildPrim));
+    for(uint32_t i = 0; i < count; i++)
+    {
+        s.prims[i].bounds = bounds[i];
+        aabbCentroid(s.prims[i].centroid, &bounds[i]);
+        s.prims[i].index = i;
+        s.prims[i].obj = NULL;
+    }
+    scratch.nodes = malloc(2 * count * sizeof(bvhNode));
+    buildRecursive(&s, 0, count, 0);
+    for(uint32_t i = 0; i < count; i++)
+        order[i] = s.prims[i].index;
+    free(s.prims);
+    *nodeCount = scratch.nodeCount;
+    return realloc(scratch.nodes, scratch.nodeCount * sizeof(bvhNode));
+}
+
+typedef struct
+{
+    uint32_t index;
+    uint32_t end;       // one past the last node the subtree may use
+    uint32_t depth;
+} nodeRange;
+
+bool bvhValidNodes(const bvhNode* nodes, uint32_t nodeCount, uint32_t primitiveCount)
+{
+    if(nodeCount == 0)
+        return primitiveCount == 0;
+    // Children always sit inside their parent's range, so every range shrinks and the walk ends
+    nodeRange stack[BVH_STACK_SIZE + 1];
+    int sp = 0;
+    stack[sp++] = (nodeRange){0, nodeCount, 0};
+    while(sp > 0)
+    {
+        nodeRange range = stack[--sp];
+        if(range.index >= range.end || range.depth >= BVH_STACK_SIZE)
+            return false;
+        const bvhNode* node = &nodes[range.index];
+        if(node->count > 0)
+        {
+            if((uint64_t)node->offset + node->count > primitiveCount)
+                return false;
+            continue;
+        }
+        if(node->offset <= range.index + 1 || node->offset >= range.end)
+            return false;
+        stack[sp++] = (nodeRange){node->offset, range.end, range.depth + 1};
+        stack[sp++] = (nodeRange){range.index + 1, node->offset, range.depth + 1};
+    }
+    return true;
+}
+
+static bool closestHitFrom(const bvh* tree, uint32_t root, const ray r, const vector3f invDir, const bool dirNeg[3], ray* testRay, primitiveId* nearest, hitPath* path)
+{
+    bool hit = false;
+    uint32_t stack[BVH_STACK_SIZE];
+    int sp = 0;
+    uint32_t index = root;
+    while(true)
+    {
+        const bvhNode* node = &tree->nodes[index];
+        float tnear;
+        if(aabbHit(&node->bounds, &r, invDir, testRay->tmax, &tnear))
+        {
+            if(node->count == 0)
+            {
+                // Visit the near child first so the far one can be culled by tmax
+                if(dirNeg[node->axis])
+                {
+                    stack[sp++] = index + 1;
+                    index = node->offset;
+                }
+                else
+                {
+                    stack[sp++] = node->offset;
+                    index = index + 1;
+                }
+                continue;
+            }
+            hit |= bvhIntersectLeaf(tree, node->offset, node->count, r, testRay, nearest, path);
+        }
+        if(sp == 0)
+            break;
+        index = stack[--sp];
+    }
+    return hit;
+}
+
+primitiveId bvhClosestPrimitive(const bvh* tree, ray* r, hitPath* path)
+{
+    if(tree == NULL || tree->nodeCount == 0)
+        return PRIMITIVE_NONE;
+    if(tree->width != BVH2)
+        return wideBVHClosestPrimitive(tree, NULL, r, path);
+    vector3f invDir = {1.f / r->dir[0], 1.f / r->dir[1], 1.f / r->dir[2]};
+    bool dirNeg[3] = {invDir[0] < 0, invDir[1] < 0, invDir[2] < 0};
+    primitiveId nearest = PRIMITIVE_NONE;
+    closestHitFrom(tree, 0, *r, invDir, dirNeg, r, &nearest, path);
+    return nearest;
+}
+
+bool bvhClosestHit(const bvh* tree, const ray r, rayHit* rh)
+{
+    ray testRay = r;
+    hitPath path;
+    primitiveId nearest = bvhClosestPrimitive(tree, &testRay, &path);
+    if(nearest == PRIMITIVE_NONE)
+        return false;
+    primitiveSurface(tree->store, nearest, r, testRay.tmax, &path, rh);
+    return true;
+}
+
+bool bvhClosestHitCulled(const bvh* tree, const frustumCull* cull, const ray r, rayHit* rh)
+{
+    if(tree == NULL || tree->nodeCount == 0)
+        return false;
+    ray testRay = r;
+    hitPath path;
+    primitiveId nearest = PRIMITIVE_NONE;
+    if(tree->width != BVH2)
+        nearest = wideBVHClosestPrimitive(tree, cull, &testRay, &path);
+    else
+    {
+        vector3f invDir = {1.f / r.dir[0], 1.f / r.dir[1], 1.f / r.dir[2]};
+        bool dirNeg[3] = {invDir[0] < 0, invDir[1] < 0, invDir[2] < 0};
+        for(unsigned int i = 0; i < cull->subtreeCount; i++)
+            closestHitFrom(tree, cull->subtrees[i], r, invDir, dirNeg, &testRay, &nearest, &path);
+    }
+    if(nearest == PRIMITIVE_NONE)
+        return false;
+    primitiveSurface(tree->store, nearest, r, testRay.tmax, &path, rh);
+    return true;
+}
+
+bool bvhAnyHit(const bvh* tree, const ray r, const object** occluder)
+{
+    if(tree == NULL || tree->nodeCount == 0)
+        return false;
+    if(tree->width != BVH2)
+        return wideBVHAnyHit(tree, r, occluder);
+    vector3f invDir = {1.f / r.dir[0], 1.f / r.dir[1], 1.f / r.dir[2]};
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int sp = 0;
+    uint32_t index = 0;
+    while(true)
+    {
+        const bvhNode* node = &tree->nodes[index];
+        float tnear;
+        if(aabbHit(&node->bounds, &r, invDir, r.tmax, &tnear))
+        {
+            if(node->count == 0)
+            {
+                stack[sp++] = node->offset;
+                index = index + 1;
+                continue;
+            }
+            if(bvhOccludeLeaf(tree, node->offset, node->count, r, occluder))
+                return true;
+        }
+        if(sp == 0)
+            break;
+        index = stack[--sp];
+    }
+    return false;
+}
+
+float bvhSAHCost(const bvh* tree)
+{
+    if(tree == NULL || tree->nodeCount == 0)
+        return 0;
+    if(tree->nodes == NULL)
+        return tree->stats.sahCost;
+    float rootArea = aabbSurfaceArea(&tree->nodes[0].bounds);
+    if(rootArea <= 0)
+        return BVH_INTERSECT_COST * tree->primitiveCount;
+    float cost = 0;
+    for(unsigned int i = 0; i < tree->nodeCount; i++)
+    {
+        const bvhNode* node = &tree->nodes[i];
+        float area = aabbSurfaceArea(&node->bounds) / rootArea;
+        if(node->count == 0)
+            cost += BVH_TRAVERSAL_COST * area;
+        else
+            cost += BVH_INTERSECT_COST * area * node->count;
+    }
+    return cost;
+}
+
+/**
+* Unnormalized SAH cost of every subtree rooted in [begin, end).
+* Children always follow their parent so one backwards sweep is enough.
+*/
+static void subtreeCosts(const bvh* tree, uint32_t begin, uint32_t end, float* cost)
+{
+    for(uint32_t i = end; i-- > begin;)
+    {
+        const bvhNode* node = &tree->nodes[i];
+        float area = aabbSurfaceArea(&node->bounds);
+        if(node->count > 0)
+            cost[i] = BVH_INTERSECT_COST * area * node->count;
+        else
+            cost[i] = BVH_TRAVERSAL_COST * area + cost[i + 1] + cost[node->offset];
+    }
+}
+
+void bvhResetQuality(bvh* tree)
+{
+    free(tree->referenceCost);
+    tree->referenceCost = NULL;
+    if(tree->nodeCount == 0)
+        return;
+    tree->referenceCost = malloc(tree->nodeCount * sizeof(float));
+    subtreeCosts(tree, 0, tree->nodeCount, tree->referenceCost);
+}
+
+static uint32_t subtreeEnd(const bvh* tree, uint32_t index)
+{
+    while(tree->nodes[index].count == 0)
+        index = tree->nodes[index].offset;
+    return index + 1;
+}
+
+static void subtreePrimitives(const bvh* tree, uint32_t index, uint32_t* pStart, uint32_t* pEnd)
+{
+    uint32_t first = index;
+    while(tree->nodes[first].count == 0)
+        first++;
+    uint32_t last = subtreeEnd(tree, index) - 1;
+    *pStart = tree->nodes[first].offset;
+    *pEnd = tree->nodes[last].offset + tree->nodes[last].count;
+}
+
+void bvhCullFrustum(const bvh* tree, const frustum* f, frustumCull* cull)
+{
+    if(tree->width != BVH2)
+    {
+        wideBVHCullFrustum(tree, f, cull);
+        return;
+    }
+    resetFrustumCull(cull, tree->primitiveCount);
+    if(tree->nodeCount == 0)
+        return;
+    uint32_t stack[BVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while(sp > 0)
+    {
+        uint32_t index = stack[--sp];
+        const bvhNode* node = &tree->nodes[index];
+        if(frustumCullsAABB(f, &node->bounds))
+            continue;
+        if(node->count > 0 || cull->subtreeCount >= FRUSTUM_MAX_SUBTREES || frustumContainsAABB(f, &node->bounds))
+        {
+            uint32_t pStart, pEnd;
+            subtreePrimitives(tree, index, &pStart, &pEnd);
+            frustumCullAddSubtree(cull, f, index, &node->bounds, pEnd - pStart);
+        }
+        else
+        {
+            stack[sp++] = node->offset;
+            stack[sp++] = index + 1;
+        }
+    }
+    sortFrustumCull(cull);
+}
+
+static void refreshStats(bvh* tree)
+{
+    tree->stats.nodeCount = tree->nodeCount;
+    tree->stats.leafCount = 0;
+    tree->stats.maxDepth = 0;
+    if(tree->nodeCount > 0)
+    {
+        // Parents always come before their children so depths can be pushed down in one sweep
+        uint32_t* depth = malloc(tree->nodeCount * sizeof(uint32_t));
+        depth[0] = 0;
+        for(uint32_t i = 0; i < tree->nodeCount; i++)
+        {
+            if(depth[i] > tree->stats.maxDepth)
+                tree->stats.maxDepth = depth[i];
+            if(tree->nodes[i].count > 0)
+            {
+                tree->stats.leafCount++;
+                continue;
+            }
+            depth[i + 1] = depth[i] + 1;
+            depth[tree->nodes[i].offset] = depth[i] + 1;
+        }
+        free(depth);
+    }
+    tree->stats.sahCost = bvhSAHCost(tree);
+}
+
+/**
+* Rebuilds the subtree in nodes [index, end) over primitives [pStart, pEnd) with the SAH builder
+* and splices it back, shifting every node behind it if the node count changed.
+*/
+static void rebuildSubtree(bvh* tree, uint32_t index, uint32_t end, uint32_t pStart, uint32_t pEnd)
+{
+    uint32_t count = pEnd - pStart;
+    bvh scratch;
+    memset(&scratch, 0, sizeof(bvh));
+    buildState s;
+    s.tree = &scratch;
+    s.prims = malloc(count * sizeof(buildPrim));
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const object* obj = tree->primitives[pStart + i];
+        obj->bounds(obj, &s.prims[i].bounds);
+        aabbCentroid(s.prims[i].centroid, &s.prims[i].bounds);
+        s.prims[i].obj = obj;
+    }
+    scratch.nodes = malloc(2 * count * sizeof(bvhNode));
+    buildRecursive(&s, 0, count, 0);
+    for(uint32_t i = 0; i < scratch.nodeCount; i++)
+        scratch.nodes[i].offset += scratch.nodes[i].count > 0 ? pStart : index;
+    for(uint32_t i = 0; i < count; i++)
+        tree->primitives[pStart + i] = s.prims[i].obj;
+    free(s.prims);
+
+    uint32_t oldCount = end - index;
+    uint32_t newCount = scratch.nodeCount;
+    uint32_t total = tree->nodeCount - oldCount + newCount;
+    if(newCount != oldCount)
+    {
+        for(uint32_t i = 0; i < tree->nodeCount; i++)
+        {
+            if((i < index || i >= end) && tree->nodes[i].count == 0 && tree->nodes[i].offset >= end)
+                tree->nodes[i].offset = tree->nodes[i].offset - oldCount + newCount;
+        }
+        if(newCount > oldCount)
+        {
+            tree->nodes = realloc(tree->nodes, total * sizeof(bvhNode));
+            tree->referenceCost = realloc(tree->referenceCost, total * sizeof(float));
+        }
+        memmove(tree->nodes + index + newCount, tree->nodes + end, (tree->nodeCount - end) * sizeof(bvhNode));
+        memmove(tree->referenceCost + index + newCount, tree->referenceCost + end, (tree->nodeCount - end) * sizeof(float));
+    }
+    memcpy(tree->nodes + index, scratch.nodes, newCount * sizeof(bvhNode));
+    free(scratch.nodes);
+    tree->nodeCount = total;
+    subtreeCosts(tree, index, index + newCount, tree->referenceCost);
+}
+
+/**
+* Trees loaded from a cache point into a read only mapping, copy the nodes out before editing them
+*/
+static void detachMapping(bvh* tree)
+{
+    if(tree->mapping == NULL)
+        return;
+    bvhNode* nodes = malloc(tree->nodeCount * sizeof(bvhNode));
+    memcpy(nodes, tree->nodes, tree->nodeCount * sizeof(bvhNode));
+    munmap(tree->mapping, tree->mappingSize);
+    tree->mapping = NULL;
+    tree->mappingSize = 0;
+    tree->nodes = nodes;
+    if(tree->referenceCost == NULL)
+        bvhResetQuality(tree);
+}
+
+/**
+* Compressed trees dropped their binary nodes, edits need them back
+*/
+static bool restoreBinaryNodes(bvh* tree)
+{
+    if(tree->nodes != NULL || tree->primitiveCount == 0)
+        return false;
+    tree->nodeCount = 0;
+    rebuildSubtree(tree, 0, 0, 0, tree->primitiveCount);
+    return true;
+}
+
+static void refitNodes(bvh* tree)
+{
+    for(uint32_t i = tree->nodeCount; i-- > 0;)
+    {
+        bvhNode* node = &tree->nodes[i];
+        if(node->count > 0)
+        {
+            aabbEmpty(&node->bounds);
+            for(uint32_t p = node->offset; p < node->offset + node->count; p++)
+            {
+                aabb box;
+                tree->primitives[p]->bounds(tree->primitives[p], &box);
+                aabbExtend(&node->bounds, &box);
+            }
+        }
+        else
+        {
+            node->bounds = tree->nodes[i + 1].bounds;
+            aabbExtend(&node->bounds, &tree->nodes[node->offset].bounds);
+        }
+    }
+}
+
+static void dropPackets(bvh* tree)
+{
+    free(tree->packets);
+    free(tree->spherePackets);
+    free(tree->leafPacket);
+    tree->packets = NULL;
+    tree->spherePackets = NULL;
+    tree->leafPacket = NULL;
+    tree->packetCount = 0;
+    tree->spherePacketCount = 0;
+    tree->stats.packedTriangles = 0;
+    tree->stats.packedSpheres = 0;
+}
+
+/**
+* Room for one more packet, capacity is the next power of two as posix_memalign has no realloc
+*/
+static bool growPackets(void** packets, unsigned int count, size_t size)
+{
+    if((count & (count - 1)) != 0)
+        return true;
+    void* grown = NULL;
+    if(posix_memalign(&grown, 64, (count ? 2 * count : 1) * size) != 0)
+        return false;
+    if(*packets != NULL)
+        memcpy(grown, *packets, count * size);
+    free(*packets);
+    *packets = grown;
+    return true;
+}
+
+/**
+* Moves the primitives of type to the front of prims and returns how many there were
+*/
+static uint32_t gatherType(const object** prims, uint32_t count, geoEnum type)
+{
+    uint32_t found = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        if(prims[i]->type != type)
+            continue;
+        const object* tmp = prims[found];
+        prims[found++] = prims[i];
+        prims[i] = tmp;
+    }
+    return found;
+}
+
+void bvhPackLeaf(bvh* tree, uint32_t offset, uint32_t count)
+{
+    const object** prims = tree->primitives + offset;
+    uint32_t triangles = 0, spheres = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        triangles += prims[i]->type == TRIANGLE;
+        spheres += prims[i]->type == SPHERE;
+    }
+    if(triangles < BVH_PACKET_MIN && spheres < BVH_PACKET_MIN)
+        return;
+
+    if(triangles >= spheres)
+    {
+        triangles = gatherType(prims, count, TRIANGLE);
+        triangles = triangles < TRIANGLE_PACKET_WIDTH ? triangles : TRIANGLE_PACKET_WIDTH;
+        if(!growPackets((void**)&tree->packets, tree->packetCount, sizeof(trianglePacket)))
+            return;
+        const triangle_t* shapes[TRIANGLE_PACKET_WIDTH];
+        for(uint32_t i = 0; i < triangles; i++)
+            shapes[i] = prims[i]->shape;
+        packTriangles(&tree->packets[tree->packetCount], shapes, triangles);
+        tree->leafPacket[offset] = BVH_PACKET_ENTRY(tree->packetCount, false, triangles);
+        tree->packetCount++;
+        tree->stats.packedTriangles += triangles;
+    }
+    else
+    {
+        spheres = gatherType(prims, count, SPHERE);
+        spheres = spheres < SPHERE_PACKET_WIDTH ? spheres : SPHERE_PACKET_WIDTH;
+        if(!growPackets((void**)&tree->spherePackets, tree->spherePacketCount, sizeof(spherePacket)))
+            return;
+        const ellipsoid_t* shapes[SPHERE_PACKET_WIDTH];
+        for(uint32_t i = 0; i < spheres; i++)
+            shapes[i] = prims[i]->shape;
+        packSpheres(&tree->spherePackets[tree->spherePacketCount], shapes, spheres);
+        tree->leafPacket[offset] = BVH_PACKET_ENTRY(tree->spherePacketCount, true, spheres);
+        tree->spherePacketCount++;
+        tree->stats.packedSpheres += spheres;
+    }
+}
+
+void bvhPackLeaves(bvh* tree)
+{
+    dropPackets(tree);
+    tree->packed = true;
+    if(tree->primitiveCount == 0)
+        return;
+    tree->leafPacket = calloc(tree->primitiveCount, sizeof(uint32_t));
+    // Wide leaves are what traversal reaches, the binary nodes may be gone
+    if(tree->wideNodes != NULL)
+        wideBVHPackLeaves(tree);
+    else
+    {
+        for(uint32_t i = 0; i < tree->nodeCount; i++)
+        {
+            if(tree->nodes[i].count > 0)
+                bvhPackLeaf(tree, tree->nodes[i].offset, tree->nodes[i].count);
+        }
+    }
+    // Packing moved primitives to the front of their leaves
+    bvhSyncPrimitives(tree);
+}
+
+void bvhSyncPrimitives(bvh* tree)
+{
+    cleanPrimitiveStore(&tree->store);
+    tree->store = createPrimitiveStore();
+    tree->ids = realloc(tree->ids, (tree->primitiveCount > 0 ? tree->primitiveCount : 1) * sizeof(primitiveId));
+    for(uint32_t i = 0; i < tree->primitiveCount; i++)
+        tree->ids[i] = primitiveStoreAddObject(tree->store, tree->primitives[i]);
+}
+
+void refitBVH(bvh* tree)
+{
+    bool compressed = tree->compressed;
+    detachMapping(tree);
+    if(!restoreBinaryNodes(tree))
+        refitNodes(tree);
+    tree->stats.sahCost = bvhSAHCost(tree);
+    if(tree->width != BVH2)
+        collapseBVH(tree, tree->width);
+    if(compressed)
+        compressBVH(tree);
+    // Either way the store picks up the moved shapes
+    if(tree->packed)
+        bvhPackLeaves(tree);
+    else
+        bvhSyncPrimitives(tree);
+}
+
+/**
+* Refits the tree after primitives moved and rebuilds whatever degraded too far.
+* The topmost subtrees whose SAH cost grew by BVH_PARTIAL_REBUILD_RATIO are rebuilt on
+* their own, the whole tree once its cost grew by BVH_FULL_REBUILD_RATIO.
+*/
+bvhUpdateResult bvhUpdate(bvh* tree)
+{
+    double start = getTimeSeconds();
+    bvhUpdateResult result = BVH_REFIT;
+    bool compressed = tree->compressed;
+    detachMapping(tree);
+    if(restoreBinaryNodes(tree))
+    {
+        result = BVH_FULL_REBUILD;
+    }
+    else if(tree->nodeCount > 0)
+    {
+        refitNodes(tree);
+        float* cost = malloc(tree->nodeCount * sizeof(float));
+        subtreeCosts(tree, 0, tree->nodeCount, cost);
+        if(tree->referenceCost == NULL || cost[0] > BVH_FULL_REBUILD_RATIO * tree->referenceCost[0])
+        {
+            rebuildSubtree(tree, 0, tree->nodeCount, 0, tree->primitiveCount);
+            result = BVH_FULL_REBUILD;
+        }
+        else
+        {
+            uint32_t* rebuild = malloc(tree->nodeCount * sizeof(uint32_t));
+            uint32_t rebuildCount = 0;
+            uint32_t i = 0;
+            while(i < tree->nodeCount)
+            {
+                if(tree->nodes[i].count != 1 && cost[i] > BVH_PARTIAL_REBUILD_RATIO * tree->referenceCost[i])
+                {
+                    rebuild[rebuildCount++] = i;
+                    i = subtreeEnd(tree, i);
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            // Back to front so splicing never moves a subtree still waiting its turn
+            while(rebuildCount > 0)
+            {
+                uint32_t index = rebuild[--rebuildCount];
+                uint32_t pStart, pEnd;
+                subtreePrimitives(tree, index, &pStart, &pEnd);
+                rebuildSubtree(tree, index, subtreeEnd(tree, index), pStart, pEnd);
+                result = BVH_PARTIAL_REBUILD;
+            }
+            free(rebuild);
+        }
+        free(cost);
+    }
+    if(tree->width != BVH2)
+        collapseBVH(tree, tree->width);
+    refreshStats(tree);
+    if(compressed)
+        compressBVH(tree);
+    if(tree->packed)
+        bvhPackLeaves(tree);
+    else
+        bvhSyncPrimitives(tree);
+    tree->stats.updateTime = getTimeSeconds() - start;
+    tree->stats.refits++;
+    if(result == BVH_PARTIAL_REBUILD)
+        tree->stats.partialRebuilds++;
+    else if(result == BVH_FULL_REBUILD)
+        tree->stats.fullRebuilds++;
+    return result;
+}
+
+static void removePrimitiveSlot(bvh* tree, uint32_t pos)
+{
+    memmove(tree->primitives + pos, tree->primitives + pos + 1, (tree->primitiveCount - pos - 1) * sizeof(object*));
+    tree->primitiveCount--;
+    for(uint32_t i = 0; i < tree->nodeCount; i++)
+    {
+        if(tree->nodes[i].count > 0 && tree->nodes[i].offset > pos)
+            tree->nodes[i].offset--;
+    }
+}
+
+/**
+* Adds a primitive to the leaf whose bounds grow the least.
+* Like any other edit, call bvhUpdate before tracing again.
+*/
+void bvhInsert(bvh* tree, const object* obj)
+{
+    detachMapping(tree);
+    restoreBinaryNodes(tree);
+    dropPackets(tree);
+    aabb box;
+    obj->bounds(obj, &box);
+    tree->primitives = realloc(tree->primitives, (tree->primitiveCount + 1) * sizeof(object*));
+    if(tree->nodeCount == 0)
+    {
+        tree->nodes = realloc(tree->nodes, sizeof(bvhNode));
+        tree->nodes[0] = (bvhNode){.bounds = box, .offset = 0, .count = 1, .axis = 0};
+        tree->nodeCount = 1;
+        tree->primitives[0] = obj;
+        tree->primitiveCount = 1;
+        bvhSyncPrimitives(tree);
+        bvhResetQuality(tree);
+        refreshStats(tree);
+        return;
+    }
+
+    uint32_t index = 0;
+    while(tree->nodes[index].count == 0)
+    {
+        bvhNode* node = &tree->nodes[index];
+        aabbExtend(&node->bounds, &box);
+        uint32_t children[2] = {index + 1, node->offset};
+        float growth[2];
+        for(int c = 0; c < 2; c++)
+        {
+            aabb grown = tree->nodes[children[c]].bounds;
+            aabbExtend(&grown, &box);
+            growth[c] = aabbSurfaceArea(&grown) - aabbSurfaceArea(&tree->nodes[children[c]].bounds);
+        }
+        index = growth[0] <= growth[1] ? children[0] : children[1];
+    }
+
+    bvhNode* leaf = &tree->nodes[index];
+    aabbExtend(&leaf->bounds, &box);
+    uint32_t pos = leaf->offset + leaf->count;
+    memmove(tree->primitives + pos + 1, tree->primitives + pos, (tree->primitiveCount - pos) * sizeof(object*));
+    tree->primitives[pos] = obj;
+    tree->primitiveCount++;
+    for(uint32_t i = 0; i < tree->nodeCount; i++)
+    {
+        if(i != index && tree->nodes[i].count > 0 && tree->nodes[i].offset >= pos)
+            tree->nodes[i].offset++;
+    }
+    leaf->count++;
+    if(leaf->count > BVH_MAX_LEAF)
+        rebuildSubtree(tree, index, index + 1, leaf->offset, leaf->offset + leaf->count);
+    refreshStats(tree);
+    // Keep repeated inserts into one region from outgrowing the traversal stack
+    if(tree->stats.maxDepth >= BVH_STACK_SIZE / 2)
+    {
+        rebuildSubtree(tree, 0, tree->nodeCount, 0, tree->primitiveCount);
+        refreshStats(tree);
+    }
+    bvhSyncPrimitives(tree);
+}
+
+/**
+* Takes a primitive out of the tree, the caller still owns the object.
+* A leaf left empty is folded away by rebuilding its parent's subtree.
+*/
+bool bvhRemove(bvh* tree, const object* obj)
+{
+    uint32_t pos = 0;
+    while(pos < tree->primitiveCount && tree->primitives[pos] != obj)
+        pos++;
+    if(pos == tree->primitiveCount)
+        return false;
+    detachMapping(tree);
+    restoreBinaryNodes(tree);
+    dropPackets(tree);
+
+    uint32_t leaf = 0;
+    while(tree->nodes[leaf].count == 0 || pos < tree->nodes[leaf].offset || pos >= tree->nodes[leaf].offset + tree->nodes[leaf].count)
+        leaf++;
+
+    if(tree->nodes[leaf].count > 1 || leaf == 0)
+    {
+        removePrimitiveSlot(tree, pos);
+        tree->nodes[leaf].count--;
+        if(tree->nodes[leaf].count == 0)
+            tree->nodeCount = 0;
+        bvhSyncPrimitives(tree);
+        refreshStats(tree);
+        return true;
+    }
+
+    uint32_t parent = 0;
+    while(tree->nodes[parent].count > 0 || (parent + 1 != leaf && tree->nodes[parent].offset != leaf))
+        parent++;
+    uint32_t end = subtreeEnd(tree, parent);
+    uint32_t pStart, pEnd;
+    subtreePrimitives(tree, parent, &pStart, &pEnd);
+    removePrimitiveSlot(tree, pos);
+    rebuildSubtree(tree, parent, end, pStart, pEnd - 1);
+    bvhSyncPrimitives(tree);
+    refreshStats(tree);
+    return true;
+}
+
+size_t bvhMemoryUsage(const bvh* tree)
+{
+    size_t bytes = tree->primitiveCount * (sizeof(object*) + sizeof(primitiveId));
+    if(tree->store != NULL)
+        bytes += primitiveStoreMemoryUsage(tree->store);
+    if(tree->nodes != NULL)
+        bytes += tree->nodeCount * sizeof(bvhNode);
+    if(tree->compressed)
+        bytes += tree->wideNodeCount * compressedBVHNodeSize(tree->width);
+    else if(tree->width != BVH2)
+        bytes += tree->wideNodeCount * wideBVHNodeSize(tree->width);
+    if(tree->leafPacket != NULL)
+        bytes += tree->packetCount * sizeof(trianglePacket) + tree->spherePacketCount * sizeof(spherePacket) +
+                 tree->primitiveCount * sizeof(uint32_t);
+    return bytes;
+}
+
+void printBVHStats(const bvh* tree)
+{
+    printf(KRED"bvh%d["KBLU"primitives:"KGRN"%u ", tree->width, tree->primitiveCount);
+    printf(KBLU"nodes:"KGRN"%u ", tree->stats.nodeCount);
+    if(tree->width != BVH2)
+    {
+        printf(KBLU"wide nodes:"KGRN"%u ", tree->stats.wideNodeCount);
+        printf(KBLU"collapse:"KGRN"%4.4fms ", tree->stats.collapseTime * 1000.0);
+    }
+    if(tree->compressed)
+        printf(KBLU"compressed "KNRM);
+    printf(KBLU"bytes:"KGRN"%zu ", bvhMemoryUsage(tree));
+    if(tree->primitiveCount > 0)
+        printf(KBLU"bytes/primitive:"KGRN"%4.1f ", (double)bvhMemoryUsage(tree) / tree->primitiveCount);
+    printf(KBLU"leaves:"KGRN"%u ", tree->stats.leafCount);
+    if(tree->packetCount > 0)
+        printf(KBLU"packets(%s):"KGRN"%u(%u triangles) ", trianglePacketKernelName(), tree->packetCount, tree->stats.packedTriangles);
+    if(tree->spherePacketCount > 0)
+        printf(KBLU"sphere packets:"KGRN"%u(%u spheres) ", tree->spherePacketCount, tree->stats.packedSpheres);
+    printf(KBLU"depth:"KGRN"%u ", tree->stats.maxDepth);
+    printf(KBLU"sah:"KGRN"%4.4f ", tree->stats.sahCost);
+    if(tree->stats.refits > 0)
+    {
+        printf(KBLU"updates:"KGRN"%u(%u partial, %u full) ", tree->stats.refits, tree->stats.partialRebuilds, tree->stats.fullRebuilds);
+        printf(KBLU"last update:"KGRN"%4.4fms ", tree->stats.updateTime * 1000.0);
+    }
+    if(tree->stats.cached)
+        printf(KBLU"cache load:"KGRN"%4.4fms ", tree->stats.loadTime * 1000.0);
+    printf(KBLU"build(%s, %u threads):"KGRN"%4.4fms"KRED"]\n"KNRM, tree->stats.builder == BVH_LBVH ? "lbvh" : "sah",
+           tree->stats.buildThreads, tree->stats.buildTime * 1000.0);
+}
+
+void cleanBVH(bvh** tree)
+{
+    if(*tree == NULL)
+        return;
+    if((*tree)->mapping != NULL)
+        munmap((*tree)->mapping, (*tree)->mappingSize);
+    else
+        free((*tree)->nodes);
+    free((*tree)->wideNodes);
+    free((*tree)->referenceCost);
+    free((*tree)->packets);
+    free((*tree)->spherePackets);
+    free((*tree)->leafPacket);
+    free((*tree)->primitives);
+    free((*tree)->ids);
+    cleanPrimitiveStore(&(*tree)->store);
+    free(*tree);
+    *tree = NULL;
+}
@@ -0,0 +1,292 @@
+#include <rayTracerCore/bvhcache.h>
+#include <rayTracerCore/shapes/ellipsoid.h>
+#include <rayTracerCore/shapes/triangle.h>
+#include <rayTracerCore/shapes/instance.h>
+#include <rayTracerCore/shapes/mesh.h>
+#include <rayTracerCore/shapes/plane.h>
+#include <rayTracerCore/shapes/box.h>
+#include <rayTracerCore/shapes/pagedmesh.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct
+{
+    const object* obj;
+    uint32_t index;
+} objectIndex;
+
+static uint64_t hashObject(uint64_t hash, const object* obj)
+{
+    hash = fnv1a64(hash, &obj->type, sizeof(obj->type));
+    hash = fnv1a64(hash, obj->mat.color, sizeof(obj->mat.color));
+    hash = fnv1a64(hash, &obj->mat.reflect, sizeof(obj->mat.reflect));
+    switch(obj->type)
+    {
+    case SPHERE:
+    case ELLIPSOID:
+        hash = fnv1a64(hash, obj->shape, sizeof(ellipsoid_t));
+        break;
+    case TRIANGLE:
+        hash = fnv1a64(hash, obj->shape, sizeof(triangle_t));
+        break;
+    case PLANE:
+        hash = fnv1a64(hash, obj->shape, sizeof(plane_t));
+        break;
+    case QUAD:
+        hash = fnv1a64(hash, obj->shape, sizeof(parallelogram_t));
+        break;
+    case BOX:
+        hash = fnv1a64(hash, obj->shape, sizeof(box_t));
+        break;
+    case INSTANCE:
+    {
+        const instance_t* inst = obj->shape;
+        hash = fnv1a64(hash, &inst->objectToWorld, sizeof(transform));
+        hash = fnv1a64(hash, &inst->overrideMat, sizeof(inst->overrideMat));
+        for(const object* child = inst->geometry->objects; child != NULL; child = child->next)
+            hash = hashObject(hash, child);
+        break;
+    }
+    case MESH:
+    {
+        const mesh_t* m = obj->shape;
+        hash = fnv1a64(hash, m->vertices, m->vertexCount * sizeof(point3f));
+        hash = fnv1a64(hash, m->indices, m->triangleCount * 3 * sizeof(uint32_t));
+        if(m->normals != NULL)
+            hash = fnv1a64(hash, m->normals, m->vertexCount * sizeof(vector3f));
+        break;
+    }
+    case PAGED_MESH:
+    {
+        // The pages are not read for this, the top level and page table pin down the file well enough
+        const pagedMesh_t* pm = obj->shape;
+        hash = fnv1a64(hash, pm->top, pm->topNodeCount * sizeof(bvhNode));
+        hash = fnv1a64(hash, pm->pages, pm->pageCount * sizeof(pagedMeshPageRecord));
+        break;
+    }
+    }
+    return hash;
+}
+
+uint64_t bvhCacheKey(const object* list, bvhBuilder builder, const lbvhOptions* options)
+{
+    uint32_t settings[6] = {BVH_CACHE_VERSION, BVH_BINS, BVH_MAX_LEAF, builder, 0, 0};
+    if(builder == BVH_LBVH && options != NULL)
+    {
+        assert(options->mortonBits == 30 || options->mortonBits == 63);
+        settings[4] = options->mortonBits;
+        settings[5] = options->treeletRounds;
+    }
+    uint64_t hash = fnv1a64(FNV1A_SEED, settings, sizeof(settings));
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        hash = hashObject(hash, obj);
+    return hash;
+}
+
+static int compareObjectIndex(const void* a, const void* b)
+{
+    const object* x = ((const objectIndex*)a)->obj;
+    const object* y = ((const objectIndex*)b)->obj;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + BVH_CACHE_ALIGN - 1) & ~(uint64_t)(BVH_CACHE_ALIGN - 1);
+}
+
+bool saveBVHCache(const char* path, const bvh* tree, const object* list, uint64_t key)
+{
+    uint32_t count = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        count++;
+    if(count != tree->primitiveCount || tree->nodes == NULL)
+        return false;
+
+    // Pointers become list positions through a sorted lookup table
+    objectIndex* lookup = malloc(count * sizeof(objectIndex));
+    uint32_t i = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next, i++)
+    {
+        lookup[i].obj = obj;
+        lookup[i].index = i;
+    }
+    qsort(lookup, count, sizeof(objectIndex), compareObjectIndex);
+    uint32_t* indices = malloc(count * sizeof(uint32_t));
+    for(i = 0; i < count; i++)
+    {
+        objectIndex needle = {.obj = tree->primitives[i]};
+        objectIndex* found = bsearch(&needle, lookup, count, sizeof(objectIndex), compareObjectIndex);
+        if(found == NULL)
+        {
+            free(lookup);
+            free(indices);
+            return false;
+        }
+        indices[i] = found->index;
+    }
+    free(lookup);
+
+    bvhCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BVH_CACHE_MAGIC;
+    header.version = BVH_CACHE_VERSION;
+    header.key = key;
+    header.nodeSize = sizeof(bvhNode);
+    header.nodeCount = tree->nodeCount;
+    header.primitiveCount = count;
+    header.builder = tree->stats.builder;
+    header.buildThreads = tree->stats.buildThreads;
+    header.leafCount = tree->stats.leafCount;
+    header.maxDepth = tree->stats.maxDepth;
+    header.sahCost = tree->stats.sahCost;
+    header.buildTime = tree->stats.buildTime;
+    header.nodesOffset = alignOffset(sizeof(header));
+    header.primitivesOffset = alignOffset(header.nodesOffset + (uint64_t)tree->nodeCount * sizeof(bvhNode));
+    header.fileSize = header.primitivesOffset + (uint64_t)count * sizeof(uint32_t);
+
+    // Written next to the target and renamed over it so readers never map a half written file
+    size_t tmpLength = strlen(path) + 5;
+    char* tmpPath = malloc(tmpLength);
+    snprintf(tmpPath, tmpLength, "%s.tmp", path);
+    FILE* f = fopen(tmpPath, "wb");
+    bool ok = f != NULL;
+    if(ok)
+    {
+        static const char padding[BVH_CACHE_ALIGN] = {0};
+        ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = ok && fwrite(padding, header.nodesOffset - sizeof(header), 1, f) <= 1;
+        ok = ok && fwrite(tree->nodes, sizeof(bvhNode), tree->nodeCount, f) == tree->nodeCount;
+        ok = ok && fwrite(padding, header.primitivesOffset - header.nodesOffset - tree->nodeCount * sizeof(bvhNode), 1, f) <= 1;
+        ok = ok && fwrite(indices, sizeof(uint32_t), count, f) == count;
+        ok = (fclose(f) == 0) && ok;
+        ok = ok && rename(tmpPath, path) == 0;
+        if(!ok)
+            remove(tmpPath);
+    }
+    free(tmpPath);
+    free(indices);
+    return ok;
+}
+
+static bool validHeader(const bvhCacheHeader* header, size_t size)
+{
+    return header->fileSize == size &&
+           header->nodeSize == sizeof(bvhNode) &&
+           header->nodesOffset % BVH_CACHE_ALIGN == 0 &&
+           header->nodesOffset >= sizeof(bvhCacheHeader) &&
+           header->nodesOffset + (uint64_t)header->nodeCount * sizeof(bvhNode) <= header->primitivesOffset &&
+           header->primitivesOffset + (uint64_t)header->primitiveCount * sizeof(uint32_t) <= size &&
+           (header->nodeCount == 0) == (header->primitiveCount == 0);
+}
+
+bvh* loadBVHCache(const char* path, const object* list, uint64_t key, bvhCacheStatus* status)
+{
+    double start = getTimeSeconds();
+    *status = BVH_CACHE_MISSING;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(bvhCacheHeader))
+    {
+        close(fd);
+        *status = BVH_CACHE_INVALID;
+        return NULL;
+    }
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        *status = BVH_CACHE_INVALID;
+        return NULL;
+    }
+
+    const bvhCacheHeader* header = mapping;
+    *status = BVH_CACHE_INVALID;
+    if(header->magic != BVH_CACHE_MAGIC || header->version != BVH_CACHE_VERSION || !validHeader(header, size))
+    {
+        munmap(mapping, size);
+        return NULL;
+    }
+    uint32_t count = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        count++;
+    if(header->key != key || header->primitiveCount != count)
+    {
+        *status = BVH_CACHE_STALE;
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    const object** objects = malloc(count * sizeof(object*));
+    uint32_t i = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next, i++)
+        objects[i] = obj;
+    const uint32_t* indices = (const uint32_t*)((const char*)mapping + header->primitivesOffset);
+    const object** primitives = malloc(count * sizeof(object*));
+    for(i = 0; i < count; i++)
+    {
+        if(indices[i] >= count)
+        {
+            free(objects);
+            free(primitives);
+            munmap(mapping, size);
+            return NULL;
+        }
+        primitives[i] = objects[indices[i]];
+    }
+    free(objects);
+    const bvhNode* nodes = (const bvhNode*)((const char*)mapping + header->nodesOffset);
+    if(!bvhValidNodes(nodes, header->nodeCount, count))
+    {
+        free(primitives);
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    bvh* tree = calloc(1, sizeof(bvh));
+    tree->nodes = (bvhNode*)nodes;
+    tree->nodeCount = header->nodeCount;
+    tree->primitives = primitives;
+    tree->primitiveCount = count;
+    bvhSyncPrimitives(tree);
+    tree->width = BVH2;
+    tree->mapping = mapping;
+    tree->mappingSize = size;
+    tree->stats.builder = (bvhBuilder)header->builder;
+    tree->stats.buildThreads = header->buildThreads;
+    tree->stats.buildTime = header->buildTime;
+    tree->stats.nodeCount = header->nodeCount;
+    tree->stats.leafCount = header->leafCount;
+    tree->stats.maxDepth = header->maxDepth;
+    tree->stats.sahCost = header->sahCost;
+    tree->stats.cached = true;
+    tree->stats.loadTime = getTimeSeconds() - start;
+    *status = BVH_CACHE_HIT;
+    return tree;
+}
+
+bvh* cachedBVH(const char* path, const object* list, bvhBuilder builder, const lbvhOptions* options)
+{
+    uint64_t key = bvhCacheKey(list, builder, options);
+    bvhCacheStatus status;
+    bvh* tree = loadBVHCache(path, list, key, &status);
+    if(tree != NULL)
+        return tree;
+
+    static const char* reasons[] = {"hit", "missing", "stale", "invalid"};
+    printf(KYEL"bvh cache %s %s, rebuilding\n"KNRM, path, reasons[status]);
+    tree = builder == BVH_LBVH ? buildLBVH(list, options != NULL ? options : &LBVH_DEFAULTS) : buildBVH(list);
+    if(!saveBVHCache(path, tree, list, key))
+        printf(KRED"bvh cache %s could not be written\n"KNRM, path);
+    return tree;
+}
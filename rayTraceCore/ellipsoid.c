@@ -7,74 +7,105 @@
 
 bool ellipsoidTestHit(const ray r, const object *obj)
 {
-    ellipsoid_t e = *((ellipsoid_t*)(obj->shape));
-    float invasq, invbsq, invcsq;
-    invasq = 1.0f/(e.a*e.a);
-    invbsq = 1.0f/(e.b*e.b);
-    invcsq = 1.0f/(e.c*e.c);
-    vector3f origin = {};
-    vector3f_sub_new(origin, r.origin, e.center);
-    float A = r.dir[0]*r.dir[0]* invasq + r.dir[1]*r.dir[1]* invbsq + r.dir[2]*r.dir[2]* invcsq;
-    float B = 2*(r.dir[0]*origin[0]* invasq + r.dir[1]*origin[1]* invbsq + r.dir[2]*origin[2]* invcsq);
-    float C = (origin[0]*origin[0]* invasq + origin[1]*origin[1]* invbsq + origin[2]*origin[2]* invcsq) - 1;
-
-    float t0,t1;
-    if(!quadratic(A, B, C, &t0, &t1))
-        return false;
+    float t;
+    return ellipsoidIntersect(&r, obj->shape, &t);
+}
 
-    if (t0 > r.tmax || t1 < r.tmin)
+bool ellipsoidHit(const ray r, const object *obj, float *time, rayHit *rayH)
+{
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    float thit;
+    if(!ellipsoidIntersect(&r, obj->shape, &thit))
         return false;
-    float thit = t0;
-    if (t0 < r.tmin) {
-        thit = t1;
-        if (thit > r.tmax) return false;
-    }
+
+    *time = thit;
+    ellipsoidSurface(r, obj->shape, obj->mat, thit, rayH);
     return true;
 }
 
+bool ellipsoidHitTime(const ray *r, const object *obj, float *time, hitPath *path)
+{
+    (void)path;
+    return ellipsoidIntersect(r, obj->shape, time);
+}
 
+void ellipsoidHitRecord(const ray r, const object *obj, float t, const hitPath *path, rayHit *rayH)
+{
+    (void)path;
+    ellipsoidSurface(r, obj->shape, obj->mat, t, rayH);
+}
 
-bool ellipsoidHit(const ray r, const object *obj, float *time, rayHit *rayH)
+void ellipsoidSurface(const ray r, const ellipsoid_t *e, const material mat, float t, rayHit *rayH)
+{
+    rayH->hit = true;
+    rayH->mat = mat;
+    vector3f dirOffset = {};
+    vector3f_scaleMul_new(dirOffset, r.dir, t);
+    vector3f_add_new(rayH->location, r.origin, dirOffset);
+    float normalX = 2 * (rayH->location[0] - e->center[0])*e->invRadiusSq[0];
+    float normalY = 2 * (rayH->location[1] - e->center[1])*e->invRadiusSq[1];
+    float normalZ = 2 * (rayH->location[2] - e->center[2])*e->invRadiusSq[2];
+    vector3f_set(rayH->normal, normalX, normalY, normalZ);
+    vector3f_normalize(rayH->normal);
+    rayH->originRay = r;
+    rayH->offsetError = .1;
+}
+
+bool sphereTestHit(const ray r, const object *obj)
+{
+    float t;
+    return sphereIntersect(&r, obj->shape, &t);
+}
+
+bool sphereHit(const ray r, const object *obj, float *time, rayHit *rayH)
 {
     rayH->hit = false;
     rayH->mat = EMPTYNESS;
-    ellipsoid_t e = *((ellipsoid_t*)(obj->shape));
-    float invasq, invbsq, invcsq;
-    invasq = 1.0f/(e.a*e.a);
-    invbsq = 1.0f/(e.b*e.b);
-    invcsq = 1.0f/(e.c*e.c);
-    vector3f origin = {};
-    vector3f_sub_new(origin, r.origin, e.center);
-    float A = r.dir[0]*r.dir[0]* invasq + r.dir[1]*r.dir[1]* invbsq + r.dir[2]*r.dir[2]* invcsq;
-    float B = 2*(r.dir[0]*origin[0]* invasq + r.dir[1]*origin[1]* invbsq + r.dir[2]*origin[2]* invcsq);
-    float C = (origin[0]*origin[0]* invasq + origin[1]*origin[1]* invbsq + origin[2]*origin[2]* invcsq) - 1;
-
-    float t0,t1;
-    if(!quadratic(A, B, C, &t0, &t1))
+    float t;
+    if(!sphereIntersect(&r, obj->shape, &t))
         return false;
 
-    if (t0 > r.tmax || t1 < r.tmin)
-        return false;
-    float thit = t0;
-    if (t0 < r.tmin) {
-        thit = t1;
-        if (thit > r.tmax) return false;
-    }
+    *time = t;
+    sphereHitRecord(r, obj, t, NULL, rayH);
+    return true;
+}
 
-    *time = thit;
+bool sphereHitTime(const ray *r, const object *obj, float *time, hitPath *path)
+{
+    (void)path;
+    return sphereIntersect(r, obj->shape, time);
+}
+
+void sphereHitRecord(const ray r, const object *obj, float t, const hitPath *path, rayHit *rayH)
+{
+    (void)path;
+    sphereSurface(r, obj->shape, obj->mat, t, rayH);
+}
+
+void sphereSurface(const ray r, const ellipsoid_t *e, const material mat, float t, rayHit *rayH)
+{
     rayH->hit = true;
-    rayH->mat = obj->mat;
+    rayH->mat = mat;
     vector3f dirOffset = {};
-    vector3f_scaleMul_new(dirOffset, r.dir, thit);
+    vector3f_scaleMul_new(dirOffset, r.dir, t);
     vector3f_add_new(rayH->location, r.origin, dirOffset);
-    float normalX = 2 * (rayH->location[0] - e.center[0])*invasq;
-    float normalY = 2 * (rayH->location[1] - e.center[1])*invbsq;
-    float normalZ = 2 * (rayH->location[2] - e.center[2])*invcsq;
-    vector3f_set(rayH->normal, normalX, normalY, normalZ);
+    vector3f_sub_new(rayH->normal, rayH->location, e->center);
     vector3f_normalize(rayH->normal);
     rayH->originRay = r;
     rayH->offsetError = .1;
-    return true;
+}
+
+void ellipsoidBounds(const object *o, aabb *box)
+{
+    ellipsoidShapeBounds(o->shape, box);
+}
+
+void ellipsoidShapeBounds(const ellipsoid_t *e, aabb *box)
+{
+    vector3f extent = {e->a, e->b, e->c};
+    vector3f_sub_new(box->min, e->center, extent);
+    vector3f_add_new(box->max, e->center, extent);
 }
 
 void ellipsoidPrint(void *s)
@@ -88,3 +119,18 @@ void ellipsoidPrint(void *s)
     printf(KCYN"]"KNRM);
 }
 
+
+void setEllipsoidCenter(object *o, const point3f center)
+{
+    ellipsoid_t* e = (ellipsoid_t*)o->shape;
+    vector3f_copy(e->center, center);
+}
+
+void setEllipsoidRadii(object *o, float a, float b, float c)
+{
+    ellipsoid_t* e = (ellipsoid_t*)o->shape;
+    e->a = a;
+    e->b = b;
+    e->c = c;
+    vector3f_set(e->invRadiusSq, 1.0f/(a*a), 1.0f/(b*b), 1.0f/(c*c));
+}
@@ -0,0 +1,121 @@
+#include <rayTracerCore/frustum.h>
+#include <util/usefulfunctions.h>
+#include <util/vector.h>
+#include <stdlib.h>
+
+/**
+* Same mapping getSampler uses, pixel coordinates are the pixel's bottom left corner
+*/
+static void viewPlaneDirection(float dir[3], const perspective p, const float right[3], float px, float py)
+{
+    float wOffset[3], hOffset[3];
+    vector3f_copy(dir, p.cam.direction);
+    vector3f_scaleMul(dir, p.viewPlaneDistance);
+    vector3f_scaleMul_new(wOffset, right, mapToRangef(px, 0, p.res_x, -p.width / 2.0f, p.width / 2.0f));
+    vector3f_scaleMul_new(hOffset, p.cam.up, mapToRangef(py, 0, p.res_y, -p.height / 2.0f, p.height / 2.0f));
+    vector3f_add(dir, wOffset);
+    vector3f_add(dir, hOffset);
+}
+
+void buildTileFrustum(frustum* f, const perspective p, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1)
+{
+    float right[3];
+    getCameraRightVector(right, p.cam);
+    float xs[2] = {(float)x0 - 1, (float)x1 + 1};
+    float ys[2] = {(float)y0 - 1, (float)y1 + 1};
+    // Walk the corners in order so neighbours share an edge
+    float corner[4][3];
+    viewPlaneDirection(corner[0], p, right, xs[0], ys[0]);
+    viewPlaneDirection(corner[1], p, right, xs[1], ys[0]);
+    viewPlaneDirection(corner[2], p, right, xs[1], ys[1]);
+    viewPlaneDirection(corner[3], p, right, xs[0], ys[1]);
+    float center[3];
+    viewPlaneDirection(center, p, right, .5f * (xs[0] + xs[1]), .5f * (ys[0] + ys[1]));
+
+    for(int i = 0; i < 4; i++)
+    {
+        vector3f_cross_new(f->normal[i], corner[i], corner[(i + 1) % 4]);
+        if(vector3f_dot(f->normal[i], center) < 0)
+            vector3f_scaleMul(f->normal[i], -1);
+        f->d[i] = -vector3f_dot(f->normal[i], p.cam.origin);
+    }
+    // Primary rays start at the camera so nothing behind it is ever hit
+    vector3f_copy(f->normal[4], p.cam.direction);
+    f->d[4] = -vector3f_dot(f->normal[4], p.cam.origin);
+    vector3f_copy(f->origin, p.cam.origin);
+    vector3f_normalize_new(f->direction, center);
+}
+
+void resetFrustumCull(frustumCull* cull, unsigned int total)
+{
+    cull->primitiveCount = 0;
+    cull->subtreeCount = 0;
+    cull->total = total;
+    cull->kept = 0;
+}
+
+void frustumCullAddPrimitive(frustumCull* cull, const object* obj)
+{
+    if(cull->primitiveCount == cull->primitiveCapacity)
+    {
+        cull->primitiveCapacity = cull->primitiveCapacity ? cull->primitiveCapacity * 2 : 64;
+        cull->primitives = realloc(cull->primitives, cull->primitiveCapacity * sizeof(object*));
+    }
+    cull->primitives[cull->primitiveCount++] = obj;
+    cull->kept++;
+}
+
+void frustumCullAddSubtree(frustumCull* cull, const frustum* f, uint32_t node, const aabb* bounds, unsigned int primitives)
+{
+    if(cull->subtreeCount == cull->subtreeCapacity)
+    {
+        cull->subtreeCapacity = cull->subtreeCapacity ? cull->subtreeCapacity * 2 : FRUSTUM_MAX_SUBTREES;
+        cull->subtrees = realloc(cull->subtrees, cull->subtreeCapacity * sizeof(uint32_t));
+        cull->depth = realloc(cull->depth, cull->subtreeCapacity * sizeof(float));
+    }
+    // The corner nearest along direction
+    float near = 0;
+    for(int i = 0; i < 3; i++)
+        near += f->direction[i] * ((f->direction[i] >= 0 ? bounds->min[i] : bounds->max[i]) - f->origin[i]);
+    cull->subtrees[cull->subtreeCount] = node;
+    cull->depth[cull->subtreeCount] = near;
+    cull->subtreeCount++;
+    cull->kept += primitives;
+}
+
+void sortFrustumCull(frustumCull* cull)
+{
+    // Few enough per tile that insertion sort wins
+    for(unsigned int i = 1; i < cull->subtreeCount; i++)
+    {
+        uint32_t node = cull->subtrees[i];
+        float depth = cull->depth[i];
+        unsigned int j = i;
+        for(; j > 0 && cull->depth[j - 1] > depth; j--)
+        {
+            cull->subtrees[j] = cull->subtrees[j - 1];
+            cull->depth[j] = cull->depth[j - 1];
+        }
+        cull->subtrees[j] = node;
+        cull->depth[j] = depth;
+    }
+}
+
+float frustumCullRatio(const frustumCull* cull)
+{
+    if(cull->total == 0)
+        return 0;
+    return 1.f - (float)cull->kept / cull->total;
+}
+
+void cleanFrustumCull(frustumCull* cull)
+{
+    free(cull->primitives);
+    free(cull->subtrees);
+    free(cull->depth);
+    cull->primitives = NULL;
+    cull->subtrees = NULL;
+    cull->depth = NULL;
+    cull->primitiveCount = cull->primitiveCapacity = 0;
+    cull->subtreeCount = cull->subtreeCapacity = 0;
+}
@@ -3,6 +3,11 @@
 #include <rayTracerCore/shapes/ellipsoid.h>
 #include <stdlib.h>
 #include <rayTracerCore/shapes/triangle.h>
+#include <rayTracerCore/shapes/mesh.h>
+#include <rayTracerCore/shapes/instance.h>
+#include <rayTracerCore/shapes/plane.h>
+#include <rayTracerCore/shapes/box.h>
+#include <rayTracerCore/shapes/pagedmesh.h>
 
 void printObject(const object o)
 {
@@ -29,21 +34,104 @@ void printObjectList(const object* o)
     }
 }
 
+void initObject(object* o, geoEnum type, const material mat, void* shape)
+{
+    o->type = type;
+    o->mat = mat;
+    o->shape = shape;
+    o->next = NULL;
+    switch(type)
+    {
+    case SPHERE:
+        o->print = ellipsoidPrint;
+        o->hit = sphereHit;
+        o->intersect = sphereHitTime;
+        o->surface = sphereHitRecord;
+        o->test = sphereTestHit;
+        o->bounds = ellipsoidBounds;
+        break;
+    case ELLIPSOID:
+        o->print = ellipsoidPrint;
+        o->hit = ellipsoidHit;
+        o->intersect = ellipsoidHitTime;
+        o->surface = ellipsoidHitRecord;
+        o->test = ellipsoidTestHit;
+        o->bounds = ellipsoidBounds;
+        break;
+    case TRIANGLE:
+        o->print = trianglePrint;
+        o->hit = triangleHit;
+        o->intersect = triangleHitTime;
+        o->surface = triangleHitRecord;
+        o->test = triangleTestHit;
+        o->bounds = triangleBounds;
+        break;
+    case INSTANCE:
+        o->print = instancePrint;
+        o->hit = instanceHit;
+        o->intersect = instanceHitTime;
+        o->surface = instanceHitRecord;
+        o->test = instanceTestHit;
+        o->bounds = instanceBounds;
+        break;
+    case MESH:
+        o->print = meshPrint;
+        o->hit = meshHit;
+        o->intersect = meshHitTime;
+        o->surface = meshHitRecord;
+        o->test = meshTestHit;
+        o->bounds = meshBounds;
+        break;
+    case PLANE:
+        o->print = planePrint;
+        o->hit = planeHit;
+        o->intersect = planeHitTime;
+        o->surface = planeHitRecord;
+        o->test = planeTestHit;
+        o->bounds = planeBounds;
+        break;
+    case QUAD:
+        o->print = quadPrint;
+        o->hit = quadHit;
+        o->intersect = quadHitTime;
+        o->surface = quadHitRecord;
+        o->test = quadTestHit;
+        o->bounds = quadBounds;
+        break;
+    case BOX:
+        o->print = boxPrint;
+        o->hit = boxHit;
+        o->intersect = boxHitTime;
+        o->surface = boxHitRecord;
+        o->test = boxTestHit;
+        o->bounds = boxBounds;
+        break;
+    case PAGED_MESH:
+        o->print = pagedMeshPrint;
+        o->hit = pagedMeshHit;
+        o->intersect = pagedMeshHitTime;
+        o->surface = pagedMeshHitRecord;
+        o->test = pagedMeshTestHit;
+        o->bounds = pagedMeshBounds;
+        break;
+    }
+}
+
 object* createSphere(const material mat, const float radius, const point3f center)
 {
     object* ret = malloc(sizeof(object));
-    ret->mat = mat;
-    ret->shape = malloc(sizeof(ellipsoid_t));
-    ellipsoid_t * sph = (ellipsoid_t *)ret->shape;
-    vector3f_copy(sph->center, center);
-    sph->a = radius;
-    sph->b = radius;
-    sph->c = radius;
-    ret->print = ellipsoidPrint;
-    ret->hit = ellipsoidHit;
-    ret->test = ellipsoidTestHit;
-    ret->type = SPHERE;
-    ret->next = NULL;
+    initObject(ret, SPHERE, mat, malloc(sizeof(ellipsoid_t)));
+    setEllipsoidCenter(ret, center);
+    setEllipsoidRadii(ret, radius, radius, radius);
+    return ret;
+}
+
+object* createEllipsoid(const material mat, const vector3f radii, const point3f center)
+{
+    object* ret = malloc(sizeof(object));
+    initObject(ret, ELLIPSOID, mat, malloc(sizeof(ellipsoid_t)));
+    setEllipsoidCenter(ret, center);
+    setEllipsoidRadii(ret, radii[0], radii[1], radii[2]);
     return ret;
 }
 
@@ -51,17 +139,8 @@ object* createSphere(const material mat, const float radius, const point3f cente
 object*createTriangle(const material mat, const point3f p1, const point3f p2, const point3f p3)
 {
     object* ret = malloc(sizeof(object));
-    ret->mat = mat;
-    ret->shape = malloc(sizeof(triangle_t));
-    ret->type = TRIANGLE;
-    triangle_t* tri = (triangle_t*)ret->shape;
-    vector3f_copy(tri->a, p1);
-    vector3f_copy(tri->b, p2);
-    vector3f_copy(tri->c, p3);
-    ret->print = trianglePrint;
-    ret->hit = triangleHit;
-    ret->test = triangleTestHit;
-    ret->next = NULL;
+    initObject(ret, TRIANGLE, mat, malloc(sizeof(triangle_t)));
+    setTriangleVertices(ret, p1, p2, p3);
     return ret;
 }
 
@@ -73,7 +152,26 @@ void cleanObjectList(object** list)
     {
         object* tmp = root;
         root = root->next;
+        if(tmp->type == MESH)
+            cleanMeshBuffers(tmp->shape);
+        else if(tmp->type == PAGED_MESH)
+            cleanPagedMesh(tmp->shape);
         free(tmp->shape);
         free(tmp);
     }
-}
\ No newline at end of file
+}
+/**
+* Unlinks o without freeing it
+*/
+bool removeFromObjectList(object** list, const object* o)
+{
+    for(object** link = list; *link != NULL; link = &(*link)->next)
+    {
+        if(*link == o)
+        {
+            *link = o->next;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,303 @@
+#include <rayTracerCore/grid.h>
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID_EMPTY_MAILBOX 0xFFFFFFFFu
+
+static int clampCell(int c, int resolution)
+{
+    return c < 0 ? 0 : (c >= resolution ? resolution - 1 : c);
+}
+
+static int cellCoordinate(const grid* g, float p, int axis)
+{
+    return clampCell((int)((p - g->bounds.min[axis]) * g->invCellSize[axis]), g->resolution[axis]);
+}
+
+/**
+* Cells along each axis follow the scene's shape, scaled so there are about
+* density cells per primitive. Flat axes keep a sliver of the largest extent
+* so a planar scene still gets a sensible cell count.
+*/
+static void chooseResolution(grid* g, unsigned int count, float density)
+{
+    vector3f extent = {};
+    vector3f_sub_new(extent, g->bounds.max, g->bounds.min);
+    float maxExtent = fmaxf(extent[0], fmaxf(extent[1], extent[2]));
+    float volume = 1;
+    for(int a = 0; a < 3; a++)
+    {
+        extent[a] = fmaxf(extent[a], maxExtent * 1e-2f);
+        volume *= extent[a];
+    }
+    float cellsPerUnit = cbrtf(density * count / volume);
+    for(int a = 0; a < 3; a++)
+    {
+        int res = (int)lroundf(extent[a] * cellsPerUnit);
+        g->resolution[a] = res < 1 ? 1 : (res > GRID_MAX_RESOLUTION ? GRID_MAX_RESOLUTION : res);
+        g->cellSize[a] = extent[a] / g->resolution[a];
+        g->invCellSize[a] = 1.0f / g->cellSize[a];
+        // Flat axes were widened above, grow the bounds to match
+        float center = (g->bounds.min[a] + g->bounds.max[a]) * .5f;
+        g->bounds.min[a] = center - extent[a] * .5f;
+        g->bounds.max[a] = center + extent[a] * .5f;
+    }
+}
+
+static void primitiveCells(const grid* g, const aabb* box, int lo[3], int hi[3])
+{
+    for(int a = 0; a < 3; a++)
+    {
+        lo[a] = cellCoordinate(g, box->min[a], a);
+        hi[a] = cellCoordinate(g, box->max[a], a);
+    }
+}
+
+grid* buildGrid(const object* list, float density)
+{
+    double start = getTimeSeconds();
+    grid* g = calloc(1, sizeof(grid));
+    if(density <= 0)
+        density = GRID_DEFAULT_DENSITY;
+    unsigned int count = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        count++;
+
+    g->store = createPrimitiveStore();
+    primitiveId* ids = malloc((count > 0 ? count : 1) * sizeof(primitiveId));
+    aabb* boxes = malloc((count > 0 ? count : 1) * sizeof(aabb));
+    aabbEmpty(&g->bounds);
+    unsigned int i = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next, i++)
+    {
+        ids[i] = primitiveStoreAddObject(g->store, obj);
+        obj->bounds(obj, &boxes[i]);
+        aabbExtend(&g->bounds, &boxes[i]);
+    }
+    if(count == 0)
+        aabbExtendPoint(&g->bounds, (point3f){0, 0, 0});
+    chooseResolution(g, count > 0 ? count : 1, density);
+
+    // Count, prefix sum, then fill so the whole build stays linear in the references
+    unsigned int cells = (unsigned int)(g->resolution[0] * g->resolution[1] * g->resolution[2]);
+    g->cellStart = calloc(cells + 1, sizeof(uint32_t));
+    int lo[3], hi[3];
+    for(i = 0; i < count; i++)
+    {
+        primitiveCells(g, &boxes[i], lo, hi);
+        for(int z = lo[2]; z <= hi[2]; z++)
+            for(int y = lo[1]; y <= hi[1]; y++)
+                for(int x = lo[0]; x <= hi[0]; x++)
+                    g->cellStart[(z * g->resolution[1] + y) * g->resolution[0] + x + 1]++;
+    }
+    for(unsigned int c = 0; c < cells; c++)
+    {
+        if(g->cellStart[c + 1] == 0)
+            g->stats.emptyCells++;
+        g->cellStart[c + 1] += g->cellStart[c];
+    }
+    unsigned int references = g->cellStart[cells];
+    g->cellPrimitives = malloc((references > 0 ? references : 1) * sizeof(primitiveId));
+    uint32_t* fill = malloc(cells * sizeof(uint32_t));
+    memcpy(fill, g->cellStart, cells * sizeof(uint32_t));
+    for(i = 0; i < count; i++)
+    {
+        primitiveCells(g, &boxes[i], lo, hi);
+        for(int z = lo[2]; z <= hi[2]; z++)
+            for(int y = lo[1]; y <= hi[1]; y++)
+                for(int x = lo[0]; x <= hi[0]; x++)
+                    g->cellPrimitives[fill[(z * g->resolution[1] + y) * g->resolution[0] + x]++] = ids[i];
+    }
+    free(fill);
+    free(boxes);
+    free(ids);
+
+    g->stats.primitiveCount = count;
+    g->stats.cellCount = cells;
+    g->stats.references = references;
+    g->stats.density = density;
+    g->stats.buildTime = getTimeSeconds() - start;
+    return g;
+}
+
+typedef struct
+{
+    int cell[3];
+    int step[3];
+    int out[3];
+    float tNext[3];
+    float tDelta[3];
+} gridWalker;
+
+/**
+* Amanatides & Woo setup, returns false when the ray misses the grid
+*/
+static bool startWalk(const grid* g, const ray* r, gridWalker* w)
+{
+    vector3f invDir = {1.f / r->dir[0], 1.f / r->dir[1], 1.f / r->dir[2]};
+    float tEnter;
+    if(!aabbHit(&g->bounds, r, invDir, r->tmax, &tEnter))
+        return false;
+    for(int a = 0; a < 3; a++)
+    {
+        float p = r->origin[a] + r->dir[a] * tEnter;
+        w->cell[a] = cellCoordinate(g, p, a);
+        if(r->dir[a] > 0)
+        {
+            w->step[a] = 1;
+            w->out[a] = g->resolution[a];
+            w->tNext[a] = (g->bounds.min[a] + (w->cell[a] + 1) * g->cellSize[a] - r->origin[a]) * invDir[a];
+            w->tDelta[a] = g->cellSize[a] * invDir[a];
+        }
+        else if(r->dir[a] < 0)
+        {
+            w->step[a] = -1;
+            w->out[a] = -1;
+            w->tNext[a] = (g->bounds.min[a] + w->cell[a] * g->cellSize[a] - r->origin[a]) * invDir[a];
+            w->tDelta[a] = -g->cellSize[a] * invDir[a];
+        }
+        else
+        {
+            w->step[a] = 0;
+            w->out[a] = -1;
+            w->tNext[a] = INFINITY;
+            w->tDelta[a] = INFINITY;
+        }
+    }
+    return true;
+}
+
+static int nextAxis(const gridWalker* w)
+{
+    if(w->tNext[0] < w->tNext[1])
+        return w->tNext[0] < w->tNext[2] ? 0 : 2;
+    return w->tNext[1] < w->tNext[2] ? 1 : 2;
+}
+
+/**
+* Steps into the next cell, false once the walk leaves the grid
+*/
+static bool stepWalk(gridWalker* w)
+{
+    int axis = nextAxis(w);
+    w->cell[axis] += w->step[axis];
+    if(w->cell[axis] == w->out[axis])
+        return false;
+    w->tNext[axis] += w->tDelta[axis];
+    return true;
+}
+
+/**
+* Remembers the last few primitives tested by this ray so ones spanning several
+* cells are not tested again. It lives on the stack so concurrent rays never share it,
+* an evicted id only costs a repeated test. The type is folded in so the first primitives of each type
+* do not all land in the same slots.
+*/
+static bool mailboxTested(primitiveId* mailbox, primitiveId id)
+{
+    primitiveId* slot = &mailbox[(id ^ id >> PRIMITIVE_INDEX_BITS) & (GRID_MAILBOX_SIZE - 1)];
+    if(*slot == id)
+        return true;
+    *slot = id;
+    return false;
+}
+
+bool gridClosestHit(const grid* g, const ray r, rayHit* rh)
+{
+    gridWalker w;
+    if(g->stats.primitiveCount == 0 || !startWalk(g, &r, &w))
+        return false;
+    primitiveId mailbox[GRID_MAILBOX_SIZE];
+    memset(mailbox, 0xFF, sizeof(mailbox));
+    primitiveId batch[GRID_BATCH_SIZE];
+    ray testRay = r;
+    hitPath path;
+    primitiveId nearest = PRIMITIVE_NONE;
+    do
+    {
+        unsigned int c = (unsigned int)((w.cell[2] * g->resolution[1] + w.cell[1]) * g->resolution[0] + w.cell[0]);
+        uint32_t p = g->cellStart[c];
+        while(p < g->cellStart[c + 1])
+        {
+            uint32_t count = 0;
+            for(; p < g->cellStart[c + 1] && count < GRID_BATCH_SIZE; p++)
+            {
+                if(!mailboxTested(mailbox, g->cellPrimitives[p]))
+                    batch[count++] = g->cellPrimitives[p];
+            }
+            primitiveId id = primitivesClosestHit(g->store, batch, count, &testRay, &path);
+            if(id != PRIMITIVE_NONE)
+                nearest = id;
+        }
+        // A hit inside this cell can not be beaten by anything further along
+        if(testRay.tmax <= w.tNext[nextAxis(&w)])
+            break;
+    } while(stepWalk(&w));
+    if(nearest == PRIMITIVE_NONE)
+        return false;
+    primitiveSurface(g->store, nearest, r, testRay.tmax, &path, rh);
+    return true;
+}
+
+bool gridAnyHit(const grid* g, const ray r, const object** occluder)
+{
+    gridWalker w;
+    if(g->stats.primitiveCount == 0 || !startWalk(g, &r, &w))
+        return false;
+    primitiveId mailbox[GRID_MAILBOX_SIZE];
+    memset(mailbox, 0xFF, sizeof(mailbox));
+    primitiveId batch[GRID_BATCH_SIZE];
+    do
+    {
+        unsigned int c = (unsigned int)((w.cell[2] * g->resolution[1] + w.cell[1]) * g->resolution[0] + w.cell[0]);
+        uint32_t p = g->cellStart[c];
+        while(p < g->cellStart[c + 1])
+        {
+            uint32_t count = 0;
+            for(; p < g->cellStart[c + 1] && count < GRID_BATCH_SIZE; p++)
+            {
+                if(!mailboxTested(mailbox, g->cellPrimitives[p]))
+                    batch[count++] = g->cellPrimitives[p];
+            }
+            primitiveId id = primitivesAnyHit(g->store, batch, count, r);
+            if(id != PRIMITIVE_NONE)
+            {
+                if(occluder != NULL)
+                    *occluder = primitiveObject(g->store, id);
+                return true;
+            }
+        }
+        if(r.tmax <= w.tNext[nextAxis(&w)])
+            break;
+    } while(stepWalk(&w));
+    return false;
+}
+
+size_t gridMemoryUsage(const grid* g)
+{
+    return sizeof(grid) + (g->stats.cellCount + 1) * sizeof(uint32_t) + g->stats.references * sizeof(primitiveId) +
+           primitiveStoreMemoryUsage(g->store);
+}
+
+void printGridStats(const grid* g)
+{
+    printf(KRED"grid["KBLU"primitives:"KGRN"%u ", g->stats.primitiveCount);
+    printf(KBLU"resolution:"KGRN"%dx%dx%d ", g->resolution[0], g->resolution[1], g->resolution[2]);
+    printf(KBLU"cells:"KGRN"%u(%u empty) ", g->stats.cellCount, g->stats.emptyCells);
+    printf(KBLU"references:"KGRN"%u ", g->stats.references);
+    printf(KBLU"bytes:"KGRN"%zu ", gridMemoryUsage(g));
+    printf(KBLU"build(density %.1f):"KGRN"%4.4fms"KRED"]\n"KNRM, g->stats.density, g->stats.buildTime * 1000.0);
+}
+
+void cleanGrid(grid** g)
+{
+    if(*g == NULL)
+        return;
+    free((*g)->cellStart);
+    free((*g)->cellPrimitives);
+    cleanPrimitiveStore(&(*g)->store);
+    free(*g);
+    *g = NULL;
+}
@@ -0,0 +1,236 @@
+#include <rayTracerCore/shapes/instance.h>
+#include <rayTracerCore/shapes/ellipsoid.h>
+#include <rayTracerCore/shapes/triangle.h>
+#include <rayTracerCore/shapes/mesh.h>
+#include <rayTracerCore/shapes/plane.h>
+#include <rayTracerCore/shapes/box.h>
+#include <rayTracerCore/shapes/pagedmesh.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <math.h>
+
+/**
+* Path levels a hit on one of list's objects takes up
+*/
+static unsigned int listPathDepth(const object* list)
+{
+    unsigned int depth = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+    {
+        unsigned int levels = 0;
+        if(obj->type == MESH || obj->type == PAGED_MESH)
+            levels = 1;
+        else if(obj->type == INSTANCE)
+            levels = ((const instance_t*)obj->shape)->geometry->pathDepth + 1;
+        depth = levels > depth ? levels : depth;
+    }
+    return depth;
+}
+
+instanceGeometry* createInstanceGeometry(object* list)
+{
+    unsigned int depth = listPathDepth(list);
+    // Instances of it add one more level
+    if(depth + 1 > HIT_PATH_LEVELS)
+        return NULL;
+    instanceGeometry* ret = malloc(sizeof(instanceGeometry));
+    ret->objects = list;
+    ret->pathDepth = depth;
+    ret->tree = buildBVH(list);
+    bvhPackLeaves(ret->tree);
+    ret->primitiveCount = ret->tree->primitiveCount;
+    aabbEmpty(&ret->bounds);
+    if(ret->tree->nodeCount > 0)
+        ret->bounds = ret->tree->nodes[0].bounds;
+    return ret;
+}
+
+void cleanInstanceGeometry(instanceGeometry** geometry)
+{
+    if(*geometry == NULL)
+        return;
+    cleanBVH(&(*geometry)->tree);
+    cleanObjectList(&(*geometry)->objects);
+    free(*geometry);
+    *geometry = NULL;
+}
+
+size_t instanceGeometryMemoryUsage(const instanceGeometry* geometry)
+{
+    size_t bytes = sizeof(instanceGeometry) + bvhMemoryUsage(geometry->tree);
+    for(const object* obj = geometry->objects; obj != NULL; obj = obj->next)
+    {
+        bytes += sizeof(object);
+        switch(obj->type)
+        {
+        case SPHERE:
+        case ELLIPSOID:
+            bytes += sizeof(ellipsoid_t);
+            break;
+        case TRIANGLE:
+            bytes += sizeof(triangle_t);
+            break;
+        case PLANE:
+            bytes += sizeof(plane_t);
+            break;
+        case QUAD:
+            bytes += sizeof(parallelogram_t);
+            break;
+        case BOX:
+            bytes += sizeof(box_t);
+            break;
+        case INSTANCE:
+            bytes += sizeof(instance_t);
+            break;
+        case MESH:
+            bytes += meshMemoryUsage(obj->shape);
+            break;
+        case PAGED_MESH:
+            bytes += pagedMeshMemoryUsage(obj->shape);
+            break;
+        }
+    }
+    return bytes;
+}
+
+object* createInstance(const instanceGeometry* geometry, const transform* objectToWorld, const material* mat)
+{
+    object* ret = malloc(sizeof(object));
+    initObject(ret, INSTANCE, mat != NULL ? *mat : EMPTYNESS, malloc(sizeof(instance_t)));
+    instance_t* inst = (instance_t*)ret->shape;
+    inst->geometry = geometry;
+    inst->overrideMat = mat != NULL;
+    if(!setInstanceTransform(ret, objectToWorld))
+    {
+        transformIdentity(&inst->objectToWorld);
+        transformIdentity(&inst->worldToObject);
+    }
+    return ret;
+}
+
+/**
+* The direction is not renormalized so hit times stay the same in both spaces
+*/
+static void toObjectSpace(ray* local, const instance_t* inst, const ray r)
+{
+    transformPoint(local->origin, &inst->worldToObject, r.origin);
+    transformVector(local->dir, &inst->worldToObject, r.dir);
+    local->tmin = r.tmin;
+    local->tmax = r.tmax;
+}
+
+bool instanceTestHit(const ray r, const object *obj)
+{
+    const instance_t* inst = obj->shape;
+    ray local;
+    toObjectSpace(&local, inst, r);
+    return bvhAnyHit(inst->geometry->tree, local, NULL);
+}
+
+/**
+* Takes the surface rayH holds in the instance's space out to the world
+*/
+static void toWorldSurface(const instance_t* inst, const object* o, const ray r, rayHit* rayH)
+{
+    vector3f normal = {};
+    vector3f_copy(normal, rayH->normal);
+    transformPoint(rayH->location, &inst->objectToWorld, rayH->location);
+    transformNormal(rayH->normal, &inst->worldToObject, normal);
+    vector3f_normalize(rayH->normal);
+    if(inst->overrideMat)
+        rayH->mat = o->mat;
+    rayH->originRay = r;
+}
+
+bool instanceHit(const ray r, const object *o, float *time, rayHit *rayH)
+{
+    const instance_t* inst = o->shape;
+    ray local;
+    toObjectSpace(&local, inst, r);
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    if(!bvhClosestHit(inst->geometry->tree, local, rayH))
+        return false;
+
+    vector3f toHit = {};
+    vector3f_sub_new(toHit, rayH->location, local.origin);
+    *time = vector3f_dot(toHit, local.dir) / vector3f_dot(local.dir, local.dir);
+    toWorldSurface(inst, o, r, rayH);
+    return true;
+}
+
+bool instanceHitTime(const ray *r, const object *o, float *time, hitPath *path)
+{
+    const instance_t* inst = o->shape;
+    ray local;
+    toObjectSpace(&local, inst, *r);
+    ray testRay = local;
+    // The inner primitive's own levels go in first, this instance's goes on top
+    path->depth = 0;
+    primitiveId primitive = bvhClosestPrimitive(inst->geometry->tree, &testRay, path);
+    if(primitive == PRIMITIVE_NONE)
+        return false;
+
+    // The same steps instanceHit takes from the surface location so both agree on the time
+    vector3f dirOffset = {}, location = {}, toHit = {};
+    vector3f_scaleMul_new(dirOffset, local.dir, testRay.tmax);
+    vector3f_add_new(location, local.origin, dirOffset);
+    vector3f_sub_new(toHit, location, local.origin);
+    *time = vector3f_dot(toHit, local.dir) / vector3f_dot(local.dir, local.dir);
+    path->level[path->depth++] = (hitLevel){primitive, 0, testRay.tmax};
+    return true;
+}
+
+void instanceHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH)
+{
+    (void)t;
+    const instance_t* inst = o->shape;
+    hitPath inner = *path;
+    hitLevel hit = inner.level[--inner.depth];
+    ray local;
+    toObjectSpace(&local, inst, r);
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    primitiveSurface(inst->geometry->tree->store, hit.primitive, local, hit.time, &inner, rayH);
+    toWorldSurface(inst, o, r, rayH);
+}
+
+void instanceBounds(const object *o, aabb *box)
+{
+    const instance_t* inst = o->shape;
+    const aabb* local = &inst->geometry->bounds;
+    aabbEmpty(box);
+    for(int corner = 0; corner < 8; corner++)
+    {
+        point3f p = {
+            corner & 1 ? local->max[0] : local->min[0],
+            corner & 2 ? local->max[1] : local->min[1],
+            corner & 4 ? local->max[2] : local->min[2]};
+        transformPoint(p, &inst->objectToWorld, p);
+        aabbExtendPoint(box, p);
+    }
+}
+
+void instancePrint(void *s)
+{
+    const instance_t* inst = s;
+    printf(KCYN"instance[");
+    printf(KBLU"primitives:"KGRN"%u ", inst->geometry->primitiveCount);
+    printf(KBLU"override:"KGRN"%s ", inst->overrideMat ? "yes" : "no");
+    printTransform(&inst->objectToWorld);
+    printf(KCYN"]"KNRM);
+}
+
+/**
+* Moving an instance only invalidates the top level bvh, the shared geometry stays put
+*/
+bool setInstanceTransform(object *o, const transform* objectToWorld)
+{
+    instance_t* inst = o->shape;
+    transform inverse;
+    if(!transformInverse(&inverse, objectToWorld))
+        return false;
+    inst->objectToWorld = *objectToWorld;
+    inst->worldToObject = inverse;
+    return true;
+}
@@ -0,0 +1,642 @@
+#include <rayTracerCore/lbvh.h>
+#include <util/colors.h>
+#include <util/parallel.h>
+#include <util/usefulfunctions.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define LBVH_TRAVERSAL_COST 1.0f
+#define LBVH_INTERSECT_COST 1.0f
+#define LBVH_RADIX_BITS 8
+#define LBVH_RADIX (1 << LBVH_RADIX_BITS)
+#define LBVH_NONE 0xFFFFFFFFu
+// Subtrees handed to each thread when the hierarchy is flattened
+#define LBVH_TASKS_PER_THREAD 8
+
+/**
+* Internal nodes are [0, count - 1), leaf k of the sorted primitives is count - 1 + k.
+*/
+typedef struct
+{
+    aabb bounds;
+    uint32_t left, right;
+    uint32_t parent;
+    uint32_t leaves;
+    uint32_t outNodes;  // nodes this subtree flattens to
+    uint32_t visits;    // arrival counter for bottom up passes
+    float area;
+    float cost;
+    bool collapse;      // flattens to a single leaf
+} lbvhNode;
+
+typedef struct
+{
+    uint32_t node;
+    uint32_t index;
+    uint32_t primOffset;
+    uint32_t depth;
+} flattenTask;
+
+typedef struct
+{
+    unsigned int set;
+    uint32_t node;
+    int stage;
+} treeletEntry;
+
+typedef struct
+{
+    unsigned int maxDepth;
+    unsigned int leafCount;
+} flattenStats;
+
+typedef struct
+{
+    unsigned int threads;
+    unsigned int mortonBits;
+    uint32_t count;
+    const object** objects;
+    aabb* primBounds;
+    aabb* threadBounds;
+    aabb centroidBounds;
+    uint64_t* keys, *keysTmp;
+    uint32_t* ids, *idsTmp;
+    uint32_t* histograms;
+    int shift;
+    lbvhNode* nodes;
+    bvh* tree;
+    flattenTask* tasks;
+    flattenStats* threadStats;
+} lbvhBuild;
+
+static inline uint32_t expandBits10(uint32_t v)
+{
+    v &= 0x3FFu;
+    v = (v | (v << 16)) & 0x030000FFu;
+    v = (v | (v << 8)) & 0x0300F00Fu;
+    v = (v | (v << 4)) & 0x030C30C3u;
+    v = (v | (v << 2)) & 0x09249249u;
+    return v;
+}
+
+static inline uint64_t expandBits21(uint64_t v)
+{
+    v &= 0x1FFFFFull;
+    v = (v | (v << 32)) & 0x001F00000000FFFFull;
+    v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+    v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+    v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+    v = (v | (v << 2)) & 0x1249249249249249ull;
+    return v;
+}
+
+static inline uint64_t mortonCode(const lbvhBuild* b, const aabb* bounds)
+{
+    point3f c;
+    aabbCentroid(c, bounds);
+    float scale = b->mortonBits > 30 ? (float)(1 << 21) : (float)(1 << 10);
+    uint64_t q[3];
+    for(int i = 0; i < 3; i++)
+    {
+        float extent = b->centroidBounds.max[i] - b->centroidBounds.min[i];
+        float v = extent > 0 ? (c[i] - b->centroidBounds.min[i]) / extent : 0;
+        v *= scale;
+        if(v < 0) v = 0;
+        if(v > scale - 1) v = scale - 1;
+        q[i] = (uint64_t) v;
+    }
+    if(b->mortonBits > 30)
+        return (expandBits21(q[0]) << 2) | (expandBits21(q[1]) << 1) | expandBits21(q[2]);
+    return (expandBits10((uint32_t) q[0]) << 2) | (expandBits10((uint32_t) q[1]) << 1) | expandBits10((uint32_t) q[2]);
+}
+
+static void computeBounds(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    lbvhBuild* b = ctx;
+    aabb centroids;
+    aabbEmpty(&centroids);
+    for(size_t i = begin; i < end; i++)
+    {
+        const object* obj = b->objects[i];
+        obj->bounds(obj, &b->primBounds[i]);
+        point3f c;
+        aabbCentroid(c, &b->primBounds[i]);
+        aabbExtendPoint(&centroids, c);
+    }
+    b->threadBounds[thread] = centroids;
+}
+
+static void computeMortonCodes(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    (void)thread;
+    lbvhBuild* b = ctx;
+    for(size_t i = begin; i < end; i++)
+    {
+        b->keys[i] = mortonCode(b, &b->primBounds[i]);
+        b->ids[i] = (uint32_t) i;
+    }
+}
+
+static void radixHistogram(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    lbvhBuild* b = ctx;
+    uint32_t* hist = b->histograms + thread * LBVH_RADIX;
+    memset(hist, 0, LBVH_RADIX * sizeof(uint32_t));
+    for(size_t i = begin; i < end; i++)
+        hist[(b->keys[i] >> b->shift) & (LBVH_RADIX - 1)]++;
+}
+
+static void radixScatter(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    lbvhBuild* b = ctx;
+    uint32_t* offsets = b->histograms + thread * LBVH_RADIX;
+    for(size_t i = begin; i < end; i++)
+    {
+        uint32_t dst = offsets[(b->keys[i] >> b->shift) & (LBVH_RADIX - 1)]++;
+        b->keysTmp[dst] = b->keys[i];
+        b->idsTmp[dst] = b->ids[i];
+    }
+}
+
+/**
+* Stable LSD radix sort of the morton codes, one parallel histogram and scatter per digit.
+* Every thread keeps its own chunk for both so the scatter stays stable.
+*/
+static void radixSort(lbvhBuild* b)
+{
+    int passes = (b->mortonBits > 30 ? 64 : 32) / LBVH_RADIX_BITS;
+    for(int pass = 0; pass < passes; pass++)
+    {
+        b->shift = pass * LBVH_RADIX_BITS;
+        parallelFor(b->threads, b->count, radixHistogram, b);
+        uint32_t sum = 0;
+        for(int digit = 0; digit < LBVH_RADIX; digit++)
+        {
+            for(unsigned int t = 0; t < b->threads; t++)
+            {
+                uint32_t c = b->histograms[t * LBVH_RADIX + digit];
+                b->histograms[t * LBVH_RADIX + digit] = sum;
+                sum += c;
+            }
+        }
+        parallelFor(b->threads, b->count, radixScatter, b);
+        uint64_t* keys = b->keys;
+        b->keys = b->keysTmp;
+        b->keysTmp = keys;
+        uint32_t* ids = b->ids;
+        b->ids = b->idsTmp;
+        b->idsTmp = ids;
+    }
+}
+
+/**
+* Length of the common prefix of two sorted keys, duplicates are told apart by their index.
+*/
+static inline int delta(const lbvhBuild* b, int64_t i, int64_t j)
+{
+    if(j < 0 || j >= (int64_t) b->count)
+        return -1;
+    uint64_t x = b->keys[i] ^ b->keys[j];
+    if(x == 0)
+        return 64 + __builtin_clz((uint32_t) i ^ (uint32_t) j);
+    return __builtin_clzll(x);
+}
+
+/**
+* Karras 2012, every internal node finds its key range and split independently.
+*/
+static void emitInternalNodes(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    (void)thread;
+    lbvhBuild* b = ctx;
+    uint32_t leafBase = b->count - 1;
+    for(size_t n = begin; n < end; n++)
+    {
+        int64_t i = (int64_t) n;
+        int d = delta(b, i, i + 1) > delta(b, i, i - 1) ? 1 : -1;
+        int deltaMin = delta(b, i, i - d);
+        int64_t lmax = 2;
+        while(delta(b, i, i + lmax * d) > deltaMin)
+            lmax *= 2;
+        int64_t l = 0;
+        for(int64_t t = lmax / 2; t >= 1; t /= 2)
+        {
+            if(delta(b, i, i + (l + t) * d) > deltaMin)
+                l += t;
+        }
+        int64_t j = i + l * d;
+        int deltaNode = delta(b, i, j);
+        int64_t s = 0;
+        for(int64_t div = 2;; div *= 2)
+        {
+            int64_t t = (l + div - 1) / div;
+            if(delta(b, i, i + (s + t) * d) > deltaNode)
+                s += t;
+            if(t == 1)
+                break;
+        }
+        int64_t split = i + s * d + (d < 0 ? -1 : 0);
+        int64_t lo = i < j ? i : j;
+        int64_t hi = i < j ? j : i;
+        uint32_t left = lo == split ? leafBase + (uint32_t) split : (uint32_t) split;
+        uint32_t right = hi == split + 1 ? leafBase + (uint32_t) split + 1 : (uint32_t) split + 1;
+        b->nodes[n].left = left;
+        b->nodes[n].right = right;
+        b->nodes[left].parent = (uint32_t) n;
+        b->nodes[right].parent = (uint32_t) n;
+    }
+}
+
+static inline bool isLeaf(const lbvhBuild* b, uint32_t node)
+{
+    return node >= b->count - 1;
+}
+
+/**
+* Refreshes a node from its children, choosing between keeping it interior
+* or collapsing the whole subtree into one leaf by SAH cost.
+*/
+static void updateNode(lbvhBuild* b, uint32_t id)
+{
+    lbvhNode* n = &b->nodes[id];
+    const lbvhNode* l = &b->nodes[n->left];
+    const lbvhNode* r = &b->nodes[n->right];
+    n->bounds = l->bounds;
+    aabbExtend(&n->bounds, &r->bounds);
+    n->leaves = l->leaves + r->leaves;
+    n->area = aabbSurfaceArea(&n->bounds);
+    float interiorCost = LBVH_TRAVERSAL_COST * n->area + l->cost + r->cost;
+    float leafCost = n->leaves <= BVH_MAX_LEAF ? LBVH_INTERSECT_COST * n->area * n->leaves : INFINITY;
+    n->collapse = leafCost <= interiorCost;
+    n->cost = n->collapse ? leafCost : interiorCost;
+    n->outNodes = n->collapse ? 1 : 1 + l->outNodes + r->outNodes;
+}
+
+static void initLeaves(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    (void)thread;
+    lbvhBuild* b = ctx;
+    for(size_t k = begin; k < end; k++)
+    {
+        lbvhNode* leaf = &b->nodes[b->count - 1 + k];
+        leaf->bounds = b->primBounds[b->ids[k]];
+        leaf->leaves = 1;
+        leaf->outNodes = 1;
+        leaf->collapse = true;
+        leaf->area = aabbSurfaceArea(&leaf->bounds);
+        leaf->cost = LBVH_INTERSECT_COST * leaf->area;
+    }
+}
+
+static void resetVisits(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    (void)thread;
+    lbvhBuild* b = ctx;
+    for(size_t n = begin; n < end; n++)
+        b->nodes[n].visits = 0;
+}
+
+/**
+* Karras & Aila 2013, finds the SAH optimal topology over the treelet's leaves
+* by dynamic programming over every subset and rewires the treelet's internal nodes.
+*/
+static void restructureTreelet(lbvhBuild* b, uint32_t root)
+{
+    lbvhNode* nodes = b->nodes;
+    uint32_t leaves[LBVH_TREELET_LEAVES];
+    uint32_t internals[LBVH_TREELET_LEAVES];
+    int n = 0, ni = 0;
+    leaves[n++] = nodes[root].left;
+    leaves[n++] = nodes[root].right;
+    while(n < LBVH_TREELET_LEAVES)
+    {
+        int best = -1;
+        float bestArea = -1;
+        for(int i = 0; i < n; i++)
+        {
+            if(!isLeaf(b, leaves[i]) && nodes[leaves[i]].area > bestArea)
+            {
+                bestArea = nodes[leaves[i]].area;
+                best = i;
+            }
+        }
+        if(best < 0)
+            break;
+        uint32_t open = leaves[best];
+        internals[ni++] = open;
+        leaves[best] = nodes[open].left;
+        leaves[n++] = nodes[open].right;
+    }
+    if(n < 3)
+        return;
+
+    unsigned int full = (1u << n) - 1;
+    aabb bounds[1 << LBVH_TREELET_LEAVES];
+    float cost[1 << LBVH_TREELET_LEAVES];
+    uint32_t prims[1 << LBVH_TREELET_LEAVES];
+    uint8_t split[1 << LBVH_TREELET_LEAVES];
+    // Subsets of s are all smaller than s so one increasing sweep sees them first
+    for(unsigned int s = 1; s <= full; s++)
+    {
+        int low = __builtin_ctz(s);
+        unsigned int rest = s & (s - 1);
+        if(rest == 0)
+        {
+            bounds[s] = nodes[leaves[low]].bounds;
+            prims[s] = nodes[leaves[low]].leaves;
+            cost[s] = nodes[leaves[low]].cost;
+            continue;
+        }
+        bounds[s] = bounds[rest];
+        aabbExtend(&bounds[s], &nodes[leaves[low]].bounds);
+        prims[s] = prims[rest] + nodes[leaves[low]].leaves;
+
+        float best = INFINITY;
+        for(unsigned int p = (s - 1) & s; p != 0; p = (p - 1) & s)
+        {
+            // Each partition shows up twice, only look at it from one side
+            if(p < (s ^ p))
+                continue;
+            float c = cost[p] + cost[s ^ p];
+            if(c < best)
+            {
+                best = c;
+                split[s] = (uint8_t) p;
+            }
+        }
+        float area = aabbSurfaceArea(&bounds[s]);
+        float leafCost = prims[s] <= BVH_MAX_LEAF ? LBVH_INTERSECT_COST * area * prims[s] : INFINITY;
+        float interiorCost = LBVH_TRAVERSAL_COST * area + best;
+        cost[s] = leafCost < interiorCost ? leafCost : interiorCost;
+    }
+    if(cost[full] >= nodes[root].cost)
+        return;
+
+    // Rebuild top down, internal nodes are reused and fixed up bottom up on the way out
+    treeletEntry stack[LBVH_TREELET_LEAVES];
+    int sp = 0;
+    stack[sp++] = (treeletEntry){full, root, 0};
+    while(sp > 0)
+    {
+        treeletEntry* top = &stack[sp - 1];
+        if(top->stage == 1)
+        {
+            updateNode(b, top->node);
+            sp--;
+            continue;
+        }
+        top->stage = 1;
+        unsigned int halves[2] = {split[top->set], top->set ^ split[top->set]};
+        uint32_t children[2];
+        for(int h = 0; h < 2; h++)
+        {
+            if((halves[h] & (halves[h] - 1)) == 0)
+            {
+                children[h] = leaves[__builtin_ctz(halves[h])];
+            }
+            else
+            {
+                children[h] = internals[--ni];
+                stack[sp++] = (treeletEntry){halves[h], children[h], 0};
+            }
+            nodes[children[h]].parent = top->node;
+        }
+        nodes[top->node].left = children[0];
+        nodes[top->node].right = children[1];
+    }
+}
+
+typedef struct
+{
+    lbvhBuild* build;
+    bool restructure;
+} bottomUpPass;
+
+/**
+* Every leaf walks towards the root, the second child to arrive at a node
+* finishes it so each node is refreshed once with both children complete.
+*/
+static void bottomUp(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    (void)thread;
+    bottomUpPass* pass = ctx;
+    lbvhBuild* b = pass->build;
+    for(size_t k = begin; k < end; k++)
+    {
+        uint32_t node = b->nodes[b->count - 1 + k].parent;
+        while(node != LBVH_NONE)
+        {
+            if(__atomic_fetch_add(&b->nodes[node].visits, 1, __ATOMIC_ACQ_REL) == 0)
+                break;
+            // Children may have been restructured below us, so refresh before trying our own treelet
+            updateNode(b, node);
+            if(pass->restructure && b->nodes[node].leaves >= LBVH_TREELET_LEAVES)
+                restructureTreelet(b, node);
+            node = b->nodes[node].parent;
+        }
+    }
+}
+
+static void gatherPrimitives(lbvhBuild* b, uint32_t node, uint32_t* offset)
+{
+    if(isLeaf(b, node))
+    {
+        b->tree->primitives[(*offset)++] = b->objects[b->ids[node - (b->count - 1)]];
+        return;
+    }
+    gatherPrimitives(b, b->nodes[node].left, offset);
+    gatherPrimitives(b, b->nodes[node].right, offset);
+}
+
+/**
+* Writes one node in depth first order. The child with the lower centroid along
+* the axis they differ most on goes first, which is what traversal expects.
+* Returns the task for the second child and continues with the first.
+*/
+static flattenTask writeNode(lbvhBuild* b, flattenTask* task, flattenStats* stats)
+{
+    const lbvhNode* n = &b->nodes[task->node];
+    bvhNode* out = &b->tree->nodes[task->index];
+    out->bounds = n->bounds;
+    if(task->depth > stats->maxDepth)
+        stats->maxDepth = task->depth;
+    if(n->collapse)
+    {
+        uint32_t offset = task->primOffset;
+        gatherPrimitives(b, task->node, &offset);
+        out->offset = task->primOffset;
+        out->count = (uint16_t) n->leaves;
+        out->axis = 0;
+        stats->leafCount++;
+        return (flattenTask){LBVH_NONE, 0, 0, 0};
+    }
+
+    point3f cl, cr;
+    aabbCentroid(cl, &b->nodes[n->left].bounds);
+    aabbCentroid(cr, &b->nodes[n->right].bounds);
+    int axis = 0;
+    for(int i = 1; i < 3; i++)
+    {
+        if(fabsf(cr[i] - cl[i]) > fabsf(cr[axis] - cl[axis]))
+            axis = i;
+    }
+    uint32_t first = n->left, second = n->right;
+    if(cr[axis] < cl[axis])
+    {
+        first = n->right;
+        second = n->left;
+    }
+    out->count = 0;
+    out->axis = (uint16_t) axis;
+    out->offset = task->index + 1 + b->nodes[first].outNodes;
+    flattenTask secondTask = {second, out->offset, task->primOffset + b->nodes[first].leaves, task->depth + 1};
+    *task = (flattenTask){first, task->index + 1, task->primOffset, task->depth + 1};
+    return secondTask;
+}
+
+static void flattenSubtree(lbvhBuild* b, flattenTask task, flattenStats* stats)
+{
+    while(task.node != LBVH_NONE)
+    {
+        flattenTask second = writeNode(b, &task, stats);
+        if(second.node == LBVH_NONE)
+            return;
+        flattenSubtree(b, second, stats);
+    }
+}
+
+static void flattenTasks(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    lbvhBuild* b = ctx;
+    for(size_t i = begin; i < end; i++)
+        flattenSubtree(b, b->tasks[i], &b->threadStats[thread]);
+}
+
+/**
+* Splits the top of the tree into independent subtrees until every thread
+* has a few, then writes the subtrees in parallel.
+*/
+static void flatten(lbvhBuild* b)
+{
+    bvh* tree = b->tree;
+    tree->nodeCount = b->nodes[0].outNodes;
+    tree->nodes = malloc(tree->nodeCount * sizeof(bvhNode));
+    tree->primitives = malloc(b->count * sizeof(object*));
+
+    unsigned int maxTasks = b->threads * LBVH_TASKS_PER_THREAD;
+    b->tasks = malloc((maxTasks + 1) * sizeof(flattenTask));
+    b->threadStats = calloc(b->threads, sizeof(flattenStats));
+    flattenStats topStats = {0, 0};
+    unsigned int taskCount = 0;
+    b->tasks[taskCount++] = (flattenTask){0, 0, 0, 0};
+    while(taskCount < maxTasks)
+    {
+        unsigned int largest = 0;
+        for(unsigned int i = 1; i < taskCount; i++)
+        {
+            if(b->nodes[b->tasks[i].node].leaves > b->nodes[b->tasks[largest].node].leaves)
+                largest = i;
+        }
+        if(b->nodes[b->tasks[largest].node].collapse)
+            break;
+        flattenTask second = writeNode(b, &b->tasks[largest], &topStats);
+        b->tasks[taskCount++] = second;
+    }
+    parallelFor(b->threads, taskCount, flattenTasks, b);
+
+    tree->stats.maxDepth = topStats.maxDepth;
+    tree->stats.leafCount = topStats.leafCount;
+    for(unsigned int t = 0; t < b->threads; t++)
+    {
+        if(b->threadStats[t].maxDepth > tree->stats.maxDepth)
+            tree->stats.maxDepth = b->threadStats[t].maxDepth;
+        tree->stats.leafCount += b->threadStats[t].leafCount;
+    }
+    free(b->tasks);
+    free(b->threadStats);
+}
+
+bvh* buildLBVH(const object* list, const lbvhOptions* options)
+{
+    if(options == NULL)
+        options = &LBVH_DEFAULTS;
+    double start = getTimeSeconds();
+    lbvhBuild b;
+    memset(&b, 0, sizeof(b));
+    b.threads = options->threads ? options->threads : getProcessorCount();
+    assert(options->mortonBits == 30 || options->mortonBits == 63);
+    b.mortonBits = options->mortonBits;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        b.count++;
+    if(b.count < 2)
+    {
+        bvh* tree = buildBVH(list);
+        tree->stats.builder = BVH_LBVH;
+        return tree;
+    }
+
+    b.objects = malloc(b.count * sizeof(object*));
+    uint32_t i = 0;
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        b.objects[i++] = obj;
+
+    b.primBounds = malloc(b.count * sizeof(aabb));
+    b.threadBounds = malloc(b.threads * sizeof(aabb));
+    parallelFor(b.threads, b.count, computeBounds, &b);
+    aabbEmpty(&b.centroidBounds);
+    for(unsigned int t = 0; t < b.threads; t++)
+        aabbExtend(&b.centroidBounds, &b.threadBounds[t]);
+
+    b.keys = malloc(b.count * sizeof(uint64_t));
+    b.keysTmp = malloc(b.count * sizeof(uint64_t));
+    b.ids = malloc(b.count * sizeof(uint32_t));
+    b.idsTmp = malloc(b.count * sizeof(uint32_t));
+    b.histograms = malloc(b.threads * LBVH_RADIX * sizeof(uint32_t));
+    parallelFor(b.threads, b.count, computeMortonCodes, &b);
+    radixSort(&b);
+
+    b.nodes = calloc(2 * b.count - 1, sizeof(lbvhNode));
+    b.nodes[0].parent = LBVH_NONE;
+    parallelFor(b.threads, b.count - 1, emitInternalNodes, &b);
+    parallelFor(b.threads, b.count, initLeaves, &b);
+    bottomUpPass pass = {&b, false};
+    parallelFor(b.threads, b.count, bottomUp, &pass);
+    for(unsigned int round = 0; round < options->treeletRounds; round++)
+    {
+        parallelFor(b.threads, b.count - 1, resetVisits, &b);
+        pass.restructure = true;
+        parallelFor(b.threads, b.count, bottomUp, &pass);
+    }
+
+    b.tree = calloc(1, sizeof(bvh));
+    b.tree->primitiveCount = b.count;
+    b.tree->width = BVH2;
+    flatten(&b);
+
+    free(b.nodes);
+    free(b.histograms);
+    free(b.idsTmp);
+    free(b.ids);
+    free(b.keysTmp);
+    free(b.keys);
+    free(b.threadBounds);
+    free(b.primBounds);
+    free(b.objects);
+
+    bvh* tree = b.tree;
+    if(tree->stats.maxDepth >= BVH_STACK_SIZE)
+    {
+        printf(KYEL"LBVH depth %u is past the traversal stack, falling back to the SAH builder\n"KNRM, tree->stats.maxDepth);
+        cleanBVH(&tree);
+        return buildBVH(list);
+    }
+    bvhSyncPrimitives(tree);
+    tree->stats.builder = BVH_LBVH;
+    tree->stats.buildThreads = b.threads;
+    tree->stats.nodeCount = tree->nodeCount;
+    tree->stats.sahCost = bvhSAHCost(tree);
+    bvhResetQuality(tree);
+    tree->stats.buildTime = getTimeSeconds() - start;
+    return tree;
+}
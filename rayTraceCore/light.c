@@ -2,6 +2,22 @@
 #include <rayTracerCore/ray.h>
 #include <rayTracerCore/rayhit.h>
 #include <rayTracerCore/shapes/geometry.h>
+#include <rayTracerCore/accel.h>
+#include <util/colors.h>
+#include <string.h>
+
+typedef struct
+{
+    unsigned int accelId;
+    point3f location;
+    const object* occluder;
+} shadowCacheEntry;
+
+static bool shadowCacheEnabled = true;
+static __thread shadowCacheEntry shadowCache[SHADOW_CACHE_LIGHTS];
+static __thread unsigned int shadowCacheNext;
+static __thread shadowCacheStats localShadowStats;
+static shadowCacheStats totalShadowStats;
 
 void getRayToLight(const point3f start, const light l, ray* r)
 {
@@ -11,8 +27,9 @@ void getRayToLight(const point3f start, const light l, ray* r)
         {
             vector3f_copy(r->origin, start);
             vector3f_sub_new(r->dir, l.l.point.location, start);
+            // Anything past the light can not block it
+            r->tmax = vector3f_norm(r->dir);
             vector3f_normalize(r->dir);
-            r->tmax = INFINITY;
             r->tmin = 0.1f;
             break;
         }
@@ -27,6 +44,39 @@ bool inShadow(const rayHit rh, const light l)
     vector3f_scaleMul_new(start, rh.normal, rh.offsetError);
     vector3f_add(start, rh.location);
     getRayToLight(start, l, &lightRay);
+    localShadowStats.rays++;
+    if(rh.accel != NULL)
+    {
+        if(!shadowCacheEnabled)
+            return rh.accel->anyHit(rh.accel, lightRay, NULL);
+        // Neighbouring shadow rays are usually blocked by the same object, try it before the full query
+        shadowCacheEntry* entry = NULL;
+        for(int i = 0; i < SHADOW_CACHE_LIGHTS && entry == NULL; i++)
+        {
+            if(shadowCache[i].accelId == rh.accel->id && memcmp(shadowCache[i].location, l.l.point.location, sizeof(point3f)) == 0)
+                entry = &shadowCache[i];
+        }
+        if(entry == NULL)
+        {
+            entry = &shadowCache[shadowCacheNext++ % SHADOW_CACHE_LIGHTS];
+            entry->accelId = rh.accel->id;
+            vector3f_copy(entry->location, l.l.point.location);
+            entry->occluder = NULL;
+        }
+        if(entry->occluder != NULL)
+        {
+            localShadowStats.cacheTests++;
+            if(entry->occluder->test(lightRay, entry->occluder))
+            {
+                localShadowStats.cacheHits++;
+                return true;
+            }
+        }
+        const object* occluder = NULL;
+        bool hit = rh.accel->anyHit(rh.accel, lightRay, &occluder);
+        entry->occluder = occluder;
+        return hit;
+    }
     bool hit = false;
     for(object* obj = rh.objects; obj != NULL; obj = obj->next)
     {
@@ -39,6 +89,43 @@ bool inShadow(const rayHit rh, const light l)
 
 
 
+void setShadowCache(bool enabled)
+{
+    shadowCacheEnabled = enabled;
+}
+
+bool getShadowCache(void)
+{
+    return shadowCacheEnabled;
+}
+
+void flushShadowCacheStats(void)
+{
+    __atomic_fetch_add(&totalShadowStats.rays, localShadowStats.rays, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totalShadowStats.cacheTests, localShadowStats.cacheTests, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totalShadowStats.cacheHits, localShadowStats.cacheHits, __ATOMIC_RELAXED);
+    memset(&localShadowStats, 0, sizeof(shadowCacheStats));
+}
+
+void getShadowCacheStats(shadowCacheStats* stats)
+{
+    stats->rays = __atomic_load_n(&totalShadowStats.rays, __ATOMIC_RELAXED);
+    stats->cacheTests = __atomic_load_n(&totalShadowStats.cacheTests, __ATOMIC_RELAXED);
+    stats->cacheHits = __atomic_load_n(&totalShadowStats.cacheHits, __ATOMIC_RELAXED);
+}
+
+void printShadowCacheStats(void)
+{
+    shadowCacheStats stats;
+    getShadowCacheStats(&stats);
+    printf(KRED"shadows["KBLU"rays:"KGRN"%llu ", stats.rays);
+    printf(KBLU"cache:"KGRN"%s ", shadowCacheEnabled ? "on" : "off");
+    printf(KBLU"cache tests:"KGRN"%llu ", stats.cacheTests);
+    printf(KBLU"cache hits:"KGRN"%llu(%4.1f%% of tests, %4.1f%% of rays)"KRED"]\n"KNRM, stats.cacheHits,
+           stats.cacheTests ? 100.0 * stats.cacheHits / stats.cacheTests : 0.0,
+           stats.rays ? 100.0 * stats.cacheHits / stats.rays : 0.0);
+}
+
 float getDiffuseFactor(const rayHit rh, const light l)
 {
     float diffuse = 0.0f;
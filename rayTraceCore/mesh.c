@@ -0,0 +1,211 @@
+#include <rayTracerCore/shapes/mesh.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+object* createMesh(const material mat, point3f* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t triangleCount, vector3f* normals)
+{
+    for(size_t i = 0; i < (size_t)triangleCount * 3; i++)
+    {
+        if(indices[i] >= vertexCount)
+            return NULL;
+    }
+    mesh_t* m = malloc(sizeof(mesh_t));
+    m->vertices = vertices;
+    m->normals = normals;
+    m->indices = indices;
+    m->vertexCount = vertexCount;
+    m->triangleCount = triangleCount;
+
+    aabb* bounds = malloc(triangleCount * sizeof(aabb));
+    for(uint32_t i = 0; i < triangleCount; i++)
+        meshTriangleBounds(m, i, &bounds[i]);
+    m->order = malloc(triangleCount * sizeof(uint32_t));
+    m->nodes = buildBVHNodes(bounds, triangleCount, m->order, &m->nodeCount);
+    free(bounds);
+
+    object* ret = malloc(sizeof(object));
+    initObject(ret, MESH, mat, m);
+    return ret;
+}
+
+void meshTriangleBounds(const mesh_t* m, uint32_t tri, aabb* box)
+{
+    // The same padded box as a triangle object so rounding in the edges can not slip a hit past it
+    triangle_t shape;
+    meshTriangle(m, tri, &shape);
+    triangleShapeBounds(&shape, box);
+}
+
+/**
+* Walks the mesh's nodes near child first. With closest unset it stops at the first triangle
+* hit, otherwise it keeps pulling r->tmax in and returns the nearest triangle.
+*/
+static uint32_t traverse(const mesh_t* m, ray* r, bool closest)
+{
+    if(m->nodeCount == 0)
+        return MESH_NO_TRIANGLE;
+    vector3f invDir = {1.f / r->dir[0], 1.f / r->dir[1], 1.f / r->dir[2]};
+    bool dirNeg[3] = {invDir[0] < 0, invDir[1] < 0, invDir[2] < 0};
+    uint32_t nearest = MESH_NO_TRIANGLE;
+    uint32_t stack[BVH_STACK_SIZE];
+    int sp = 0;
+    uint32_t index = 0;
+    while(true)
+    {
+        const bvhNode* node = &m->nodes[index];
+        float tnear;
+        if(aabbHit(&node->bounds, r, invDir, r->tmax, &tnear))
+        {
+            if(node->count == 0)
+            {
+                if(dirNeg[node->axis])
+                {
+                    stack[sp++] = index + 1;
+                    index = node->offset;
+                }
+                else
+                {
+                    stack[sp++] = node->offset;
+                    index = index + 1;
+                }
+                continue;
+            }
+            for(uint32_t i = node->offset; i < node->offset + node->count; i++)
+            {
+                triangle_t tri;
+                meshTriangle(m, m->order[i], &tri);
+                float t;
+                if(triangleIntersect(r, &tri, &t) && (!closest || t < r->tmax))
+                {
+                    if(!closest)
+                        return m->order[i];
+                    r->tmax = t;
+                    nearest = m->order[i];
+                }
+            }
+        }
+        if(sp == 0)
+            break;
+        index = stack[--sp];
+    }
+    return nearest;
+}
+
+uint32_t meshClosestTriangle(const mesh_t* m, ray* r)
+{
+    return traverse(m, r, true);
+}
+
+bool meshAnyTriangle(const mesh_t* m, const ray* r)
+{
+    ray testRay = *r;
+    return traverse(m, &testRay, false) != MESH_NO_TRIANGLE;
+}
+
+void meshSurface(const ray r, const mesh_t* m, uint32_t tri, const material mat, float t, rayHit* rh)
+{
+    triangle_t shape;
+    meshTriangle(m, tri, &shape);
+    rh->hit = true;
+    rh->mat = mat;
+    vector3f dirOffset = {};
+    vector3f_scaleMul_new(dirOffset, r.dir, t);
+    vector3f_add_new(rh->location, r.origin, dirOffset);
+    if(m->normals == NULL)
+    {
+        vector3f_cross_new(rh->normal, shape.e1, shape.e2);
+    }
+    else
+    {
+        // Barycentrics the same way triangleIntersect finds them
+        vector3f s1 = {}, s2 = {}, d = {};
+        vector3f_cross_new(s1, r.dir, shape.e2);
+        float invD = 1.f / vector3f_dot(s1, shape.e1);
+        vector3f_sub_new(d, r.origin, shape.a);
+        float b1 = vector3f_dot(d, s1) * invD;
+        vector3f_cross_new(s2, d, shape.e1);
+        float b2 = vector3f_dot(r.dir, s2) * invD;
+        const uint32_t* idx = m->indices + 3 * tri;
+        for(int i = 0; i < 3; i++)
+            rh->normal[i] = (1.f - b1 - b2) * m->normals[idx[0]][i] + b1 * m->normals[idx[1]][i] + b2 * m->normals[idx[2]][i];
+    }
+    vector3f_normalize(rh->normal);
+    rh->originRay = r;
+    rh->offsetError = .1;
+}
+
+bool meshTestHit(const ray r, const object *obj)
+{
+    return meshAnyTriangle(obj->shape, &r);
+}
+
+bool meshHitTime(const ray *r, const object *o, float *time, hitPath *path)
+{
+    ray testRay = *r;
+    uint32_t tri = meshClosestTriangle(o->shape, &testRay);
+    if(tri == MESH_NO_TRIANGLE)
+        return false;
+    *time = testRay.tmax;
+    path->level[0] = (hitLevel){tri, 0, testRay.tmax};
+    path->depth = 1;
+    return true;
+}
+
+void meshHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH)
+{
+    meshSurface(r, o->shape, path->level[path->depth - 1].primitive, o->mat, t, rayH);
+}
+
+bool meshHit(const ray r, const object *o, float *time, rayHit *rayH)
+{
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    ray testRay = r;
+    uint32_t tri = meshClosestTriangle(o->shape, &testRay);
+    if(tri == MESH_NO_TRIANGLE)
+        return false;
+
+    *time = testRay.tmax;
+    meshSurface(r, o->shape, tri, o->mat, testRay.tmax, rayH);
+    return true;
+}
+
+void meshBounds(const object *o, aabb *box)
+{
+    const mesh_t* m = o->shape;
+    if(m->nodeCount > 0)
+        *box = m->nodes[0].bounds;
+    else
+        aabbEmpty(box);
+}
+
+void meshPrint(void *s)
+{
+    const mesh_t* m = s;
+    printf(KCYN"mesh[");
+    printf(KBLU"vertices:"KGRN"%u ", m->vertexCount);
+    printf(KBLU"triangles:"KGRN"%u ", m->triangleCount);
+    printf(KBLU"normals:"KGRN"%s ", m->normals != NULL ? "yes" : "no");
+    printf(KBLU"bytes:"KGRN"%zu", meshMemoryUsage(m));
+    printf(KCYN"]"KNRM);
+}
+
+size_t meshMemoryUsage(const mesh_t* m)
+{
+    size_t bytes = sizeof(mesh_t) + m->vertexCount * sizeof(point3f) + m->triangleCount * 3 * sizeof(uint32_t);
+    if(m->normals != NULL)
+        bytes += m->vertexCount * sizeof(vector3f);
+    bytes += m->nodeCount * sizeof(bvhNode) + m->triangleCount * sizeof(uint32_t);
+    return bytes;
+}
+
+void cleanMeshBuffers(mesh_t* m)
+{
+    free(m->vertices);
+    free(m->normals);
+    free(m->indices);
+    free(m->nodes);
+    free(m->order);
+}
@@ -0,0 +1,890 @@
+#include <rayTracerCore/meshloader.h>
+#include <util/parallel.h>
+#include <util/usefulfunctions.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PLY_MAX_ELEMENTS 16
+#define PLY_MAX_PROPERTIES 32
+#define PLY_NAME_LENGTH 32
+#define PLY_LINE_LENGTH 256
+
+/**
+* The file as one read only mapping, nothing in it is copied before it is parsed
+*/
+typedef struct
+{
+    const char* data;
+    size_t size;
+} mappedFile;
+
+static meshLoadStatus mapFile(const char* path, mappedFile* file)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return MESH_LOAD_MISSING;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return MESH_LOAD_INVALID;
+    }
+    file->size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        return MESH_LOAD_INVALID;
+    // Every thread reads its own part straight away, ask for all of it now
+    madvise(mapping, file->size, MADV_WILLNEED);
+    file->data = mapping;
+    return MESH_LOAD_OK;
+}
+
+static void freeBuffers(meshBuffers* out)
+{
+    free(out->vertices);
+    free(out->normals);
+    free(out->indices);
+    memset(out, 0, sizeof(meshBuffers));
+}
+
+/* ---- binary PLY ---- */
+
+typedef enum
+{
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64,
+    PLY_NONE
+} plyType;
+
+static const size_t plySizes[PLY_NONE] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+typedef struct
+{
+    char name[PLY_NAME_LENGTH];
+    plyType type;       // of the items for a list
+    plyType countType;  // PLY_NONE unless it is a list
+    size_t offset;      // from the start of the element, only for properties before any list
+} plyProperty;
+
+typedef struct
+{
+    char name[PLY_NAME_LENGTH];
+    uint64_t count;
+    plyProperty properties[PLY_MAX_PROPERTIES];
+    unsigned int propertyCount;
+} plyElement;
+
+typedef struct
+{
+    bool swap;          // file byte order is not ours
+    plyElement elements[PLY_MAX_ELEMENTS];
+    unsigned int elementCount;
+    size_t dataOffset;
+} plyHeader;
+
+static plyType parsePlyType(const char* name)
+{
+    static const char* names[][2] = {
+        {"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+        {"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}};
+    for(int i = 0; i < PLY_NONE; i++)
+    {
+        if(strcmp(name, names[i][0]) == 0 || strcmp(name, names[i][1]) == 0)
+            return (plyType)i;
+    }
+    return PLY_NONE;
+}
+
+static bool hostIsLittleEndian(void)
+{
+    const uint16_t probe = 1;
+    return *(const uint8_t*)&probe == 1;
+}
+
+static meshLoadStatus parsePlyHeader(const mappedFile* file, plyHeader* header)
+{
+    memset(header, 0, sizeof(plyHeader));
+    size_t pos = 0;
+    bool format = false;
+    while(pos < file->size)
+    {
+        char line[PLY_LINE_LENGTH];
+        size_t length = 0;
+        while(pos < file->size && file->data[pos] != '\n')
+        {
+            if(length < PLY_LINE_LENGTH - 1)
+                line[length++] = file->data[pos];
+            pos++;
+        }
+        pos++;
+        if(length > 0 && line[length - 1] == '\r')
+            length--;
+        line[length] = '\0';
+
+        char word[PLY_NAME_LENGTH], a[PLY_NAME_LENGTH], b[PLY_NAME_LENGTH], c[PLY_NAME_LENGTH];
+        int fields = sscanf(line, "%31s %31s %31s %31s", word, a, b, c);
+        if(fields <= 0 || strcmp(word, "comment") == 0 || strcmp(word, "obj_info") == 0 || strcmp(word, "ply") == 0)
+            continue;
+        if(strcmp(word, "end_header") == 0)
+        {
+            header->dataOffset = pos;
+            return format && pos <= file->size ? MESH_LOAD_OK : MESH_LOAD_INVALID;
+        }
+        if(strcmp(word, "format") == 0 && fields >= 2)
+        {
+            if(strcmp(a, "binary_little_endian") == 0)
+                header->swap = !hostIsLittleEndian();
+            else if(strcmp(a, "binary_big_endian") == 0)
+                header->swap = hostIsLittleEndian();
+            else
+                return MESH_LOAD_UNSUPPORTED;
+            format = true;
+        }
+        else if(strcmp(word, "element") == 0 && fields >= 3)
+        {
+            if(header->elementCount == PLY_MAX_ELEMENTS)
+                return MESH_LOAD_UNSUPPORTED;
+            plyElement* e = &header->elements[header->elementCount++];
+            snprintf(e->name, PLY_NAME_LENGTH, "%s", a);
+            e->count = strtoull(b, NULL, 10);
+        }
+        else if(strcmp(word, "property") == 0 && fields >= 3 && header->elementCount > 0)
+        {
+            plyElement* e = &header->elements[header->elementCount - 1];
+            if(e->propertyCount == PLY_MAX_PROPERTIES)
+                return MESH_LOAD_UNSUPPORTED;
+            plyProperty* p = &e->properties[e->propertyCount++];
+            if(strcmp(a, "list") == 0)
+            {
+                if(fields < 4)
+                    return MESH_LOAD_INVALID;
+                p->countType = parsePlyType(b);
+                p->type = parsePlyType(c);
+                if(p->countType == PLY_NONE || p->type == PLY_NONE)
+                    return MESH_LOAD_INVALID;
+                // The name is the last word on the line
+                const char* name = strrchr(line, ' ');
+                snprintf(p->name, PLY_NAME_LENGTH, "%s", name != NULL ? name + 1 : "");
+            }
+            else
+            {
+                p->countType = PLY_NONE;
+                p->type = parsePlyType(a);
+                if(p->type == PLY_NONE)
+                    return MESH_LOAD_INVALID;
+                snprintf(p->name, PLY_NAME_LENGTH, "%s", b);
+            }
+        }
+    }
+    return MESH_LOAD_INVALID;
+}
+
+/**
+* Bytes per entry when the element has no lists, 0 otherwise
+*/
+static size_t plyStride(plyElement* e)
+{
+    size_t stride = 0;
+    for(unsigned int i = 0; i < e->propertyCount; i++)
+    {
+        if(e->properties[i].countType != PLY_NONE)
+            return 0;
+        e->properties[i].offset = stride;
+        stride += plySizes[e->properties[i].type];
+    }
+    return stride;
+}
+
+static inline double plyRead(const char* src, plyType type, bool swap)
+{
+    unsigned char bytes[8];
+    size_t size = plySizes[type];
+    if(swap)
+    {
+        for(size_t i = 0; i < size; i++)
+            bytes[i] = (unsigned char)src[size - 1 - i];
+    }
+    else
+        memcpy(bytes, src, size);
+    switch(type)
+    {
+    case PLY_INT8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+    case PLY_UINT8: { uint8_t v; memcpy(&v, bytes, 1); return v; }
+    case PLY_INT16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+    case PLY_UINT16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+    case PLY_INT32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+    case PLY_UINT32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+    case PLY_FLOAT64: { double v; memcpy(&v, bytes, 8); return v; }
+    case PLY_NONE: break;
+    }
+    return 0;
+}
+
+static inline uint32_t plyReadIndex(const char* src, plyType type, bool swap)
+{
+    double v = plyRead(src, type, swap);
+    // Negative or huge indices become one createMesh turns down
+    return v >= 0 && v < UINT32_MAX ? (uint32_t)v : UINT32_MAX;
+}
+
+static int findProperty(const plyElement* e, const char* name)
+{
+    for(unsigned int i = 0; i < e->propertyCount; i++)
+    {
+        if(strcmp(e->properties[i].name, name) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+typedef struct
+{
+    const char* data;
+    size_t stride;
+    bool swap;
+    const plyProperty* position[3];
+    const plyProperty* normal[3];   // all NULL without normals
+    meshBuffers* out;
+} plyVertexPass;
+
+static void plyVertices(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    (void)thread;
+    const plyVertexPass* pass = ctx;
+    for(size_t i = begin; i < end; i++)
+    {
+        const char* v = pass->data + i * pass->stride;
+        for(int axis = 0; axis < 3; axis++)
+            pass->out->vertices[i][axis] = (float)plyRead(v + pass->position[axis]->offset, pass->position[axis]->type, pass->swap);
+        if(pass->normal[0] != NULL)
+        {
+            for(int axis = 0; axis < 3; axis++)
+                pass->out->normals[i][axis] = (float)plyRead(v + pass->normal[axis]->offset, pass->normal[axis]->type, pass->swap);
+        }
+    }
+}
+
+/**
+* Faces laid out as the properties before the index list, the list, and the ones after it
+*/
+typedef struct
+{
+    const char* data;
+    size_t before, after;
+    plyType countType, indexType;
+    size_t countSize, indexSize;
+    bool swap;
+    uint32_t* indices;
+    bool* notTriangle;  // per thread
+} plyFacePass;
+
+static void plyTriangles(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    plyFacePass* pass = ctx;
+    size_t stride = pass->before + pass->countSize + 3 * pass->indexSize + pass->after;
+    for(size_t i = begin; i < end; i++)
+    {
+        const char* face = pass->data + i * stride + pass->before;
+        if(plyRead(face, pass->countType, pass->swap) != 3)
+        {
+            // Everything before this face was a triangle so it really is where it was read from
+            pass->notTriangle[thread] = true;
+            return;
+        }
+        for(int corner = 0; corner < 3; corner++)
+            pass->indices[3 * i + corner] = plyReadIndex(face + pass->countSize + corner * pass->indexSize, pass->indexType, pass->swap);
+    }
+}
+
+/**
+* Walks faces of any size one after the other, counting triangles when indices is NULL and writing fans otherwise.
+* Returns the bytes the faces take or 0 when they run past the end of the file.
+*/
+static size_t plyPolygons(const plyFacePass* pass, size_t faceCount, size_t available, uint32_t* triangles)
+{
+    size_t pos = 0;
+    uint32_t written = 0;
+    for(size_t i = 0; i < faceCount; i++)
+    {
+        if(pos + pass->before + pass->countSize > available)
+            return 0;
+        double count = plyRead(pass->data + pos + pass->before, pass->countType, pass->swap);
+        size_t n = count > 0 ? (size_t)count : 0;
+        const char* list = pass->data + pos + pass->before + pass->countSize;
+        pos += pass->before + pass->countSize + n * pass->indexSize + pass->after;
+        if(pos > available)
+            return 0;
+        for(size_t k = 2; k < n; k++, written++)
+        {
+            if(pass->indices == NULL)
+                continue;
+            pass->indices[3 * written] = plyReadIndex(list, pass->indexType, pass->swap);
+            pass->indices[3 * written + 1] = plyReadIndex(list + (k - 1) * pass->indexSize, pass->indexType, pass->swap);
+            pass->indices[3 * written + 2] = plyReadIndex(list + k * pass->indexSize, pass->indexType, pass->swap);
+        }
+    }
+    *triangles = written;
+    return pos;
+}
+
+static meshLoadStatus loadPLY(const mappedFile* file, unsigned int threads, meshBuffers* out)
+{
+    plyHeader header;
+    meshLoadStatus status = parsePlyHeader(file, &header);
+    if(status != MESH_LOAD_OK)
+        return status;
+
+    size_t pos = header.dataOffset;
+    bool haveVertices = false, haveFaces = false;
+    for(unsigned int e = 0; e < header.elementCount && !(haveVertices && haveFaces); e++)
+    {
+        plyElement* element = &header.elements[e];
+        size_t stride = plyStride(element);
+        size_t available = file->size - pos;
+        if(strcmp(element->name, "vertex") == 0)
+        {
+            int x = findProperty(element, "x"), y = findProperty(element, "y"), z = findProperty(element, "z");
+            int nx = findProperty(element, "nx"), ny = findProperty(element, "ny"), nz = findProperty(element, "nz");
+            if(stride == 0 || x < 0 || y < 0 || z < 0 || element->count > UINT32_MAX)
+                return MESH_LOAD_UNSUPPORTED;
+            if(element->count > available / stride)
+                return MESH_LOAD_INVALID;
+            out->vertexCount = (uint32_t)element->count;
+            out->vertices = malloc(out->vertexCount * sizeof(point3f));
+            bool normals = nx >= 0 && ny >= 0 && nz >= 0;
+            if(normals)
+                out->normals = malloc(out->vertexCount * sizeof(vector3f));
+            plyVertexPass pass = {file->data + pos, stride, header.swap,
+                                  {&element->properties[x], &element->properties[y], &element->properties[z]},
+                                  {NULL, NULL, NULL}, out};
+            if(normals)
+            {
+                pass.normal[0] = &element->properties[nx];
+                pass.normal[1] = &element->properties[ny];
+                pass.normal[2] = &element->properties[nz];
+            }
+            parallelFor(threads, out->vertexCount, plyVertices, &pass);
+            pos += element->count * stride;
+            haveVertices = true;
+        }
+        else if(strcmp(element->name, "face") == 0)
+        {
+            plyFacePass pass;
+            memset(&pass, 0, sizeof(pass));
+            pass.data = file->data + pos;
+            pass.swap = header.swap;
+            int list = -1;
+            for(unsigned int i = 0; i < element->propertyCount; i++)
+            {
+                const plyProperty* p = &element->properties[i];
+                if(p->countType != PLY_NONE)
+                {
+                    if(list >= 0)
+                        return MESH_LOAD_UNSUPPORTED;
+                    list = (int)i;
+                    pass.countType = p->countType;
+                    pass.indexType = p->type;
+                }
+                else if(list < 0)
+                    pass.before += plySizes[p->type];
+                else
+                    pass.after += plySizes[p->type];
+            }
+            if(list < 0)
+                return MESH_LOAD_UNSUPPORTED;
+            pass.countSize = plySizes[pass.countType];
+            pass.indexSize = plySizes[pass.indexType];
+
+            // Nearly every file is all triangles, which puts every face at a fixed stride
+            size_t triangleStride = pass.before + pass.countSize + 3 * pass.indexSize + pass.after;
+            bool fixed = element->count <= UINT32_MAX && element->count <= available / triangleStride;
+            if(fixed)
+            {
+                unsigned int threadCount = threads > 0 ? threads : getProcessorCount();
+                pass.notTriangle = calloc(threadCount, sizeof(bool));
+                out->triangleCount = (uint32_t)element->count;
+                out->indices = malloc((size_t)out->triangleCount * 3 * sizeof(uint32_t));
+                pass.indices = out->indices;
+                parallelFor(threadCount, out->triangleCount, plyTriangles, &pass);
+                for(unsigned int t = 0; t < threadCount; t++)
+                    fixed &= !pass.notTriangle[t];
+                free(pass.notTriangle);
+                pass.notTriangle = NULL;
+                if(fixed)
+                    pos += element->count * triangleStride;
+            }
+            if(!fixed)
+            {
+                // Some other polygon, count the fans and write them in one pass each
+                free(out->indices);
+                out->indices = NULL;
+                pass.indices = NULL;
+                uint32_t triangles = 0;
+                size_t bytes = plyPolygons(&pass, element->count, available, &triangles);
+                if(bytes == 0 && element->count > 0)
+                    return MESH_LOAD_INVALID;
+                out->triangleCount = triangles;
+                out->indices = malloc((size_t)triangles * 3 * sizeof(uint32_t));
+                pass.indices = out->indices;
+                plyPolygons(&pass, element->count, available, &triangles);
+                pos += bytes;
+            }
+            haveFaces = true;
+        }
+        else
+        {
+            // Anything else is skipped, which needs a fixed size
+            if(stride == 0)
+                return MESH_LOAD_UNSUPPORTED;
+            if(element->count > available / stride)
+                return MESH_LOAD_INVALID;
+            pos += element->count * stride;
+        }
+    }
+    return haveVertices && haveFaces ? MESH_LOAD_OK : MESH_LOAD_INVALID;
+}
+
+/* ---- Wavefront OBJ ---- */
+
+typedef struct
+{
+    size_t vertices, normals, triangles;
+} objCounts;
+
+typedef struct
+{
+    const char* data;
+    size_t size;
+    objCounts* counts;      // per thread from the first pass
+    objCounts* offsets;     // where each thread writes in the second
+    meshBuffers* out;
+    vector3f* normals;      // as the file numbers them
+    bool* normalsMatch;     // per thread, every corner's normal index was its vertex index
+} objLoad;
+
+static const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/**
+* Decimal float without strtof's locale and null terminator, p is left after it
+*/
+static float parseFloat(const char** p, const char* end)
+{
+    const char* s = *p;
+    while(s < end && isBlank(*s))
+        s++;
+    bool negative = false;
+    if(s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for(; s < end && isDigit(*s); s++)
+    {
+        if(digits < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+            digits += mantissa > 0;
+        }
+        else
+            exponent++;
+    }
+    if(s < end && *s == '.')
+    {
+        for(s++; s < end && isDigit(*s); s++)
+        {
+            if(digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+                digits += mantissa > 0;
+                exponent--;
+            }
+        }
+    }
+    if(s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char* e = s + 1;
+        bool negativeExponent = false;
+        if(e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if(e < end && isDigit(*e))
+        {
+            int value = 0;
+            for(; e < end && isDigit(*e); e++)
+                value = value < 10000 ? value * 10 + (*e - '0') : value;
+            exponent += negativeExponent ? -value : value;
+            s = e;
+        }
+    }
+    *p = s;
+    double value = (double)mantissa;
+    if(exponent < 0)
+        value = exponent >= -22 ? value / powersOf10[-exponent] : value * pow(10, exponent);
+    else if(exponent > 0)
+        value = exponent <= 22 ? value * powersOf10[exponent] : value * pow(10, exponent);
+    return (float)(negative ? -value : value);
+}
+
+static int64_t parseInt(const char** p, const char* end)
+{
+    const char* s = *p;
+    bool negative = false;
+    if(s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+    int64_t value = 0;
+    for(; s < end && isDigit(*s); s++)
+        value = value < ((int64_t)1 << 40) ? value * 10 + (*s - '0') : value;
+    *p = s;
+    return negative ? -value : value;
+}
+
+/**
+* 1 based, negative counts back from the last one seen. Anything out of range is turned down once every face is in.
+*/
+static inline uint32_t resolveIndex(int64_t index, size_t seen)
+{
+    int64_t resolved = index > 0 ? index - 1 : (int64_t)seen + index;
+    return resolved >= 0 && resolved < UINT32_MAX ? (uint32_t)resolved : UINT32_MAX;
+}
+
+typedef enum
+{
+    OBJ_OTHER,
+    OBJ_VERTEX,
+    OBJ_NORMAL,
+    OBJ_FACE
+} objLineType;
+
+/**
+* What the line at p is, body is left at the first character after the keyword
+*/
+static objLineType classifyLine(const char* p, const char* lineEnd, const char** body)
+{
+    while(p < lineEnd && isBlank(*p))
+        p++;
+    objLineType type = OBJ_OTHER;
+    if(p + 1 < lineEnd && p[0] == 'v' && isBlank(p[1]))
+        type = OBJ_VERTEX, p += 1;
+    else if(p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && isBlank(p[2]))
+        type = OBJ_NORMAL, p += 2;
+    else if(p + 1 < lineEnd && p[0] == 'f' && isBlank(p[1]))
+        type = OBJ_FACE, p += 1;
+    *body = p;
+    return type;
+}
+
+/**
+* The next whitespace separated corner of a face line, false past the last one or a comment
+*/
+static bool nextCorner(const char** p, const char* lineEnd, const char** cornerEnd)
+{
+    const char* s = *p;
+    while(s < lineEnd && isBlank(*s))
+        s++;
+    if(s >= lineEnd || *s == '#')
+        return false;
+    const char* e = s;
+    while(e < lineEnd && !isBlank(*e))
+        e++;
+    *p = s;
+    *cornerEnd = e;
+    return true;
+}
+
+/**
+* Lines belong to the chunk their first character is in
+*/
+static size_t chunkStart(const char* data, size_t size, size_t begin)
+{
+    if(begin == 0 || data[begin - 1] == '\n')
+        return begin;
+    const char* newline = memchr(data + begin, '\n', size - begin);
+    return newline != NULL ? (size_t)(newline - data) + 1 : size;
+}
+
+static void objCount(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    objLoad* load = ctx;
+    objCounts counts = {0, 0, 0};
+    size_t pos = chunkStart(load->data, load->size, begin);
+    while(pos < end)
+    {
+        const char* line = load->data + pos;
+        const char* newline = memchr(line, '\n', load->size - pos);
+        const char* lineEnd = newline != NULL ? newline : load->data + load->size;
+        const char* body;
+        switch(classifyLine(line, lineEnd, &body))
+        {
+        case OBJ_VERTEX:
+            counts.vertices++;
+            break;
+        case OBJ_NORMAL:
+            counts.normals++;
+            break;
+        case OBJ_FACE:
+        {
+            size_t corners = 0;
+            const char* cornerEnd;
+            while(nextCorner(&body, lineEnd, &cornerEnd))
+            {
+                corners++;
+                body = cornerEnd;
+            }
+            counts.triangles += corners > 2 ? corners - 2 : 0;
+            break;
+        }
+        case OBJ_OTHER:
+            break;
+        }
+        pos = (size_t)(lineEnd - load->data) + 1;
+    }
+    load->counts[thread] = counts;
+}
+
+static void objParse(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    objLoad* load = ctx;
+    objCounts at = load->offsets[thread];
+    bool normalsMatch = true;
+    size_t pos = chunkStart(load->data, load->size, begin);
+    while(pos < end)
+    {
+        const char* line = load->data + pos;
+        const char* newline = memchr(line, '\n', load->size - pos);
+        const char* lineEnd = newline != NULL ? newline : load->data + load->size;
+        const char* body;
+        switch(classifyLine(line, lineEnd, &body))
+        {
+        case OBJ_VERTEX:
+        {
+            float* v = load->out->vertices[at.vertices++];
+            for(int axis = 0; axis < 3; axis++)
+                v[axis] = parseFloat(&body, lineEnd);
+            break;
+        }
+        case OBJ_NORMAL:
+        {
+            float* n = load->normals[at.normals++];
+            for(int axis = 0; axis < 3; axis++)
+                n[axis] = parseFloat(&body, lineEnd);
+            break;
+        }
+        case OBJ_FACE:
+        {
+            uint32_t first = 0, previous = 0;
+            size_t corner = 0;
+            const char* cornerEnd;
+            while(nextCorner(&body, lineEnd, &cornerEnd))
+            {
+                uint32_t v = resolveIndex(parseInt(&body, cornerEnd), at.vertices);
+                uint32_t n = UINT32_MAX;
+                if(body < cornerEnd && *body == '/')
+                {
+                    body++;
+                    parseInt(&body, cornerEnd);
+                    if(body < cornerEnd && *body == '/')
+                    {
+                        body++;
+                        n = resolveIndex(parseInt(&body, cornerEnd), at.normals);
+                    }
+                }
+                normalsMatch &= n == v;
+                if(corner == 0)
+                    first = v;
+                else if(corner >= 2)
+                {
+                    uint32_t* tri = load->out->indices + 3 * at.triangles++;
+                    tri[0] = first;
+                    tri[1] = previous;
+                    tri[2] = v;
+                }
+                previous = v;
+                corner++;
+                body = cornerEnd;
+            }
+            break;
+        }
+        case OBJ_OTHER:
+            break;
+        }
+        pos = (size_t)(lineEnd - load->data) + 1;
+    }
+    load->normalsMatch[thread] = normalsMatch;
+}
+
+static meshLoadStatus loadOBJ(const mappedFile* file, unsigned int threads, meshBuffers* out)
+{
+    unsigned int threadCount = threads > 0 ? threads : getProcessorCount();
+    objLoad load;
+    load.data = file->data;
+    load.size = file->size;
+    load.counts = calloc(threadCount, sizeof(objCounts));
+    load.offsets = calloc(threadCount, sizeof(objCounts));
+    load.normalsMatch = calloc(threadCount, sizeof(bool));
+    load.out = out;
+    parallelFor(threadCount, file->size, objCount, &load);
+
+    objCounts total = {0, 0, 0};
+    for(unsigned int t = 0; t < threadCount; t++)
+    {
+        load.offsets[t] = total;
+        total.vertices += load.counts[t].vertices;
+        total.normals += load.counts[t].normals;
+        total.triangles += load.counts[t].triangles;
+    }
+    meshLoadStatus status = MESH_LOAD_OK;
+    if(total.vertices > UINT32_MAX || total.triangles > UINT32_MAX)
+        status = MESH_LOAD_UNSUPPORTED;
+    else if(total.vertices == 0 || total.triangles == 0)
+        status = MESH_LOAD_INVALID;
+    if(status == MESH_LOAD_OK)
+    {
+        out->vertexCount = (uint32_t)total.vertices;
+        out->triangleCount = (uint32_t)total.triangles;
+        out->vertices = malloc(total.vertices * sizeof(point3f));
+        out->indices = malloc(total.triangles * 3 * sizeof(uint32_t));
+        load.normals = malloc(total.normals * sizeof(vector3f));
+        // Same thread count and size, so every thread gets back the chunk it counted
+        parallelFor(threadCount, file->size, objParse, &load);
+
+        bool normalsMatch = total.normals == total.vertices;
+        for(unsigned int t = 0; t < threadCount; t++)
+            normalsMatch &= load.normalsMatch[t];
+        if(normalsMatch)
+            out->normals = load.normals;
+        else
+            free(load.normals);
+    }
+    free(load.counts);
+    free(load.offsets);
+    free(load.normalsMatch);
+    return status;
+}
+
+/* ---- entry points ---- */
+
+static bool hasExtension(const char* path, const char* extension)
+{
+    const char* dot = strrchr(path, '.');
+    return dot != NULL && strcasecmp(dot + 1, extension) == 0;
+}
+
+typedef struct
+{
+    const meshBuffers* out;
+    bool* outOfRange;   // per thread
+} indexCheckPass;
+
+static void checkIndices(void* ctx, size_t begin, size_t end, unsigned int thread)
+{
+    indexCheckPass* pass = ctx;
+    for(size_t i = begin; i < end; i++)
+    {
+        if(pass->out->indices[i] >= pass->out->vertexCount)
+        {
+            pass->outOfRange[thread] = true;
+            return;
+        }
+    }
+}
+
+// Both formats only bound indices by what fits in 32 bits, a face may still name a vertex the file does not have
+static bool validIndices(const meshBuffers* out, unsigned int threads)
+{
+    indexCheckPass pass = {out, calloc(threads, sizeof(bool))};
+    parallelFor(threads, (size_t)out->triangleCount * 3, checkIndices, &pass);
+    bool valid = true;
+    for(unsigned int t = 0; t < threads; t++)
+        valid &= !pass.outOfRange[t];
+    free(pass.outOfRange);
+    return valid;
+}
+
+meshLoadStatus loadMeshBuffers(const char* path, unsigned int threads, meshBuffers* out, meshLoadStats* stats)
+{
+    double start = getTimeSeconds();
+    memset(out, 0, sizeof(meshBuffers));
+    memset(stats, 0, sizeof(meshLoadStats));
+    stats->threads = threads > 0 ? threads : getProcessorCount();
+
+    bool ply = hasExtension(path, "ply");
+    if(!ply && !hasExtension(path, "obj"))
+        return stats->status = MESH_LOAD_UNSUPPORTED;
+    mappedFile file;
+    stats->status = mapFile(path, &file);
+    if(stats->status != MESH_LOAD_OK)
+        return stats->status;
+    stats->fileSize = file.size;
+    stats->status = ply ? loadPLY(&file, stats->threads, out) : loadOBJ(&file, stats->threads, out);
+    munmap((void*)file.data, file.size);
+    if(stats->status == MESH_LOAD_OK && !validIndices(out, stats->threads))
+        stats->status = MESH_LOAD_INVALID;
+    if(stats->status != MESH_LOAD_OK)
+    {
+        freeBuffers(out);
+        return stats->status;
+    }
+    stats->vertexCount = out->vertexCount;
+    stats->triangleCount = out->triangleCount;
+    stats->normals = out->normals != NULL;
+    stats->parseTime = getTimeSeconds() - start;
+    return stats->status;
+}
+
+object* loadMesh(const char* path, const material mat, unsigned int threads, meshLoadStats* stats)
+{
+    meshBuffers buffers;
+    if(loadMeshBuffers(path, threads, &buffers, stats) != MESH_LOAD_OK)
+        return NULL;
+    double start = getTimeSeconds();
+    object* mesh = createMesh(mat, buffers.vertices, buffers.vertexCount, buffers.indices, buffers.triangleCount, buffers.normals);
+    if(mesh == NULL)
+    {
+        freeBuffers(&buffers);
+        stats->status = MESH_LOAD_INVALID;
+        return NULL;
+    }
+    stats->buildTime = getTimeSeconds() - start;
+    return mesh;
+}
+
+void printMeshLoadStats(const char* path, const meshLoadStats* stats)
+{
+    static const char* reasons[] = {"ok", "missing", "unsupported", "invalid"};
+    if(stats->status != MESH_LOAD_OK)
+    {
+        printf(KRED"mesh %s could not be loaded: %s\n"KNRM, path, reasons[stats->status]);
+        return;
+    }
+    printf(KRED"mesh load["KBLU"file:"KGRN"%s ", path);
+    printf(KBLU"vertices:"KGRN"%u "KBLU"triangles:"KGRN"%u ", stats->vertexCount, stats->triangleCount);
+    printf(KBLU"normals:"KGRN"%s ", stats->normals ? "yes" : "no");
+    printf(KBLU"parse(%u threads):"KGRN"%4.1fms ", stats->threads, stats->parseTime * 1000.0);
+    printf(KBLU"throughput:"KGRN"%.1fMB/s %.2fMtriangles/s ", stats->fileSize / stats->parseTime * 1e-6, stats->triangleCount / stats->parseTime * 1e-6);
+    printf(KBLU"bvh:"KGRN"%4.1fms"KRED"]\n"KNRM, stats->buildTime * 1000.0);
+}
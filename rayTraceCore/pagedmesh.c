@@ -0,0 +1,745 @@
+#include <rayTracerCore/shapes/pagedmesh.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PAGE_BUFFER_ALIGN 64
+
+static uint64_t alignTo(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+* Where each buffer sits inside a page, relative to its start
+*/
+typedef struct
+{
+    uint64_t vertices, normals, indices, nodes, order, bytes;
+} pageLayout;
+
+static pageLayout layoutPage(uint32_t vertexCount, uint32_t triangleCount, uint32_t nodeCount, bool normals)
+{
+    pageLayout l;
+    l.vertices = 0;
+    uint64_t offset = alignTo((uint64_t)vertexCount * sizeof(point3f), PAGE_BUFFER_ALIGN);
+    l.normals = offset;
+    if(normals)
+        offset = alignTo(offset + (uint64_t)vertexCount * sizeof(vector3f), PAGE_BUFFER_ALIGN);
+    l.indices = offset;
+    offset = alignTo(offset + (uint64_t)triangleCount * 3 * sizeof(uint32_t), PAGE_BUFFER_ALIGN);
+    l.nodes = offset;
+    offset = alignTo(offset + (uint64_t)nodeCount * sizeof(bvhNode), PAGE_BUFFER_ALIGN);
+    l.order = offset;
+    l.bytes = offset + (uint64_t)triangleCount * sizeof(uint32_t);
+    return l;
+}
+
+/**
+* The top level being cut out of the mesh bvh, and the source subtree behind each page
+*/
+typedef struct
+{
+    const mesh_t* m;
+    uint32_t pageTriangles;
+    uint32_t* subtreeTriangles;
+    bvhNode* top;
+    uint32_t topCount, topCapacity;
+    uint32_t* pageRoots;
+    uint32_t pageCount, pageCapacity;
+} pageCut;
+
+static uint32_t countTriangles(const mesh_t* m, uint32_t index, uint32_t* counts)
+{
+    const bvhNode* node = &m->nodes[index];
+    if(node->count > 0)
+        return counts[index] = node->count;
+    return counts[index] = countTriangles(m, index + 1, counts) + countTriangles(m, node->offset, counts);
+}
+
+static uint32_t cutNode(pageCut* c, uint32_t index)
+{
+    const bvhNode* node = &c->m->nodes[index];
+    if(c->topCount == c->topCapacity)
+    {
+        c->topCapacity = c->topCapacity ? c->topCapacity * 2 : 64;
+        c->top = realloc(c->top, c->topCapacity * sizeof(bvhNode));
+    }
+    uint32_t out = c->topCount++;
+    c->top[out].bounds = node->bounds;
+    c->top[out].axis = node->axis;
+    if(node->count > 0 || c->subtreeTriangles[index] <= c->pageTriangles)
+    {
+        if(c->pageCount == c->pageCapacity)
+        {
+            c->pageCapacity = c->pageCapacity ? c->pageCapacity * 2 : 64;
+            c->pageRoots = realloc(c->pageRoots, c->pageCapacity * sizeof(uint32_t));
+        }
+        c->top[out].count = 1;
+        c->top[out].offset = c->pageCount;
+        c->pageRoots[c->pageCount++] = index;
+        return out;
+    }
+    c->top[out].count = 0;
+    cutNode(c, index + 1);
+    uint32_t right = cutNode(c, node->offset);
+    c->top[out].offset = right;
+    return out;
+}
+
+/**
+* Mesh triangle indices under a source subtree, in leaf order
+*/
+static uint32_t gatherTriangles(const mesh_t* m, uint32_t root, uint32_t* out)
+{
+    uint32_t stack[BVH_STACK_SIZE];
+    int sp = 0;
+    uint32_t count = 0;
+    stack[sp++] = root;
+    while(sp > 0)
+    {
+        const bvhNode* node = &m->nodes[stack[--sp]];
+        if(node->count > 0)
+        {
+            for(uint32_t i = node->offset; i < node->offset + node->count; i++)
+                out[count++] = m->order[i];
+            continue;
+        }
+        stack[sp++] = node->offset;
+        stack[sp++] = (uint32_t)(node - m->nodes) + 1;
+    }
+    return count;
+}
+
+static bool writePadding(FILE* f, uint64_t* pos, uint64_t offset)
+{
+    static const char padding[PAGED_MESH_ALIGN] = {0};
+    bool ok = offset >= *pos && offset - *pos <= PAGED_MESH_ALIGN;
+    ok = ok && fwrite(padding, offset - *pos, 1, f) <= 1;
+    *pos = offset;
+    return ok;
+}
+
+static bool writeBuffer(FILE* f, uint64_t* pos, uint64_t offset, const void* data, size_t bytes)
+{
+    bool ok = writePadding(f, pos, offset) && (bytes == 0 || fwrite(data, bytes, 1, f) == 1);
+    *pos = offset + bytes;
+    return ok;
+}
+
+/**
+* Turns the triangles under one source subtree into a page with its own vertices and bvh and writes it at offset
+*/
+static bool writePage(FILE* f, uint64_t* pos, const mesh_t* m, const uint32_t* triangles, uint32_t count,
+                      uint32_t* local, pagedMeshPageRecord* record, uint64_t offset)
+{
+    uint32_t* globals = malloc((size_t)count * 3 * sizeof(uint32_t));
+    uint32_t* indices = malloc((size_t)count * 3 * sizeof(uint32_t));
+    uint32_t vertexCount = 0;
+    for(uint32_t t = 0; t < count; t++)
+    {
+        for(int corner = 0; corner < 3; corner++)
+        {
+            uint32_t v = m->indices[3 * triangles[t] + corner];
+            if(local[v] == UINT32_MAX)
+            {
+                local[v] = vertexCount;
+                globals[vertexCount++] = v;
+            }
+            indices[3 * t + corner] = local[v];
+        }
+    }
+    point3f* vertices = malloc(vertexCount * sizeof(point3f));
+    vector3f* normals = m->normals != NULL ? malloc(vertexCount * sizeof(vector3f)) : NULL;
+    for(uint32_t v = 0; v < vertexCount; v++)
+    {
+        vector3f_copy(vertices[v], m->vertices[globals[v]]);
+        if(normals != NULL)
+            vector3f_copy(normals[v], m->normals[globals[v]]);
+        local[globals[v]] = UINT32_MAX;
+    }
+    free(globals);
+
+    mesh_t page = {.vertices = vertices, .normals = normals, .indices = indices, .vertexCount = vertexCount, .triangleCount = count};
+    aabb* bounds = malloc(count * sizeof(aabb));
+    for(uint32_t t = 0; t < count; t++)
+        meshTriangleBounds(&page, t, &bounds[t]);
+    page.order = malloc(count * sizeof(uint32_t));
+    page.nodes = buildBVHNodes(bounds, count, page.order, &page.nodeCount);
+    free(bounds);
+
+    pageLayout l = layoutPage(vertexCount, count, page.nodeCount, normals != NULL);
+    record->offset = offset;
+    record->bytes = l.bytes;
+    record->vertexCount = vertexCount;
+    record->triangleCount = count;
+    record->nodeCount = page.nodeCount;
+    record->pad = 0;
+    bool ok = writeBuffer(f, pos, offset + l.vertices, vertices, vertexCount * sizeof(point3f));
+    if(normals != NULL)
+        ok = ok && writeBuffer(f, pos, offset + l.normals, normals, vertexCount * sizeof(vector3f));
+    ok = ok && writeBuffer(f, pos, offset + l.indices, indices, (size_t)count * 3 * sizeof(uint32_t));
+    ok = ok && writeBuffer(f, pos, offset + l.nodes, page.nodes, page.nodeCount * sizeof(bvhNode));
+    ok = ok && writeBuffer(f, pos, offset + l.order, page.order, count * sizeof(uint32_t));
+    cleanMeshBuffers(&page);
+    return ok;
+}
+
+bool writePagedMesh(const char* path, const mesh_t* m, uint32_t pageTriangles)
+{
+    if(m->nodeCount == 0)
+        return false;
+    pageCut c;
+    memset(&c, 0, sizeof(c));
+    c.m = m;
+    c.pageTriangles = pageTriangles ? pageTriangles : PAGED_MESH_PAGE_TRIANGLES;
+    c.subtreeTriangles = malloc(m->nodeCount * sizeof(uint32_t));
+    countTriangles(m, 0, c.subtreeTriangles);
+    cutNode(&c, 0);
+
+    pagedMeshHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PAGED_MESH_MAGIC;
+    header.version = PAGED_MESH_VERSION;
+    header.nodeSize = sizeof(bvhNode);
+    header.topNodeCount = c.topCount;
+    header.pageCount = c.pageCount;
+    header.triangleCount = m->triangleCount;
+    header.normals = m->normals != NULL;
+    header.topNodesOffset = alignTo(sizeof(header), PAGE_BUFFER_ALIGN);
+    header.pagesOffset = alignTo(header.topNodesOffset + (uint64_t)c.topCount * sizeof(bvhNode), PAGE_BUFFER_ALIGN);
+    pagedMeshPageRecord* records = calloc(c.pageCount, sizeof(pagedMeshPageRecord));
+
+    size_t tmpLength = strlen(path) + 5;
+    char* tmpPath = malloc(tmpLength);
+    snprintf(tmpPath, tmpLength, "%s.tmp", path);
+    FILE* f = fopen(tmpPath, "wb");
+    bool ok = f != NULL;
+    if(ok)
+    {
+        // Pages first, the header and page table go in front once every page's size is known
+        uint32_t* triangles = malloc(c.pageTriangles > BVH_MAX_LEAF ? c.pageTriangles * sizeof(uint32_t) : BVH_MAX_LEAF * sizeof(uint32_t));
+        uint32_t* local = malloc(m->vertexCount * sizeof(uint32_t));
+        memset(local, 0xff, m->vertexCount * sizeof(uint32_t));
+        uint64_t pos = 0;
+        uint64_t offset = alignTo(header.pagesOffset + (uint64_t)c.pageCount * sizeof(pagedMeshPageRecord), PAGED_MESH_ALIGN);
+        ok = writePadding(f, &pos, 0) && fseeko(f, (off_t)offset, SEEK_SET) == 0;
+        pos = offset;
+        for(uint32_t p = 0; p < c.pageCount && ok; p++)
+        {
+            uint32_t count = gatherTriangles(m, c.pageRoots[p], triangles);
+            ok = writePage(f, &pos, m, triangles, count, local, &records[p], offset);
+            header.vertexCount += records[p].vertexCount;
+            offset = alignTo(pos, PAGED_MESH_ALIGN);
+        }
+        header.fileSize = pos;
+        free(triangles);
+        free(local);
+        ok = ok && fseeko(f, 0, SEEK_SET) == 0;
+        pos = 0;
+        ok = ok && writeBuffer(f, &pos, 0, &header, sizeof(header));
+        ok = ok && writeBuffer(f, &pos, header.topNodesOffset, c.top, c.topCount * sizeof(bvhNode));
+        ok = ok && writeBuffer(f, &pos, header.pagesOffset, records, c.pageCount * sizeof(pagedMeshPageRecord));
+        ok = (fclose(f) == 0) && ok;
+        ok = ok && rename(tmpPath, path) == 0;
+        if(!ok)
+            remove(tmpPath);
+    }
+    free(tmpPath);
+    free(records);
+    free(c.subtreeTriangles);
+    free(c.top);
+    free(c.pageRoots);
+    return ok;
+}
+
+static bool readAt(int fd, void* data, size_t bytes, uint64_t offset)
+{
+    char* out = data;
+    while(bytes > 0)
+    {
+        ssize_t got = pread(fd, out, bytes, (off_t)offset);
+        if(got <= 0)
+            return false;
+        out += got;
+        bytes -= (size_t)got;
+        offset += (uint64_t)got;
+    }
+    return true;
+}
+
+static bool validPagedMesh(const pagedMeshHeader* header, const bvhNode* top, const pagedMeshPageRecord* pages, uint64_t size)
+{
+    for(uint32_t i = 0; i < header->topNodeCount; i++)
+    {
+        uint32_t limit = top[i].count == 0 ? header->topNodeCount : header->pageCount;
+        if(top[i].offset >= limit)
+            return false;
+    }
+    for(uint32_t p = 0; p < header->pageCount; p++)
+    {
+        pageLayout l = layoutPage(pages[p].vertexCount, pages[p].triangleCount, pages[p].nodeCount, header->normals != 0);
+        if(pages[p].offset % PAGED_MESH_ALIGN != 0 || pages[p].bytes != l.bytes || pages[p].offset > size ||
+           pages[p].bytes > size - pages[p].offset)
+            return false;
+    }
+    return true;
+}
+
+object* loadPagedMesh(const char* path, const material mat, size_t budget)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    struct stat info;
+    pagedMeshHeader header;
+    if(fstat(fd, &info) != 0 || !readAt(fd, &header, sizeof(header), 0) ||
+       header.magic != PAGED_MESH_MAGIC || header.version != PAGED_MESH_VERSION || header.nodeSize != sizeof(bvhNode) ||
+       header.fileSize != (uint64_t)info.st_size || header.topNodeCount == 0 ||
+       header.topNodesOffset + (uint64_t)header.topNodeCount * sizeof(bvhNode) > header.pagesOffset ||
+       header.pagesOffset + (uint64_t)header.pageCount * sizeof(pagedMeshPageRecord) > header.fileSize)
+    {
+        close(fd);
+        return NULL;
+    }
+    bvhNode* top = malloc(header.topNodeCount * sizeof(bvhNode));
+    pagedMeshPageRecord* pages = malloc(header.pageCount * sizeof(pagedMeshPageRecord));
+    if(!readAt(fd, top, header.topNodeCount * sizeof(bvhNode), header.topNodesOffset) ||
+       !readAt(fd, pages, header.pageCount * sizeof(pagedMeshPageRecord), header.pagesOffset) ||
+       !validPagedMesh(&header, top, pages, header.fileSize))
+    {
+        free(top);
+        free(pages);
+        close(fd);
+        return NULL;
+    }
+
+    pagedMesh_t* pm = calloc(1, sizeof(pagedMesh_t));
+    pm->fd = fd;
+    pm->top = top;
+    pm->topNodeCount = header.topNodeCount;
+    pm->pages = pages;
+    pm->pageCount = header.pageCount;
+    pm->triangleCount = header.triangleCount;
+    pm->normals = header.normals != 0;
+    pm->slots = calloc(pm->pageCount, sizeof(pagedMeshSlot));
+    pm->lruHead = pm->lruTail = PAGED_MESH_NO_PAGE;
+    pm->budget = budget;
+    pthread_mutex_init(&pm->lock, NULL);
+    pthread_cond_init(&pm->loaded, NULL);
+    object* ret = malloc(sizeof(object));
+    initObject(ret, PAGED_MESH, mat, pm);
+    return ret;
+}
+
+static void lruUnlink(pagedMesh_t* pm, uint32_t page)
+{
+    pagedMeshSlot* slot = &pm->slots[page];
+    if(slot->prev != PAGED_MESH_NO_PAGE)
+        pm->slots[slot->prev].next = slot->next;
+    else
+        pm->lruHead = slot->next;
+    if(slot->next != PAGED_MESH_NO_PAGE)
+        pm->slots[slot->next].prev = slot->prev;
+    else
+        pm->lruTail = slot->prev;
+}
+
+static void lruPushFront(pagedMesh_t* pm, uint32_t page)
+{
+    pagedMeshSlot* slot = &pm->slots[page];
+    slot->prev = PAGED_MESH_NO_PAGE;
+    slot->next = pm->lruHead;
+    if(pm->lruHead != PAGED_MESH_NO_PAGE)
+        pm->slots[pm->lruHead].prev = page;
+    else
+        pm->lruTail = page;
+    pm->lruHead = page;
+}
+
+/**
+* Drops unpinned pages from the cold end until the cache fits its budget, called with the lock held
+*/
+static void evictPages(pagedMesh_t* pm)
+{
+    uint32_t page = pm->lruTail;
+    while(pm->budget > 0 && pm->stats.residentBytes > pm->budget && page != PAGED_MESH_NO_PAGE)
+    {
+        pagedMeshSlot* slot = &pm->slots[page];
+        uint32_t prev = slot->prev;
+        if(slot->pins == 0)
+        {
+            lruUnlink(pm, page);
+            free(slot->data);
+            slot->data = NULL;
+            slot->state = PAGE_MISSING;
+            pm->stats.residentBytes -= pm->pages[page].bytes;
+            pm->stats.evictions++;
+        }
+        page = prev;
+    }
+}
+
+/**
+* Pins a page and returns it as a mesh. Without load a page that is not resident gives NULL
+* instead of being read. The read itself happens outside the lock, other threads wanting
+* the same page wait for it rather than read it twice.
+*/
+static const mesh_t* acquirePage(pagedMesh_t* pm, uint32_t page, bool load)
+{
+    pagedMeshSlot* slot = &pm->slots[page];
+    pthread_mutex_lock(&pm->lock);
+    while(load && slot->state == PAGE_LOADING)
+        pthread_cond_wait(&pm->loaded, &pm->lock);
+    if(slot->state == PAGE_RESIDENT)
+    {
+        pm->stats.hits++;
+        slot->pins++;
+        lruUnlink(pm, page);
+        lruPushFront(pm, page);
+        pthread_mutex_unlock(&pm->lock);
+        return &slot->mesh;
+    }
+    if(!load || slot->state == PAGE_LOADING)
+    {
+        pthread_mutex_unlock(&pm->lock);
+        return NULL;
+    }
+    slot->state = PAGE_LOADING;
+    pm->stats.faults++;
+    pthread_mutex_unlock(&pm->lock);
+
+    const pagedMeshPageRecord* record = &pm->pages[page];
+    void* data = NULL;
+    if(posix_memalign(&data, PAGE_BUFFER_ALIGN, record->bytes > 0 ? record->bytes : 1) != 0)
+        data = NULL;
+    if(data != NULL && !readAt(pm->fd, data, record->bytes, record->offset))
+    {
+        free(data);
+        data = NULL;
+    }
+
+    pthread_mutex_lock(&pm->lock);
+    if(data == NULL)
+    {
+        slot->state = PAGE_MISSING;
+        pthread_cond_broadcast(&pm->loaded);
+        pthread_mutex_unlock(&pm->lock);
+        return NULL;
+    }
+    pageLayout l = layoutPage(record->vertexCount, record->triangleCount, record->nodeCount, pm->normals);
+    char* base = data;
+    slot->data = data;
+    slot->mesh.vertices = (point3f*)(base + l.vertices);
+    slot->mesh.normals = pm->normals ? (vector3f*)(base + l.normals) : NULL;
+    slot->mesh.indices = (uint32_t*)(base + l.indices);
+    slot->mesh.vertexCount = record->vertexCount;
+    slot->mesh.triangleCount = record->triangleCount;
+    slot->mesh.nodes = (bvhNode*)(base + l.nodes);
+    slot->mesh.nodeCount = record->nodeCount;
+    slot->mesh.order = (uint32_t*)(base + l.order);
+    slot->state = PAGE_RESIDENT;
+    slot->pins = 1;
+    pm->stats.bytesRead += record->bytes;
+    pm->stats.residentBytes += record->bytes;
+    if(pm->stats.residentBytes > pm->stats.peakBytes)
+        pm->stats.peakBytes = pm->stats.residentBytes;
+    lruPushFront(pm, page);
+    evictPages(pm);
+    pthread_cond_broadcast(&pm->loaded);
+    pthread_mutex_unlock(&pm->lock);
+    return &slot->mesh;
+}
+
+static void releasePage(pagedMesh_t* pm, uint32_t page)
+{
+    pthread_mutex_lock(&pm->lock);
+    pm->slots[page].pins--;
+    evictPages(pm);
+    pthread_mutex_unlock(&pm->lock);
+}
+
+/**
+* A batch ray waiting for a page, tnear is where it enters the page's bounds
+*/
+typedef struct
+{
+    uint32_t ray, page;
+    float tnear;
+} parkedRay;
+
+typedef struct
+{
+    parkedRay* rays;
+    uint32_t count, capacity;
+} parkedList;
+
+static void parkRay(parkedList* parked, uint32_t ray, uint32_t page, float tnear)
+{
+    if(parked->count == parked->capacity)
+    {
+        parked->capacity = parked->capacity ? parked->capacity * 2 : 256;
+        parked->rays = realloc(parked->rays, parked->capacity * sizeof(parkedRay));
+    }
+    parked->rays[parked->count++] = (parkedRay){.ray = ray, .page = page, .tnear = tnear};
+}
+
+/**
+* Walks the top level near child first and tests each page the ray reaches, the same way
+* the mesh walks its own nodes. With parked set, pages that are not resident are left for
+* later under rayIndex instead of read. Returns the page local triangle, hitPage its page.
+*/
+static uint32_t traverse(pagedMesh_t* pm, ray* r, bool closest, uint32_t* hitPage, parkedList* parked, uint32_t rayIndex)
+{
+    vector3f invDir = {1.f / r->dir[0], 1.f / r->dir[1], 1.f / r->dir[2]};
+    bool dirNeg[3] = {invDir[0] < 0, invDir[1] < 0, invDir[2] < 0};
+    uint32_t nearest = MESH_NO_TRIANGLE;
+    uint32_t stack[BVH_STACK_SIZE];
+    int sp = 0;
+    uint32_t index = 0;
+    while(true)
+    {
+        const bvhNode* node = &pm->top[index];
+        float tnear;
+        if(aabbHit(&node->bounds, r, invDir, r->tmax, &tnear))
+        {
+            if(node->count == 0)
+            {
+                if(dirNeg[node->axis])
+                {
+                    stack[sp++] = index + 1;
+                    index = node->offset;
+                }
+                else
+                {
+                    stack[sp++] = node->offset;
+                    index = index + 1;
+                }
+                continue;
+            }
+            uint32_t page = node->offset;
+            const mesh_t* m = acquirePage(pm, page, parked == NULL);
+            if(m == NULL)
+            {
+                if(parked != NULL)
+                    parkRay(parked, rayIndex, page, tnear);
+            }
+            else
+            {
+                uint32_t tri = closest ? meshClosestTriangle(m, r) : (meshAnyTriangle(m, r) ? 0 : MESH_NO_TRIANGLE);
+                releasePage(pm, page);
+                if(tri != MESH_NO_TRIANGLE)
+                {
+                    nearest = tri;
+                    *hitPage = page;
+                    if(!closest)
+                        return nearest;
+                }
+            }
+        }
+        if(sp == 0)
+            break;
+        index = stack[--sp];
+    }
+    return nearest;
+}
+
+static int compareParked(const void* a, const void* b)
+{
+    const parkedRay* x = a;
+    const parkedRay* y = b;
+    if(x->page != y->page)
+        return x->page < y->page ? -1 : 1;
+    return x->ray < y->ray ? -1 : x->ray > y->ray;
+}
+
+/**
+* Sorts the parked rays by page and asks the OS to start reading the pages the cache has room for,
+* so later pages arrive while earlier ones are being tested
+*/
+static void prepareParked(pagedMesh_t* pm, parkedList* parked)
+{
+    if(parked->count == 0)
+        return;
+    qsort(parked->rays, parked->count, sizeof(parkedRay), compareParked);
+    uint64_t hinted = 0;
+    for(uint32_t i = 0; i < parked->count; i++)
+    {
+        uint32_t page = parked->rays[i].page;
+        if(i > 0 && parked->rays[i - 1].page == page)
+            continue;
+        if(pm->budget > 0 && hinted + pm->pages[page].bytes > pm->budget)
+            break;
+        hinted += pm->pages[page].bytes;
+        posix_fadvise(pm->fd, (off_t)pm->pages[page].offset, (off_t)pm->pages[page].bytes, POSIX_FADV_WILLNEED);
+    }
+    pthread_mutex_lock(&pm->lock);
+    pm->stats.deferred += parked->count;
+    pthread_mutex_unlock(&pm->lock);
+}
+
+void pagedMeshClosestHits(pagedMesh_t* pm, ray* rays, uint32_t count, pagedTriangle* hits)
+{
+    parkedList parked = {NULL, 0, 0};
+    for(uint32_t i = 0; i < count; i++)
+    {
+        hits[i].page = PAGED_MESH_NO_PAGE;
+        hits[i].triangle = traverse(pm, &rays[i], true, &hits[i].page, &parked, i);
+    }
+    prepareParked(pm, &parked);
+    // Order does not matter for the nearest hit, each page only has to be read once for every ray waiting on it
+    uint32_t i = 0;
+    while(i < parked.count)
+    {
+        uint32_t page = parked.rays[i].page;
+        const mesh_t* m = acquirePage(pm, page, true);
+        for(; i < parked.count && parked.rays[i].page == page; i++)
+        {
+            ray* r = &rays[parked.rays[i].ray];
+            if(m == NULL || parked.rays[i].tnear > r->tmax)
+                continue;
+            uint32_t tri = meshClosestTriangle(m, r);
+            if(tri != MESH_NO_TRIANGLE)
+            {
+                hits[parked.rays[i].ray].page = page;
+                hits[parked.rays[i].ray].triangle = tri;
+            }
+        }
+        if(m != NULL)
+            releasePage(pm, page);
+    }
+    free(parked.rays);
+}
+
+void pagedMeshAnyHits(pagedMesh_t* pm, const ray* rays, uint32_t count, bool* blocked)
+{
+    parkedList parked = {NULL, 0, 0};
+    for(uint32_t i = 0; i < count; i++)
+    {
+        ray testRay = rays[i];
+        uint32_t page;
+        blocked[i] = traverse(pm, &testRay, false, &page, &parked, i) != MESH_NO_TRIANGLE;
+    }
+    prepareParked(pm, &parked);
+    uint32_t i = 0;
+    while(i < parked.count)
+    {
+        uint32_t page = parked.rays[i].page;
+        const mesh_t* m = acquirePage(pm, page, true);
+        for(; i < parked.count && parked.rays[i].page == page; i++)
+        {
+            uint32_t ray = parked.rays[i].ray;
+            if(m != NULL && !blocked[ray])
+                blocked[ray] = meshAnyTriangle(m, &rays[ray]);
+        }
+        if(m != NULL)
+            releasePage(pm, page);
+    }
+    free(parked.rays);
+}
+
+void pagedMeshSurface(pagedMesh_t* pm, const ray r, pagedTriangle hit, const material mat, float t, rayHit* rh)
+{
+    const mesh_t* m = acquirePage(pm, hit.page, true);
+    if(m == NULL)
+    {
+        rh->hit = false;
+        rh->mat = EMPTYNESS;
+        return;
+    }
+    meshSurface(r, m, hit.triangle, mat, t, rh);
+    releasePage(pm, hit.page);
+}
+
+bool pagedMeshTestHit(const ray r, const object *obj)
+{
+    ray testRay = r;
+    uint32_t page;
+    return traverse(obj->shape, &testRay, false, &page, NULL, 0) != MESH_NO_TRIANGLE;
+}
+
+bool pagedMeshHitTime(const ray *r, const object *o, float *time, hitPath *path)
+{
+    ray testRay = *r;
+    uint32_t page;
+    uint32_t tri = traverse(o->shape, &testRay, true, &page, NULL, 0);
+    if(tri == MESH_NO_TRIANGLE)
+        return false;
+    *time = testRay.tmax;
+    path->level[0] = (hitLevel){page, tri, testRay.tmax};
+    path->depth = 1;
+    return true;
+}
+
+void pagedMeshHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH)
+{
+    const hitLevel* hit = &path->level[path->depth - 1];
+    pagedMeshSurface(o->shape, r, (pagedTriangle){.page = hit->primitive, .triangle = hit->detail}, o->mat, t, rayH);
+}
+
+bool pagedMeshHit(const ray r, const object *o, float *time, rayHit *rayH)
+{
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    ray testRay = r;
+    pagedTriangle hit;
+    hit.triangle = traverse(o->shape, &testRay, true, &hit.page, NULL, 0);
+    if(hit.triangle == MESH_NO_TRIANGLE)
+        return false;
+
+    *time = testRay.tmax;
+    pagedMeshSurface(o->shape, r, hit, o->mat, testRay.tmax, rayH);
+    return true;
+}
+
+void pagedMeshBounds(const object *o, aabb *box)
+{
+    const pagedMesh_t* pm = o->shape;
+    *box = pm->top[0].bounds;
+}
+
+void pagedMeshPrint(void *s)
+{
+    const pagedMesh_t* pm = s;
+    printf(KCYN"pagedMesh[");
+    printf(KBLU"triangles:"KGRN"%u ", pm->triangleCount);
+    printf(KBLU"pages:"KGRN"%u ", pm->pageCount);
+    printf(KBLU"normals:"KGRN"%s ", pm->normals ? "yes" : "no");
+    printf(KBLU"bytes:"KGRN"%zu", pagedMeshMemoryUsage(pm));
+    printf(KCYN"]"KNRM);
+}
+
+void printPagedMeshStats(const pagedMesh_t* pm)
+{
+    const pagedMeshStats* s = &pm->stats;
+    uint64_t lookups = s->hits + s->faults;
+    printf(KRED"pages["KBLU"pages:"KGRN"%u "KBLU"budget:"KGRN"%.1fMB ", pm->pageCount, pm->budget * 1e-6);
+    printf(KBLU"hits:"KGRN"%llu "KBLU"faults:"KGRN"%llu(%4.1f%% hit) ", (unsigned long long)s->hits, (unsigned long long)s->faults,
+           lookups > 0 ? 100.0 * s->hits / lookups : 0.0);
+    printf(KBLU"evictions:"KGRN"%llu "KBLU"deferred rays:"KGRN"%llu ", (unsigned long long)s->evictions, (unsigned long long)s->deferred);
+    printf(KBLU"read:"KGRN"%.1fMB "KBLU"resident:"KGRN"%.1fMB "KBLU"peak:"KGRN"%.1fMB"KRED"]\n"KNRM,
+           s->bytesRead * 1e-6, s->residentBytes * 1e-6, s->peakBytes * 1e-6);
+}
+
+size_t pagedMeshMemoryUsage(const pagedMesh_t* pm)
+{
+    return sizeof(pagedMesh_t) + pm->topNodeCount * sizeof(bvhNode) +
+           pm->pageCount * (sizeof(pagedMeshPageRecord) + sizeof(pagedMeshSlot)) + pm->stats.residentBytes;
+}
+
+void cleanPagedMesh(pagedMesh_t* pm)
+{
+    for(uint32_t p = 0; p < pm->pageCount; p++)
+        free(pm->slots[p].data);
+    free(pm->slots);
+    free(pm->top);
+    free(pm->pages);
+    close(pm->fd);
+    pthread_mutex_destroy(&pm->lock);
+    pthread_cond_destroy(&pm->loaded);
+}
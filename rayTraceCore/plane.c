@@ -0,0 +1,181 @@
+#include <rayTracerCore/shapes/plane.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+
+object* createPlane(const material mat, const vector3f normal, const point3f point)
+{
+    plane_t* p = malloc(sizeof(plane_t));
+    vector3f_copy(p->normal, normal);
+    vector3f_normalize(p->normal);
+    p->offset = vector3f_dot(p->normal, point);
+    object* ret = malloc(sizeof(object));
+    initObject(ret, PLANE, mat, p);
+    return ret;
+}
+
+object* createQuad(const material mat, const point3f corner, const vector3f u, const vector3f v)
+{
+    object* ret = malloc(sizeof(object));
+    initObject(ret, QUAD, mat, malloc(sizeof(parallelogram_t)));
+    setQuadVertices(ret, corner, u, v);
+    return ret;
+}
+
+void planarSurface(const ray r, const vector3f normal, const material mat, float t, rayHit *rayH)
+{
+    rayH->hit = true;
+    rayH->mat = mat;
+    vector3f dirOffset = {};
+    vector3f_scaleMul_new(dirOffset, r.dir, t);
+    vector3f_add_new(rayH->location, r.origin, dirOffset);
+    vector3f_copy(rayH->normal, normal);
+    rayH->originRay = r;
+    rayH->offsetError = .1;
+}
+
+bool planeTestHit(const ray r, const object *obj)
+{
+    float t;
+    return planeIntersect(&r, obj->shape, &t);
+}
+
+bool planeHit(const ray r, const object *o, float *time, rayHit *rayH)
+{
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    float t;
+    if(!planeIntersect(&r, o->shape, &t))
+        return false;
+
+    *time = t;
+    planeHitRecord(r, o, t, NULL, rayH);
+    return true;
+}
+
+bool planeHitTime(const ray *r, const object *o, float *time, hitPath *path)
+{
+    (void)path;
+    return planeIntersect(r, o->shape, time);
+}
+
+void planeHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH)
+{
+    (void)path;
+    const plane_t* p = o->shape;
+    planarSurface(r, p->normal, o->mat, t, rayH);
+}
+
+void planeBounds(const object *o, aabb *box)
+{
+    planeShapeBounds(o->shape, box);
+}
+
+void planeShapeBounds(const plane_t *p, aabb *box)
+{
+    // Endless along every axis except the normal of an axis aligned plane
+    vector3f_set(box->min, -INFINITY, -INFINITY, -INFINITY);
+    vector3f_set(box->max, INFINITY, INFINITY, INFINITY);
+    for(int i = 0; i < 3; i++)
+    {
+        if(fabsf(p->normal[i]) == 1.f)
+            box->min[i] = box->max[i] = p->offset * p->normal[i];
+    }
+}
+
+void planePrint(void *s)
+{
+    const plane_t* p = s;
+    printf(KCYN"plane[");
+    printf(KBLU"normal:"KGRN);
+    vector3f_print(p->normal);
+    printf(KBLU"offset:"KGRN"%f", p->offset);
+    printf(KCYN"]"KNRM);
+}
+
+bool quadTestHit(const ray r, const object *obj)
+{
+    float t;
+    return quadIntersect(&r, obj->shape, &t);
+}
+
+bool quadHit(const ray r, const object *o, float *time, rayHit *rayH)
+{
+    rayH->hit = false;
+    rayH->mat = EMPTYNESS;
+    float t;
+    if(!quadIntersect(&r, o->shape, &t))
+        return false;
+
+    *time = t;
+    quadHitRecord(r, o, t, NULL, rayH);
+    return true;
+}
+
+bool quadHitTime(const ray *r, const object *o, float *time, hitPath *path)
+{
+    (void)path;
+    return quadIntersect(r, o->shape, time);
+}
+
+void quadHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH)
+{
+    (void)path;
+    const parallelogram_t* q = o->shape;
+    planarSurface(r, q->normal, o->mat, t, rayH);
+}
+
+void quadBounds(const object *o, aabb *box)
+{
+    quadShapeBounds(o->shape, box);
+}
+
+void quadShapeBounds(const parallelogram_t *q, aabb *box)
+{
+    aabbEmpty(box);
+    for(int corner = 0; corner < 4; corner++)
+    {
+        point3f p = {};
+        for(int i = 0; i < 3; i++)
+            p[i] = q->corner[i] + (corner & 1 ? q->u[i] : 0) + (corner & 2 ? q->v[i] : 0);
+        aabbExtendPoint(box, p);
+    }
+    // The same padding as triangles, the far corners are sums that round
+    for(int i = 0; i < 3; i++)
+    {
+        float pad = (fabsf(box->min[i]) + fabsf(box->max[i])) * FLT_EPSILON;
+        box->min[i] -= pad;
+        box->max[i] += pad;
+    }
+}
+
+void quadPrint(void *s)
+{
+    const parallelogram_t* q = s;
+    printf(KCYN"quad[");
+    printf(KBLU"corner:"KGRN);
+    vector3f_print(q->corner);
+    printf(KBLU"u:"KGRN);
+    vector3f_print(q->u);
+    printf(KBLU"v:"KGRN);
+    vector3f_print(q->v);
+    printf(KCYN"]"KNRM);
+}
+
+void setQuadVertices(object *o, const point3f corner, const vector3f u, const vector3f v)
+{
+    parallelogram_t* q = o->shape;
+    vector3f_copy(q->corner, corner);
+    vector3f_copy(q->u, u);
+    vector3f_copy(q->v, v);
+    vector3f_cross_new(q->normal, u, v);
+    vector3f_normalize(q->normal);
+    q->offset = vector3f_dot(q->normal, corner);
+    // a = dot(p, du) needs du perpendicular to v in the plane and dot(u, du) == 1, dv the same way round
+    vector3f_cross_new(q->du, v, q->normal);
+    vector3f_scaleMul(q->du, 1.f / vector3f_dot(u, q->du));
+    vector3f_cross_new(q->dv, q->normal, u);
+    vector3f_scaleMul(q->dv, 1.f / vector3f_dot(v, q->dv));
+}
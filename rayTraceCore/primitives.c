@@ -0,0 +1,345 @@
+#include <rayTracerCore/primitives.h>
+#include <rayTracerCore/shapes/ellipsoid.h>
+#include <rayTracerCore/shapes/triangle.h>
+#include <rayTracerCore/shapes/instance.h>
+#include <rayTracerCore/shapes/mesh.h>
+#include <rayTracerCore/shapes/plane.h>
+#include <rayTracerCore/shapes/box.h>
+#include <rayTracerCore/shapes/pagedmesh.h>
+#include <util/colors.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* typeNames[PRIMITIVE_TYPES] = {"spheres", "ellipsoids", "triangles", "instances", "meshes", "planes", "quads", "boxes", "paged meshes"};
+
+primitiveStore* createPrimitiveStore(void)
+{
+    primitiveStore* store = calloc(1, sizeof(primitiveStore));
+    store->arrays[SPHERE].stride = sizeof(ellipsoid_t);
+    store->arrays[ELLIPSOID].stride = sizeof(ellipsoid_t);
+    store->arrays[TRIANGLE].stride = sizeof(triangle_t);
+    // Instances and meshes are only reached through their objects
+    store->arrays[INSTANCE].stride = 0;
+    store->arrays[MESH].stride = 0;
+    store->arrays[PAGED_MESH].stride = 0;
+    store->arrays[PLANE].stride = sizeof(plane_t);
+    store->arrays[QUAD].stride = sizeof(parallelogram_t);
+    store->arrays[BOX].stride = sizeof(box_t);
+    return store;
+}
+
+/**
+* Index of a new slot at the end of a, or PRIMITIVE_NONE when it is out of ids
+*/
+static primitiveId reserve(primitiveArray* a, geoEnum type)
+{
+    if(a->count > PRIMITIVE_MAX_INDEX)
+        return PRIMITIVE_NONE;
+    if(a->count == a->capacity)
+    {
+        a->capacity = a->capacity ? a->capacity * 2 : 64;
+        a->shapes = realloc(a->shapes, a->capacity * a->stride);
+        a->materials = realloc(a->materials, a->capacity * sizeof(material));
+        if(a->objects != NULL)
+            a->objects = realloc(a->objects, a->capacity * sizeof(object*));
+    }
+    return PRIMITIVE_ID(type, a->count++);
+}
+
+static primitiveId add(primitiveStore* store, geoEnum type, const material mat, const void* shape, const object* source)
+{
+    primitiveArray* a = &store->arrays[type];
+    primitiveId id = reserve(a, type);
+    if(id == PRIMITIVE_NONE)
+        return id;
+    uint32_t index = PRIMITIVE_INDEX(id);
+    // Sources are only kept once there is one to keep
+    if(source != NULL && a->objects == NULL)
+        a->objects = calloc(a->capacity, sizeof(object*));
+    if(a->stride > 0)
+        memcpy((char*)a->shapes + index * a->stride, shape, a->stride);
+    a->materials[index] = mat;
+    if(a->objects != NULL)
+        a->objects[index] = source;
+    store->count++;
+    return id;
+}
+
+primitiveId primitiveStoreAddObject(primitiveStore* store, const object* obj)
+{
+    return add(store, obj->type, obj->mat, obj->shape, obj);
+}
+
+primitiveId primitiveStoreAddSphere(primitiveStore* store, const material mat, float radius, const point3f center)
+{
+    object* obj = createSphere(mat, radius, center);
+    primitiveId id = add(store, SPHERE, mat, obj->shape, NULL);
+    cleanObjectList(&obj);
+    return id;
+}
+
+primitiveId primitiveStoreAddTriangle(primitiveStore* store, const material mat, const point3f p1, const point3f p2, const point3f p3)
+{
+    object* obj = createTriangle(mat, p1, p2, p3);
+    primitiveId id = add(store, TRIANGLE, mat, obj->shape, NULL);
+    cleanObjectList(&obj);
+    return id;
+}
+
+primitiveStore* buildPrimitiveStore(const object* list)
+{
+    primitiveStore* store = createPrimitiveStore();
+    for(const object* obj = list; obj != NULL; obj = obj->next)
+        primitiveStoreAddObject(store, obj);
+    return store;
+}
+
+/**
+* The per type loops every intersection goes through, i is an index into the type's array
+*/
+static inline bool intersectOne(const primitiveArray* a, geoEnum type, uint32_t i, const ray* r, float* t, hitPath* path)
+{
+    switch(type)
+    {
+    case SPHERE:
+        return sphereIntersect(r, (const ellipsoid_t*)a->shapes + i, t);
+    case ELLIPSOID:
+        return ellipsoidIntersect(r, (const ellipsoid_t*)a->shapes + i, t);
+    case TRIANGLE:
+        return triangleIntersect(r, (const triangle_t*)a->shapes + i, t);
+    case PLANE:
+        return planeIntersect(r, (const plane_t*)a->shapes + i, t);
+    case QUAD:
+        return quadIntersect(r, (const parallelogram_t*)a->shapes + i, t);
+    case BOX:
+        return boxIntersect(r, (const box_t*)a->shapes + i, t);
+    case INSTANCE:
+    case MESH:
+    case PAGED_MESH:
+        return a->objects[i]->intersect(r, a->objects[i], t, path);
+    }
+    return false;
+}
+
+static inline bool occludesOne(const primitiveArray* a, geoEnum type, uint32_t i, const ray* r)
+{
+    if(type == INSTANCE || type == MESH || type == PAGED_MESH)
+        return a->objects[i]->test(*r, a->objects[i]);
+    float t;
+    return intersectOne(a, type, i, r, &t, NULL);
+}
+
+/**
+* One array from begin to end, the switch is hoisted out of the loop so each type's kernel inlines
+*/
+#define CLOSEST_LOOP(kernel, shapeType)                                     \
+    for(uint32_t i = begin; i < end; i++)                                   \
+    {                                                                       \
+        float t;                                                            \
+        if(kernel(r, (const shapeType*)a->shapes + i, &t) && t < r->tmax)   \
+        {                                                                   \
+            r->tmax = t;                                                    \
+            best = PRIMITIVE_ID(type, i);                                   \
+        }                                                                   \
+    }
+
+static primitiveId closestInRange(const primitiveArray* a, geoEnum type, uint32_t begin, uint32_t end, ray* r, primitiveId best, hitPath* path)
+{
+    switch(type)
+    {
+    case SPHERE:
+        CLOSEST_LOOP(sphereIntersect, ellipsoid_t)
+        break;
+    case ELLIPSOID:
+        CLOSEST_LOOP(ellipsoidIntersect, ellipsoid_t)
+        break;
+    case TRIANGLE:
+        CLOSEST_LOOP(triangleIntersect, triangle_t)
+        break;
+    case PLANE:
+        CLOSEST_LOOP(planeIntersect, plane_t)
+        break;
+    case QUAD:
+        CLOSEST_LOOP(quadIntersect, parallelogram_t)
+        break;
+    case BOX:
+        CLOSEST_LOOP(boxIntersect, box_t)
+        break;
+    case INSTANCE:
+    case MESH:
+    case PAGED_MESH:
+        for(uint32_t i = begin; i < end; i++)
+        {
+            // A candidate's path is only kept once it is the nearest
+            float t;
+            hitPath candidate;
+            if(intersectOne(a, type, i, r, &t, &candidate) && t < r->tmax)
+            {
+                r->tmax = t;
+                best = PRIMITIVE_ID(type, i);
+                *path = candidate;
+            }
+        }
+        break;
+    }
+    return best;
+}
+
+primitiveId primitiveStoreClosestHit(const primitiveStore* store, ray* r, hitPath* path)
+{
+    primitiveId best = PRIMITIVE_NONE;
+    for(int type = 0; type < PRIMITIVE_TYPES; type++)
+    {
+        const primitiveArray* a = &store->arrays[type];
+        best = closestInRange(a, (geoEnum)type, 0, a->count, r, best, path);
+    }
+    return best;
+}
+
+primitiveId primitivesClosestHit(const primitiveStore* store, const primitiveId* ids, uint32_t count, ray* r, hitPath* path)
+{
+    primitiveId best = PRIMITIVE_NONE;
+    uint32_t i = 0;
+    while(i < count)
+    {
+        geoEnum type = PRIMITIVE_TYPE(ids[i]);
+        const primitiveArray* a = &store->arrays[type];
+        // Consecutive indices of one type are a range, anything else goes one at a time
+        uint32_t first = PRIMITIVE_INDEX(ids[i]);
+        uint32_t end = i + 1;
+        while(end < count && ids[end] == ids[end - 1] + 1)
+            end++;
+        best = closestInRange(a, type, first, first + (end - i), r, best, path);
+        i = end;
+    }
+    return best;
+}
+
+primitiveId primitiveStoreAnyHit(const primitiveStore* store, const ray r)
+{
+    for(int type = 0; type < PRIMITIVE_TYPES; type++)
+    {
+        const primitiveArray* a = &store->arrays[type];
+        for(uint32_t i = 0; i < a->count; i++)
+        {
+            if(occludesOne(a, (geoEnum)type, i, &r))
+                return PRIMITIVE_ID(type, i);
+        }
+    }
+    return PRIMITIVE_NONE;
+}
+
+primitiveId primitivesAnyHit(const primitiveStore* store, const primitiveId* ids, uint32_t count, const ray r)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        const primitiveArray* a = &store->arrays[PRIMITIVE_TYPE(ids[i])];
+        if(occludesOne(a, PRIMITIVE_TYPE(ids[i]), PRIMITIVE_INDEX(ids[i]), &r))
+            return ids[i];
+    }
+    return PRIMITIVE_NONE;
+}
+
+void primitiveSurface(const primitiveStore* store, primitiveId id, const ray r, float t, const hitPath* path, rayHit* rh)
+{
+    const primitiveArray* a = &store->arrays[PRIMITIVE_TYPE(id)];
+    uint32_t i = PRIMITIVE_INDEX(id);
+    switch(PRIMITIVE_TYPE(id))
+    {
+    case SPHERE:
+        sphereSurface(r, (const ellipsoid_t*)a->shapes + i, a->materials[i], t, rh);
+        break;
+    case ELLIPSOID:
+        ellipsoidSurface(r, (const ellipsoid_t*)a->shapes + i, a->materials[i], t, rh);
+        break;
+    case TRIANGLE:
+        triangleSurface(r, (const triangle_t*)a->shapes + i, a->materials[i], t, rh);
+        break;
+    case PLANE:
+        planarSurface(r, ((const plane_t*)a->shapes + i)->normal, a->materials[i], t, rh);
+        break;
+    case QUAD:
+        planarSurface(r, ((const parallelogram_t*)a->shapes + i)->normal, a->materials[i], t, rh);
+        break;
+    case BOX:
+        boxSurface(r, (const box_t*)a->shapes + i, a->materials[i], t, rh);
+        break;
+    case INSTANCE:
+    case MESH:
+    case PAGED_MESH:
+        a->objects[i]->surface(r, a->objects[i], t, path, rh);
+        break;
+    }
+}
+
+void primitiveBounds(const primitiveStore* store, primitiveId id, aabb* box)
+{
+    const primitiveArray* a = &store->arrays[PRIMITIVE_TYPE(id)];
+    uint32_t i = PRIMITIVE_INDEX(id);
+    switch(PRIMITIVE_TYPE(id))
+    {
+    case SPHERE:
+    case ELLIPSOID:
+        ellipsoidShapeBounds((const ellipsoid_t*)a->shapes + i, box);
+        break;
+    case TRIANGLE:
+        triangleShapeBounds((const triangle_t*)a->shapes + i, box);
+        break;
+    case PLANE:
+        planeShapeBounds((const plane_t*)a->shapes + i, box);
+        break;
+    case QUAD:
+        quadShapeBounds((const parallelogram_t*)a->shapes + i, box);
+        break;
+    case BOX:
+    {
+        const box_t* b = (const box_t*)a->shapes + i;
+        vector3f_copy(box->min, b->min);
+        vector3f_copy(box->max, b->max);
+        break;
+    }
+    case INSTANCE:
+    case MESH:
+    case PAGED_MESH:
+        a->objects[i]->bounds(a->objects[i], box);
+        break;
+    }
+}
+
+size_t primitiveStoreMemoryUsage(const primitiveStore* store)
+{
+    size_t bytes = sizeof(primitiveStore);
+    for(int type = 0; type < PRIMITIVE_TYPES; type++)
+    {
+        const primitiveArray* a = &store->arrays[type];
+        bytes += a->capacity * (a->stride + sizeof(material));
+        if(a->objects != NULL)
+            bytes += a->capacity * sizeof(object*);
+    }
+    return bytes;
+}
+
+void printPrimitiveStoreStats(const primitiveStore* store)
+{
+    printf(KRED"primitives["KBLU"count:"KGRN"%u ", store->count);
+    for(int type = 0; type < PRIMITIVE_TYPES; type++)
+    {
+        if(store->arrays[type].count > 0)
+            printf(KBLU"%s:"KGRN"%u ", typeNames[type], store->arrays[type].count);
+    }
+    printf(KBLU"bytes:"KGRN"%zu"KRED"]\n"KNRM, primitiveStoreMemoryUsage(store));
+}
+
+void cleanPrimitiveStore(primitiveStore** store)
+{
+    if(*store == NULL)
+        return;
+    for(int type = 0; type < PRIMITIVE_TYPES; type++)
+    {
+        free((*store)->arrays[type].shapes);
+        free((*store)->arrays[type].materials);
+        free((*store)->arrays[type].objects);
+    }
+    free(*store);
+    *store = NULL;
+}
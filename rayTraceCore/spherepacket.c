@@ -0,0 +1,140 @@
+#include <rayTracerCore/spherepacket.h>
+#include <util/usefulfunctions.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+void packSpheres(spherePacket* p, const ellipsoid_t* const* spheres, unsigned int count)
+{
+    memset(p, 0, sizeof(spherePacket));
+    for(unsigned int i = 0; i < count && i < SPHERE_PACKET_WIDTH; i++)
+    {
+        p->cx[i] = spheres[i]->center[0];
+        p->cy[i] = spheres[i]->center[1];
+        p->cz[i] = spheres[i]->center[2];
+        p->invRadiusSq[i] = spheres[i]->invRadiusSq[0];
+    }
+}
+
+/**
+* intersectSphere from ellipsoid.c one lane at a time, the SIMD kernels below follow it op for op
+*/
+int spherePacketTestScalar(const spherePacket* p, const ray* r, float tmax, float t[SPHERE_PACKET_WIDTH])
+{
+    int mask = 0;
+    float dd = r->dir[0] * r->dir[0] + r->dir[1] * r->dir[1] + r->dir[2] * r->dir[2];
+    for(int i = 0; i < SPHERE_PACKET_WIDTH; i++)
+    {
+        t[i] = INFINITY;
+        float ox = r->origin[0] - p->cx[i];
+        float oy = r->origin[1] - p->cy[i];
+        float oz = r->origin[2] - p->cz[i];
+        float A = dd * p->invRadiusSq[i];
+        float B = 2 * ((r->dir[0] * ox + r->dir[1] * oy + r->dir[2] * oz) * p->invRadiusSq[i]);
+        float C = (ox * ox + oy * oy + oz * oz) * p->invRadiusSq[i] - 1;
+        float t0, t1;
+        if(!quadratic(A, B, C, &t0, &t1))
+            continue;
+        if(t0 > tmax || t1 < r->tmin)
+            continue;
+        float thit = t0;
+        if(t0 < r->tmin)
+        {
+            thit = t1;
+            if(thit > tmax)
+                continue;
+        }
+        t[i] = thit;
+        mask |= 1 << i;
+    }
+    return mask;
+}
+
+#ifdef __SSE__
+/**
+* quadratic from usefulfunctions.h for 4 lanes, reject is set where it has no roots
+*/
+static inline void quadraticSSE(__m128 a, __m128 b, __m128 c, __m128* t0, __m128* t1, __m128* reject)
+{
+    __m128 d = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.f), a), c));
+    *reject = _mm_cmple_ps(d, _mm_setzero_ps());
+    __m128 rootd = _mm_sqrt_ps(d);
+    __m128 negative = _mm_cmplt_ps(b, _mm_setzero_ps());
+    __m128 q = _mm_mul_ps(_mm_set1_ps(-.5f), _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(b, rootd)),
+                                                        _mm_andnot_ps(negative, _mm_add_ps(b, rootd))));
+    __m128 q0 = _mm_div_ps(q, a), q1 = _mm_div_ps(c, q);
+    // Swapped only when t0 > t1, as in the scalar version
+    *t0 = _mm_min_ps(q1, q0);
+    *t1 = _mm_max_ps(q0, q1);
+}
+
+static inline int testSSE(const spherePacket* p, int base, const ray* r, float tmax, float t[])
+{
+    __m128 dirX = _mm_set1_ps(r->dir[0]), dirY = _mm_set1_ps(r->dir[1]), dirZ = _mm_set1_ps(r->dir[2]);
+    __m128 dd = _mm_set1_ps(r->dir[0] * r->dir[0] + r->dir[1] * r->dir[1] + r->dir[2] * r->dir[2]);
+    __m128 inv = _mm_load_ps(p->invRadiusSq + base);
+    __m128 ox = _mm_sub_ps(_mm_set1_ps(r->origin[0]), _mm_load_ps(p->cx + base));
+    __m128 oy = _mm_sub_ps(_mm_set1_ps(r->origin[1]), _mm_load_ps(p->cy + base));
+    __m128 oz = _mm_sub_ps(_mm_set1_ps(r->origin[2]), _mm_load_ps(p->cz + base));
+    __m128 A = _mm_mul_ps(dd, inv);
+    __m128 B = _mm_mul_ps(_mm_set1_ps(2.f), _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dirX, ox), _mm_mul_ps(dirY, oy)), _mm_mul_ps(dirZ, oz)), inv));
+    __m128 C = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)), inv), _mm_set1_ps(1.f));
+
+    __m128 t0, t1, reject;
+    quadraticSSE(A, B, C, &t0, &t1, &reject);
+    __m128 tmin = _mm_set1_ps(r->tmin), far = _mm_set1_ps(tmax);
+    reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmpgt_ps(t0, far), _mm_cmplt_ps(t1, tmin)));
+    __m128 second = _mm_cmplt_ps(t0, tmin);
+    __m128 thit = _mm_or_ps(_mm_and_ps(second, t1), _mm_andnot_ps(second, t0));
+    reject = _mm_or_ps(reject, _mm_and_ps(second, _mm_cmpgt_ps(thit, far)));
+    _mm_storeu_ps(t + base, _mm_or_ps(_mm_and_ps(reject, _mm_set1_ps(INFINITY)), _mm_andnot_ps(reject, thit)));
+    return (~_mm_movemask_ps(reject) & 0xF) << base;
+}
+
+int spherePacketTestSSE(const spherePacket* p, const ray* r, float tmax, float t[SPHERE_PACKET_WIDTH])
+{
+    return testSSE(p, 0, r, tmax, t) | testSSE(p, 4, r, tmax, t);
+}
+#endif
+
+#ifdef __AVX2__
+static inline void quadraticAVX2(__m256 a, __m256 b, __m256 c, __m256* t0, __m256* t1, __m256* reject)
+{
+    __m256 d = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.f), a), c));
+    *reject = _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LE_OQ);
+    __m256 rootd = _mm256_sqrt_ps(d);
+    __m256 negative = _mm256_cmp_ps(b, _mm256_setzero_ps(), _CMP_LT_OQ);
+    __m256 q = _mm256_mul_ps(_mm256_set1_ps(-.5f), _mm256_blendv_ps(_mm256_add_ps(b, rootd), _mm256_sub_ps(b, rootd), negative));
+    __m256 q0 = _mm256_div_ps(q, a), q1 = _mm256_div_ps(c, q);
+    *t0 = _mm256_min_ps(q1, q0);
+    *t1 = _mm256_max_ps(q0, q1);
+}
+
+int spherePacketTestAVX2(const spherePacket* p, const ray* r, float tmax, float t[SPHERE_PACKET_WIDTH])
+{
+    __m256 dirX = _mm256_set1_ps(r->dir[0]), dirY = _mm256_set1_ps(r->dir[1]), dirZ = _mm256_set1_ps(r->dir[2]);
+    __m256 dd = _mm256_set1_ps(r->dir[0] * r->dir[0] + r->dir[1] * r->dir[1] + r->dir[2] * r->dir[2]);
+    __m256 inv = _mm256_load_ps(p->invRadiusSq);
+    __m256 ox = _mm256_sub_ps(_mm256_set1_ps(r->origin[0]), _mm256_load_ps(p->cx));
+    __m256 oy = _mm256_sub_ps(_mm256_set1_ps(r->origin[1]), _mm256_load_ps(p->cy));
+    __m256 oz = _mm256_sub_ps(_mm256_set1_ps(r->origin[2]), _mm256_load_ps(p->cz));
+    __m256 A = _mm256_mul_ps(dd, inv);
+    __m256 B = _mm256_mul_ps(_mm256_set1_ps(2.f), _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dirX, ox), _mm256_mul_ps(dirY, oy)), _mm256_mul_ps(dirZ, oz)), inv));
+    __m256 C = _mm256_sub_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)), _mm256_mul_ps(oz, oz)), inv), _mm256_set1_ps(1.f));
+
+    __m256 t0, t1, reject;
+    quadraticAVX2(A, B, C, &t0, &t1, &reject);
+    __m256 tmin = _mm256_set1_ps(r->tmin), far = _mm256_set1_ps(tmax);
+    reject = _mm256_or_ps(reject, _mm256_or_ps(_mm256_cmp_ps(t0, far, _CMP_GT_OQ), _mm256_cmp_ps(t1, tmin, _CMP_LT_OQ)));
+    __m256 second = _mm256_cmp_ps(t0, tmin, _CMP_LT_OQ);
+    __m256 thit = _mm256_blendv_ps(t0, t1, second);
+    reject = _mm256_or_ps(reject, _mm256_and_ps(second, _mm256_cmp_ps(thit, far, _CMP_GT_OQ)));
+    _mm256_storeu_ps(t, _mm256_blendv_ps(thit, _mm256_set1_ps(INFINITY), reject));
+    return ~_mm256_movemask_ps(reject) & 0xFF;
+}
+#endif
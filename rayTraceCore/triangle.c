@@ -1,102 +1,100 @@
 #include <rayTracerCore/shapes/triangle.h>
 #include <util/colors.h>
 #include <stdio.h>
+#include <float.h>
+#include <math.h>
 #include <rayTracerCore/ray.h>
 #include <rayTracerCore/rayhit.h>
 
 bool triangleTestHit(const ray r, const object *obj)
 {
-    triangle_t* tri = obj->shape;
-    // Get Points
-    point3f p1= {},p2= {},p3= {};
-    vector3f_copy(p1, tri->a);
-    vector3f_copy(p2, tri->b);
-    vector3f_copy(p3, tri->c);
-
-    // get bercentric coor
-    vector3f e1 = {}, e2 = {}, s1 = {};
-    vector3f_sub_new(e1, p2, p1);
-    vector3f_sub_new(e2, p3, p1);
-    vector3f_cross_new(s1, r.dir, e2);
-    float det = vector3f_dot(s1, e1);
-    if(det == 0)
-        return false;
-    float invD = 1.f/ det;
-    vector3f d = {};
-    vector3f_sub_new(d, r.origin, p1);
-    float b1 = vector3f_dot(d, s1) * invD;
-    if(b1 < 0.f || b1 > 1.f)
-        return false;
-    vector3f s2 = {};
-    vector3f_cross_new(s2, d, e1);
-    float b2 = vector3f_dot(r.dir, s2) * invD;
-    if(b2 < 0.f || (b1+b2) > 1.f)
-        return false;
-
-    float t = vector3f_dot(e2, s2)*invD;
-    if(t < r.tmin || t > r.tmax)
-        return false;
-
-    return !true;
+    float t;
+    return triangleIntersect(&r, obj->shape, &t);
 }
 
 bool triangleHit(const ray r, const object *o, float *time, rayHit *rayH)
 {
     rayH->hit = false;
     rayH->mat = EMPTYNESS;
-    triangle_t* tri = o->shape;
-    // Get Points
-    point3f p1= {},p2= {},p3= {};
-    vector3f_copy(p1, tri->a);
-    vector3f_copy(p2, tri->b);
-    vector3f_copy(p3, tri->c);
-
-    // get bercentric coor
-    vector3f e1 = {}, e2 = {}, s1 = {};
-    vector3f_sub_new(e1, p2, p1);
-    vector3f_sub_new(e2, p3, p1);
-    vector3f_cross_new(s1, r.dir, e2);
-    float det = vector3f_dot(s1, e1);
-    if(det == 0)
-        return false;
-    float invD = 1.f/ det;
-    vector3f d = {};
-    vector3f_sub_new(d, r.origin, p1);
-    float b1 = vector3f_dot(d, s1) * invD;
-    if(b1 < 0.f || b1 > 1.f)
-        return false;
-    vector3f s2 = {};
-    vector3f_cross_new(s2, d, e1);
-    float b2 = vector3f_dot(r.dir, s2) * invD;
-    if(b2 < 0.f || (b1+b2) > 1.f)
-        return false;
-
-    float t = vector3f_dot(e2, s2)*invD;
-    if(t < r.tmin || t > r.tmax)
+    float t;
+    if(!triangleIntersect(&r, o->shape, &t))
         return false;
 
     *time = t;
+    triangleHitRecord(r, o, t, NULL, rayH);
+    return true;
+}
+
+bool triangleHitTime(const ray *r, const object *o, float *time, hitPath *path)
+{
+    (void)path;
+    return triangleIntersect(r, o->shape, time);
+}
+
+void triangleHitRecord(const ray r, const object *o, float t, const hitPath *path, rayHit *rayH)
+{
+    (void)path;
+    triangleSurface(r, o->shape, o->mat, t, rayH);
+}
+
+void triangleSurface(const ray r, const triangle_t *tri, const material mat, float t, rayHit *rayH)
+{
     rayH->hit = true;
-    rayH->mat = o->mat;
+    rayH->mat = mat;
     vector3f dirOffset = {};
     vector3f_scaleMul_new(dirOffset, r.dir, t);
     vector3f_add_new(rayH->location, r.origin, dirOffset);
-    vector3f_cross_new(rayH->normal, e1, e2);
-    vector3f_normalize(rayH->normal);
+    vector3f_copy(rayH->normal, tri->normal);
     rayH->originRay = r;
     rayH->offsetError = .1;
-    return true;
+}
+
+void triangleBounds(const object *o, aabb *box)
+{
+    triangleShapeBounds(o->shape, box);
+}
+
+void triangleShapeBounds(const triangle_t *tri, aabb *box)
+{
+    point3f b = {}, c = {};
+    vector3f_add_new(b, tri->a, tri->e1);
+    vector3f_add_new(c, tri->a, tri->e2);
+    aabbEmpty(box);
+    aabbExtendPoint(box, tri->a);
+    aabbExtendPoint(box, b);
+    aabbExtendPoint(box, c);
+    // b and c are rebuilt from the edges, pad for the rounding so the box still holds the original vertices
+    for(int i = 0; i < 3; i++)
+    {
+        float pad = (fabsf(box->min[i]) + fabsf(box->max[i])) * FLT_EPSILON;
+        box->min[i] -= pad;
+        box->max[i] += pad;
+    }
 }
 
 void trianglePrint(void* t)
 {
+    const triangle_t* tri = t;
+    point3f b = {}, c = {};
+    vector3f_add_new(b, tri->a, tri->e1);
+    vector3f_add_new(c, tri->a, tri->e2);
     printf(KCYN"triangle[");
     printf(KBLU"a:"KGRN);
-    vector3f_print(((triangle_t*)t)->a);
+    vector3f_print(tri->a);
     printf(KBLU"b:"KGRN);
-    vector3f_print(((triangle_t*)t)->b);
+    vector3f_print(b);
     printf(KBLU"c:"KGRN);
-    vector3f_print(((triangle_t*)t)->c);
+    vector3f_print(c);
     printf(KCYN"]"KNRM);
 }
 
+
+void setTriangleVertices(object *o, const point3f p1, const point3f p2, const point3f p3)
+{
+    triangle_t* tri = (triangle_t*)o->shape;
+    vector3f_copy(tri->a, p1);
+    vector3f_sub_new(tri->e1, p2, p1);
+    vector3f_sub_new(tri->e2, p3, p1);
+    vector3f_cross_new(tri->normal, tri->e1, tri->e2);
+    vector3f_normalize(tri->normal);
+}
@@ -0,0 +1,148 @@
+#include <rayTracerCore/trianglepacket.h>
+#include <string.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+void packTriangles(trianglePacket* p, const triangle_t* const* triangles, unsigned int count)
+{
+    memset(p, 0, sizeof(trianglePacket));
+    for(unsigned int i = 0; i < count && i < TRIANGLE_PACKET_WIDTH; i++)
+    {
+        const triangle_t* tri = triangles[i];
+        p->ax[i] = tri->a[0];
+        p->ay[i] = tri->a[1];
+        p->az[i] = tri->a[2];
+        p->e1x[i] = tri->e1[0];
+        p->e1y[i] = tri->e1[1];
+        p->e1z[i] = tri->e1[2];
+        p->e2x[i] = tri->e2[0];
+        p->e2y[i] = tri->e2[1];
+        p->e2z[i] = tri->e2[2];
+    }
+}
+
+/**
+* Same operations in the same order as triangleTestHit so every kernel agrees with it bit for bit.
+* Each test rejects, so NaN lanes slip through exactly like they do there.
+*/
+int trianglePacketTestScalar(const trianglePacket* p, const ray* r, float tmax, float t[TRIANGLE_PACKET_WIDTH])
+{
+    int mask = 0;
+    for(int i = 0; i < TRIANGLE_PACKET_WIDTH; i++)
+    {
+        t[i] = INFINITY;
+        float s1x = r->dir[1] * p->e2z[i] - r->dir[2] * p->e2y[i];
+        float s1y = r->dir[2] * p->e2x[i] - r->dir[0] * p->e2z[i];
+        float s1z = r->dir[0] * p->e2y[i] - r->dir[1] * p->e2x[i];
+        float det = s1x * p->e1x[i] + s1y * p->e1y[i] + s1z * p->e1z[i];
+        if(det == 0)
+            continue;
+        float invD = 1.f / det;
+        float dx = r->origin[0] - p->ax[i];
+        float dy = r->origin[1] - p->ay[i];
+        float dz = r->origin[2] - p->az[i];
+        float b1 = (dx * s1x + dy * s1y + dz * s1z) * invD;
+        if(b1 < 0.f || b1 > 1.f)
+            continue;
+        float s2x = dy * p->e1z[i] - dz * p->e1y[i];
+        float s2y = dz * p->e1x[i] - dx * p->e1z[i];
+        float s2z = dx * p->e1y[i] - dy * p->e1x[i];
+        float b2 = (r->dir[0] * s2x + r->dir[1] * s2y + r->dir[2] * s2z) * invD;
+        if(b2 < 0.f || (b1 + b2) > 1.f)
+            continue;
+        float hitT = (p->e2x[i] * s2x + p->e2y[i] * s2y + p->e2z[i] * s2z) * invD;
+        if(hitT < r->tmin || hitT > tmax)
+            continue;
+        t[i] = hitT;
+        mask |= 1 << i;
+    }
+    return mask;
+}
+
+#ifdef __SSE__
+static inline int testSSE(const trianglePacket* p, int base, const ray* r, float tmax, float t[])
+{
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+    __m128 dirX = _mm_set1_ps(r->dir[0]), dirY = _mm_set1_ps(r->dir[1]), dirZ = _mm_set1_ps(r->dir[2]);
+    __m128 e1x = _mm_load_ps(p->e1x + base), e1y = _mm_load_ps(p->e1y + base), e1z = _mm_load_ps(p->e1z + base);
+    __m128 e2x = _mm_load_ps(p->e2x + base), e2y = _mm_load_ps(p->e2y + base), e2z = _mm_load_ps(p->e2z + base);
+
+    __m128 s1x = _mm_sub_ps(_mm_mul_ps(dirY, e2z), _mm_mul_ps(dirZ, e2y));
+    __m128 s1y = _mm_sub_ps(_mm_mul_ps(dirZ, e2x), _mm_mul_ps(dirX, e2z));
+    __m128 s1z = _mm_sub_ps(_mm_mul_ps(dirX, e2y), _mm_mul_ps(dirY, e2x));
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s1x, e1x), _mm_mul_ps(s1y, e1y)), _mm_mul_ps(s1z, e1z));
+    __m128 reject = _mm_cmpeq_ps(det, zero);
+    __m128 invD = _mm_div_ps(one, det);
+
+    __m128 dx = _mm_sub_ps(_mm_set1_ps(r->origin[0]), _mm_load_ps(p->ax + base));
+    __m128 dy = _mm_sub_ps(_mm_set1_ps(r->origin[1]), _mm_load_ps(p->ay + base));
+    __m128 dz = _mm_sub_ps(_mm_set1_ps(r->origin[2]), _mm_load_ps(p->az + base));
+    __m128 b1 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, s1x), _mm_mul_ps(dy, s1y)), _mm_mul_ps(dz, s1z)), invD);
+    reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmplt_ps(b1, zero), _mm_cmpgt_ps(b1, one)));
+
+    __m128 s2x = _mm_sub_ps(_mm_mul_ps(dy, e1z), _mm_mul_ps(dz, e1y));
+    __m128 s2y = _mm_sub_ps(_mm_mul_ps(dz, e1x), _mm_mul_ps(dx, e1z));
+    __m128 s2z = _mm_sub_ps(_mm_mul_ps(dx, e1y), _mm_mul_ps(dy, e1x));
+    __m128 b2 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dirX, s2x), _mm_mul_ps(dirY, s2y)), _mm_mul_ps(dirZ, s2z)), invD);
+    reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmplt_ps(b2, zero), _mm_cmpgt_ps(_mm_add_ps(b1, b2), one)));
+
+    __m128 hitT = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, s2x), _mm_mul_ps(e2y, s2y)), _mm_mul_ps(e2z, s2z)), invD);
+    reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmplt_ps(hitT, _mm_set1_ps(r->tmin)), _mm_cmpgt_ps(hitT, _mm_set1_ps(tmax))));
+    _mm_storeu_ps(t + base, _mm_or_ps(_mm_and_ps(reject, _mm_set1_ps(INFINITY)), _mm_andnot_ps(reject, hitT)));
+    return (~_mm_movemask_ps(reject) & 0xF) << base;
+}
+
+int trianglePacketTestSSE(const trianglePacket* p, const ray* r, float tmax, float t[TRIANGLE_PACKET_WIDTH])
+{
+    return testSSE(p, 0, r, tmax, t) | testSSE(p, 4, r, tmax, t);
+}
+#endif
+
+#ifdef __AVX2__
+int trianglePacketTestAVX2(const trianglePacket* p, const ray* r, float tmax, float t[TRIANGLE_PACKET_WIDTH])
+{
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+    __m256 dirX = _mm256_set1_ps(r->dir[0]), dirY = _mm256_set1_ps(r->dir[1]), dirZ = _mm256_set1_ps(r->dir[2]);
+    __m256 e1x = _mm256_load_ps(p->e1x), e1y = _mm256_load_ps(p->e1y), e1z = _mm256_load_ps(p->e1z);
+    __m256 e2x = _mm256_load_ps(p->e2x), e2y = _mm256_load_ps(p->e2y), e2z = _mm256_load_ps(p->e2z);
+
+    __m256 s1x = _mm256_sub_ps(_mm256_mul_ps(dirY, e2z), _mm256_mul_ps(dirZ, e2y));
+    __m256 s1y = _mm256_sub_ps(_mm256_mul_ps(dirZ, e2x), _mm256_mul_ps(dirX, e2z));
+    __m256 s1z = _mm256_sub_ps(_mm256_mul_ps(dirX, e2y), _mm256_mul_ps(dirY, e2x));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s1x, e1x), _mm256_mul_ps(s1y, e1y)), _mm256_mul_ps(s1z, e1z));
+    __m256 reject = _mm256_cmp_ps(det, zero, _CMP_EQ_OQ);
+    __m256 invD = _mm256_div_ps(one, det);
+
+    __m256 dx = _mm256_sub_ps(_mm256_set1_ps(r->origin[0]), _mm256_load_ps(p->ax));
+    __m256 dy = _mm256_sub_ps(_mm256_set1_ps(r->origin[1]), _mm256_load_ps(p->ay));
+    __m256 dz = _mm256_sub_ps(_mm256_set1_ps(r->origin[2]), _mm256_load_ps(p->az));
+    __m256 b1 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, s1x), _mm256_mul_ps(dy, s1y)), _mm256_mul_ps(dz, s1z)), invD);
+    reject = _mm256_or_ps(reject, _mm256_or_ps(_mm256_cmp_ps(b1, zero, _CMP_LT_OQ), _mm256_cmp_ps(b1, one, _CMP_GT_OQ)));
+
+    __m256 s2x = _mm256_sub_ps(_mm256_mul_ps(dy, e1z), _mm256_mul_ps(dz, e1y));
+    __m256 s2y = _mm256_sub_ps(_mm256_mul_ps(dz, e1x), _mm256_mul_ps(dx, e1z));
+    __m256 s2z = _mm256_sub_ps(_mm256_mul_ps(dx, e1y), _mm256_mul_ps(dy, e1x));
+    __m256 b2 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dirX, s2x), _mm256_mul_ps(dirY, s2y)), _mm256_mul_ps(dirZ, s2z)), invD);
+    reject = _mm256_or_ps(reject, _mm256_or_ps(_mm256_cmp_ps(b2, zero, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_add_ps(b1, b2), one, _CMP_GT_OQ)));
+
+    __m256 hitT = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, s2x), _mm256_mul_ps(e2y, s2y)), _mm256_mul_ps(e2z, s2z)), invD);
+    reject = _mm256_or_ps(reject, _mm256_or_ps(_mm256_cmp_ps(hitT, _mm256_set1_ps(r->tmin), _CMP_LT_OQ), _mm256_cmp_ps(hitT, _mm256_set1_ps(tmax), _CMP_GT_OQ)));
+    _mm256_storeu_ps(t, _mm256_blendv_ps(hitT, _mm256_set1_ps(INFINITY), reject));
+    return ~_mm256_movemask_ps(reject) & 0xFF;
+}
+#endif
+
+const char* trianglePacketKernelName(void)
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE__)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,633 @@
+#include <rayTracerCore/widebvh.h>
+#include <util/usefulfunctions.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+typedef struct
+{
+    float* minX, *minY, *minZ;
+    float* maxX, *maxY, *maxZ;
+    uint32_t* child;
+    uint16_t* count;
+} laneView;
+
+typedef struct
+{
+    float origin[3];
+    float invDir[3];
+    bool dirNeg[3];
+    float tmin;
+} wideRay;
+
+typedef struct
+{
+    uint32_t child;
+    uint32_t count;
+    float tnear;
+} wideStackEntry;
+
+#define LANE_VIEW(node) (laneView){(node)->minX, (node)->minY, (node)->minZ, (node)->maxX, (node)->maxY, (node)->maxZ, (node)->child, (node)->count}
+
+static laneView getLanes(void* nodes, bvhWidth width, uint32_t index)
+{
+    if(width == BVH4)
+        return LANE_VIEW((bvh4Node*)nodes + index);
+    return LANE_VIEW((bvh8Node*)nodes + index);
+}
+
+size_t compressedBVHNodeSize(bvhWidth width)
+{
+    return width == BVH8 ? sizeof(qbvh8Node) : sizeof(qbvh4Node);
+}
+
+size_t wideBVHNodeSize(bvhWidth width)
+{
+    switch(width)
+    {
+        case BVH4: return sizeof(bvh4Node);
+        case BVH8: return sizeof(bvh8Node);
+        default: return sizeof(bvhNode);
+    }
+}
+
+static void setLane(laneView lanes, int lane, const aabb* bounds, uint32_t child, uint16_t count)
+{
+    lanes.minX[lane] = bounds->min[0];
+    lanes.minY[lane] = bounds->min[1];
+    lanes.minZ[lane] = bounds->min[2];
+    lanes.maxX[lane] = bounds->max[0];
+    lanes.maxY[lane] = bounds->max[1];
+    lanes.maxZ[lane] = bounds->max[2];
+    lanes.child[lane] = child;
+    lanes.count[lane] = count;
+}
+
+/**
+* Pulls grandchildren up into one wide node, always opening the
+* interior child with the largest surface area first.
+*/
+static uint32_t collapseNode(bvh* tree, uint32_t* wideCount, uint32_t binaryIndex)
+{
+    const bvhNode* nodes = tree->nodes;
+    uint32_t kids[BVH8];
+    int n = 0;
+    if(nodes[binaryIndex].count > 0)
+    {
+        kids[n++] = binaryIndex;
+    }
+    else
+    {
+        kids[n++] = binaryIndex + 1;
+        kids[n++] = nodes[binaryIndex].offset;
+    }
+    while(n < (int)tree->width)
+    {
+        int best = -1;
+        float bestArea = -1;
+        for(int i = 0; i < n; i++)
+        {
+            if(nodes[kids[i]].count > 0)
+                continue;
+            float area = aabbSurfaceArea(&nodes[kids[i]].bounds);
+            if(area > bestArea)
+            {
+                bestArea = area;
+                best = i;
+            }
+        }
+        if(best < 0)
+            break;
+        uint32_t open = kids[best];
+        kids[best] = open + 1;
+        kids[n++] = nodes[open].offset;
+    }
+
+    uint32_t index = (*wideCount)++;
+    laneView lanes = getLanes(tree->wideNodes, tree->width, index);
+    aabb empty;
+    aabbEmpty(&empty);
+    for(int i = 0; i < (int)tree->width; i++)
+        setLane(lanes, i, &empty, WIDEBVH_EMPTY, 0);
+    for(int i = 0; i < n; i++)
+    {
+        const bvhNode* kid = &nodes[kids[i]];
+        if(kid->count > 0)
+            setLane(lanes, i, &kid->bounds, kid->offset, kid->count);
+        else
+            setLane(lanes, i, &kid->bounds, collapseNode(tree, wideCount, kids[i]), 0);
+    }
+    return index;
+}
+
+void collapseBVH(bvh* tree, bvhWidth width)
+{
+    // Compressed trees have no binary nodes left to collapse
+    if(tree->nodes == NULL)
+        return;
+    free(tree->wideNodes);
+    tree->compressed = false;
+    tree->wideNodes = NULL;
+    tree->wideNodeCount = 0;
+    tree->width = width;
+    if(width == BVH2 || tree->nodeCount == 0)
+    {
+        tree->width = BVH2;
+        return;
+    }
+
+    double start = getTimeSeconds();
+    void* nodes = NULL;
+    if(posix_memalign(&nodes, 64, tree->nodeCount * wideBVHNodeSize(width)) != 0)
+    {
+        tree->width = BVH2;
+        return;
+    }
+    tree->wideNodes = nodes;
+    uint32_t count = 0;
+    collapseNode(tree, &count, 0);
+    tree->wideNodeCount = count;
+    tree->stats.wideNodeCount = count;
+    tree->stats.collapseTime = getTimeSeconds() - start;
+}
+
+/**
+* Builds the float 2^e directly, e stays within the normal range
+*/
+static inline float exp2i(int e)
+{
+    union
+    {
+        uint32_t u;
+        float f;
+    } bits = {.u = (uint32_t)(e + 127) << 23};
+    return bits.f;
+}
+
+typedef struct
+{
+    float* origin;
+    int8_t* exponent;
+    uint8_t* valid;
+    uint8_t* qmin[3];
+    uint8_t* qmax[3];
+    uint32_t* child;
+    uint16_t* count;
+} quantizedView;
+
+#define QUANTIZED_VIEW(node) (quantizedView){(node)->origin, (node)->exponent, &(node)->valid, \
+    {(node)->qminX, (node)->qminY, (node)->qminZ}, {(node)->qmaxX, (node)->qmaxY, (node)->qmaxZ}, (node)->child, (node)->count}
+
+static quantizedView getQuantized(void* nodes, bvhWidth width, uint32_t index)
+{
+    if(width == BVH4)
+        return QUANTIZED_VIEW((qbvh4Node*)nodes + index);
+    return QUANTIZED_VIEW((qbvh8Node*)nodes + index);
+}
+
+static inline float dequantize(float origin, int q, float scale)
+{
+    return origin + (float)q * scale;
+}
+
+/**
+* Smallest exponent whose 255 steps still reach every child's max on this axis
+*/
+static bool quantizeAxis(const float* lo, const float* hi, int lanes, uint8_t valid, float origin, int exponent, uint8_t* qmin, uint8_t* qmax)
+{
+    float scale = exp2i(exponent);
+    for(int i = 0; i < lanes; i++)
+    {
+        if(!(valid & (1 << i)))
+        {
+            qmin[i] = 255;
+            qmax[i] = 0;
+            continue;
+        }
+        float fmin = floorf((lo[i] - origin) / scale);
+        int q = fmin < 0 ? 0 : (fmin > 255 ? 255 : (int)fmin);
+        while(q > 0 && dequantize(origin, q, scale) > lo[i])
+            q--;
+        qmin[i] = (uint8_t)q;
+        float fmax = ceilf((hi[i] - origin) / scale);
+        q = fmax < 0 ? 0 : (fmax > 255 ? 255 : (int)fmax);
+        while(dequantize(origin, q, scale) < hi[i])
+        {
+            if(q == 255)
+                return false;
+            q++;
+        }
+        qmax[i] = (uint8_t)q;
+    }
+    return true;
+}
+
+static void quantizeNode(const laneView* full, quantizedView* q, int lanes)
+{
+    uint8_t valid = 0;
+    aabb bounds;
+    aabbEmpty(&bounds);
+    for(int i = 0; i < lanes; i++)
+    {
+        q->child[i] = full->child[i];
+        q->count[i] = full->count[i];
+        if(full->child[i] == WIDEBVH_EMPTY)
+            continue;
+        valid |= 1 << i;
+        point3f lo = {full->minX[i], full->minY[i], full->minZ[i]};
+        point3f hi = {full->maxX[i], full->maxY[i], full->maxZ[i]};
+        aabbExtendPoint(&bounds, lo);
+        aabbExtendPoint(&bounds, hi);
+    }
+    *q->valid = valid;
+    const float* lo[3] = {full->minX, full->minY, full->minZ};
+    const float* hi[3] = {full->maxX, full->maxY, full->maxZ};
+    for(int a = 0; a < 3; a++)
+    {
+        q->origin[a] = valid ? bounds.min[a] : 0;
+        float extent = valid ? bounds.max[a] - bounds.min[a] : 0;
+        int exponent = -126;
+        if(extent > 0)
+        {
+            frexpf(extent / 255.0f, &exponent);
+            exponent = exponent < -126 ? -126 : exponent;
+        }
+        while(!quantizeAxis(lo[a], hi[a], lanes, valid, q->origin[a], exponent, q->qmin[a], q->qmax[a]) && exponent < 127)
+            exponent++;
+        q->exponent[a] = (int8_t)exponent;
+    }
+}
+
+void compressBVH(bvh* tree)
+{
+    if(tree->nodes == NULL || tree->nodeCount == 0)
+        return;
+    if(tree->width == BVH2)
+        collapseBVH(tree, BVH4);
+    if(tree->wideNodes == NULL)
+        return;
+
+    double start = getTimeSeconds();
+    void* nodes = NULL;
+    if(posix_memalign(&nodes, 64, tree->wideNodeCount * compressedBVHNodeSize(tree->width)) != 0)
+        return;
+    for(uint32_t i = 0; i < tree->wideNodeCount; i++)
+    {
+        laneView full = getLanes(tree->wideNodes, tree->width, i);
+        quantizedView q = getQuantized(nodes, tree->width, i);
+        quantizeNode(&full, &q, (int)tree->width);
+    }
+    free(tree->wideNodes);
+    tree->wideNodes = nodes;
+    tree->compressed = true;
+
+    if(tree->mapping != NULL)
+    {
+        munmap(tree->mapping, tree->mappingSize);
+        tree->mapping = NULL;
+        tree->mappingSize = 0;
+    }
+    else
+    {
+        free(tree->nodes);
+    }
+    tree->nodes = NULL;
+    free(tree->referenceCost);
+    tree->referenceCost = NULL;
+    tree->stats.collapseTime += getTimeSeconds() - start;
+}
+
+static inline int slab4(const laneView* lanes, int base, const wideRay* wr, float tmax, float tnear[])
+{
+    const float* nearX = (wr->dirNeg[0] ? lanes->maxX : lanes->minX) + base;
+    const float* nearY = (wr->dirNeg[1] ? lanes->maxY : lanes->minY) + base;
+    const float* nearZ = (wr->dirNeg[2] ? lanes->maxZ : lanes->minZ) + base;
+    const float* farX = (wr->dirNeg[0] ? lanes->minX : lanes->maxX) + base;
+    const float* farY = (wr->dirNeg[1] ? lanes->minY : lanes->maxY) + base;
+    const float* farZ = (wr->dirNeg[2] ? lanes->minZ : lanes->maxZ) + base;
+#ifdef __SSE__
+    // max/min return their second operand on NaN so 0 * inf lanes fall back to the running interval
+    __m128 t0 = _mm_set1_ps(wr->tmin);
+    __m128 t1 = _mm_set1_ps(tmax);
+    __m128 o = _mm_set1_ps(wr->origin[0]), id = _mm_set1_ps(wr->invDir[0]);
+    t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearX), o), id), t0);
+    t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farX), o), id), t1);
+    o = _mm_set1_ps(wr->origin[1]);
+    id = _mm_set1_ps(wr->invDir[1]);
+    t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearY), o), id), t0);
+    t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farY), o), id), t1);
+    o = _mm_set1_ps(wr->origin[2]);
+    id = _mm_set1_ps(wr->invDir[2]);
+    t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearZ), o), id), t0);
+    t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farZ), o), id), t1);
+    _mm_storeu_ps(tnear + base, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1)) << base;
+#else
+    int mask = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        float t0 = wr->tmin, t1 = tmax;
+        float tn = (nearX[i] - wr->origin[0]) * wr->invDir[0];
+        float tf = (farX[i] - wr->origin[0]) * wr->invDir[0];
+        t0 = tn > t0 ? tn : t0;
+        t1 = tf < t1 ? tf : t1;
+        tn = (nearY[i] - wr->origin[1]) * wr->invDir[1];
+        tf = (farY[i] - wr->origin[1]) * wr->invDir[1];
+        t0 = tn > t0 ? tn : t0;
+        t1 = tf < t1 ? tf : t1;
+        tn = (nearZ[i] - wr->origin[2]) * wr->invDir[2];
+        tf = (farZ[i] - wr->origin[2]) * wr->invDir[2];
+        t0 = tn > t0 ? tn : t0;
+        t1 = tf < t1 ? tf : t1;
+        tnear[base + i] = t0;
+        if(t0 <= t1)
+            mask |= 1 << (base + i);
+    }
+    return mask;
+#endif
+}
+
+static inline int slab8(const laneView* lanes, const wideRay* wr, float tmax, float tnear[])
+{
+#ifdef __AVX__
+    const float* nearX = wr->dirNeg[0] ? lanes->maxX : lanes->minX;
+    const float* nearY = wr->dirNeg[1] ? lanes->maxY : lanes->minY;
+    const float* nearZ = wr->dirNeg[2] ? lanes->maxZ : lanes->minZ;
+    const float* farX = wr->dirNeg[0] ? lanes->minX : lanes->maxX;
+    const float* farY = wr->dirNeg[1] ? lanes->minY : lanes->maxY;
+    const float* farZ = wr->dirNeg[2] ? lanes->minZ : lanes->maxZ;
+    __m256 t0 = _mm256_set1_ps(wr->tmin);
+    __m256 t1 = _mm256_set1_ps(tmax);
+    __m256 o = _mm256_set1_ps(wr->origin[0]), id = _mm256_set1_ps(wr->invDir[0]);
+    t0 = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearX), o), id), t0);
+    t1 = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farX), o), id), t1);
+    o = _mm256_set1_ps(wr->origin[1]);
+    id = _mm256_set1_ps(wr->invDir[1]);
+    t0 = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearY), o), id), t0);
+    t1 = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farY), o), id), t1);
+    o = _mm256_set1_ps(wr->origin[2]);
+    id = _mm256_set1_ps(wr->invDir[2]);
+    t0 = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearZ), o), id), t0);
+    t1 = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farZ), o), id), t1);
+    _mm256_storeu_ps(tnear, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+#else
+    return slab4(lanes, 0, wr, tmax, tnear) | slab4(lanes, 4, wr, tmax, tnear);
+#endif
+}
+
+/**
+* Expands a compressed node into scratch so the float slab tests can run on it
+*/
+static inline laneView decodeNode(const bvh* tree, uint32_t index, bvh8Node* scratch, uint8_t* valid)
+{
+    quantizedView q = getQuantized(tree->wideNodes, tree->width, index);
+    float* lo[3] = {scratch->minX, scratch->minY, scratch->minZ};
+    float* hi[3] = {scratch->maxX, scratch->maxY, scratch->maxZ};
+    for(int a = 0; a < 3; a++)
+    {
+        float origin = q.origin[a];
+        float scale = exp2i(q.exponent[a]);
+        for(int i = 0; i < (int)tree->width; i++)
+        {
+            lo[a][i] = dequantize(origin, q.qmin[a][i], scale);
+            hi[a][i] = dequantize(origin, q.qmax[a][i], scale);
+        }
+    }
+    *valid = *q.valid;
+    return (laneView){scratch->minX, scratch->minY, scratch->minZ, scratch->maxX, scratch->maxY, scratch->maxZ, q.child, q.count};
+}
+
+static inline int testNode(const bvh* tree, uint32_t index, const wideRay* wr, float tmax, float tnear[], laneView* lanes)
+{
+    if(tree->compressed)
+    {
+        bvh8Node scratch;
+        uint8_t valid;
+        *lanes = decodeNode(tree, index, &scratch, &valid);
+        int mask = tree->width == BVH4 ? slab4(lanes, 0, wr, tmax, tnear) : slab8(lanes, wr, tmax, tnear);
+        // Only child and count outlive scratch, they point into the compressed node
+        return mask & valid;
+    }
+    *lanes = getLanes(tree->wideNodes, tree->width, index);
+    if(tree->width == BVH4)
+        return slab4(lanes, 0, wr, tmax, tnear);
+    return slab8(lanes, wr, tmax, tnear);
+}
+
+static void setupWideRay(wideRay* wr, const ray* r)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        wr->origin[i] = r->origin[i];
+        wr->invDir[i] = 1.f / r->dir[i];
+        wr->dirNeg[i] = wr->invDir[i] < 0;
+    }
+    wr->tmin = r->tmin;
+}
+
+static bool closestHitFrom(const bvh* tree, uint32_t root, const wideRay* wr, const ray r, ray* testRay, primitiveId* nearest, hitPath* path)
+{
+    bool hit = false;
+    wideStackEntry stack[WIDEBVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = (wideStackEntry){root, 0, r.tmin};
+    while(sp > 0)
+    {
+        wideStackEntry e = stack[--sp];
+        if(e.tnear > testRay->tmax)
+            continue;
+        if(e.count > 0)
+        {
+            hit |= bvhIntersectLeaf(tree, e.child, e.count, r, testRay, nearest, path);
+            continue;
+        }
+
+        float tnear[BVH8];
+        laneView lanes;
+        int mask = testNode(tree, e.child, wr, testRay->tmax, tnear, &lanes);
+
+        // Order the hit children far to near so the nearest is popped first
+        int order[BVH8];
+        int n = 0;
+        while(mask)
+        {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            int j = n++;
+            while(j > 0 && tnear[order[j - 1]] < tnear[lane])
+            {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = lane;
+        }
+        for(int i = 0; i < n; i++)
+            stack[sp++] = (wideStackEntry){lanes.child[order[i]], lanes.count[order[i]], tnear[order[i]]};
+    }
+    return hit;
+}
+
+primitiveId wideBVHClosestPrimitive(const bvh* tree, const frustumCull* cull, ray* r, hitPath* path)
+{
+    wideRay wr;
+    setupWideRay(&wr, r);
+    primitiveId nearest = PRIMITIVE_NONE;
+    if(cull == NULL)
+        closestHitFrom(tree, 0, &wr, *r, r, &nearest, path);
+    else
+    {
+        for(unsigned int i = 0; i < cull->subtreeCount; i++)
+            closestHitFrom(tree, cull->subtrees[i], &wr, *r, r, &nearest, path);
+    }
+    return nearest;
+}
+
+bool wideBVHAnyHit(const bvh* tree, const ray r, const object** occluder)
+{
+    wideRay wr;
+    setupWideRay(&wr, &r);
+
+    uint32_t stack[WIDEBVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while(sp > 0)
+    {
+        float tnear[BVH8];
+        laneView lanes;
+        int mask = testNode(tree, stack[--sp], &wr, r.tmax, tnear, &lanes);
+        while(mask)
+        {
+            int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if(lanes.count[lane] == 0)
+                stack[sp++] = lanes.child[lane];
+            else if(bvhOccludeLeaf(tree, lanes.child[lane], lanes.count[lane], r, occluder))
+                return true;
+        }
+    }
+    return false;
+}
+
+static unsigned int subtreePrimitiveCount(const bvh* tree, uint32_t root)
+{
+    unsigned int total = 0;
+    uint32_t stack[WIDEBVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = root;
+    while(sp > 0)
+    {
+        laneView lanes;
+        bvh8Node scratch;
+        uint8_t valid;
+        uint32_t index = stack[--sp];
+        lanes = tree->compressed ? decodeNode(tree, index, &scratch, &valid) : getLanes(tree->wideNodes, tree->width, index);
+        for(int i = 0; i < (int)tree->width; i++)
+        {
+            if(lanes.child[i] == WIDEBVH_EMPTY)
+                continue;
+            if(lanes.count[i] > 0)
+                total += lanes.count[i];
+            else
+                stack[sp++] = lanes.child[i];
+        }
+    }
+    return total;
+}
+
+static inline aabb laneBounds(const laneView* lanes, int lane)
+{
+    return (aabb){{lanes->minX[lane], lanes->minY[lane], lanes->minZ[lane]}, {lanes->maxX[lane], lanes->maxY[lane], lanes->maxZ[lane]}};
+}
+
+/**
+* A wide leaf is only a lane, so a node with any visible leaf is kept whole.
+* Its other lanes are still culled per ray by the slab test.
+*/
+void wideBVHCullFrustum(const bvh* tree, const frustum* f, frustumCull* cull)
+{
+    resetFrustumCull(cull, tree->primitiveCount);
+    if(tree->wideNodes == NULL)
+        return;
+    uint32_t stack[WIDEBVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = 0;
+    while(sp > 0)
+    {
+        laneView lanes;
+        bvh8Node scratch;
+        uint8_t valid;
+        uint32_t index = stack[--sp];
+        lanes = tree->compressed ? decodeNode(tree, index, &scratch, &valid) : getLanes(tree->wideNodes, tree->width, index);
+        int visible = 0;
+        bool leaf = false;
+        for(int i = 0; i < (int)tree->width; i++)
+        {
+            aabb box = laneBounds(&lanes, i);
+            if(lanes.child[i] == WIDEBVH_EMPTY || frustumCullsAABB(f, &box))
+                continue;
+            visible |= 1 << i;
+            leaf |= lanes.count[i] > 0;
+        }
+        if(leaf)
+        {
+            aabb bounds;
+            aabbEmpty(&bounds);
+            unsigned int primitives = 0;
+            for(int i = 0; i < (int)tree->width; i++)
+            {
+                if(!(visible & (1 << i)))
+                    continue;
+                aabb box = laneBounds(&lanes, i);
+                aabbExtend(&bounds, &box);
+                primitives += lanes.count[i] > 0 ? lanes.count[i] : subtreePrimitiveCount(tree, lanes.child[i]);
+            }
+            frustumCullAddSubtree(cull, f, index, &bounds, primitives);
+            continue;
+        }
+        for(int i = 0; i < (int)tree->width; i++)
+        {
+            if(!(visible & (1 << i)))
+                continue;
+            aabb box = laneBounds(&lanes, i);
+            if(cull->subtreeCount >= FRUSTUM_MAX_SUBTREES || frustumContainsAABB(f, &box))
+                frustumCullAddSubtree(cull, f, lanes.child[i], &box, subtreePrimitiveCount(tree, lanes.child[i]));
+            else
+                stack[sp++] = lanes.child[i];
+        }
+    }
+    sortFrustumCull(cull);
+}
+
+void wideBVHPackLeaves(bvh* tree)
+{
+    for(uint32_t index = 0; index < tree->wideNodeCount; index++)
+    {
+        uint32_t* child;
+        uint16_t* count;
+        if(tree->compressed)
+        {
+            quantizedView q = getQuantized(tree->wideNodes, tree->width, index);
+            child = q.child;
+            count = q.count;
+        }
+        else
+        {
+            laneView lanes = getLanes(tree->wideNodes, tree->width, index);
+            child = lanes.child;
+            count = lanes.count;
+        }
+        for(int i = 0; i < (int)tree->width; i++)
+        {
+            if(child[i] != WIDEBVH_EMPTY && count[i] > 0)
+                bvhPackLeaf(tree, child[i], count[i]);
+        }
+    }
+}
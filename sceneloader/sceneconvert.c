@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <util/colors.h>
+#include <rayTracerCore/meshloader.h>
+#include <rayTracerCore/shapes/pagedmesh.h>
+#include "sceneloader.h"
+
+/**
+* Writes a binary scene from a text description or a single PLY/OBJ mesh.
+*
+* Usage: sceneconvert input.txt|input.ply|input.obj output.scene [threads]
+*        sceneconvert input.ply|input.obj output.pmesh [threads] [page triangles]
+*
+* A .pmesh output is the mesh cut into pages for rendering with --paged, see pagedmesh.h.
+*
+* The text format is one entry per line, # starts a comment and materials are numbered in order:
+*   camera eyeX eyeY eyeZ lookatX lookatY lookatZ upX upY upZ
+*   view width height distance
+*   light x y z r g b ambient
+*   material r g b reflect(0|1)
+*   sphere material x y z radius
+*   ellipsoid material x y z a b c
+*   triangle material x1 y1 z1 x2 y2 z2 x3 y3 z3
+*   plane material normalX normalY normalZ pointX pointY pointZ
+*   quad material cornerX cornerY cornerZ uX uY uZ vX vY vZ
+*   box material minX minY minZ maxX maxY maxZ
+*   mesh material file.ply|file.obj
+*/
+
+// The reference scene's camera and light until the input says otherwise
+static const sceneView defaultView = {.eye = {0, 0, 1}, .lookat = {0, 0, -2}, .up = {0, 1, 0}, .width = 4, .height = 4, .viewPlaneDistance = 2};
+static const light defaultLight = {.type = POINT, .ambinentFactor = .2f, .l.point = {.color = {1, 1, 1}, .location = {0.0f, 10.0f, -4.0f}}};
+static const material defaultMaterial = {.reflect = false, .color = {.3, .6, .3}};
+
+#define MAX_LIGHTS 64
+#define MAX_MATERIALS 1024
+
+typedef struct
+{
+    sceneView view;
+    light lights[MAX_LIGHTS];
+    uint32_t lightCount;
+    material materials[MAX_MATERIALS];
+    uint32_t materialCount;
+    object* objects;
+    object* tail;
+    unsigned int threads;
+} sceneInput;
+
+static void append(sceneInput* in, object* o)
+{
+    if(in->tail == NULL)
+        in->objects = o;
+    else
+        in->tail->next = o;
+    in->tail = o;
+}
+
+static object* loadMeshFile(const char* path, const material mat, unsigned int threads)
+{
+    meshLoadStats stats;
+    object* mesh = loadMesh(path, mat, threads, &stats);
+    printMeshLoadStats(path, &stats);
+    return mesh;
+}
+
+static bool parseLine(sceneInput* in, const char* line)
+{
+    char word[32], path[1024];
+    unsigned int m;
+    float v[10];
+    int reflect;
+    if(sscanf(line, "%31s", word) != 1 || word[0] == '#')
+        return true;
+    if(strcmp(word, "camera") == 0 &&
+       sscanf(line, "%*s %f %f %f %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8]) == 9)
+    {
+        vector3f_set(in->view.eye, v[0], v[1], v[2]);
+        vector3f_set(in->view.lookat, v[3], v[4], v[5]);
+        vector3f_set(in->view.up, v[6], v[7], v[8]);
+        return true;
+    }
+    if(strcmp(word, "view") == 0 &&
+       sscanf(line, "%*s %f %f %f", &in->view.width, &in->view.height, &in->view.viewPlaneDistance) == 3)
+        return true;
+    if(strcmp(word, "light") == 0 && in->lightCount < MAX_LIGHTS &&
+       sscanf(line, "%*s %f %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) == 7)
+    {
+        light* l = &in->lights[in->lightCount++];
+        memset(l, 0, sizeof(light));
+        l->type = POINT;
+        vector3f_set(l->l.point.location, v[0], v[1], v[2]);
+        vector3f_set(l->l.point.color, v[3], v[4], v[5]);
+        l->ambinentFactor = v[6];
+        return true;
+    }
+    if(strcmp(word, "material") == 0 && in->materialCount < MAX_MATERIALS &&
+       sscanf(line, "%*s %f %f %f %d", &v[0], &v[1], &v[2], &reflect) == 4)
+    {
+        material* mat = &in->materials[in->materialCount++];
+        vector3f_set(mat->color, v[0], v[1], v[2]);
+        mat->reflect = reflect != 0;
+        return true;
+    }
+    if(sscanf(line, "%*s %u", &m) != 1 || m >= in->materialCount)
+        return false;
+    const material mat = in->materials[m];
+    if(strcmp(word, "sphere") == 0 && sscanf(line, "%*s %*u %f %f %f %f", &v[0], &v[1], &v[2], &v[3]) == 4)
+    {
+        append(in, createSphere(mat, v[3], v));
+        return true;
+    }
+    if(strcmp(word, "ellipsoid") == 0 && sscanf(line, "%*s %*u %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6)
+    {
+        append(in, createEllipsoid(mat, v + 3, v));
+        return true;
+    }
+    if(strcmp(word, "triangle") == 0 &&
+       sscanf(line, "%*s %*u %f %f %f %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8]) == 9)
+    {
+        append(in, createTriangle(mat, v, v + 3, v + 6));
+        return true;
+    }
+    if(strcmp(word, "plane") == 0 && sscanf(line, "%*s %*u %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6)
+    {
+        append(in, createPlane(mat, v, v + 3));
+        return true;
+    }
+    if(strcmp(word, "quad") == 0 &&
+       sscanf(line, "%*s %*u %f %f %f %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8]) == 9)
+    {
+        append(in, createQuad(mat, v, v + 3, v + 6));
+        return true;
+    }
+    if(strcmp(word, "box") == 0 && sscanf(line, "%*s %*u %f %f %f %f %f %f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6)
+    {
+        append(in, createBox(mat, v, v + 3));
+        return true;
+    }
+    if(strcmp(word, "mesh") == 0 && sscanf(line, "%*s %*u %1023s", path) == 1)
+    {
+        object* mesh = loadMeshFile(path, mat, in->threads);
+        if(mesh != NULL)
+            append(in, mesh);
+        return mesh != NULL;
+    }
+    return false;
+}
+
+static bool parseText(sceneInput* in, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if(f == NULL)
+    {
+        printf(KRED"%s could not be opened\n"KNRM, path);
+        return false;
+    }
+    char line[4096];
+    unsigned int number = 0;
+    bool ok = true;
+    while(ok && fgets(line, sizeof(line), f) != NULL)
+    {
+        number++;
+        ok = parseLine(in, line);
+        if(!ok)
+            printf(KRED"%s:%u: could not read: %s"KNRM, path, number, line);
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool hasExtension(const char* path, const char* extension)
+{
+    const char* dot = strrchr(path, '.');
+    return dot != NULL && strcasecmp(dot + 1, extension) == 0;
+}
+
+static int writePages(const char* input, const char* output, unsigned int threads, uint32_t pageTriangles)
+{
+    object* mesh = loadMeshFile(input, defaultMaterial, threads);
+    bool ok = mesh != NULL && writePagedMesh(output, mesh->shape, pageTriangles);
+    cleanObjectList(&mesh);
+    if(!ok)
+    {
+        printf(KRED"%s was not written\n"KNRM, output);
+        return 1;
+    }
+    object* paged = loadPagedMesh(output, defaultMaterial, 0);
+    if(paged != NULL)
+    {
+        paged->print(paged->shape);
+        printf("\n");
+    }
+    cleanObjectList(&paged);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        printf("Usage: %s input.txt|input.ply|input.obj output.scene [threads]\n", argv[0]);
+        printf("       %s input.ply|input.obj output.pmesh [threads] [page triangles]\n", argv[0]);
+        return 1;
+    }
+    if(hasExtension(argv[2], "pmesh"))
+        return writePages(argv[1], argv[2], argc > 3 ? (unsigned int)atoi(argv[3]) : 0, argc > 4 ? (uint32_t)atoi(argv[4]) : 0);
+    sceneInput in;
+    memset(&in, 0, sizeof(in));
+    in.view = defaultView;
+    in.threads = argc > 3 ? (unsigned int)atoi(argv[3]) : 0;
+
+    bool ok;
+    if(hasExtension(argv[1], "ply") || hasExtension(argv[1], "obj"))
+    {
+        object* mesh = loadMeshFile(argv[1], defaultMaterial, in.threads);
+        ok = mesh != NULL;
+        if(ok)
+            append(&in, mesh);
+    }
+    else
+        ok = parseText(&in, argv[1]);
+    if(in.lightCount == 0)
+        in.lights[in.lightCount++] = defaultLight;
+
+    ok = ok && saveScene(argv[2], &in.view, in.lights, in.lightCount, in.objects);
+    if(!ok)
+        printf(KRED"%s was not written\n"KNRM, argv[2]);
+    else
+    {
+        sceneLoadStatus status;
+        scene_t* s = loadScene(argv[2], &status);
+        if(s != NULL)
+            printSceneStats(argv[2], s);
+        cleanScene(&s);
+    }
+    cleanObjectList(&in.objects);
+    return !ok;
+}
@@ -1 +1,482 @@
-#include "sceneloader.h"
\ No newline at end of file
+#include "sceneloader.h"
+#include <util/colors.h>
+#include <util/usefulfunctions.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const uint32_t sectionStrides[SCENE_SECTIONS] = {
+    sizeof(light), sizeof(material), sizeof(ellipsoid_t), sizeof(triangle_t),
+    sizeof(plane_t), sizeof(parallelogram_t), sizeof(box_t),
+    sizeof(sceneMeshRecord), sizeof(uint32_t), sizeof(sceneInstanceRecord), sizeof(sceneObjectRecord)};
+
+/**
+* Records of one section collected before anything is written
+*/
+typedef struct
+{
+    char* data;
+    uint32_t count, capacity;
+    size_t stride;
+} recordArray;
+
+static void* pushRecord(recordArray* a)
+{
+    if(a->count == a->capacity)
+    {
+        a->capacity = a->capacity > 0 ? a->capacity * 2 : 64;
+        a->data = realloc(a->data, a->capacity * a->stride);
+    }
+    // Zeroed so padding inside the records is the same on every save
+    void* record = a->data + a->count++ * a->stride;
+    memset(record, 0, a->stride);
+    return record;
+}
+
+typedef struct
+{
+    recordArray sections[SCENE_SECTIONS];
+    const mesh_t** meshes;          // in SCENE_MESHES order
+    const instanceGeometry** geometries;
+} sceneWriter;
+
+static uint32_t addMaterial(sceneWriter* w, const material mat)
+{
+    material m;
+    memset(&m, 0, sizeof(m));
+    memcpy(m.color, mat.color, sizeof(m.color));
+    m.reflect = mat.reflect;
+    recordArray* materials = &w->sections[SCENE_MATERIALS];
+    // Scenes use a handful of materials, newest first finds a run of one quickly
+    for(uint32_t i = materials->count; i-- > 0;)
+    {
+        if(memcmp(materials->data + i * sizeof(material), &m, sizeof(material)) == 0)
+            return i;
+    }
+    memcpy(pushRecord(materials), &m, sizeof(material));
+    return materials->count - 1;
+}
+
+static bool addObject(sceneWriter* w, const object* obj, uint32_t geometry)
+{
+    sceneObjectRecord record = {.type = obj->type, .material = addMaterial(w, obj->mat), .geometry = geometry};
+    switch(obj->type)
+    {
+    case SPHERE:
+    case ELLIPSOID:
+        record.shape = w->sections[SCENE_ELLIPSOIDS].count;
+        memcpy(pushRecord(&w->sections[SCENE_ELLIPSOIDS]), obj->shape, sizeof(ellipsoid_t));
+        break;
+    case TRIANGLE:
+        record.shape = w->sections[SCENE_TRIANGLES].count;
+        memcpy(pushRecord(&w->sections[SCENE_TRIANGLES]), obj->shape, sizeof(triangle_t));
+        break;
+    case PLANE:
+        record.shape = w->sections[SCENE_PLANES].count;
+        memcpy(pushRecord(&w->sections[SCENE_PLANES]), obj->shape, sizeof(plane_t));
+        break;
+    case QUAD:
+        record.shape = w->sections[SCENE_QUADS].count;
+        memcpy(pushRecord(&w->sections[SCENE_QUADS]), obj->shape, sizeof(parallelogram_t));
+        break;
+    case BOX:
+        record.shape = w->sections[SCENE_BOXES].count;
+        memcpy(pushRecord(&w->sections[SCENE_BOXES]), obj->shape, sizeof(box_t));
+        break;
+    case MESH:
+        record.shape = w->sections[SCENE_MESHES].count;
+        pushRecord(&w->sections[SCENE_MESHES]);
+        w->meshes = realloc(w->meshes, w->sections[SCENE_MESHES].count * sizeof(mesh_t*));
+        w->meshes[record.shape] = obj->shape;
+        break;
+    case INSTANCE:
+    {
+        if(geometry != SCENE_TOP_LEVEL)
+            return false;
+        const instance_t* inst = obj->shape;
+        uint32_t g = 0;
+        while(g < w->sections[SCENE_GEOMETRIES].count && w->geometries[g] != inst->geometry)
+            g++;
+        if(g == w->sections[SCENE_GEOMETRIES].count)
+        {
+            pushRecord(&w->sections[SCENE_GEOMETRIES]);
+            w->geometries = realloc(w->geometries, (g + 1) * sizeof(instanceGeometry*));
+            w->geometries[g] = inst->geometry;
+            for(const object* child = inst->geometry->objects; child != NULL; child = child->next)
+            {
+                if(!addObject(w, child, g))
+                    return false;
+            }
+        }
+        record.shape = w->sections[SCENE_INSTANCES].count;
+        sceneInstanceRecord* out = pushRecord(&w->sections[SCENE_INSTANCES]);
+        out->geometry = g;
+        out->overrideMat = inst->overrideMat;
+        out->objectToWorld = inst->objectToWorld;
+        out->worldToObject = inst->worldToObject;
+        break;
+    }
+    case PAGED_MESH:
+        // Already a file of its own, and one that may not fit in memory to copy
+        return false;
+    }
+    memcpy(pushRecord(&w->sections[SCENE_OBJECTS]), &record, sizeof(record));
+    return true;
+}
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + SCENE_ALIGN - 1) & ~(uint64_t)(SCENE_ALIGN - 1);
+}
+
+/**
+* Pads from *pos up to offset, then writes the bytes
+*/
+static bool writeAt(FILE* f, uint64_t* pos, uint64_t offset, const void* data, size_t bytes)
+{
+    static const char padding[SCENE_ALIGN] = {0};
+    bool ok = offset >= *pos && fwrite(padding, offset - *pos, 1, f) <= 1;
+    ok = ok && (bytes == 0 || fwrite(data, bytes, 1, f) == 1);
+    *pos = offset + bytes;
+    return ok;
+}
+
+bool saveScene(const char* path, const sceneView* view, const light* lights, uint32_t lightCount, const object* list)
+{
+    sceneWriter w;
+    memset(&w, 0, sizeof(w));
+    for(int i = 0; i < SCENE_SECTIONS; i++)
+        w.sections[i].stride = sectionStrides[i];
+    for(uint32_t i = 0; i < lightCount; i++)
+        memcpy(pushRecord(&w.sections[SCENE_LIGHTS]), &lights[i], sizeof(light));
+    bool ok = true;
+    for(const object* obj = list; obj != NULL && ok; obj = obj->next)
+        ok = addObject(&w, obj, SCENE_TOP_LEVEL);
+
+    sceneHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SCENE_MAGIC;
+    header.version = SCENE_VERSION;
+    header.view = *view;
+    uint64_t offset = alignOffset(sizeof(header));
+    for(int i = 0; i < SCENE_SECTIONS; i++)
+    {
+        header.sections[i].offset = offset;
+        header.sections[i].count = w.sections[i].count;
+        header.sections[i].stride = sectionStrides[i];
+        offset = alignOffset(offset + (uint64_t)w.sections[i].count * sectionStrides[i]);
+    }
+    // Mesh buffers follow the sections, their records only know where
+    for(uint32_t i = 0; i < w.sections[SCENE_MESHES].count; i++)
+    {
+        const mesh_t* m = w.meshes[i];
+        sceneMeshRecord* record = (sceneMeshRecord*)(w.sections[SCENE_MESHES].data + i * sizeof(sceneMeshRecord));
+        record->vertexCount = m->vertexCount;
+        record->triangleCount = m->triangleCount;
+        record->nodeCount = m->nodeCount;
+        record->vertices = offset;
+        offset = alignOffset(offset + (uint64_t)m->vertexCount * sizeof(point3f));
+        if(m->normals != NULL)
+        {
+            record->normals = offset;
+            offset = alignOffset(offset + (uint64_t)m->vertexCount * sizeof(vector3f));
+        }
+        record->indices = offset;
+        offset = alignOffset(offset + (uint64_t)m->triangleCount * 3 * sizeof(uint32_t));
+        record->nodes = offset;
+        offset = alignOffset(offset + (uint64_t)m->nodeCount * sizeof(bvhNode));
+        record->order = offset;
+        offset += (uint64_t)m->triangleCount * sizeof(uint32_t);
+    }
+    header.fileSize = offset;
+
+    size_t tmpLength = strlen(path) + 5;
+    char* tmpPath = malloc(tmpLength);
+    snprintf(tmpPath, tmpLength, "%s.tmp", path);
+    FILE* f = ok ? fopen(tmpPath, "wb") : NULL;
+    ok = f != NULL;
+    if(ok)
+    {
+        uint64_t pos = 0;
+        ok = writeAt(f, &pos, 0, &header, sizeof(header));
+        for(int i = 0; i < SCENE_SECTIONS && ok; i++)
+            ok = writeAt(f, &pos, header.sections[i].offset, w.sections[i].data, w.sections[i].count * w.sections[i].stride);
+        for(uint32_t i = 0; i < w.sections[SCENE_MESHES].count && ok; i++)
+        {
+            const mesh_t* m = w.meshes[i];
+            const sceneMeshRecord* record = (const sceneMeshRecord*)(w.sections[SCENE_MESHES].data + i * sizeof(sceneMeshRecord));
+            ok = writeAt(f, &pos, record->vertices, m->vertices, m->vertexCount * sizeof(point3f));
+            if(m->normals != NULL)
+                ok = ok && writeAt(f, &pos, record->normals, m->normals, m->vertexCount * sizeof(vector3f));
+            ok = ok && writeAt(f, &pos, record->indices, m->indices, (size_t)m->triangleCount * 3 * sizeof(uint32_t));
+            ok = ok && writeAt(f, &pos, record->nodes, m->nodes, m->nodeCount * sizeof(bvhNode));
+            ok = ok && writeAt(f, &pos, record->order, m->order, m->triangleCount * sizeof(uint32_t));
+        }
+        // A scene without meshes ends on its last section, padded out to the aligned size
+        ok = ok && writeAt(f, &pos, header.fileSize, NULL, 0);
+        ok = (fclose(f) == 0) && ok;
+        ok = ok && rename(tmpPath, path) == 0;
+        if(!ok)
+            remove(tmpPath);
+    }
+    free(tmpPath);
+    for(int i = 0; i < SCENE_SECTIONS; i++)
+        free(w.sections[i].data);
+    free(w.meshes);
+    free(w.geometries);
+    return ok;
+}
+
+static bool validHeader(const sceneHeader* header, size_t size)
+{
+    if(header->magic != SCENE_MAGIC || header->version != SCENE_VERSION || header->fileSize != size)
+        return false;
+    for(int i = 0; i < SCENE_SECTIONS; i++)
+    {
+        const sceneSectionRecord* section = &header->sections[i];
+        if(section->stride != sectionStrides[i] || section->offset % SCENE_ALIGN != 0 ||
+           section->offset < sizeof(sceneHeader) || section->offset + (uint64_t)section->count * section->stride > size)
+            return false;
+    }
+    return true;
+}
+
+static bool inFile(uint64_t offset, uint64_t bytes, size_t size)
+{
+    return offset % sizeof(float) == 0 && offset <= size && bytes <= size - offset;
+}
+
+/**
+* Every triangle's vertices, every leaf entry's triangle and the tree itself have to stay inside the mesh,
+* traversal reads them without checking
+*/
+static bool validMesh(const mesh_t* m)
+{
+    for(uint64_t i = 0; i < (uint64_t)m->triangleCount * 3; i++)
+    {
+        if(m->indices[i] >= m->vertexCount)
+            return false;
+    }
+    for(uint32_t i = 0; i < m->triangleCount; i++)
+    {
+        if(m->order[i] >= m->triangleCount)
+            return false;
+    }
+    return bvhValidNodes(m->nodes, m->nodeCount, m->triangleCount);
+}
+
+/**
+* Meshes point into the mapping, their indices and trees are checked once here
+*/
+static bool fixupMeshes(scene_t* s, const sceneHeader* header)
+{
+    const char* base = s->mapping;
+    const sceneMeshRecord* records = (const sceneMeshRecord*)(base + header->sections[SCENE_MESHES].offset);
+    for(uint32_t i = 0; i < s->meshCount; i++)
+    {
+        const sceneMeshRecord* r = &records[i];
+        if(!inFile(r->vertices, (uint64_t)r->vertexCount * sizeof(point3f), s->mappingSize) ||
+           (r->normals != 0 && !inFile(r->normals, (uint64_t)r->vertexCount * sizeof(vector3f), s->mappingSize)) ||
+           !inFile(r->indices, (uint64_t)r->triangleCount * 3 * sizeof(uint32_t), s->mappingSize) ||
+           !inFile(r->nodes, (uint64_t)r->nodeCount * sizeof(bvhNode), s->mappingSize) ||
+           !inFile(r->order, (uint64_t)r->triangleCount * sizeof(uint32_t), s->mappingSize))
+            return false;
+        mesh_t* m = &s->meshes[i];
+        m->vertices = (point3f*)(base + r->vertices);
+        m->normals = r->normals != 0 ? (vector3f*)(base + r->normals) : NULL;
+        m->indices = (uint32_t*)(base + r->indices);
+        m->vertexCount = r->vertexCount;
+        m->triangleCount = r->triangleCount;
+        m->nodes = (bvhNode*)(base + r->nodes);
+        m->nodeCount = r->nodeCount;
+        m->order = (uint32_t*)(base + r->order);
+        if(!validMesh(m))
+            return false;
+    }
+    return true;
+}
+
+/**
+* Points every object at its shape and links them into the scene list or their geometry's
+*/
+static bool fixupObjects(scene_t* s, const sceneHeader* header, object** geometryLists)
+{
+    const char* base = s->mapping;
+    const sceneSectionRecord* sections = header->sections;
+    const sceneObjectRecord* records = (const sceneObjectRecord*)(base + sections[SCENE_OBJECTS].offset);
+    const material* materials = (const material*)(base + sections[SCENE_MATERIALS].offset);
+    object** tails = malloc((s->geometryCount + 1) * sizeof(object*));
+    for(uint32_t g = 0; g <= s->geometryCount; g++)
+        tails[g] = NULL;
+    s->objects = NULL;
+    uint32_t topLevel = 0;
+    for(uint32_t i = 0; i < s->objectCount; i++)
+    {
+        const sceneObjectRecord* r = &records[i];
+        void* shape = NULL;
+        switch(r->type)
+        {
+        case SPHERE:
+        case ELLIPSOID:
+            if(r->shape < sections[SCENE_ELLIPSOIDS].count)
+                shape = (void*)(base + sections[SCENE_ELLIPSOIDS].offset + r->shape * sizeof(ellipsoid_t));
+            break;
+        case TRIANGLE:
+            if(r->shape < sections[SCENE_TRIANGLES].count)
+                shape = (void*)(base + sections[SCENE_TRIANGLES].offset + r->shape * sizeof(triangle_t));
+            break;
+        case PLANE:
+            if(r->shape < sections[SCENE_PLANES].count)
+                shape = (void*)(base + sections[SCENE_PLANES].offset + r->shape * sizeof(plane_t));
+            break;
+        case QUAD:
+            if(r->shape < sections[SCENE_QUADS].count)
+                shape = (void*)(base + sections[SCENE_QUADS].offset + r->shape * sizeof(parallelogram_t));
+            break;
+        case BOX:
+            if(r->shape < sections[SCENE_BOXES].count)
+                shape = (void*)(base + sections[SCENE_BOXES].offset + r->shape * sizeof(box_t));
+            break;
+        case MESH:
+            if(r->shape < s->meshCount)
+                shape = &s->meshes[r->shape];
+            break;
+        case INSTANCE:
+            if(r->shape < s->instanceCount && r->geometry == SCENE_TOP_LEVEL)
+                shape = &s->instances[r->shape];
+            break;
+        }
+        if(shape == NULL || r->material >= sections[SCENE_MATERIALS].count ||
+           (r->geometry != SCENE_TOP_LEVEL && r->geometry >= s->geometryCount))
+        {
+            free(tails);
+            return false;
+        }
+        object* o = &s->objectArray[i];
+        initObject(o, (geoEnum)r->type, materials[r->material], shape);
+        uint32_t list = r->geometry == SCENE_TOP_LEVEL ? s->geometryCount : r->geometry;
+        object** head = list == s->geometryCount ? &s->objects : &geometryLists[list];
+        if(tails[list] == NULL)
+            *head = o;
+        else
+            tails[list]->next = o;
+        tails[list] = o;
+        topLevel += list == s->geometryCount;
+    }
+    free(tails);
+    s->objectCount = topLevel;
+    return true;
+}
+
+static bool fixupInstances(scene_t* s, const sceneHeader* header)
+{
+    const sceneInstanceRecord* records = (const sceneInstanceRecord*)((const char*)s->mapping + header->sections[SCENE_INSTANCES].offset);
+    for(uint32_t i = 0; i < s->instanceCount; i++)
+    {
+        if(records[i].geometry >= s->geometryCount)
+            return false;
+        instance_t* inst = &s->instances[i];
+        inst->geometry = s->geometries[records[i].geometry];
+        inst->objectToWorld = records[i].objectToWorld;
+        inst->worldToObject = records[i].worldToObject;
+        inst->overrideMat = records[i].overrideMat != 0;
+    }
+    return true;
+}
+
+scene_t* loadScene(const char* path, sceneLoadStatus* status)
+{
+    double start = getTimeSeconds();
+    *status = SCENE_LOAD_MISSING;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    *status = SCENE_LOAD_INVALID;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(sceneHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        return NULL;
+    const sceneHeader* header = mapping;
+    if(!validHeader(header, size))
+    {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    scene_t* s = calloc(1, sizeof(scene_t));
+    s->mapping = mapping;
+    s->mappingSize = size;
+    s->view = header->view;
+    s->lights = (const light*)((const char*)mapping + header->sections[SCENE_LIGHTS].offset);
+    s->lightCount = header->sections[SCENE_LIGHTS].count;
+    s->meshCount = header->sections[SCENE_MESHES].count;
+    s->instanceCount = header->sections[SCENE_INSTANCES].count;
+    s->geometryCount = header->sections[SCENE_GEOMETRIES].count;
+    s->objectCount = header->sections[SCENE_OBJECTS].count;
+    s->meshes = calloc(s->meshCount, sizeof(mesh_t));
+    s->instances = calloc(s->instanceCount, sizeof(instance_t));
+    s->geometries = calloc(s->geometryCount, sizeof(instanceGeometry*));
+    s->objectArray = calloc(s->objectCount, sizeof(object));
+    object** geometryLists = calloc(s->geometryCount, sizeof(object*));
+
+    bool ok = fixupMeshes(s, header) && fixupObjects(s, header, geometryLists);
+    // Instance geometries are small, their bottom level trees are rebuilt rather than stored
+    for(uint32_t g = 0; g < s->geometryCount && ok; g++)
+    {
+        s->geometries[g] = createInstanceGeometry(geometryLists[g]);
+        ok = s->geometries[g] != NULL;
+    }
+    ok = ok && fixupInstances(s, header);
+    free(geometryLists);
+    if(!ok)
+    {
+        cleanScene(&s);
+        return NULL;
+    }
+    s->loadTime = getTimeSeconds() - start;
+    *status = SCENE_LOAD_OK;
+    return s;
+}
+
+void printSceneStats(const char* path, const scene_t* s)
+{
+    const sceneHeader* header = s->mapping;
+    printf(KRED"scene["KBLU"file:"KGRN"%s "KBLU"size:"KGRN"%.1fMB ", path, s->mappingSize * 1e-6);
+    printf(KBLU"objects:"KGRN"%u "KBLU"lights:"KGRN"%u "KBLU"materials:"KGRN"%u ", s->objectCount, s->lightCount, header->sections[SCENE_MATERIALS].count);
+    printf(KBLU"ellipsoids:"KGRN"%u "KBLU"triangles:"KGRN"%u ", header->sections[SCENE_ELLIPSOIDS].count, header->sections[SCENE_TRIANGLES].count);
+    printf(KBLU"planes:"KGRN"%u "KBLU"quads:"KGRN"%u "KBLU"boxes:"KGRN"%u ", header->sections[SCENE_PLANES].count, header->sections[SCENE_QUADS].count, header->sections[SCENE_BOXES].count);
+    printf(KBLU"meshes:"KGRN"%u "KBLU"instances:"KGRN"%u ", s->meshCount, s->instanceCount);
+    printf(KBLU"load:"KGRN"%4.2fms"KRED"]\n"KNRM, s->loadTime * 1000.0);
+}
+
+void cleanScene(scene_t** s)
+{
+    if(*s == NULL)
+        return;
+    // The geometries' objects live in objectArray, only their trees are theirs
+    for(uint32_t g = 0; g < (*s)->geometryCount; g++)
+    {
+        if((*s)->geometries[g] == NULL)
+            continue;
+        cleanBVH(&(*s)->geometries[g]->tree);
+        free((*s)->geometries[g]);
+    }
+    free((*s)->geometries);
+    free((*s)->objectArray);
+    free((*s)->meshes);
+    free((*s)->instances);
+    munmap((*s)->mapping, (*s)->mappingSize);
+    free(*s);
+    *s = NULL;
+}
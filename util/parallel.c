@@ -0,0 +1,187 @@
+#include <util/parallel.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <util/usefulfunctions.h>
+#include <util/workqueue.h>
+
+typedef struct
+{
+    parallelBody body;
+    void* ctx;
+    size_t begin, end;
+    unsigned int thread;
+} parallelTask;
+
+static void* runTask(void* arg)
+{
+    parallelTask* task = arg;
+    task->body(task->ctx, task->begin, task->end, task->thread);
+    return NULL;
+}
+
+unsigned int getProcessorCount(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int) count : 1;
+}
+
+void parallelFor(unsigned int threads, size_t count, parallelBody body, void* ctx)
+{
+    if(threads == 0)
+        threads = getProcessorCount();
+    if(threads <= 1 || count < threads)
+    {
+        // Still hand out one chunk per thread so per thread scratch stays valid
+        for(unsigned int t = 0; t < threads; t++)
+            body(ctx, count * t / threads, count * (t + 1) / threads, t);
+        return;
+    }
+
+    pthread_t* handles = malloc(threads * sizeof(pthread_t));
+    parallelTask* tasks = malloc(threads * sizeof(parallelTask));
+    bool* started = calloc(threads, sizeof(bool));
+    for(unsigned int t = 0; t < threads; t++)
+    {
+        tasks[t] = (parallelTask){body, ctx, count * t / threads, count * (t + 1) / threads, t};
+        if(t == 0)
+            continue;
+        started[t] = pthread_create(&handles[t], NULL, runTask, &tasks[t]) == 0;
+        if(!started[t])
+        {
+            // Out of threads, run the chunk here instead
+            runTask(&tasks[t]);
+        }
+    }
+    runTask(&tasks[0]);
+    for(unsigned int t = 1; t < threads; t++)
+    {
+        if(started[t])
+            pthread_join(handles[t], NULL);
+    }
+    free(started);
+    free(tasks);
+    free(handles);
+}
+
+typedef struct
+{
+    workDeque** deques;
+    unsigned int threads;
+    parallelTaskBody body;
+    void* ctx;
+    parallelWorkerStats* stats;
+} stealingLoop;
+
+typedef struct
+{
+    stealingLoop* loop;
+    unsigned int thread;
+} stealingWorker;
+
+static bool steal(stealingLoop* loop, unsigned int thief, unsigned int* seed, size_t* task)
+{
+    // Start at a random victim so thieves spread out instead of all draining the same deque
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    unsigned int first = *seed % loop->threads;
+    bool contended = true;
+    while(contended)
+    {
+        contended = false;
+        for(unsigned int v = 0; v < loop->threads; v++)
+        {
+            unsigned int victim = (first + v) % loop->threads;
+            if(victim == thief)
+                continue;
+            stealResult result = dequeSteal(loop->deques[victim], task);
+            if(result == STEAL_SUCCESS)
+                return true;
+            contended |= result == STEAL_ABORT;
+        }
+    }
+    // Every deque was empty when it was looked at and none can refill, so the loop is done
+    return false;
+}
+
+static void* runWorker(void* arg)
+{
+    stealingWorker* worker = arg;
+    stealingLoop* loop = worker->loop;
+    parallelWorkerStats stats = {0, 0, 0};
+    unsigned int seed = worker->thread * 2654435761u + 1;
+    size_t task;
+    while(true)
+    {
+        bool stolen = false;
+        if(!dequePop(loop->deques[worker->thread], &task))
+        {
+            if(!steal(loop, worker->thread, &seed, &task))
+                break;
+            stolen = true;
+        }
+        double start = getTimeSeconds();
+        loop->body(loop->ctx, task, worker->thread);
+        stats.busyTime += getTimeSeconds() - start;
+        stats.tasks++;
+        stats.steals += stolen;
+    }
+    if(loop->stats != NULL)
+        loop->stats[worker->thread] = stats;
+    return NULL;
+}
+
+void parallelForStealing(unsigned int threads, size_t count, parallelTaskBody body, void* ctx, parallelWorkerStats* stats)
+{
+    if(threads == 0)
+        threads = getProcessorCount();
+    for(unsigned int t = 0; stats != NULL && t < threads; t++)
+        stats[t] = (parallelWorkerStats){0, 0, 0};
+    workDeque** deques = calloc(threads, sizeof(workDeque*));
+    // Pushed last to first so each owner pops its block in order and thieves take its end
+    size_t* reversed = malloc((count > 0 ? count : 1) * sizeof(size_t));
+    bool ready = deques != NULL && reversed != NULL;
+    for(size_t task = 0; ready && task < count; task++)
+        reversed[task] = count - 1 - task;
+    for(unsigned int t = 0; ready && t < threads; t++)
+    {
+        size_t begin = count * t / threads, end = count * (t + 1) / threads;
+        deques[t] = createWorkDeque(end - begin);
+        ready = deques[t] != NULL;
+        if(ready)
+            dequePush(deques[t], reversed + count - end, end - begin);
+    }
+    free(reversed);
+    if(!ready)
+    {
+        // Out of memory, run everything here
+        for(size_t task = 0; task < count; task++)
+            body(ctx, task, 0);
+    }
+    else
+    {
+        stealingWorker* workers = malloc(threads * sizeof(stealingWorker));
+        pthread_t* handles = malloc(threads * sizeof(pthread_t));
+        bool* started = calloc(threads, sizeof(bool));
+        stealingLoop loop = {deques, threads, body, ctx, stats};
+        for(unsigned int t = 0; t < threads; t++)
+            workers[t] = (stealingWorker){&loop, t};
+        // A worker that fails to start leaves its deque to be stolen by the others
+        for(unsigned int t = 1; t < threads; t++)
+            started[t] = pthread_create(&handles[t], NULL, runWorker, &workers[t]) == 0;
+        runWorker(&workers[0]);
+        for(unsigned int t = 1; t < threads; t++)
+        {
+            if(started[t])
+                pthread_join(handles[t], NULL);
+        }
+        free(started);
+        free(handles);
+        free(workers);
+    }
+    for(unsigned int t = 0; deques != NULL && t < threads; t++)
+        cleanWorkDeque(&deques[t]);
+    free(deques);
+}
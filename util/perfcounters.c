@@ -0,0 +1,65 @@
+#include <util/perfcounters.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+static int openCounter(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+bool startPerfCounters(perfCounters* c)
+{
+    c->references = openCounter(PERF_COUNT_HW_CACHE_REFERENCES, -1);
+    c->misses = c->references >= 0 ? openCounter(PERF_COUNT_HW_CACHE_MISSES, c->references) : -1;
+    if(c->misses < 0)
+    {
+        if(c->references >= 0)
+            close(c->references);
+        c->references = -1;
+        return false;
+    }
+    ioctl(c->references, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(c->references, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+void stopPerfCounters(perfCounters* c, perfCounts* counts)
+{
+    counts->references = counts->misses = 0;
+    if(c->references < 0)
+        return;
+    ioctl(c->references, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if(read(c->references, &counts->references, sizeof(uint64_t)) != sizeof(uint64_t))
+        counts->references = 0;
+    if(read(c->misses, &counts->misses, sizeof(uint64_t)) != sizeof(uint64_t))
+        counts->misses = 0;
+    close(c->misses);
+    close(c->references);
+    c->references = c->misses = -1;
+}
+#else
+bool startPerfCounters(perfCounters* c)
+{
+    c->references = c->misses = -1;
+    return false;
+}
+
+void stopPerfCounters(perfCounters* c, perfCounts* counts)
+{
+    (void) c;
+    counts->references = counts->misses = 0;
+}
+#endif
@@ -0,0 +1,532 @@
+#include <util/renderfarm.h>
+#include <util/ringbuffer.h>
+#include <util/usefulfunctions.h>
+#include <util/colors.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define FARM_CONNECT_TRIES 300  // 30 seconds of 100ms retries
+
+typedef enum
+{
+    JOB_PENDING,
+    JOB_ASSIGNED,
+    JOB_DONE
+} farmJobState;
+
+typedef struct
+{
+    farmJobState state;
+    int worker;
+    double sent;
+    farmMessage tile;
+} farmJob;
+
+typedef struct
+{
+    int fd;
+    bool greeted;
+    bool stalled;       // a tile timed out, gets no more until it answers
+    double stalledAt;
+    uint32_t jobs[FARM_INFLIGHT];
+    unsigned int jobCount;
+    farmMessage header; // the message being read, the socket is non blocking
+    size_t headerRead;
+    char* payload;
+    size_t payloadSize, payloadRead;
+} farmWorker;
+
+typedef struct
+{
+    farmFrame* frames;
+    unsigned int frameCount;
+    const farmOptions* options;
+    farmStats* stats;
+    farmJob* jobs;
+    uint32_t jobCount, done;
+    ringbuffer pending;
+    farmWorker* workers;
+    unsigned int workerCount, workerCapacity;
+} farmCoordinator;
+
+/**
+* Splits unix:/path and tcp:host:port, fills the socket address and returns its family or -1
+*/
+static int parseAddress(const char* address, bool passive, struct sockaddr_storage* addr, socklen_t* length)
+{
+    memset(addr, 0, sizeof(*addr));
+    if(strncmp(address, "unix:", 5) == 0)
+    {
+        struct sockaddr_un* un = (struct sockaddr_un*) addr;
+        if(strlen(address + 5) >= sizeof(un->sun_path))
+            return -1;
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, address + 5);
+        *length = sizeof(struct sockaddr_un);
+        return AF_UNIX;
+    }
+    if(strncmp(address, "tcp:", 4) != 0)
+        return -1;
+    const char* port = strrchr(address + 4, ':');
+    if(port == NULL)
+        return -1;
+    char host[256];
+    size_t hostLength = (size_t) (port - (address + 4));
+    if(hostLength >= sizeof(host))
+        return -1;
+    memcpy(host, address + 4, hostLength);
+    host[hostLength] = '\0';
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = passive ? AI_PASSIVE : 0};
+    struct addrinfo* found = NULL;
+    if(getaddrinfo(hostLength > 0 ? host : NULL, port + 1, &hints, &found) != 0 || found == NULL)
+        return -1;
+    memcpy(addr, found->ai_addr, found->ai_addrlen);
+    *length = found->ai_addrlen;
+    int family = found->ai_family;
+    freeaddrinfo(found);
+    return family;
+}
+
+static bool writeAll(int fd, const void* data, size_t bytes)
+{
+    const char* at = data;
+    while(bytes > 0)
+    {
+        ssize_t sent = send(fd, at, bytes, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EAGAIN)
+        {
+            // Only the coordinator's sockets are non blocking, and it never has much queued on one
+            struct pollfd p = {.fd = fd, .events = POLLOUT};
+            if(poll(&p, 1, 1000) <= 0)
+                return false;
+            continue;
+        }
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+            return false;
+        at += sent;
+        bytes -= (size_t) sent;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t bytes)
+{
+    char* at = data;
+    while(bytes > 0)
+    {
+        ssize_t got = recv(fd, at, bytes, 0);
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got <= 0)
+            return false;
+        at += got;
+        bytes -= (size_t) got;
+    }
+    return true;
+}
+
+static bool sendMessage(int fd, farmMessage* header, const void* payload)
+{
+    header->magic = FARM_MAGIC;
+    header->version = FARM_VERSION;
+    return writeAll(fd, header, sizeof(farmMessage)) && (header->bytes == 0 || writeAll(fd, payload, header->bytes));
+}
+
+int farmListen(const char* address)
+{
+    struct sockaddr_storage addr;
+    socklen_t length;
+    int family = parseAddress(address, true, &addr, &length);
+    if(family < 0)
+        return -1;
+    int fd = socket(family, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+    if(family == AF_UNIX)
+        unlink(((struct sockaddr_un*) &addr)->sun_path);
+    else
+    {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if(bind(fd, (struct sockaddr*) &addr, length) != 0 || listen(fd, 64) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void acceptWorker(farmCoordinator* c, int listenFd)
+{
+    int fd = accept(listenFd, NULL, NULL);
+    if(fd < 0)
+        return;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if(c->workerCount == c->workerCapacity)
+    {
+        c->workerCapacity = c->workerCapacity ? 2 * c->workerCapacity : 8;
+        c->workers = realloc(c->workers, c->workerCapacity * sizeof(farmWorker));
+    }
+    c->workers[c->workerCount++] = (farmWorker){.fd = fd};
+}
+
+static void requeue(farmCoordinator* c, uint32_t job)
+{
+    if(c->jobs[job].state != JOB_ASSIGNED)
+        return;
+    c->jobs[job].state = JOB_PENDING;
+    rbadd(&c->pending, &job);
+    c->stats->reassigned++;
+}
+
+// Hands the worker's tiles back to the queue and forgets it
+static void dropWorker(farmCoordinator* c, unsigned int w)
+{
+    farmWorker* worker = &c->workers[w];
+    for(unsigned int j = 0; j < worker->jobCount; j++)
+        requeue(c, worker->jobs[j]);
+    close(worker->fd);
+    free(worker->payload);
+    c->stats->workersLost++;
+    c->workers[w] = c->workers[--c->workerCount];
+    // The worker moved into slot w keeps its jobs, only their owner index changes
+    for(unsigned int j = 0; w < c->workerCount && j < c->workers[w].jobCount; j++)
+        c->jobs[c->workers[w].jobs[j]].worker = (int) w;
+}
+
+static void forgetJob(farmWorker* worker, uint32_t job)
+{
+    for(unsigned int j = 0; j < worker->jobCount; j++)
+    {
+        if(worker->jobs[j] == job)
+        {
+            worker->jobs[j] = worker->jobs[--worker->jobCount];
+            return;
+        }
+    }
+}
+
+static bool finishTile(farmCoordinator* c, farmWorker* worker)
+{
+    const farmMessage* m = &worker->header;
+    if(m->job >= c->jobCount)
+        return false;
+    farmJob* job = &c->jobs[m->job];
+    forgetJob(worker, m->job);
+    worker->stalled = false;
+    if(job->state == JOB_DONE)
+    {
+        c->stats->duplicates++;
+        return true;
+    }
+    const farmMessage* t = &job->tile;
+    unsigned int width = t->x1 - t->x0;
+    if(m->frame != t->frame || m->x0 != t->x0 || m->y0 != t->y0 || m->x1 != t->x1 || m->y1 != t->y1 ||
+       m->bytes != width * (t->y1 - t->y0) * 3)
+        return false;
+    farmFrame* frame = &c->frames[t->frame];
+    for(unsigned int y = t->y0; y < t->y1; y++)
+        memcpy(frame->image + ((size_t) y * frame->width + t->x0) * 3, worker->payload + (size_t) (y - t->y0) * width * 3, width * 3);
+    job->state = JOB_DONE;
+    c->done++;
+    c->stats->tiles++;
+    return true;
+}
+
+// Validates a header that just came in and makes room for its payload
+static bool startMessage(farmWorker* worker)
+{
+    const farmMessage* m = &worker->header;
+    if(m->magic != FARM_MAGIC || m->version != FARM_VERSION || m->bytes > (64u << 20))
+        return false;
+    if(m->bytes > worker->payloadSize)
+    {
+        worker->payload = realloc(worker->payload, m->bytes);
+        worker->payloadSize = m->bytes;
+    }
+    worker->payloadRead = 0;
+    return true;
+}
+
+/**
+* Reads whatever the socket has, handling each message as it completes. false when the worker closed,
+* failed or sent something that is not the protocol.
+*/
+static bool readWorker(farmCoordinator* c, farmWorker* worker)
+{
+    while(true)
+    {
+        bool inHeader = worker->headerRead < sizeof(farmMessage);
+        char* target = inHeader ? (char*) &worker->header + worker->headerRead : worker->payload + worker->payloadRead;
+        size_t want = inHeader ? sizeof(farmMessage) - worker->headerRead : worker->header.bytes - worker->payloadRead;
+        if(want > 0)
+        {
+            ssize_t got = recv(worker->fd, target, want, 0);
+            if(got < 0 && (errno == EAGAIN || errno == EINTR))
+                return true;
+            if(got <= 0)
+                return false;
+            c->stats->bytesReceived += (uint64_t) got;
+            if(inHeader)
+            {
+                worker->headerRead += (size_t) got;
+                if(worker->headerRead == sizeof(farmMessage) && !startMessage(worker))
+                    return false;
+                continue;
+            }
+            worker->payloadRead += (size_t) got;
+            if(worker->payloadRead < worker->header.bytes)
+                continue;
+        }
+
+        const farmMessage* m = &worker->header;
+        if(m->type == FARM_HELLO && !worker->greeted)
+        {
+            worker->greeted = true;
+            c->stats->workers++;
+        }
+        else if(m->type != FARM_RESULT || !worker->greeted || !finishTile(c, worker))
+            return false;
+        worker->headerRead = 0;
+        worker->payloadRead = 0;
+    }
+}
+
+static bool assignTile(farmCoordinator* c, unsigned int w)
+{
+    farmWorker* worker = &c->workers[w];
+    uint32_t job;
+    do
+    {
+        if(rbEmpty(&c->pending))
+            return true;
+        rbpop(&c->pending, &job);
+    } while(c->jobs[job].state != JOB_PENDING);
+    farmJob* j = &c->jobs[job];
+    j->state = JOB_ASSIGNED;
+    j->worker = (int) w;
+    j->sent = getTimeSeconds();
+    worker->jobs[worker->jobCount++] = job;
+    const farmFrame* frame = &c->frames[j->tile.frame];
+    return sendMessage(worker->fd, &j->tile, frame->data);
+}
+
+static void buildJobs(farmCoordinator* c)
+{
+    unsigned int size = c->options->tileSize;
+    unsigned int tilesX = (c->frames[0].width + size - 1) / size;
+    unsigned int tilesY = (c->frames[0].height + size - 1) / size;
+    c->jobCount = tilesX * tilesY * c->frameCount;
+    c->jobs = calloc(c->jobCount, sizeof(farmJob));
+    createRB(&c->pending, (int) c->jobCount + 1, sizeof(uint32_t));
+    for(uint32_t job = 0; job < c->jobCount; job++)
+    {
+        uint32_t tile = job / c->frameCount;
+        if(c->options->tileOrder != NULL)
+            tile = c->options->tileOrder[tile];
+        uint32_t f = job % c->frameCount;
+        unsigned int x0 = tile % tilesX * size, y0 = tile / tilesX * size;
+        c->jobs[job].tile = (farmMessage){.type = FARM_TILE, .job = job, .frame = f, .x0 = x0, .y0 = y0,
+            .x1 = x0 + size < c->frames[f].width ? x0 + size : c->frames[f].width,
+            .y1 = y0 + size < c->frames[f].height ? y0 + size : c->frames[f].height,
+            .bytes = c->frames[f].bytes};
+        rbadd(&c->pending, &job);
+    }
+}
+
+bool farmCoordinate(int listenFd, farmFrame* frames, unsigned int frameCount, const farmOptions* options, farmStats* stats)
+{
+    farmCoordinator c = {.frames = frames, .frameCount = frameCount, .options = options, .stats = stats};
+    memset(stats, 0, sizeof(farmStats));
+    buildJobs(&c);
+    struct pollfd* polls = NULL;
+    double alone = getTimeSeconds();
+    bool finished = true;
+    while(c.done < c.jobCount)
+    {
+        for(unsigned int w = 0; w < c.workerCount; w++)
+        {
+            farmWorker* worker = &c.workers[w];
+            bool sent = true;
+            while(sent && worker->greeted && !worker->stalled && worker->jobCount < FARM_INFLIGHT && !rbEmpty(&c.pending))
+                sent = assignTile(&c, w);
+            if(!sent)
+                dropWorker(&c, w--);
+        }
+
+        polls = realloc(polls, (c.workerCount + 1) * sizeof(struct pollfd));
+        polls[0] = (struct pollfd){.fd = listenFd, .events = POLLIN};
+        for(unsigned int w = 0; w < c.workerCount; w++)
+            polls[w + 1] = (struct pollfd){.fd = c.workers[w].fd, .events = POLLIN};
+        unsigned int polled = c.workerCount;
+        if(poll(polls, polled + 1, 100) < 0 && errno != EINTR)
+        {
+            finished = false;
+            break;
+        }
+        // Backwards so a dropped worker only moves one that was already handled
+        for(unsigned int w = polled; w-- > 0;)
+        {
+            if(polls[w + 1].revents != 0 && !readWorker(&c, &c.workers[w]))
+                dropWorker(&c, w);
+        }
+        if(polls[0].revents & POLLIN)
+            acceptWorker(&c, listenFd);
+
+        double now = getTimeSeconds();
+        for(unsigned int w = 0; w < c.workerCount; w++)
+        {
+            farmWorker* worker = &c.workers[w];
+            for(unsigned int j = 0; j < worker->jobCount; j++)
+            {
+                const farmJob* job = &c.jobs[worker->jobs[j]];
+                // Finished by whoever it went to after this worker was late with it
+                bool elsewhere = job->state != JOB_ASSIGNED || job->worker != (int) w;
+                if(!elsewhere && now - job->sent <= options->stallTimeout)
+                    continue;
+                if(!elsewhere)
+                {
+                    // Its result is still taken if it turns up before the tile is done elsewhere
+                    requeue(&c, worker->jobs[j]);
+                    if(!worker->stalled)
+                        worker->stalledAt = now;
+                    worker->stalled = true;
+                }
+                worker->jobs[j--] = worker->jobs[--worker->jobCount];
+            }
+        }
+        // With every worker stalled nothing is handed out, so ones stalled for another timeout are dropped
+        // and the wait for new workers below starts instead of spinning
+        bool usable = false;
+        for(unsigned int w = 0; w < c.workerCount; w++)
+            usable |= !c.workers[w].stalled;
+        for(unsigned int w = c.workerCount; !usable && w-- > 0;)
+        {
+            if(now - c.workers[w].stalledAt > options->stallTimeout)
+            {
+                printf(KRED"render farm: dropping a worker stalled for %.0fs\n"KNRM, now - c.workers[w].stalledAt);
+                dropWorker(&c, w);
+            }
+        }
+        if(c.workerCount > 0)
+            alone = now;
+        else if(now - alone > FARM_WORKER_WAIT)
+        {
+            printf(KRED"render farm: no workers for %.0fs, giving up\n"KNRM, FARM_WORKER_WAIT);
+            finished = false;
+            break;
+        }
+    }
+
+    for(unsigned int w = 0; w < c.workerCount; w++)
+    {
+        farmMessage bye = {.type = FARM_BYE};
+        sendMessage(c.workers[w].fd, &bye, NULL);
+        close(c.workers[w].fd);
+        free(c.workers[w].payload);
+    }
+    free(polls);
+    free(c.workers);
+    cleanRB(&c.pending);
+    free(c.jobs);
+    return finished;
+}
+
+static int connectWorker(const char* address)
+{
+    struct sockaddr_storage addr;
+    socklen_t length;
+    int family = parseAddress(address, false, &addr, &length);
+    if(family < 0)
+        return -1;
+    for(int attempt = 0; attempt < FARM_CONNECT_TRIES; attempt++)
+    {
+        int fd = socket(family, SOCK_STREAM, 0);
+        if(fd < 0)
+            return -1;
+        if(connect(fd, (struct sockaddr*) &addr, length) == 0)
+        {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            return fd;
+        }
+        close(fd);
+        usleep(100000);
+    }
+    return -1;
+}
+
+bool farmWork(const char* address, farmRenderFn render, void* ctx, unsigned int* tilesRendered)
+{
+    *tilesRendered = 0;
+    int fd = connectWorker(address);
+    if(fd < 0)
+        return false;
+    farmMessage hello = {.type = FARM_HELLO};
+    bool ok = sendMessage(fd, &hello, NULL);
+    char* frameData = NULL;
+    char* pixels = NULL;
+    size_t frameSize = 0, pixelSize = 0;
+    while(ok)
+    {
+        farmMessage m;
+        if(!readAll(fd, &m, sizeof(m)) || m.magic != FARM_MAGIC || m.version != FARM_VERSION)
+        {
+            ok = false;
+            break;
+        }
+        if(m.type == FARM_BYE)
+            break;
+        if(m.type != FARM_TILE || m.x1 <= m.x0 || m.y1 <= m.y0 || m.bytes > (64u << 20))
+        {
+            ok = false;
+            break;
+        }
+        if(m.bytes > frameSize)
+        {
+            frameData = realloc(frameData, m.bytes);
+            frameSize = m.bytes;
+        }
+        size_t bytes = (size_t) (m.x1 - m.x0) * (m.y1 - m.y0) * 3;
+        if(bytes > pixelSize)
+        {
+            pixels = realloc(pixels, bytes);
+            pixelSize = bytes;
+        }
+        farmTile tile = {.frame = m.frame, .x0 = m.x0, .y0 = m.y0, .x1 = m.x1, .y1 = m.y1};
+        ok = readAll(fd, frameData, m.bytes) && render(ctx, &tile, frameData, m.bytes, pixels);
+        if(!ok)
+            break;
+        farmMessage result = m;
+        result.type = FARM_RESULT;
+        result.bytes = (uint32_t) bytes;
+        ok = sendMessage(fd, &result, pixels);
+        *tilesRendered += ok;
+    }
+    free(frameData);
+    free(pixels);
+    close(fd);
+    return ok;
+}
+
+void printFarmStats(const farmStats* stats, double time)
+{
+    printf(KRED"farm["KBLU"workers:"KGRN"%u(%u lost) "KBLU"tiles:"KGRN"%u ", stats->workers, stats->workersLost, stats->tiles);
+    printf(KBLU"reassigned:"KGRN"%u "KBLU"late duplicates:"KGRN"%u ", stats->reassigned, stats->duplicates);
+    printf(KBLU"received:"KGRN"%.1fMB "KBLU"time:"KGRN"%4.4fs"KRED"]\n"KNRM, stats->bytesReceived * 1e-6, time);
+}
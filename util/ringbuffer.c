@@ -11,9 +11,25 @@ void createRB(ringbuffer *buffer, const int size, const int offset)
     buffer->data = calloc((size_t) size, (size_t) offset);
 }
 
+/**
+* Unwraps the elements to the front of the new buffer, keeping the newest ones when they no longer fit
+*/
 void resizeRB(ringbuffer *buffer, int const newSize)
 {
-    buffer->data = realloc(buffer->data, (size_t) (newSize*buffer->offset));
+    int count = (buffer->end - buffer->start + buffer->size) % buffer->size;
+    if (count > newSize - 1)
+    {
+        buffer->start = (buffer->start + count - (newSize - 1)) % buffer->size;
+        count = newSize - 1;
+    }
+    char *data = calloc((size_t) newSize, (size_t) buffer->offset);
+    for (int e = 0; e < count; e++)
+        memcpy(data + e * buffer->offset, buffer->data + ((buffer->start + e) % buffer->size) * buffer->offset, (size_t) buffer->offset);
+    free(buffer->data);
+    buffer->data = data;
+    buffer->size = newSize;
+    buffer->start = 0;
+    buffer->end = count;
 }
 
 void cleanRB(ringbuffer* buffer)
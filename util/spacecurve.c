@@ -0,0 +1,82 @@
+#include <util/spacecurve.h>
+
+// Every other bit of v packed into the low half
+static unsigned int compactBits(uint32_t v)
+{
+    v &= 0x55555555u;
+    v = (v | (v >> 1)) & 0x33333333u;
+    v = (v | (v >> 2)) & 0x0f0f0f0fu;
+    v = (v | (v >> 4)) & 0x00ff00ffu;
+    v = (v | (v >> 8)) & 0x0000ffffu;
+    return v;
+}
+
+void mortonDecode2D(uint32_t code, unsigned int* x, unsigned int* y)
+{
+    *x = compactBits(code);
+    *y = compactBits(code >> 1);
+}
+
+void hilbertDecode2D(unsigned int side, uint32_t d, unsigned int* x, unsigned int* y)
+{
+    unsigned int hx = 0, hy = 0;
+    for(unsigned int s = 1; s < side; s *= 2)
+    {
+        unsigned int rx = 1 & (d / 2);
+        unsigned int ry = 1 & (d ^ rx);
+        // Rotate the quadrant so the sub curve enters and leaves where its neighbours do
+        if(ry == 0)
+        {
+            if(rx == 1)
+            {
+                hx = s - 1 - hx;
+                hy = s - 1 - hy;
+            }
+            unsigned int t = hx;
+            hx = hy;
+            hy = t;
+        }
+        hx += s * rx;
+        hy += s * ry;
+        d /= 4;
+    }
+    *x = hx;
+    *y = hy;
+}
+
+void buildCurveOrder(uint32_t* order, unsigned int width, unsigned int height, curveOrder curve)
+{
+    if(curve == ORDER_ROW)
+    {
+        for(uint32_t i = 0; i < width * height; i++)
+            order[i] = i;
+        return;
+    }
+    unsigned int side = 1;
+    while(side < width || side < height)
+        side *= 2;
+    uint32_t next = 0;
+    for(uint32_t d = 0; d < side * side && next < width * height; d++)
+    {
+        unsigned int x, y;
+        if(curve == ORDER_MORTON)
+            mortonDecode2D(d, &x, &y);
+        else
+            hilbertDecode2D(side, d, &x, &y);
+        if(x < width && y < height)
+            order[next++] = y * width + x;
+    }
+}
+
+const char* curveOrderName(curveOrder curve)
+{
+    switch(curve)
+    {
+    case ORDER_MORTON:
+        return "morton";
+    case ORDER_HILBERT:
+        return "hilbert";
+    default:
+        return "row";
+    }
+}
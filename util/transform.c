@@ -0,0 +1,112 @@
+#include <util/transform.h>
+#include <util/colors.h>
+
+void transformIdentity(transform* t)
+{
+    memset(t, 0, sizeof(transform));
+    t->m[0][0] = 1;
+    t->m[1][1] = 1;
+    t->m[2][2] = 1;
+}
+
+void transformTranslation(transform* t, const vector3f offset)
+{
+    transformIdentity(t);
+    t->m[0][3] = offset[0];
+    t->m[1][3] = offset[1];
+    t->m[2][3] = offset[2];
+}
+
+void transformScale(transform* t, float x, float y, float z)
+{
+    transformIdentity(t);
+    t->m[0][0] = x;
+    t->m[1][1] = y;
+    t->m[2][2] = z;
+}
+
+void transformRotation(transform* t, const vector3f axis, float radians)
+{
+    vector3f a = {};
+    vector3f_normalize_new(a, axis);
+    float s = sinf(radians), c = cosf(radians), ic = 1 - c;
+    transformIdentity(t);
+    t->m[0][0] = a[0] * a[0] * ic + c;
+    t->m[0][1] = a[0] * a[1] * ic - a[2] * s;
+    t->m[0][2] = a[0] * a[2] * ic + a[1] * s;
+    t->m[1][0] = a[1] * a[0] * ic + a[2] * s;
+    t->m[1][1] = a[1] * a[1] * ic + c;
+    t->m[1][2] = a[1] * a[2] * ic - a[0] * s;
+    t->m[2][0] = a[2] * a[0] * ic - a[1] * s;
+    t->m[2][1] = a[2] * a[1] * ic + a[0] * s;
+    t->m[2][2] = a[2] * a[2] * ic + c;
+}
+
+void transformMul(transform* result, const transform* a, const transform* b)
+{
+    transform tmp;
+    for(int r = 0; r < 3; r++)
+    {
+        for(int c = 0; c < 4; c++)
+        {
+            tmp.m[r][c] = a->m[r][0] * b->m[0][c] + a->m[r][1] * b->m[1][c] + a->m[r][2] * b->m[2][c];
+        }
+        tmp.m[r][3] += a->m[r][3];
+    }
+    *result = tmp;
+}
+
+bool transformInverse(transform* result, const transform* t)
+{
+    const float (*m)[4] = t->m;
+    float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    if(det == 0)
+        return false;
+    float invDet = 1.0f / det;
+    transform inv;
+    inv.m[0][0] = c00 * invDet;
+    inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+    inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+    inv.m[1][0] = c01 * invDet;
+    inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+    inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+    inv.m[2][0] = c02 * invDet;
+    inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+    inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+    for(int r = 0; r < 3; r++)
+        inv.m[r][3] = -(inv.m[r][0] * m[0][3] + inv.m[r][1] * m[1][3] + inv.m[r][2] * m[2][3]);
+    *result = inv;
+    return true;
+}
+
+void transformPoint(point3f result, const transform* t, const point3f p)
+{
+    float x = p[0], y = p[1], z = p[2];
+    for(int r = 0; r < 3; r++)
+        result[r] = t->m[r][0] * x + t->m[r][1] * y + t->m[r][2] * z + t->m[r][3];
+}
+
+void transformVector(vector3f result, const transform* t, const vector3f v)
+{
+    float x = v[0], y = v[1], z = v[2];
+    for(int r = 0; r < 3; r++)
+        result[r] = t->m[r][0] * x + t->m[r][1] * y + t->m[r][2] * z;
+}
+
+void transformNormal(vector3f result, const transform* inverse, const vector3f n)
+{
+    float x = n[0], y = n[1], z = n[2];
+    for(int c = 0; c < 3; c++)
+        result[c] = inverse->m[0][c] * x + inverse->m[1][c] * y + inverse->m[2][c] * z;
+}
+
+void printTransform(const transform* t)
+{
+    printf(KRED"transform[");
+    for(int r = 0; r < 3; r++)
+        printf(KGRN"(%f, %f, %f, %f)", t->m[r][0], t->m[r][1], t->m[r][2], t->m[r][3]);
+    printf(KRED"]"KNRM);
+}
@@ -0,0 +1,245 @@
+#include <util/workqueue.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+static size_t roundCapacity(size_t capacity)
+{
+    size_t size = 1;
+    while(size < capacity)
+        size *= 2;
+    return size;
+}
+
+static void* alignedAlloc(size_t bytes)
+{
+    void* data = NULL;
+    if(posix_memalign(&data, WORK_QUEUE_LINE, bytes > 0 ? bytes : 1) != 0)
+        return NULL;
+    return data;
+}
+
+spscQueue* createSPSC(size_t capacity)
+{
+    spscQueue* q = alignedAlloc(sizeof(spscQueue));
+    if(q == NULL)
+        return NULL;
+    capacity = roundCapacity(capacity);
+    q->items = alignedAlloc(capacity * sizeof(size_t));
+    if(q->items == NULL)
+    {
+        free(q);
+        return NULL;
+    }
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->headCache = q->tailCache = 0;
+    q->mask = capacity - 1;
+    return q;
+}
+
+void cleanSPSC(spscQueue** q)
+{
+    if(*q == NULL)
+        return;
+    free((*q)->items);
+    free(*q);
+    *q = NULL;
+}
+
+size_t spscPush(spscQueue* q, const size_t* items, size_t count)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t capacity = q->mask + 1;
+    if(tail - q->headCache + count > capacity)
+        q->headCache = atomic_load_explicit(&q->head, memory_order_acquire);
+    size_t room = capacity - (tail - q->headCache);
+    count = count < room ? count : room;
+    for(size_t i = 0; i < count; i++)
+        q->items[(tail + i) & q->mask] = items[i];
+    // One release for the whole batch
+    atomic_store_explicit(&q->tail, tail + count, memory_order_release);
+    return count;
+}
+
+size_t spscPop(spscQueue* q, size_t* items, size_t count)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if(q->tailCache - head < count)
+        q->tailCache = atomic_load_explicit(&q->tail, memory_order_acquire);
+    size_t ready = q->tailCache - head;
+    count = count < ready ? count : ready;
+    for(size_t i = 0; i < count; i++)
+        items[i] = q->items[(head + i) & q->mask];
+    atomic_store_explicit(&q->head, head + count, memory_order_release);
+    return count;
+}
+
+mpmcQueue* createMPMC(size_t capacity)
+{
+    mpmcQueue* q = alignedAlloc(sizeof(mpmcQueue));
+    if(q == NULL)
+        return NULL;
+    capacity = roundCapacity(capacity);
+    q->slots = alignedAlloc(capacity * sizeof(mpmcSlot));
+    if(q->slots == NULL)
+    {
+        free(q);
+        return NULL;
+    }
+    for(size_t i = 0; i < capacity; i++)
+        atomic_init(&q->slots[i].sequence, i);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->mask = capacity - 1;
+    return q;
+}
+
+void cleanMPMC(mpmcQueue** q)
+{
+    if(*q == NULL)
+        return;
+    free((*q)->slots);
+    free(*q);
+    *q = NULL;
+}
+
+/**
+* Claims up to count slots from index whose sequences equal their position plus offset, returns the
+* first position claimed and sets count to how many, 0 when none were ready
+*/
+static size_t claimSlots(mpmcQueue* q, _Atomic size_t* index, size_t offset, size_t* count)
+{
+    size_t pos = atomic_load_explicit(index, memory_order_relaxed);
+    while(true)
+    {
+        size_t ready = 0;
+        while(ready < *count)
+        {
+            size_t sequence = atomic_load_explicit(&q->slots[(pos + ready) & q->mask].sequence, memory_order_acquire);
+            if(sequence != pos + ready + offset)
+                break;
+            ready++;
+        }
+        if(ready == 0)
+        {
+            // Either the queue is full or empty, or another thread moved index past pos
+            size_t now = atomic_load_explicit(index, memory_order_relaxed);
+            if(now == pos)
+            {
+                *count = 0;
+                return pos;
+            }
+            pos = now;
+            continue;
+        }
+        // The slots checked stay ready until whoever claims their position uses them
+        if(atomic_compare_exchange_weak_explicit(index, &pos, pos + ready, memory_order_relaxed, memory_order_relaxed))
+        {
+            *count = ready;
+            return pos;
+        }
+    }
+}
+
+size_t mpmcPush(mpmcQueue* q, const size_t* items, size_t count)
+{
+    size_t pos = claimSlots(q, &q->tail, 0, &count);
+    for(size_t i = 0; i < count; i++)
+    {
+        mpmcSlot* slot = &q->slots[(pos + i) & q->mask];
+        slot->item = items[i];
+        atomic_store_explicit(&slot->sequence, pos + i + 1, memory_order_release);
+    }
+    return count;
+}
+
+size_t mpmcPop(mpmcQueue* q, size_t* items, size_t count)
+{
+    size_t pos = claimSlots(q, &q->head, 1, &count);
+    for(size_t i = 0; i < count; i++)
+    {
+        mpmcSlot* slot = &q->slots[(pos + i) & q->mask];
+        items[i] = slot->item;
+        // Ready for the push one lap later
+        atomic_store_explicit(&slot->sequence, pos + i + q->mask + 1, memory_order_release);
+    }
+    return count;
+}
+
+workDeque* createWorkDeque(size_t capacity)
+{
+    workDeque* d = alignedAlloc(sizeof(workDeque));
+    if(d == NULL)
+        return NULL;
+    capacity = roundCapacity(capacity);
+    d->items = alignedAlloc(capacity * sizeof(_Atomic size_t));
+    if(d->items == NULL)
+    {
+        free(d);
+        return NULL;
+    }
+    for(size_t i = 0; i < capacity; i++)
+        atomic_init(&d->items[i], 0);
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    d->mask = capacity - 1;
+    return d;
+}
+
+void cleanWorkDeque(workDeque** d)
+{
+    if(*d == NULL)
+        return;
+    free((*d)->items);
+    free(*d);
+    *d = NULL;
+}
+
+size_t dequePush(workDeque* d, const size_t* items, size_t count)
+{
+    ptrdiff_t bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    ptrdiff_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+    size_t room = d->mask + 1 - (size_t) (bottom - top);
+    count = count < room ? count : room;
+    for(size_t i = 0; i < count; i++)
+        atomic_store_explicit(&d->items[(size_t) (bottom + (ptrdiff_t) i) & d->mask], items[i], memory_order_relaxed);
+    // Thieves that see the new bottom also see the items
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, bottom + (ptrdiff_t) count, memory_order_relaxed);
+    return count;
+}
+
+bool dequePop(workDeque* d, size_t* item)
+{
+    ptrdiff_t bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, bottom, memory_order_relaxed);
+    // Orders taking the bottom slot before reading top, against the thieves' fence
+    atomic_thread_fence(memory_order_seq_cst);
+    ptrdiff_t top = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if(top > bottom)
+    {
+        atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+    *item = atomic_load_explicit(&d->items[(size_t) bottom & d->mask], memory_order_relaxed);
+    if(top < bottom)
+        return true;
+    // The last item, a thief may be after it too
+    bool won = atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+    return won;
+}
+
+stealResult dequeSteal(workDeque* d, size_t* item)
+{
+    ptrdiff_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    ptrdiff_t bottom = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if(top >= bottom)
+        return STEAL_EMPTY;
+    size_t stolen = atomic_load_explicit(&d->items[(size_t) top & d->mask], memory_order_relaxed);
+    if(!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        return STEAL_ABORT;
+    *item = stolen;
+    return STEAL_SUCCESS;
+}